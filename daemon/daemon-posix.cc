@@ -42,6 +42,9 @@ static void handle_signals(evutil_socket_t fd, short /*what*/, void* arg)
         case SIGHUP:
             daemon->reconfigure();
             break;
+        case SIGUSR1:
+            daemon->dump_trace();
+            break;
         case SIGINT:
         case SIGTERM:
             daemon->stop();
@@ -62,6 +65,7 @@ bool tr_daemon::setup_signals()
     sigaddset(&mask, SIGINT);
     sigaddset(&mask, SIGTERM);
     sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGUSR1);
 
     if (sigprocmask(SIG_BLOCK, &mask, nullptr) < 0)
         return false;
@@ -94,6 +98,11 @@ static void reconfigureMarshall(evutil_socket_t /*fd*/, short /*events*/, void*
     static_cast<tr_daemon*>(arg)->reconfigure();
 }
 
+static void dumpTraceMarshall(evutil_socket_t /*fd*/, short /*events*/, void* arg)
+{
+    static_cast<tr_daemon*>(arg)->dump_trace();
+}
+
 static void stopMarshall(evutil_socket_t /*fd*/, short /*events*/, void* arg)
 {
     static_cast<tr_daemon*>(arg)->stop();
@@ -118,7 +127,7 @@ static bool setup_signal(struct event_base* base, int sig, void (*callback)(evut
 bool tr_daemon::setup_signals()
 {
     return setup_signal(ev_base_, SIGHUP, reconfigureMarshall, this) && setup_signal(ev_base_, SIGINT, stopMarshall, this) &&
-        setup_signal(ev_base_, SIGTERM, stopMarshall, this);
+        setup_signal(ev_base_, SIGTERM, stopMarshall, this) && setup_signal(ev_base_, SIGUSR1, dumpTraceMarshall, this);
 }
 
 #endif /* HAVE_SYS_SIGNALFD_H */
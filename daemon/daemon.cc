@@ -665,6 +665,24 @@ void tr_daemon::reconfigure(void)
     }
 }
 
+void tr_daemon::dump_trace()
+{
+    if (my_session_ == nullptr)
+    {
+        return;
+    }
+
+    tr_error* error = nullptr;
+    if (auto const filename = tr_sessionDumpTrace(my_session_, &error); std::empty(filename))
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't save trace: {error} ({error_code})"),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+    }
+}
+
 void tr_daemon::stop(void)
 {
     event_base_loopexit(ev_base_, nullptr);
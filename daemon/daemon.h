@@ -39,6 +39,7 @@ public:
     int start(bool foreground);
     void periodic_update();
     void reconfigure();
+    void dump_trace();
     void stop();
 
 private:
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+
+# This file Copyright © 2022 Mnemosyne LLC.
+# It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+# or any future license endorsed by Mnemosyne LLC.
+# License text can be found in the licenses/ folder.
+
+# Converts a trace file written by the `trace-dump` RPC method, or by
+# sending SIGUSR1 to transmission-daemon, into the Chrome trace JSON
+# that chrome://tracing and https://ui.perfetto.dev/ can display.
+#
+# usage: trace-to-chrome.py trace-1660000000000-1.trtrace > trace.json
+
+import json
+import struct
+import sys
+
+MAGIC = b"TRTRACE2"
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, fmt):
+        values = struct.unpack_from(fmt, self.data, self.pos)
+        self.pos += struct.calcsize(fmt)
+        return values
+
+    def u16(self):
+        return self.take("<H")[0]
+
+    def u32(self):
+        return self.take("<I")[0]
+
+    def u64(self):
+        return self.take("<Q")[0]
+
+    def string(self):
+        length = self.u16()
+        value = self.data[self.pos:self.pos + length].decode("utf-8", "replace")
+        self.pos += length
+        return value
+
+
+def convert(data):
+    if not data.startswith(MAGIC):
+        raise ValueError("not a Transmission trace file")
+
+    reader = Reader(data)
+    reader.pos = len(MAGIC)
+
+    event_names = [reader.string() for _ in range(reader.u32())]
+    thread_names = {}
+    for _ in range(reader.u32()):
+        thread_id = reader.u32()
+        thread_names[thread_id] = reader.string()
+    arg_names = {}
+    for _ in range(reader.u32()):
+        event = reader.take("<B")[0]
+        arg = reader.u64()
+        arg_names[(event, arg)] = reader.string()
+
+    events = []
+    thread_ids = set()
+    for _ in range(reader.u64()):
+        start, packed, arg = reader.take("<QQQ")
+        duration = packed >> 32
+        thread_id = (packed >> 8) & 0xFFFFFF
+        event = packed & 0xFF
+        thread_ids.add(thread_id)
+        name = event_names[event] if event < len(event_names) else f"event-{event}"
+        if (event, arg) in arg_names:
+            name = f"{name} {arg_names[(event, arg)]}"
+        events.append({
+            "name": name,
+            "ph": "X",
+            "ts": start,
+            "dur": duration,
+            "pid": 1,
+            "tid": thread_id,
+            "args": {"arg": arg},
+        })
+
+    for thread_id in sorted(thread_ids):
+        events.append({
+            "name": "thread_name",
+            "ph": "M",
+            "pid": 1,
+            "tid": thread_id,
+            "args": {"name": thread_names.get(thread_id, f"thread-{thread_id}")},
+        })
+
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(f"usage: {sys.argv[0]} trace-file > trace.json")
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    try:
+        json.dump(convert(data), sys.stdout)
+    except (ValueError, struct.error) as e:
+        sys.exit(f"{sys.argv[1]}: {e}")
+
+
+if __name__ == "__main__":
+    main()
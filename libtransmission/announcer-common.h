@@ -9,7 +9,9 @@
 #error only the libtransmission announcer module should #include this header.
 #endif
 
+#include <algorithm> // std::min, std::max
 #include <array>
+#include <cstddef> // size_t
 #include <cstdint> // uint64_t
 #include <optional>
 #include <string>
@@ -244,3 +246,138 @@ void tr_announcerParseHttpAnnounceResponse(tr_announce_response& response, std::
 void tr_announcerParseHttpScrapeResponse(tr_scrape_response& response, std::string_view benc, std::string_view log_name);
 
 tr_interned_string tr_announcerGetKey(tr_url_parsed_t const& parsed);
+
+/***
+****  ANNOUNCE POLICY
+***/
+
+struct tr_announce_policy_input
+{
+    // the tracker's `interval` and `min interval`
+    int interval_sec = 0;
+    int min_interval_sec = 0;
+
+    // the swarm's size, or -1 if unknown
+    int seeders = -1;
+    int leechers = -1;
+
+    // true if we have everything we want from the swarm
+    bool is_done = false;
+
+    // true if we've uploaded to the swarm since our last announce
+    bool uploaded = false;
+};
+
+/**
+ * Picks how long to wait before a tier's next periodic announce.
+ *
+ * The tracker's interval is stretched, up to 4x, when we're one of many
+ * idle seeds in a swarm that has no need for us, and shortened, down to
+ * the tracker's `min interval`, when the swarm is short of seeds or we're
+ * downloading and don't know any yet.
+ */
+[[nodiscard]] int tr_announcerPolicyInterval(tr_announce_policy_input const& in);
+
+/***
+****  RATE CONTROL
+***/
+
+/**
+ * Limits how hard the announcer pushes a single tracker host.
+ *
+ * Each host gets a cap on requests in flight and a budget of requests
+ * per second. Both grow by one with every response and are halved when
+ * the tracker can't be reached or doesn't answer in time, so an
+ * overloaded tracker is backed off quickly while a healthy one works
+ * through a burst, such as the announces that follow a restart.
+ */
+class tr_tracker_host_budget
+{
+public:
+    static auto constexpr InitialRate = size_t{ 10U };
+    static auto constexpr MaxRate = size_t{ 100U };
+    static auto constexpr InitialInFlight = size_t{ 16U };
+    static auto constexpr MaxInFlight = size_t{ 64U };
+
+    // How many requests may be started right now?
+    [[nodiscard]] size_t available(uint64_t now_msec)
+    {
+        refill(now_msec);
+
+        auto const by_concurrency = in_flight_ < max_in_flight_ ? max_in_flight_ - in_flight_ : 0U;
+        auto const by_rate = static_cast<size_t>(tokens_);
+        return std::min(by_concurrency, by_rate);
+    }
+
+    void started(uint64_t now_msec)
+    {
+        refill(now_msec);
+        tokens_ = std::max(0.0, tokens_ - 1.0);
+        ++in_flight_;
+    }
+
+    // the request was never sent
+    void cancelled()
+    {
+        if (in_flight_ > 0U)
+        {
+            --in_flight_;
+        }
+    }
+
+    // `reachable` is false if the tracker couldn't be reached or timed out
+    void finished(bool reachable)
+    {
+        if (in_flight_ > 0U)
+        {
+            --in_flight_;
+        }
+
+        if (reachable)
+        {
+            rate_ = std::min(rate_ + 1U, MaxRate);
+            max_in_flight_ = std::min(max_in_flight_ + 1U, MaxInFlight);
+        }
+        else
+        {
+            rate_ = std::max(rate_ / 2U, size_t{ 1U });
+            max_in_flight_ = std::max(max_in_flight_ / 2U, size_t{ 1U });
+            tokens_ = std::min(tokens_, static_cast<double>(rate_));
+        }
+    }
+
+    [[nodiscard]] constexpr auto rate() const noexcept
+    {
+        return rate_;
+    }
+
+    [[nodiscard]] constexpr auto maxInFlight() const noexcept
+    {
+        return max_in_flight_;
+    }
+
+    [[nodiscard]] constexpr auto inFlight() const noexcept
+    {
+        return in_flight_;
+    }
+
+private:
+    void refill(uint64_t now_msec)
+    {
+        if (now_msec > refilled_at_msec_)
+        {
+            auto const elapsed_sec = (now_msec - refilled_at_msec_) / 1000.0;
+            tokens_ = std::min(static_cast<double>(rate_), tokens_ + elapsed_sec * rate_);
+        }
+
+        refilled_at_msec_ = now_msec;
+    }
+
+    size_t rate_ = InitialRate;
+    size_t max_in_flight_ = InitialInFlight;
+    size_t in_flight_ = 0;
+
+    // a full second's worth of requests may be sent at once
+    double tokens_ = static_cast<double>(InitialRate);
+    uint64_t refilled_at_msec_ = 0;
+};
@@ -17,6 +17,7 @@
 #include <set>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include <fmt/core.h>
@@ -32,9 +33,11 @@
 #include "log.h"
 #include "peer-mgr.h" /* tr_peerMgrCompactToPex() */
 #include "session.h"
+#include "timer-wheel.h"
 #include "timer.h"
 #include "torrent.h"
 #include "tr-assert.h"
+#include "tracing.h"
 #include "utils.h"
 #include "web-utils.h"
 
@@ -56,15 +59,19 @@ static auto constexpr Numwant = int{ 80 };
 
 /* how often to announce & scrape */
 static auto constexpr UpkeepInterval = 500ms;
-static auto constexpr MaxAnnouncesPerUpkeep = int{ 20 };
-static auto constexpr MaxScrapesPerUpkeep = int{ 20 };
 
 /* this is how often to call the UDP tracker upkeep */
 static auto constexpr TauUpkeepIntervalSecs = int{ 5 };
 
+/* how long a due tier waits before we check again for a tracker to send it to */
+static auto constexpr NoTrackerRetrySec = int{ 60 };
+
 /* how many infohashes to remove when we get a scrape-too-long error */
 static auto constexpr TrMultiscrapeStep = int{ 5 };
 
+/* the most that idle seeding can stretch the tracker's announce interval */
+static auto constexpr MaxAnnounceStretch = int{ 4 };
+
 /***
 ****
 ***/
@@ -143,17 +150,50 @@ struct StopsCompare
 
 struct tr_scrape_info
 {
+    // how many info_hashes to put in a scrape request
     int multiscrape_max;
 
+    // the most info_hashes the tracker might accept, lowered whenever
+    // it says a request was too big. multiscrape_max grows back to this.
+    int multiscrape_ceiling = TR_MULTISCRAPE_MAX;
+
     tr_interned_string scrape_url;
 
-    tr_scrape_info(tr_interned_string scrape_url_in, int const multiscrape_max_in)
+    // the tracker's `${host}:${port}`
+    tr_interned_string host;
+
+    tr_scrape_info(tr_interned_string scrape_url_in, tr_interned_string host_in, int const multiscrape_max_in)
         : multiscrape_max{ multiscrape_max_in }
         , scrape_url{ scrape_url_in }
+        , host{ host_in }
     {
     }
 };
 
+// identifies a tier without pointing to it, since the tier may be gone
+// by the time its announce or scrape comes due
+struct tr_tier_key
+{
+    tr_torrent_id_t tor_id;
+    int tier_id;
+};
+
+// the tiers that are due to announce or scrape to one tracker host
+struct tr_tracker_host_queue
+{
+    tr_tracker_host_budget budget;
+    std::vector<tr_tier_key> announces;
+    std::vector<tr_tier_key> scrapes;
+
+    // True if the queues need another look: tiers were added, a request
+    // finished, or ready tiers were left waiting for the budget.
+    bool dirty = true;
+
+    // ready tiers that the budget couldn't cover the last time we looked
+    size_t n_waiting_announces = 0;
+    size_t n_waiting_scrapes = 0;
+};
+
 /**
  * "global" (per-tr_session) fields
  */
@@ -162,6 +202,8 @@ struct tr_announcer
     explicit tr_announcer(tr_session* session_in)
         : session{ session_in }
         , upkeep_timer{ session_in->timerMaker().create() }
+        , announce_wheel{ tr_time() }
+        , scrape_wheel{ tr_time() }
     {
         upkeep_timer->setCallback([this]() { this->upkeep(); });
         upkeep_timer->startRepeating(UpkeepInterval);
@@ -175,18 +217,28 @@ struct tr_announcer
 
     void upkeep();
 
+    [[nodiscard]] struct tr_tier* getTier(tr_tier_key key) const;
+
     std::set<tr_announce_request*, StopsCompare> stops;
     std::map<tr_interned_string, tr_scrape_info> scrape_info;
 
     tr_session* const session;
     std::unique_ptr<libtransmission::Timer> const upkeep_timer;
 
+    // When each tier's next announce and scrape are due. Once due,
+    // a tier moves to its tracker's host queue until it's been sent.
+    tr_timer_wheel<tr_tier_key> announce_wheel;
+    tr_timer_wheel<tr_tier_key> scrape_wheel;
+    std::map<tr_interned_string, tr_tracker_host_queue> hosts;
+
+    tr_announcer_stats stats;
+
     time_t tau_upkeep_at = 0;
 
     int const key = tr_rand_int(INT_MAX);
 };
 
-static tr_scrape_info* tr_announcerGetScrapeInfo(tr_announcer* announcer, tr_interned_string url)
+static tr_scrape_info* tr_announcerGetScrapeInfo(tr_announcer* announcer, tr_interned_string url, tr_interned_string host)
 {
     if (std::empty(url))
     {
@@ -194,10 +246,17 @@ static tr_scrape_info* tr_announcerGetScrapeInfo(tr_announcer* announcer, tr_int
     }
 
     auto& scrapes = announcer->scrape_info;
-    auto const [it, is_new] = scrapes.try_emplace(url, url, TR_MULTISCRAPE_MAX);
+    auto const [it, is_new] = scrapes.try_emplace(url, url, host, TR_MULTISCRAPE_MAX);
     return &it->second;
 }
 
+static tr_scrape_info* tr_announcerFindScrapeInfo(tr_announcer* announcer, tr_interned_string url)
+{
+    auto& scrapes = announcer->scrape_info;
+    auto const it = scrapes.find(url);
+    return it == std::end(scrapes) ? nullptr : &it->second;
+}
+
 void tr_announcerInit(tr_session* session)
 {
     TR_ASSERT(session != nullptr);
@@ -232,7 +291,7 @@ struct tr_tracker
         : host{ info.host }
         , announce_url{ info.announce }
         , sitename{ info.sitename }
-        , scrape_info{ std::empty(info.scrape) ? nullptr : tr_announcerGetScrapeInfo(announcer, info.scrape) }
+        , scrape_info{ std::empty(info.scrape) ? nullptr : tr_announcerGetScrapeInfo(announcer, info.scrape, info.host) }
         , id{ info.id }
     {
     }
@@ -292,6 +351,41 @@ tr_interned_string tr_announcerGetKey(tr_url_parsed_t const& parsed)
     return tr_interned_string{ sv };
 }
 
+int tr_announcerPolicyInterval(tr_announce_policy_input const& in)
+{
+    auto const interval = in.interval_sec;
+    auto const shortened = std::min(interval, std::max(interval / 2, in.min_interval_sec));
+
+    if (in.seeders < 0 || in.leechers < 0)
+    {
+        return interval;
+    }
+
+    if (!in.is_done)
+    {
+        // nobody to download from yet, so look for new peers more often
+        return in.seeders == 0 ? shortened : interval;
+    }
+
+    // help new leechers find us in a swarm that's short of seeds
+    if (in.leechers > in.seeders)
+    {
+        return shortened;
+    }
+
+    // we're still useful here, or might be the only seed
+    if (in.uploaded || in.seeders <= 1)
+    {
+        return interval;
+    }
+
+    // one of many seeds, so back off in proportion to how little we're needed:
+    // each seed per leecher adds an eighth of the interval
+    auto const seeds_per_leecher = in.seeders / (in.leechers + 1);
+    auto const eighths = std::min(8 * MaxAnnounceStretch, 8 + seeds_per_leecher);
+    return static_cast<int>(int64_t{ interval } * eighths / 8);
+}
+
 /***
 ****
 ***/
@@ -299,8 +393,9 @@ tr_interned_string tr_announcerGetKey(tr_url_parsed_t const& parsed)
 /** @brief A group of trackers in a single tier, as per the multitracker spec */
 struct tr_tier
 {
-    tr_tier(tr_announcer* announcer, tr_torrent* tor_in, std::vector<tr_announce_list::tracker_info const*> const& infos)
-        : tor{ tor_in }
+    tr_tier(tr_announcer* announcer_in, tr_torrent* tor_in, std::vector<tr_announce_list::tracker_info const*> const& infos)
+        : announcer{ announcer_in }
+        , tor{ tor_in }
         , id{ next_key++ }
     {
         trackers.reserve(std::size(infos));
@@ -334,16 +429,31 @@ struct tr_tier
         return &trackers[*current_tracker_index_];
     }
 
-    [[nodiscard]] constexpr bool needsToAnnounce(time_t now) const
+    [[nodiscard]] bool isAnnounceDue(time_t now) const
     {
-        return !isAnnouncing && !isScraping && announceAt != 0 && announceAt <= now && !std::empty(announce_events);
+        return announceAt != 0 && announceAt <= now && !std::empty(announce_events) && currentTracker() != nullptr;
     }
 
-    [[nodiscard]] bool needsToScrape(time_t now) const
+    [[nodiscard]] bool isScrapeDue(time_t now) const
     {
         auto const* const tracker = currentTracker();
 
-        return !isScraping && scrapeAt != 0 && scrapeAt <= now && tracker != nullptr && tracker->scrape_info != nullptr;
+        return scrapeAt != 0 && scrapeAt <= now && tracker != nullptr && tracker->scrape_info != nullptr;
+    }
+
+    [[nodiscard]] bool needsToAnnounce(time_t now) const
+    {
+        return !isAnnouncing && !isScraping && isAnnounceDue(now);
+    }
+
+    [[nodiscard]] bool needsToScrape(time_t now) const
+    {
+        return !isScraping && isScrapeDue(now);
+    }
+
+    [[nodiscard]] tr_tier_key key() const noexcept
+    {
+        return { tor->id(), id };
     }
 
     [[nodiscard]] auto countDownloaders() const
@@ -427,6 +537,11 @@ struct tr_tier
     void scheduleNextScrape(int interval)
     {
         this->scrapeAt = getNextScrapeTime(tor->session, this, interval);
+
+        if (this->scrapeAt != 0)
+        {
+            announcer->scrape_wheel.add(this->scrapeAt, key());
+        }
     }
 
     std::deque<tr_announce_event> announce_events;
@@ -442,6 +557,7 @@ struct tr_tier
 
     std::optional<size_t> current_tracker_index_;
 
+    tr_announcer* const announcer;
     tr_torrent* const tor;
 
     time_t scrapeAt = 0;
@@ -463,6 +579,13 @@ struct tr_tier
 
     size_t lastAnnouncePeerCount = 0;
 
+    // byteCounts[TR_ANN_UP] as of the last successful announce
+    uint64_t lastAnnounceUpBytes = 0;
+
+    // how long tr_announcerPolicyInterval() chose to wait
+    // before the periodic announce that's scheduled now
+    int announcePolicyIntervalSec = 0;
+
     bool lastScrapeSucceeded = false;
     bool lastScrapeTimedOut = false;
 
@@ -473,6 +596,10 @@ struct tr_tier
     bool isAnnouncing = false;
     bool isScraping = false;
 
+    // true while the tier is in its tracker host's announce or scrape queue
+    bool announceQueued = false;
+    bool scrapeQueued = false;
+
 private:
     [[nodiscard]] static time_t getNextScrapeTime(tr_session const* session, tr_tier const* tier, int interval)
     {
@@ -600,6 +727,17 @@ private:
     }
 };
 
+tr_tier* tr_announcer::getTier(tr_tier_key key) const
+{
+    auto* const tor = session->torrents().get(key.tor_id);
+    if (tor == nullptr || tor->torrent_announcer == nullptr)
+    {
+        return nullptr;
+    }
+
+    return tor->torrent_announcer->getTier(key.tier_id);
+}
+
 static tr_tier* getTier(tr_announcer* announcer, tr_sha1_digest_t const& info_hash, int tier_id)
 {
     if (announcer == nullptr)
@@ -803,6 +941,7 @@ static void tier_announce_event_push(tr_tier* tier, tr_announce_event e, time_t
     /* add it */
     events.push_back(e);
     tier->announceAt = announce_at;
+    tier->announcer->announce_wheel.add(announce_at, tier->key());
     tier_update_announce_priority(tier);
 
     tr_logAddTrace_tier_announce_queue(tier);
@@ -817,6 +956,45 @@ static auto tier_announce_event_pull(tr_tier* tier)
     return e;
 }
 
+static int tier_policy_interval(tr_tier const* tier)
+{
+    auto in = tr_announce_policy_input{};
+    in.interval_sec = tier->announceIntervalSec;
+    in.min_interval_sec = tier->announceMinIntervalSec;
+    if (auto const* const tracker = tier->currentTracker(); tracker != nullptr)
+    {
+        in.seeders = tracker->seeder_count;
+        in.leechers = tracker->leecher_count;
+    }
+    in.is_done = tier->tor->isDone();
+    in.uploaded = tier->byteCounts[TR_ANN_UP] != tier->lastAnnounceUpBytes;
+    return tr_announcerPolicyInterval(in);
+}
+
+// A scrape may show that the swarm needs us more, or less, than it did
+// when the periodic announce was scheduled. If so, move the announce.
+static void tier_reschedule_periodic_announce(tr_tier* tier, time_t now)
+{
+    auto const& events = tier->announce_events;
+    if (tier->isAnnouncing || !tier->lastAnnounceSucceeded || tier->announcePolicyIntervalSec == 0 ||
+        std::size(events) != 1U || events.front() != TR_ANNOUNCE_EVENT_NONE)
+    {
+        return;
+    }
+
+    auto const interval = tier_policy_interval(tier);
+    if (interval == tier->announcePolicyIntervalSec)
+    {
+        return;
+    }
+
+    tr_logAddTraceTier(
+        tier,
+        fmt::format("Swarm changed; periodic reannounce interval {} -> {}", tier->announcePolicyIntervalSec, interval));
+    tier->announcePolicyIntervalSec = interval;
+    tier_announce_event_push(tier, TR_ANNOUNCE_EVENT_NONE, std::max(now, tier->lastAnnounceTime + interval));
+}
+
 static void torrentAddAnnounce(tr_torrent* tor, tr_announce_event e, time_t announce_at)
 {
     // tell each tier to announce
@@ -934,6 +1112,11 @@ struct announce_data
     tr_announce_event event = {};
     tr_session* session = nullptr;
 
+    // the tracker's `${host}:${port}`, for returning its budget slot
+    tr_interned_string host;
+
+    uint64_t trace_begin_usec = 0;
+
     /** If the request succeeds, the value for tier's "isRunning" flag */
     bool is_running_on_success = false;
 };
@@ -992,6 +1175,18 @@ static void onAnnounceDone(tr_announce_response const* response, void* vdata)
     time_t const now = tr_time();
     tr_announce_event const event = data->event;
 
+    if (announcer != nullptr)
+    {
+        auto& queue = announcer->hosts[data->host];
+        queue.budget.finished(response->did_connect && !response->did_timeout);
+        queue.dirty = true;
+    }
+
+    if (tier != nullptr)
+    {
+        tr_traceRecord(tr_trace_event::Announce, data->trace_begin_usec, tier->tor->id());
+    }
+
     if (tier != nullptr)
     {
         tr_logAddTraceTier(
@@ -1149,6 +1344,8 @@ static void onAnnounceDone(tr_announce_response const* response, void* vdata)
             tier->lastAnnounceSucceeded = true;
             tier->lastAnnouncePeerCount = std::size(response->pex) + std::size(response->pex6);
 
+            auto const policy_interval = tier_policy_interval(tier);
+
             if (is_stopped)
             {
                 /* now that we've successfully stopped the torrent,
@@ -1159,11 +1356,20 @@ static void onAnnounceDone(tr_announce_response const* response, void* vdata)
                 tier->byteCounts[TR_ANN_CORRUPT] = 0;
             }
 
+            tier->lastAnnounceUpBytes = tier->byteCounts[TR_ANN_UP];
+            tier->announcePolicyIntervalSec = 0;
+
             if (!is_stopped && std::empty(tier->announce_events))
             {
                 /* the queue is empty, so enqueue a periodic update */
-                int const i = tier->announceIntervalSec;
-                tr_logAddTraceTier(tier, fmt::format("Sending periodic reannounce in {} seconds", i));
+                int const i = policy_interval;
+                tr_logAddTraceTier(
+                    tier,
+                    fmt::format(
+                        "Sending periodic reannounce in {} seconds (tracker's interval is {})",
+                        i,
+                        tier->announceIntervalSec));
+                tier->announcePolicyIntervalSec = i;
                 tier_announce_event_push(tier, TR_ANNOUNCE_EVENT_NONE, now + i);
             }
         }
@@ -1172,7 +1378,9 @@ static void onAnnounceDone(tr_announce_response const* response, void* vdata)
     delete data;
 }
 
-static void announce_request_delegate(
+// Returns false if the request couldn't be sent, in which case
+// `callback` won't be called.
+static bool announce_request_delegate(
     tr_announcer* announcer,
     tr_announce_request* request,
     tr_announce_response_func callback,
@@ -1190,6 +1398,8 @@ static void announce_request_delegate(
 
 #endif
 
+    auto sent = true;
+
     if (auto const announce_sv = request->announce_url.sv();
         tr_strvStartsWith(announce_sv, "http://"sv) || tr_strvStartsWith(announce_sv, "https://"sv))
     {
@@ -1203,12 +1413,29 @@ static void announce_request_delegate(
     {
         tr_logAddWarn(fmt::format(_("Unsupported URL: '{url}'"), fmt::arg("url", announce_sv)));
         delete callback_data;
+        sent = false;
     }
 
     delete request;
+    return sent;
 }
 
-static void tierAnnounce(tr_announcer* announcer, tr_tier* tier)
+// bucket 0 counts lags under 1 second and bucket N counts lags in [2^(N-1), 2^N) seconds
+static void addLag(tr_announcer_stats::LagHistogram& histogram, uint64_t& sum, time_t due_at, time_t now)
+{
+    auto lag = now > due_at ? static_cast<uint64_t>(now - due_at) : uint64_t{};
+    sum += lag;
+    auto bucket = size_t{};
+    while (lag > 0U && bucket + 1U < std::size(histogram))
+    {
+        lag >>= 1;
+        ++bucket;
+    }
+
+    ++histogram[bucket];
+}
+
+static void tierAnnounce(tr_announcer* announcer, tr_tier* tier, tr_tracker_host_budget& budget)
 {
     TR_ASSERT(!tier->isAnnouncing);
     TR_ASSERT(!std::empty(tier->announce_events));
@@ -1219,13 +1446,22 @@ static void tierAnnounce(tr_announcer* announcer, tr_tier* tier)
     tr_torrent* tor = tier->tor;
     tr_announce_event const announce_event = tier_announce_event_pull(tier);
     tr_announce_request* req = announce_request_new(announcer, tor, tier, announce_event);
+    auto const host = tier->currentTracker()->host;
 
-    auto* const data = new announce_data{ tier->id, now, announce_event, announcer->session, tor->isRunning };
+    auto* const data = new announce_data{
+        tier->id, now, announce_event, announcer->session, host, tr_traceNow(), tor->isRunning,
+    };
 
     tier->isAnnouncing = true;
     tier->lastAnnounceStartTime = now;
+    addLag(announcer->stats.announce_lag_sec, announcer->stats.announce_lag_sum_sec, tier->announceAt, now);
 
-    announce_request_delegate(announcer, req, onAnnounceDone, data);
+    budget.started(tr_time_msec());
+    if (!announce_request_delegate(announcer, req, onAnnounceDone, data))
+    {
+        tier->isAnnouncing = false;
+        budget.cancelled();
+    }
 }
 
 /***
@@ -1277,28 +1513,39 @@ static void on_scrape_error(tr_session const* /*session*/, tr_tier* tier, char c
 
 static void checkMultiscrapeMax(tr_announcer* announcer, tr_scrape_response const* response)
 {
-    if (!multiscrape_too_big(response->errmsg))
+    auto const& url = response->scrape_url;
+    auto* const scrape_info = tr_announcerFindScrapeInfo(announcer, url);
+    if (scrape_info == nullptr)
     {
         return;
     }
 
-    auto const& url = response->scrape_url;
-    auto* const scrape_info = tr_announcerGetScrapeInfo(announcer, url);
-    if (scrape_info == nullptr)
+    int& multiscrape_max = scrape_info->multiscrape_max;
+    int& multiscrape_ceiling = scrape_info->multiscrape_ceiling;
+
+    if (!multiscrape_too_big(response->errmsg))
     {
+        // A full request went through, so try a slightly bigger one next time.
+        if (response->did_connect && !response->did_timeout && std::empty(response->errmsg) &&
+            response->row_count >= multiscrape_max && multiscrape_max < multiscrape_ceiling)
+        {
+            ++multiscrape_max;
+        }
+
         return;
     }
 
+    multiscrape_ceiling = std::max(1, std::min(multiscrape_ceiling, response->row_count - 1));
+
     // Lower the max only if it hasn't already lowered for a similar
     // error. So if N parallel multiscrapes all have the same `max`
     // and error out, lower the value once for that batch, not N times.
-    int& multiscrape_max = scrape_info->multiscrape_max;
     if (multiscrape_max < response->row_count)
     {
         return;
     }
 
-    int const n = std::max(1, int{ multiscrape_max - TrMultiscrapeStep });
+    int const n = std::max(1, std::min(multiscrape_max - TrMultiscrapeStep, multiscrape_ceiling));
     if (multiscrape_max != n)
     {
         // don't log the full URL, since that might have a personal announce id
@@ -1320,6 +1567,13 @@ static void on_scrape_done(tr_scrape_response const* response, void* vsession)
     auto* const session = static_cast<tr_session*>(vsession);
     auto* const announcer = session->announcer;
 
+    if (auto const* const scrape_info = tr_announcerFindScrapeInfo(announcer, response->scrape_url); scrape_info != nullptr)
+    {
+        auto& queue = announcer->hosts[scrape_info->host];
+        queue.budget.finished(response->did_connect && !response->did_timeout);
+        queue.dirty = true;
+    }
+
     for (int i = 0; i < response->row_count; ++i)
     {
         auto const& row = response->rows[i];
@@ -1370,6 +1624,11 @@ static void on_scrape_done(tr_scrape_response const* response, void* vsession)
             {
                 on_scrape_error(session, tier, _("Tracker did not respond"));
             }
+            else if (response->row_count > 1 && multiscrape_too_big(response->errmsg))
+            {
+                // not the tracker's fault; retry in a smaller batch
+                tier->scrapeSoon();
+            }
             else if (!std::empty(response->errmsg))
             {
                 on_scrape_error(session, tier, response->errmsg.c_str());
@@ -1406,6 +1665,8 @@ static void on_scrape_done(tr_scrape_response const* response, void* vsession)
                 {
                     publishPeerCounts(tier, row.seeders, row.leechers);
                 }
+
+                tier_reschedule_periodic_announce(tier, now);
             }
         }
     }
@@ -1413,7 +1674,9 @@ static void on_scrape_done(tr_scrape_response const* response, void* vsession)
     checkMultiscrapeMax(announcer, response);
 }
 
-static void scrape_request_delegate(
+// Returns false if the request couldn't be sent, in which case
+// `callback` won't be called.
+static bool scrape_request_delegate(
     tr_announcer* announcer,
     tr_scrape_request const* request,
     tr_scrape_response_func callback,
@@ -1434,65 +1697,71 @@ static void scrape_request_delegate(
     else
     {
         tr_logAddError(fmt::format(_("Unsupported URL: '{url}'"), fmt::arg("url", scrape_sv)));
+        return false;
     }
+
+    return true;
 }
 
-static void multiscrape(tr_announcer* announcer, std::vector<tr_tier*> const& tiers)
+// Batch as many info_hashes into each request as we can and send up to
+// `max_requests` of them. Tiers that don't fit are left for next time.
+static void multiscrape(
+    tr_announcer* announcer,
+    std::vector<tr_tier*> const& tiers,
+    size_t max_requests,
+    tr_tracker_host_budget& budget)
 {
     auto const now = tr_time();
-    auto requests = std::array<tr_scrape_request, MaxScrapesPerUpkeep>{};
-    auto request_count = size_t{};
+    auto requests = std::vector<tr_scrape_request>{};
+    requests.reserve(std::min(max_requests, std::size(tiers)));
+
+    // scrape URL -> index of the request that's being filled for it
+    auto filling = std::unordered_map<tr_quark, size_t>{};
 
-    // batch as many info_hashes into a request as we can
     for (auto* tier : tiers)
     {
         auto const* const scrape_info = tier->currentTracker()->scrape_info;
-        bool found = false;
-
         TR_ASSERT(scrape_info != nullptr);
 
-        /* if there's a request with this scrape URL and a free slot, use it */
-        for (size_t j = 0; !found && j < request_count; ++j)
-        {
-            auto* const req = &requests[j];
+        auto const max_hashes = std::clamp(scrape_info->multiscrape_max, 1, TR_MULTISCRAPE_MAX);
+        auto [it, is_new] = filling.try_emplace(scrape_info->scrape_url.quark(), std::size(requests));
 
-            if (req->info_hash_count >= scrape_info->multiscrape_max)
-            {
-                continue;
-            }
+        /* if this scrape URL's request is full, start a new one if there's room */
+        if (!is_new && requests[it->second].info_hash_count >= max_hashes)
+        {
+            it->second = std::size(requests);
+            is_new = true;
+        }
 
-            if (scrape_info->scrape_url != req->scrape_url)
+        if (is_new)
+        {
+            if (std::size(requests) >= max_requests)
             {
+                filling.erase(it);
                 continue;
             }
 
-            req->info_hash[req->info_hash_count] = tier->tor->infoHash();
-            ++req->info_hash_count;
-            tier->isScraping = true;
-            tier->lastScrapeStartTime = now;
-            found = true;
+            auto& req = requests.emplace_back();
+            req.scrape_url = scrape_info->scrape_url;
+            tier->buildLogName(req.log_name, sizeof(req.log_name));
         }
 
-        /* otherwise, if there's room for another request, build a new one */
-        if (!found && request_count < MaxScrapesPerUpkeep)
-        {
-            auto* const req = &requests[request_count];
-            req->scrape_url = scrape_info->scrape_url;
-            tier->buildLogName(req->log_name, sizeof(req->log_name));
-
-            req->info_hash[req->info_hash_count] = tier->tor->infoHash();
-            ++req->info_hash_count;
-            tier->isScraping = true;
-            tier->lastScrapeStartTime = now;
-
-            ++request_count;
-        }
+        auto& req = requests[it->second];
+        req.info_hash[req.info_hash_count] = tier->tor->infoHash();
+        ++req.info_hash_count;
+        tier->isScraping = true;
+        tier->lastScrapeStartTime = now;
+        addLag(announcer->stats.scrape_lag_sec, announcer->stats.scrape_lag_sum_sec, tier->scrapeAt, now);
     }
 
     /* send the requests we just built */
-    for (size_t i = 0; i < request_count; ++i)
+    for (auto const& req : requests)
     {
-        scrape_request_delegate(announcer, &requests[i], on_scrape_done, announcer->session);
+        budget.started(tr_time_msec());
+        if (!scrape_request_delegate(announcer, &req, on_scrape_done, announcer->session))
+        {
+            budget.cancelled();
+        }
     }
 }
 
@@ -1545,56 +1814,251 @@ static int compareAnnounceTiers(tr_tier const* a, tr_tier const* b)
     return a < b ? -1 : 1;
 }
 
-static void scrapeAndAnnounceMore(tr_announcer* announcer)
+// A tier that comes off the wheel, or out of a host queue, without being
+// due is dropped. Put it back if it still has something to send.
+static void putBack(tr_timer_wheel<tr_tier_key>& wheel, tr_tier_key key, time_t due_at, time_t now, int retry_sec)
 {
-    time_t const now = tr_time();
+    if (due_at == 0)
+    {
+        return;
+    }
 
-    /* build a list of tiers that need to be announced */
-    auto announce_me = std::vector<tr_tier*>{};
-    auto scrape_me = std::vector<tr_tier*>{};
-    for (auto* const tor : announcer->session->torrents())
+    if (due_at > now)
     {
-        for (auto& tier : tor->torrent_announcer->tiers)
+        // If tr_time() went backwards, a tier may come off the wheel before
+        // its time and after the wheel has passed it. Don't lose it.
+        if (due_at <= wheel.now())
         {
-            if (tier.needsToAnnounce(now))
-            {
-                announce_me.push_back(&tier);
-            }
+            wheel.add(due_at, key);
+        }
 
-            if (tier.needsToScrape(now))
-            {
-                scrape_me.push_back(&tier);
-            }
+        return;
+    }
+
+    // It's overdue, so the only thing stopping it is that there's no
+    // tracker to send it to right now. Look again after a while.
+    if (retry_sec > 0)
+    {
+        wheel.add(now + retry_sec, key);
+    }
+}
+
+static void putBackAnnounce(tr_announcer* announcer, tr_tier const& tier, time_t now)
+{
+    auto const retry_sec = std::empty(tier.announce_events) ? 0 : NoTrackerRetrySec;
+    putBack(announcer->announce_wheel, tier.key(), tier.announceAt, now, retry_sec);
+}
+
+static void putBackScrape(tr_announcer* announcer, tr_tier const& tier, time_t now)
+{
+    // e.g. the current tracker has no scrape URL; wait for a
+    // whole interval, since a failover is the only way out
+    putBack(announcer->scrape_wheel, tier.key(), tier.scrapeAt, now, tier.scrapeIntervalSec);
+}
+
+// Refile each tier queued for `host` under its current tracker's host,
+// dropping the ones that are gone or no longer due, and return the ones
+// that are ready to be sent to `host` now.
+template<typename IsDue, typename IsReady, typename PutBack>
+static std::vector<tr_tier*> takeReadyTiers(
+    tr_announcer* announcer,
+    tr_interned_string const& host,
+    std::vector<tr_tier_key> tr_tracker_host_queue::*queue,
+    bool tr_tier::*queued,
+    IsDue const& is_due,
+    IsReady const& is_ready,
+    PutBack const& put_back)
+{
+    auto keys = std::vector<tr_tier_key>{};
+    std::swap(keys, announcer->hosts[host].*queue);
+
+    auto ready = std::vector<tr_tier*>{};
+    for (auto const& key : keys)
+    {
+        auto* const tier = announcer->getTier(key);
+        if (tier == nullptr)
+        {
+            continue;
+        }
+
+        if (!is_due(*tier))
+        {
+            tier->*queued = false;
+            put_back(*tier);
+            continue;
+        }
+
+        auto const& tier_host = tier->currentTracker()->host;
+        auto& tier_queue = announcer->hosts[tier_host];
+        (tier_queue.*queue).push_back(key);
+
+        if (tier_host != host)
+        {
+            tier_queue.dirty = true;
+        }
+        else if (is_ready(*tier))
+        {
+            ready.push_back(tier);
         }
     }
 
+    return ready;
+}
+
+// Send what `host`'s budget allows from its queues.
+static void sendQueued(
+    tr_announcer* announcer,
+    tr_interned_string const& host,
+    tr_tracker_host_queue& queue,
+    time_t now,
+    uint64_t now_msec)
+{
+    auto& budget = queue.budget;
+
     /* First, scrape what we can. We handle scrapes first because
      * we can work through that queue much faster than announces
      * (thanks to multiscrape) _and_ the scrape responses will tell
      * us which swarms are interesting and should be announced next. */
-    multiscrape(announcer, scrape_me);
-
-    /* Second, announce what we can. If there aren't enough slots
-     * available, use compareAnnounceTiers to prioritize. */
-    if (announce_me.size() > MaxAnnouncesPerUpkeep)
-    {
-        std::partial_sort(
-            std::begin(announce_me),
-            std::begin(announce_me) + MaxAnnouncesPerUpkeep,
-            std::end(announce_me),
-            [](auto const* a, auto const* b) { return compareAnnounceTiers(a, b) < 0; });
-        announce_me.resize(MaxAnnouncesPerUpkeep);
+    auto const scrape_me = takeReadyTiers(
+        announcer,
+        host,
+        &tr_tracker_host_queue::scrapes,
+        &tr_tier::scrapeQueued,
+        [now](tr_tier const& tier) { return tier.isScrapeDue(now); },
+        [now](tr_tier const& tier) { return tier.needsToScrape(now); },
+        [announcer, now](tr_tier const& tier) { putBackScrape(announcer, tier, now); });
+
+    queue.n_waiting_scrapes = 0;
+    if (!std::empty(scrape_me))
+    {
+        multiscrape(announcer, scrape_me, budget.available(now_msec), budget);
+        queue.n_waiting_scrapes = std::count_if(
+            std::begin(scrape_me),
+            std::end(scrape_me),
+            [](auto const* tier) { return !tier->isScraping; });
+    }
+
+    /* Second, announce what we can. If the tracker's budget won't
+     * cover them all, use compareAnnounceTiers to prioritize. */
+    auto announce_me = takeReadyTiers(
+        announcer,
+        host,
+        &tr_tracker_host_queue::announces,
+        &tr_tier::announceQueued,
+        [now](tr_tier const& tier) { return tier.isAnnounceDue(now); },
+        [now](tr_tier const& tier) { return tier.needsToAnnounce(now); },
+        [announcer, now](tr_tier const& tier) { putBackAnnounce(announcer, tier, now); });
+
+    auto const n_announces = std::min(std::size(announce_me), budget.available(now_msec));
+    std::partial_sort(
+        std::begin(announce_me),
+        std::begin(announce_me) + n_announces,
+        std::end(announce_me),
+        [](auto const* a, auto const* b) { return compareAnnounceTiers(a, b) < 0; });
+
+    for (size_t i = 0; i < n_announces; ++i)
+    {
+        auto* const tier = announce_me[i];
+        tr_logAddTraceTier(tier, "Announcing to tracker");
+        tierAnnounce(announcer, tier, budget);
     }
 
-    for (auto*& tier : announce_me)
+    queue.n_waiting_announces = std::size(announce_me) - n_announces;
+
+    // come back when the budget refills
+    queue.dirty = queue.n_waiting_announces != 0U || queue.n_waiting_scrapes != 0U;
+}
+
+static void scrapeAndAnnounceMore(tr_announcer* announcer)
+{
+    time_t const now = tr_time();
+
+    /* move the tiers whose time has come into their trackers' queues */
+    announcer->announce_wheel.advance(
+        now,
+        [announcer, now](tr_tier_key key)
+        {
+            auto* const tier = announcer->getTier(key);
+            if (tier == nullptr || tier->announceQueued)
+            {
+                return;
+            }
+
+            if (tier->isAnnounceDue(now))
+            {
+                tier->announceQueued = true;
+                auto& queue = announcer->hosts[tier->currentTracker()->host];
+                queue.announces.push_back(key);
+                queue.dirty = true;
+            }
+            else
+            {
+                putBackAnnounce(announcer, *tier, now);
+            }
+        });
+
+    announcer->scrape_wheel.advance(
+        now,
+        [announcer, now](tr_tier_key key)
+        {
+            auto* const tier = announcer->getTier(key);
+            if (tier == nullptr || tier->scrapeQueued)
+            {
+                return;
+            }
+
+            if (tier->isScrapeDue(now))
+            {
+                tier->scrapeQueued = true;
+                auto& queue = announcer->hosts[tier->currentTracker()->host];
+                queue.scrapes.push_back(key);
+                queue.dirty = true;
+            }
+            else
+            {
+                putBackScrape(announcer, *tier, now);
+            }
+        });
+
+    auto const now_msec = tr_time_msec();
+    auto n_waiting_announces = size_t{};
+    auto n_waiting_scrapes = size_t{};
+
+    for (auto it = std::begin(announcer->hosts); it != std::end(announcer->hosts);)
     {
-        tr_logAddTraceTier(tier, "Announcing to tracker");
-        tierAnnounce(announcer, tier);
+        auto& [host, queue] = *it;
+
+        // Only look at a host's queues if something changed since last
+        // time and there's budget to send with. Otherwise, refiling them
+        // would just put the same tiers back where they were.
+        if (queue.dirty && queue.budget.available(now_msec) > 0U)
+        {
+            sendQueued(announcer, host, queue, now, now_msec);
+        }
+
+        n_waiting_announces += queue.n_waiting_announces;
+        n_waiting_scrapes += queue.n_waiting_scrapes;
+
+        // forget hosts we're done with for now
+        if (std::empty(queue.announces) && std::empty(queue.scrapes) && queue.budget.inFlight() == 0U)
+        {
+            it = announcer->hosts.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
     }
+
+    announcer->stats.queued_announces = n_waiting_announces;
+    announcer->stats.queued_scrapes = n_waiting_scrapes;
 }
 
 void tr_announcer::upkeep()
 {
+    auto const loop_scope = tr_event_loop_stats::Scope{ session->eventLoopStats(),
+                                                        tr_event_loop_callback::AnnouncerUpkeep,
+                                                        upkeep_timer->lateness() };
     auto const lock = session->unique_lock();
 
     bool const is_closing = session->isClosed();
@@ -1753,6 +2217,25 @@ tr_tracker_view tr_announcerTracker(tr_torrent const* tor, size_t nth)
 ****
 ***/
 
+tr_announcer_stats tr_announcerStats(tr_announcer const* announcer)
+{
+    auto stats = announcer->stats;
+
+    for (auto const* const tor : announcer->session->torrents())
+    {
+        for (auto const& tier : tor->torrent_announcer->tiers)
+        {
+            if (tier.isRunning && tier.announcePolicyIntervalSec > 0)
+            {
+                stats.announces_per_hour += 3600.0 / tier.announcePolicyIntervalSec;
+                stats.unadjusted_announces_per_hour += 3600.0 / std::max(1, tier.announceIntervalSec);
+            }
+        }
+    }
+
+    return stats;
+}
+
 // called after the torrent's announceList was rebuilt --
 // so announcer needs to update the tr_tier / tr_trackers to match
 void tr_announcerResetTorrent(tr_announcer* /*announcer*/, tr_torrent* tor)
@@ -9,8 +9,9 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <array>
 #include <cstddef> // size_t
-#include <cstdint> // uint32_t
+#include <cstdint> // uint32_t, uint64_t
 #include <ctime>
 #include <string_view>
 #include <vector>
@@ -104,6 +105,33 @@ size_t tr_announcerTrackerCount(tr_torrent const* tor);
 ****
 ***/
 
+struct tr_announcer_stats
+{
+    // Bucket 0 counts requests sent less than a second after they were due,
+    // and bucket N counts requests sent [2^(N-1), 2^N) seconds late.
+    using LagHistogram = std::array<uint64_t, 16>;
+
+    LagHistogram announce_lag_sec = {};
+    LagHistogram scrape_lag_sec = {};
+    uint64_t announce_lag_sum_sec = 0;
+    uint64_t scrape_lag_sum_sec = 0;
+
+    // tiers that are due but waiting for their tracker's request budget
+    size_t queued_announces = 0;
+    size_t queued_scrapes = 0;
+
+    // The periodic announce load that running torrents put on trackers,
+    // and what it would be if every tracker's interval were used as-is.
+    double announces_per_hour = 0;
+    double unadjusted_announces_per_hour = 0;
+};
+
+tr_announcer_stats tr_announcerStats(tr_announcer const* announcer);
+
+/***
+****
+***/
+
 void tr_tracker_udp_upkeep(tr_session* session);
 
 void tr_tracker_udp_close(tr_session* session);
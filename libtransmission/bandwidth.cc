@@ -296,13 +296,18 @@ unsigned int tr_bandwidth::clamp(uint64_t now, tr_direction dir, unsigned int by
     return byte_count;
 }
 
-void tr_bandwidth::notifyBandwidthConsumed(tr_direction dir, size_t byte_count, bool is_piece_data, uint64_t now)
+void tr_bandwidth::notifyBandwidthConsumed(
+    tr_direction dir,
+    size_t byte_count,
+    bool is_piece_data,
+    uint64_t now,
+    bool is_reserved)
 {
     TR_ASSERT(tr_isDirection(dir));
 
     Band* band = &this->band_[dir];
 
-    if (band->is_limited_ && is_piece_data)
+    if (band->is_limited_ && is_piece_data && !is_reserved)
     {
         band->bytes_left_ -= std::min(size_t{ band->bytes_left_ }, byte_count);
     }
@@ -332,7 +337,20 @@ void tr_bandwidth::notifyBandwidthConsumed(tr_direction dir, size_t byte_count,
 
     if (this->parent_ != nullptr)
     {
-        this->parent_->notifyBandwidthConsumed(dir, byte_count, is_piece_data, now);
+        this->parent_->notifyBandwidthConsumed(dir, byte_count, is_piece_data, now, is_reserved);
+    }
+}
+
+void tr_bandwidth::reserve(tr_direction dir, size_t byte_count) noexcept
+{
+    TR_ASSERT(tr_isDirection(dir));
+
+    for (auto* bandwidth = this; bandwidth != nullptr; bandwidth = bandwidth->parent_)
+    {
+        if (auto& band = bandwidth->band_[dir]; band.is_limited_)
+        {
+            band.bytes_left_ -= std::min(size_t{ band.bytes_left_ }, byte_count);
+        }
     }
 }
 
@@ -110,7 +110,18 @@ public:
      * @brief Notify the bandwidth object that some of its allocated bandwidth has been consumed.
      * This is is usually invoked by the peer-io after a read or write.
      */
-    void notifyBandwidthConsumed(tr_direction dir, size_t byte_count, bool is_piece_data, uint64_t now);
+    void notifyBandwidthConsumed(
+        tr_direction dir,
+        size_t byte_count,
+        bool is_piece_data,
+        uint64_t now,
+        bool is_reserved = false);
+
+    /**
+     * @brief Take byte_count off of what's left to consume this period before the bytes are known.
+     * Once they are, notifyBandwidthConsumed() them with `is_reserved` set so they aren't counted twice.
+     */
+    void reserve(tr_direction dir, size_t byte_count) noexcept;
 
     /**
      * @brief allocate the next period_msec's worth of bandwidth for the peer-ios to consume
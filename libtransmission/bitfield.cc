@@ -379,6 +379,12 @@ void tr_bitfield::set(size_t nth, bool value)
     }
     have_all_hint_ = true_count_ == bit_count_;
     have_none_hint_ = true_count_ == 0;
+
+    // e.g. a peer that became a seed by sending us `have` messages
+    if (have_all_hint_ || have_none_hint_)
+    {
+        freeArray();
+    }
 }
 
 /* Sets bit range [begin, end) to 1 */
@@ -95,6 +95,12 @@ public:
 
     [[nodiscard]] bool isValid() const;
 
+    // heap bytes used by the bit array. Zero when all or none are set.
+    [[nodiscard]] size_t memoryUsage() const noexcept
+    {
+        return flags_.capacity();
+    }
+
 private:
     [[nodiscard]] size_t countFlags() const noexcept;
     [[nodiscard]] size_t countFlags(size_t begin, size_t end) const noexcept;
@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <cerrno> // EAGAIN
 #include <cstdlib> // std::lldiv()
 #include <iterator> // std::distance(), std::next(), std::prev()
 #include <limits> // std::numeric_limits<size_t>::max()
@@ -21,6 +22,7 @@
 #include "torrent.h"
 #include "torrents.h"
 #include "tr-assert.h"
+#include "tracing.h"
 #include "utils.h" // tr_time(), tr_formatter
 
 Cache::Key Cache::makeKey(tr_torrent const* torrent, tr_block_info::Location loc) noexcept
@@ -69,8 +71,25 @@ std::pair<Cache::CIter, Cache::CIter> Cache::findContiguous(CIter const begin, C
     return std::make_pair(span_begin, span_end);
 }
 
+bool Cache::isDeferred(CIter const begin, CIter const end) const
+{
+    auto* const tor = torrents_.get(begin->key.first);
+    if (tor == nullptr)
+    {
+        return false;
+    }
+
+    auto const last = std::prev(end);
+    auto const first_file = tor->fileOffset(tor->blockLoc(begin->key.second)).index;
+    auto const last_byte = tor->blockLoc(last->key.second).byte + std::size(*last->buf) - 1;
+    auto const last_file = tor->fileOffset(tor->byteLoc(last_byte)).index;
+    return tor->session->isPreallocating(tor->id(), first_file, last_file + 1);
+}
+
 int Cache::writeContiguous(CIter const begin, CIter const end) const
 {
+    auto const trace = tr_trace_scope{ tr_trace_event::CacheFlush, static_cast<uint64_t>(std::distance(begin, end)) };
+
     // join the blocks together into contiguous memory `buf`
     auto buf = std::vector<uint8_t>{};
     auto const buflen = std::accumulate(
@@ -150,6 +169,12 @@ void Cache::writeBlock(tr_torrent_id_t tor_id, tr_block_index_t block, std::uniq
     ++cache_writes_;
     cache_write_bytes_ += std::size(*iter->buf);
 
+    // a peer is sending us this file, so it's next in line for preallocation
+    if (auto* const tor = torrents_.get(tor_id); tor != nullptr && tor->session->preallocationMode() == TR_PREALLOCATE_FULL)
+    {
+        (void)tor->session->preallocatePrioritize(tor_id, tor->fileOffset(tor->blockLoc(block)).index);
+    }
+
     (void)cacheTrim();
 }
 
@@ -172,10 +197,12 @@ int Cache::readBlock(tr_torrent* torrent, tr_block_info::Location loc, uint32_t
 {
     if (auto const iter = getBlock(torrent, loc); iter != std::end(blocks_))
     {
+        ++read_hits_;
         std::copy_n(std::begin(*iter->buf), len, setme);
         return {};
     }
 
+    ++read_misses_;
     return tr_ioRead(torrent, loc, len, setme);
 }
 
@@ -195,20 +222,44 @@ int Cache::prefetchBlock(tr_torrent* torrent, tr_block_info::Location loc, uint3
 
 int Cache::flushSpan(CIter const begin, CIter const end)
 {
+    auto written = std::vector<std::pair<CIter, CIter>>{};
+    auto deferred = false;
+
     for (auto walk = begin; walk < end;)
     {
         auto const [contig_begin, contig_end] = findContiguous(begin, end, walk);
 
-        if (auto const err = writeContiguous(contig_begin, contig_end); err != 0)
+        // EAGAIN: tr_ioWrite() just queued the file for preallocation
+        if (auto const err = isDeferred(contig_begin, contig_end) ? EAGAIN : writeContiguous(contig_begin, contig_end);
+            err == EAGAIN)
+        {
+            deferred = true;
+        }
+        else if (err != 0)
         {
             return err;
         }
+        else
+        {
+            written.emplace_back(contig_begin, contig_end);
+        }
 
         walk = contig_end;
     }
 
-    blocks_.erase(begin, end);
-    return {};
+    if (!deferred)
+    {
+        blocks_.erase(begin, end);
+        return {};
+    }
+
+    // erase back-to-front so that the earlier iterators stay valid
+    for (auto iter = std::rbegin(written); iter != std::rend(written); ++iter)
+    {
+        blocks_.erase(iter->first, iter->second);
+    }
+
+    return EAGAIN;
 }
 
 int Cache::flushFile(tr_torrent const* torrent, tr_file_index_t file)
@@ -232,26 +283,80 @@ int Cache::flushTorrent(tr_torrent const* torrent)
         std::lower_bound(std::begin(blocks_), std::end(blocks_), std::make_pair(tor_id + 1, 0), compare));
 }
 
-int Cache::flushOldest()
+Cache::Stats Cache::stats() const noexcept
+{
+    auto stats = Stats{};
+    stats.blocks = std::size(blocks_);
+    stats.cache_writes = cache_writes_;
+    stats.cache_write_bytes = cache_write_bytes_;
+    stats.disk_writes = disk_writes_;
+    stats.disk_write_bytes = disk_write_bytes_;
+    stats.read_hits = read_hits_;
+    stats.read_misses = read_misses_;
+    return stats;
+}
+
+size_t Cache::memoryUsage() const noexcept
 {
-    auto const oldest = std::min_element(
+    return std::accumulate(
         std::begin(blocks_),
         std::end(blocks_),
-        [](auto const& a, auto const& b) { return a.time_added < b.time_added; });
+        blocks_.capacity() * sizeof(CacheBlock),
+        [](size_t sum, auto const& block) { return sum + block.buf->capacity(); });
+}
+
+int Cache::flushOldest()
+{
+    auto const by_age = [](auto const& a, auto const& b)
+    {
+        return a.time_added < b.time_added;
+    };
+
+    CIter const oldest = std::min_element(std::begin(blocks_), std::end(blocks_), by_age);
 
     if (oldest == std::end(blocks_)) // nothing to flush
     {
         return 0;
     }
 
-    auto const [begin, end] = findContiguous(std::begin(blocks_), std::end(blocks_), oldest);
+    auto span = findContiguous(std::begin(blocks_), std::end(blocks_), oldest);
 
-    if (auto const err = writeContiguous(begin, end); err != 0)
+    if (isDeferred(span.first, span.second))
+    {
+        // the oldest blocks are waiting on a file that's still
+        // being preallocated, so flush the oldest of the rest
+        auto found = std::cend(blocks_);
+
+        for (auto walk = std::cbegin(blocks_); walk != std::cend(blocks_);)
+        {
+            auto const contig = findContiguous(std::cbegin(blocks_), std::cend(blocks_), walk);
+
+            if (!isDeferred(contig.first, contig.second))
+            {
+                auto const iter = std::min_element(contig.first, contig.second, by_age);
+
+                if (found == std::cend(blocks_) || iter->time_added < found->time_added)
+                {
+                    found = iter;
+                    span = contig;
+                }
+            }
+
+            walk = contig.second;
+        }
+
+        if (found == std::cend(blocks_))
+        {
+            return EAGAIN;
+        }
+    }
+
+    if (auto const err = writeContiguous(span.first, span.second); err != 0)
     {
         return err;
     }
 
-    blocks_.erase(begin, end);
+    blocks_.erase(span.first, span.second);
     return 0;
 }
 
@@ -261,7 +366,10 @@ int Cache::cacheTrim()
     {
         if (auto const err = flushOldest(); err != 0)
         {
-            return err;
+            // If everything left is waiting on preallocation, let the
+            // cache run over its limit until that's done. Meanwhile, no
+            // more blocks are requested for those files; see isBackedUp().
+            return err == EAGAIN ? 0 : err;
         }
     }
 
@@ -41,6 +41,29 @@ public:
     int flushTorrent(tr_torrent const* torrent);
     int flushFile(tr_torrent const* torrent, tr_file_index_t file);
 
+    [[nodiscard]] size_t memoryUsage() const noexcept;
+
+    // @return true if the cache is over its limit. Everything else gets
+    // flushed first, so the blocks over the limit are waiting on files
+    // that are still being preallocated.
+    [[nodiscard]] bool isBackedUp() const noexcept
+    {
+        return std::size(blocks_) > max_blocks_;
+    }
+
+    struct Stats
+    {
+        size_t blocks = 0; // blocks waiting to be written
+        uint64_t cache_writes = 0; // blocks added to the cache
+        uint64_t cache_write_bytes = 0;
+        uint64_t disk_writes = 0; // contiguous spans flushed to disk
+        uint64_t disk_write_bytes = 0;
+        uint64_t read_hits = 0; // block reads served from the cache
+        uint64_t read_misses = 0; // block reads that went to disk
+    };
+
+    [[nodiscard]] Stats stats() const noexcept;
+
 private:
     using Key = std::pair<tr_torrent_id_t, tr_block_index_t>;
 
@@ -70,13 +93,17 @@ private:
 
     [[nodiscard]] static std::pair<CIter, CIter> findContiguous(CIter const begin, CIter const end, CIter const iter) noexcept;
 
+    // @return true if the blocks belong to a file that's still being preallocated
+    [[nodiscard]] bool isDeferred(CIter const begin, CIter const end) const;
+
     // @return any error code from tr_ioWrite()
     [[nodiscard]] int writeContiguous(CIter const begin, CIter const end) const;
 
-    // @return any error code from writeContiguous()
+    // Blocks for files that are still being preallocated stay in the cache.
+    // @return any error code from writeContiguous(), or EAGAIN if some blocks stayed
     [[nodiscard]] int flushSpan(CIter const begin, CIter const end);
 
-    // @return any error code from writeContiguous()
+    // @return any error code from writeContiguous(), or EAGAIN if every block is deferred
     [[nodiscard]] int flushOldest();
 
     // @return any error code from writeContiguous()
@@ -92,8 +119,10 @@ private:
     size_t max_blocks_ = 0;
     size_t max_bytes_ = 0;
 
-    mutable size_t disk_writes_ = 0;
-    mutable size_t disk_write_bytes_ = 0;
-    mutable size_t cache_writes_ = 0;
-    mutable size_t cache_write_bytes_ = 0;
+    mutable uint64_t disk_writes_ = 0;
+    mutable uint64_t disk_write_bytes_ = 0;
+    uint64_t cache_writes_ = 0;
+    uint64_t cache_write_bytes_ = 0;
+    uint64_t read_hits_ = 0;
+    uint64_t read_misses_ = 0;
 };
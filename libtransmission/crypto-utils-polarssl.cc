@@ -184,6 +184,7 @@ public:
         API(sha1_free)(&handle_);
 #endif
 
+        clear();
         return digest;
     }
 
@@ -240,6 +241,7 @@ public:
         API(sha256_free)(&handle_);
 #endif
 
+        clear();
         return digest;
     }
 
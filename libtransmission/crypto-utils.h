@@ -13,6 +13,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "transmission.h" // tr_sha1_digest_t
 
@@ -38,6 +39,11 @@ public:
         (context->add(std::data(args), std::size(args)), ...);
         return context->finish();
     }
+
+    // Hash a run of consecutive pieces that are laid out back-to-back in one
+    // buffer, e.g. from a single large read. Every piece is `piece_size` bytes
+    // except possibly the last one. Returns one digest per piece.
+    [[nodiscard]] static std::vector<tr_sha1_digest_t> digestPieces(void const* data, size_t data_length, size_t piece_size);
 };
 
 class tr_sha256
@@ -0,0 +1,98 @@
+// This file Copyright 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "transmission.h"
+
+#include "crypto-worker.h"
+#include "tracing.h"
+#include "utils.h" // tr_wait_msec()
+
+tr_crypto_worker::tr_crypto_worker(post_func post, size_t max_threads)
+    : post_{ std::move(post) }
+    , max_threads_{ std::max(std::min(size_t{ std::thread::hardware_concurrency() }, max_threads), size_t{ 1U }) }
+{
+}
+
+void tr_crypto_worker::workerThreadFunc()
+{
+    tr_traceSetThreadName("crypto");
+
+    for (;;)
+    {
+        auto job = Job{};
+
+        {
+            auto const lock = std::lock_guard(mutex_);
+
+            if (stopping_ || std::empty(todo_))
+            {
+                --n_threads_;
+                return;
+            }
+
+            job = std::move(todo_.front());
+            todo_.pop_front();
+            ++n_running_;
+        }
+
+        job.work();
+        jobs_done_.fetch_add(1U, std::memory_order_relaxed);
+        post_(std::move(job.done));
+
+        auto const lock = std::lock_guard(mutex_);
+        --n_running_;
+    }
+}
+
+bool tr_crypto_worker::add(func_t work, func_t done)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    if (stopping_)
+    {
+        return false;
+    }
+
+    todo_.push_back(Job{ std::move(work), std::move(done) });
+
+    // start another thread if every running one is busy
+    if (n_threads_ < max_threads_ && n_threads_ - n_running_ < std::size(todo_))
+    {
+        auto thread = std::thread(&tr_crypto_worker::workerThreadFunc, this);
+        ++n_threads_;
+        thread.detach();
+    }
+
+    return true;
+}
+
+tr_crypto_worker::Stats tr_crypto_worker::stats()
+{
+    auto stats = Stats{};
+    stats.jobs_done = jobs_done_.load(std::memory_order_relaxed);
+
+    auto const lock = std::lock_guard(mutex_);
+    stats.queued = std::size(todo_) + n_running_;
+    return stats;
+}
+
+tr_crypto_worker::~tr_crypto_worker()
+{
+    auto lock = std::unique_lock(mutex_);
+    stopping_ = true;
+    todo_.clear();
+
+    while (n_threads_ > 0U)
+    {
+        lock.unlock();
+        tr_wait_msec(20);
+        lock.lock();
+    }
+}
@@ -0,0 +1,73 @@
+// This file Copyright 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <atomic>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+
+// Runs CPU-heavy crypto, such as the key exchange in encrypted
+// peer handshakes, on a small pool of worker threads so that it
+// doesn't stall the event loop.
+//
+// Each job's `done` function is handed to `post` once `work` has
+// finished, so the owner decides which thread it runs on.
+class tr_crypto_worker
+{
+public:
+    using func_t = std::function<void()>;
+    using post_func = std::function<void(func_t)>;
+
+    explicit tr_crypto_worker(post_func post, size_t max_threads = DefaultMaxThreads);
+    ~tr_crypto_worker();
+
+    tr_crypto_worker(tr_crypto_worker&&) = delete;
+    tr_crypto_worker(tr_crypto_worker const&) = delete;
+    tr_crypto_worker& operator=(tr_crypto_worker&&) = delete;
+    tr_crypto_worker& operator=(tr_crypto_worker const&) = delete;
+
+    // Called from any thread. `work` runs on a worker thread,
+    // then `done` is passed to the post function.
+    // @return false if the worker is shutting down and dropped the job
+    [[nodiscard]] bool add(func_t work, func_t done);
+
+    struct Stats
+    {
+        size_t queued = 0; // jobs waiting or running
+        uint64_t jobs_done = 0;
+    };
+
+    [[nodiscard]] Stats stats();
+
+    static size_t constexpr DefaultMaxThreads = 4U;
+
+private:
+    struct Job
+    {
+        func_t work;
+        func_t done;
+    };
+
+    void workerThreadFunc();
+
+    post_func const post_;
+    size_t const max_threads_;
+
+    std::mutex mutex_;
+    std::list<Job> todo_;
+    size_t n_threads_ = 0;
+    size_t n_running_ = 0;
+    bool stopping_ = false;
+
+    std::atomic<uint64_t> jobs_done_ = {};
+};
@@ -0,0 +1,228 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <iterator> // std::next
+
+#include "transmission.h"
+
+#include "crypto-utils.h" // tr_rand_int_weak()
+#include "dht-scheduler.h"
+
+tr_dht_scheduler::tr_dht_scheduler(Mediator& mediator, time_t now, size_t min_searches)
+    : mediator_{ mediator }
+    , wheel_{ now }
+    , min_searches_{ std::clamp(min_searches, size_t{ 1U }, MaxSearches) }
+    , tokens_at_{ now }
+{
+}
+
+void tr_dht_scheduler::add(tr_torrent_id_t tor_id, tr_address_type type, time_t at)
+{
+    auto const key = Key{ tor_id, type };
+    auto const [iter, is_new] = entries_.try_emplace(key);
+    auto& entry = iter->second;
+
+    if (is_new || (!entry.queued && at < entry.due_at))
+    {
+        entry.due_at = at;
+        wheel_.add(at, key);
+    }
+}
+
+void tr_dht_scheduler::remove(tr_torrent_id_t tor_id)
+{
+    // stale copies in `wheel_` and `queue_` are skipped when they come up
+    entries_.erase(Key{ tor_id, TR_AF_INET });
+    entries_.erase(Key{ tor_id, TR_AF_INET6 });
+}
+
+// bucket 0 counts lags under 1 second and bucket N counts lags in [2^(N-1), 2^N) seconds
+void tr_dht_scheduler::addLag(time_t due_at, time_t now)
+{
+    auto& histogram = stats_.lag_sec;
+    auto lag = now > due_at ? static_cast<uint64_t>(now - due_at) : uint64_t{};
+    stats_.lag_sum_sec += lag;
+    auto bucket = size_t{};
+    while (lag > 0U && bucket + 1U < std::size(histogram))
+    {
+        lag >>= 1;
+        ++bucket;
+    }
+
+    ++histogram[bucket];
+}
+
+void tr_dht_scheduler::expireSearches(time_t now)
+{
+    for (auto iter = std::begin(searching_); iter != std::end(searching_);)
+    {
+        iter = iter->second + SearchTimeoutSec <= now ? searching_.erase(iter) : std::next(iter);
+    }
+}
+
+// drop queued keys that were removed or have since been started
+void tr_dht_scheduler::dropStale()
+{
+    queue_.erase(
+        std::remove_if(
+            std::begin(queue_),
+            std::end(queue_),
+            [this](Key const& key)
+            {
+                auto const iter = entries_.find(key);
+                return iter == std::end(entries_) || !iter->second.queued;
+            }),
+        std::end(queue_));
+}
+
+// Spread the announces evenly over the interval: enough to announce every
+// scheduled entry once per interval, plus a floor for small sessions.
+void tr_dht_scheduler::refill(time_t now)
+{
+    auto const rate = std::max(MinAnnouncesPerSec, static_cast<double>(std::size(entries_)) / AnnounceIntervalSec);
+    auto const elapsed = now > tokens_at_ ? now - tokens_at_ : time_t{};
+    tokens_ = std::min(tokens_ + elapsed * rate, rate * 2);
+    tokens_at_ = now;
+}
+
+// Rank the announces that can go out now. Fewer peers and
+// a longer wait both move an announce up the queue.
+std::vector<std::pair<time_t, tr_dht_scheduler::Key>> tr_dht_scheduler::rankQueue()
+{
+    auto ranked = std::vector<std::pair<time_t, Key>>{};
+    ranked.reserve(std::size(queue_));
+
+    for (auto const& key : queue_)
+    {
+        auto const iter = entries_.find(key);
+        if (iter == std::end(entries_) || !mediator_.isReady(key.second))
+        {
+            continue;
+        }
+
+        auto const n_peers = mediator_.peerCount(key.first);
+        if (!n_peers)
+        {
+            remove(key.first);
+            continue;
+        }
+
+        auto const penalty = std::min(static_cast<time_t>(*n_peers) * PeerPenaltySec, MaxPeerPenaltySec);
+        ranked.emplace_back(iter->second.due_at + penalty, key);
+    }
+
+    return ranked;
+}
+
+void tr_dht_scheduler::pulse(time_t now)
+{
+    expireSearches(now);
+    refill(now);
+
+    // move the entries whose time has come into the queue
+    wheel_.advance(
+        now,
+        [this, now](Key const& key)
+        {
+            auto const iter = entries_.find(key);
+            if (iter == std::end(entries_) || iter->second.queued)
+            {
+                return;
+            }
+
+            auto& entry = iter->second;
+            if (entry.due_at <= now)
+            {
+                entry.queued = true;
+                queue_.push_back(key);
+            }
+            else if (entry.due_at <= wheel_.now())
+            {
+                // tr_time() went backwards; put it back so it isn't lost
+                wheel_.add(entry.due_at, key);
+            }
+        });
+
+    dropStale();
+
+    auto const max_searches = maxSearches();
+    auto const n_free = max_searches > std::size(searching_) ? max_searches - std::size(searching_) : size_t{};
+    auto const n_wanted = std::min({ n_free, static_cast<size_t>(tokens_), std::size(queue_) });
+    if (now < paused_until_ || n_wanted == 0U)
+    {
+        return;
+    }
+
+    auto ranked = rankQueue();
+    auto const n_ranked = std::min(n_wanted, std::size(ranked));
+    std::partial_sort(std::begin(ranked), std::begin(ranked) + n_ranked, std::end(ranked));
+
+    for (size_t i = 0; i < n_ranked; ++i)
+    {
+        auto const& key = ranked[i].second;
+
+        if (!mediator_.startSearch(key.first, key.second))
+        {
+            // leave the rest queued until libdht has room again
+            ++stats_.failed;
+            paused_until_ = std::max(paused_until_, now + FullBackoffSec);
+            break;
+        }
+
+        searching_[key] = now;
+        tokens_ -= 1;
+        ++stats_.started;
+
+        if (auto const iter = entries_.find(key); iter != std::end(entries_))
+        {
+            auto& entry = iter->second;
+            addLag(entry.due_at, now);
+            entry.queued = false;
+            entry.due_at = now + AnnounceIntervalSec + tr_rand_int_weak(AnnounceJitterSec);
+            wheel_.add(entry.due_at, key);
+        }
+    }
+
+    dropStale();
+}
+
+void tr_dht_scheduler::searchDone(tr_torrent_id_t tor_id, tr_address_type type)
+{
+    searching_.erase(Key{ tor_id, type });
+}
+
+void tr_dht_scheduler::searchFailed(tr_torrent_id_t tor_id, tr_address_type type, time_t now)
+{
+    searchDone(tor_id, type);
+    ++stats_.failed;
+    paused_until_ = std::max(paused_until_, now + FullBackoffSec);
+
+    if (auto const iter = entries_.find(Key{ tor_id, type }); iter != std::end(entries_) && !iter->second.queued)
+    {
+        iter->second.due_at = now;
+        wheel_.add(now, iter->first);
+    }
+}
+
+// Twice what announcing every entry once per interval keeps busy, so that
+// slow searches and the queue built up by a burst of new torrents don't
+// make every announce late.
+size_t tr_dht_scheduler::maxSearches() const noexcept
+{
+    auto constexpr SearchSec = static_cast<size_t>(ExpectedSearchSec);
+    auto constexpr IntervalSec = static_cast<size_t>(AnnounceIntervalSec);
+    auto const n_busy = std::size(entries_) * SearchSec / IntervalSec + 1U;
+    return std::clamp(n_busy * 2U, min_searches_, MaxSearches);
+}
+
+tr_dht_scheduler::Stats tr_dht_scheduler::stats() const
+{
+    auto stats = stats_;
+    stats.scheduled = std::size(entries_);
+    stats.queued = std::size(queue_);
+    stats.searching = std::size(searching_);
+    return stats;
+}
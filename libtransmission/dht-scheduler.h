@@ -0,0 +1,166 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <map>
+#include <optional>
+#include <utility> // std::pair
+#include <vector>
+
+#include "transmission.h" // tr_torrent_id_t
+
+#include "net.h" // tr_address_type
+#include "timer-wheel.h"
+
+/**
+ * Decides when each running torrent announces itself to the DHT.
+ *
+ * Announces that come due wait in a queue until there's a free search
+ * slot in libdht and the pacing allows another one, so that thousands
+ * of torrents neither overflow libdht's search table nor all announce
+ * in the same second. Torrents with few peers go to the front of the
+ * queue, since they're the ones that need the DHT most.
+ */
+class tr_dht_scheduler
+{
+public:
+    using Key = std::pair<tr_torrent_id_t, tr_address_type>;
+
+    class Mediator
+    {
+    public:
+        virtual ~Mediator() = default;
+
+        // Whether the DHT on this address family can take announces right now.
+        [[nodiscard]] virtual bool isReady(tr_address_type type) const = 0;
+
+        // How many peers the torrent is connected to, or
+        // nullopt if it shouldn't announce anymore.
+        [[nodiscard]] virtual std::optional<size_t> peerCount(tr_torrent_id_t tor_id) const = 0;
+
+        // @return false if the search couldn't be started. Searches
+        // that fail later on are reported with searchFailed().
+        [[nodiscard]] virtual bool startSearch(tr_torrent_id_t tor_id, tr_address_type type) = 0;
+    };
+
+    // How often each torrent announces on each address family.
+    static auto constexpr AnnounceIntervalSec = time_t{ 25 * 60 };
+    static auto constexpr AnnounceJitterSec = time_t{ 3 * 60 };
+
+    // About how long a libdht search takes from start to done.
+    static auto constexpr ExpectedSearchSec = time_t{ 60 };
+
+    // Concurrent searches to allow. Announcing every entry once per
+    // interval keeps `entries * ExpectedSearchSec / AnnounceIntervalSec`
+    // searches busy, so the slots grow with the entry count, with room
+    // to spare, from `min_searches` up to MaxSearches.
+    //
+    // libdht's own table holds 1024, but each search keeps several queries
+    // in flight, so MaxSearches stays well under that to keep the DHT's
+    // traffic bursts small. That makes the ceiling about
+    // `MaxSearches * AnnounceIntervalSec / ExpectedSearchSec / 2`
+    // torrent/family pairs, i.e. 6400, before announces start running late.
+    static auto constexpr DefaultMinSearches = size_t{ 64 };
+    static auto constexpr MaxSearches = size_t{ 512 };
+
+    tr_dht_scheduler(Mediator& mediator, time_t now, size_t min_searches = DefaultMinSearches);
+
+    // Announce `tor_id` on `type` at `at`, or sooner if it's already due.
+    void add(tr_torrent_id_t tor_id, tr_address_type type, time_t at);
+
+    // Stop announcing `tor_id`. Its searches still hold their
+    // slots until they're done or have timed out.
+    void remove(tr_torrent_id_t tor_id);
+
+    // Start as many of the due announces as the search slots and
+    // pacing allow, best first. Call this about once a second.
+    // If libdht refuses a search, most likely because its table is
+    // full, this holds off on starting any more for a bit.
+    void pulse(time_t now);
+
+    // Frees the search's slot.
+    void searchDone(tr_torrent_id_t tor_id, tr_address_type type);
+
+    // For when libdht refuses a search after startSearch() returned true.
+    // Frees its slot, holds off like pulse() does, and makes it due again.
+    void searchFailed(tr_torrent_id_t tor_id, tr_address_type type, time_t now);
+
+    struct Stats
+    {
+        // bucket 0 counts announces started less than a second after they
+        // were due, and bucket N counts ones started [2^(N-1), 2^N) seconds late.
+        using LagHistogram = std::array<uint64_t, 16>;
+
+        LagHistogram lag_sec = {};
+        uint64_t lag_sum_sec = 0;
+        size_t scheduled = 0; // torrent/family pairs being announced
+        size_t queued = 0; // announces that are due but waiting for a slot
+        size_t searching = 0;
+        uint64_t started = 0;
+        uint64_t failed = 0;
+    };
+
+    [[nodiscard]] Stats stats() const;
+
+    // How many searches can run at once with the current entry count.
+    [[nodiscard]] size_t maxSearches() const noexcept;
+
+private:
+    // Give up on hearing that a search is done after this long.
+    // libdht's searches finish well within it.
+    static auto constexpr SearchTimeoutSec = time_t{ 5 * 60 };
+
+    // How long to wait after libdht refuses a search.
+    static auto constexpr FullBackoffSec = time_t{ 5 };
+
+    // Start at least this many announces per second, so a session
+    // with just a few torrents doesn't trickle out its first announces.
+    static auto constexpr MinAnnouncesPerSec = 4.0;
+
+    // A torrent with lots of peers yields to ones with few,
+    // but never by more than this.
+    static auto constexpr MaxPeerPenaltySec = time_t{ 5 * 60 };
+    static auto constexpr PeerPenaltySec = time_t{ 5 };
+
+    struct Entry
+    {
+        time_t due_at = 0;
+        bool queued = false;
+    };
+
+    [[nodiscard]] std::vector<std::pair<time_t, Key>> rankQueue();
+    void expireSearches(time_t now);
+    void dropStale();
+    void refill(time_t now);
+    void addLag(time_t due_at, time_t now);
+
+    Mediator& mediator_;
+
+    std::map<Key, Entry> entries_;
+    std::map<Key, time_t> searching_; // when each search was started
+
+    // When each entry's next announce is due. Once due, an entry
+    // moves to `queue_` until there's room to start its search.
+    tr_timer_wheel<Key> wheel_;
+    std::vector<Key> queue_;
+
+    size_t const min_searches_;
+    time_t paused_until_ = 0;
+
+    // pacing
+    double tokens_ = 0;
+    time_t tokens_at_;
+
+    Stats stats_;
+};
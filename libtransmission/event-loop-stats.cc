@@ -0,0 +1,107 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <string>
+#include <utility> // std::move
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "event-loop-stats.h"
+#include "metrics.h"
+
+namespace
+{
+
+using Histogram = tr_latency_histogram::Snapshot;
+
+[[nodiscard]] Histogram minus(Histogram const& now, Histogram const& since)
+{
+    auto ret = Histogram{};
+    for (size_t i = 0; i < std::size(ret.buckets); ++i)
+    {
+        ret.buckets[i] = now.buckets[i] - since.buckets[i];
+    }
+    ret.count = now.count - since.count;
+    ret.sum_usec = now.sum_usec - since.sum_usec;
+    return ret;
+}
+
+[[nodiscard]] double averageMsec(Histogram const& histogram)
+{
+    return histogram.count == 0U ? 0.0 : histogram.sum_usec / 1000.0 / histogram.count;
+}
+
+// An upper bound on the 99th percentile: the top of the bucket it falls in.
+[[nodiscard]] double p99Msec(Histogram const& histogram)
+{
+    auto const target = histogram.count - histogram.count / 100U;
+    auto seen = uint64_t{};
+    for (size_t i = 0; i < std::size(histogram.buckets); ++i)
+    {
+        seen += histogram.buckets[i];
+        if (seen >= target)
+        {
+            return static_cast<double>(uint64_t{ 1 } << i) / 1000.0;
+        }
+    }
+    return static_cast<double>(uint64_t{ 1 } << (std::size(histogram.buckets) - 1U)) / 1000.0;
+}
+
+} // namespace
+
+tr_event_loop_stats::Snapshot tr_event_loop_stats::snapshot() const noexcept
+{
+    auto ret = Snapshot{};
+    for (size_t i = 0; i < NumCallbacks; ++i)
+    {
+        ret.callbacks[i].duration = histograms_[i].duration.snapshot();
+        ret.callbacks[i].lag = histograms_[i].lag.snapshot();
+    }
+    ret.work_queue_tasks = work_queue_tasks_.load(std::memory_order_relaxed);
+    ret.work_queue_max_depth = work_queue_max_depth_.load(std::memory_order_relaxed);
+    return ret;
+}
+
+std::vector<std::string> tr_event_loop_stats::describe(Snapshot const& now, Snapshot const& since)
+{
+    auto lines = std::vector<std::string>{};
+
+    for (size_t i = 0; i < NumCallbacks; ++i)
+    {
+        auto const duration = minus(now.callbacks[i].duration, since.callbacks[i].duration);
+        if (duration.count == 0U)
+        {
+            continue;
+        }
+
+        auto line = fmt::format(
+            FMT_STRING("{:s}: {:d} runs, {:.1f} ms avg, {:.1f} ms p99"),
+            TrEventLoopCallbackNames[i],
+            duration.count,
+            averageMsec(duration),
+            p99Msec(duration));
+
+        if (auto const lag = minus(now.callbacks[i].lag, since.callbacks[i].lag); lag.count != 0U)
+        {
+            line += fmt::format(FMT_STRING(", {:.1f} ms avg lag, {:.1f} ms p99 lag"), averageMsec(lag), p99Msec(lag));
+        }
+
+        if (i == size_t(tr_event_loop_callback::WorkQueue))
+        {
+            line += fmt::format(
+                FMT_STRING(", {:d} tasks, {:d} max depth"),
+                now.work_queue_tasks - since.work_queue_tasks,
+                now.work_queue_max_depth);
+        }
+
+        lines.emplace_back(std::move(line));
+    }
+
+    return lines;
+}
@@ -0,0 +1,162 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "metrics.h"
+
+// The periodic work that the libevent thread does.
+enum class tr_event_loop_callback : uint8_t
+{
+    BandwidthPulse,
+    RechokePulse,
+    RefillUpkeep,
+    ReconnectPulse,
+    AnnouncerUpkeep,
+    SessionSave,
+    WorkQueue, // draining tasks posted by tr_runInEventThread()
+
+    N_CALLBACKS
+};
+
+inline auto constexpr TrEventLoopCallbackNames = std::array<std::string_view, size_t(tr_event_loop_callback::N_CALLBACKS)>{
+    "bandwidth-pulse",
+    "rechoke-pulse",
+    "refill-upkeep",
+    "reconnect-pulse",
+    "announcer-upkeep",
+    "session-save",
+    "work-queue",
+};
+
+/**
+ * How long the libevent thread spends in each of its periodic callbacks,
+ * and how late those callbacks run compared to when they were due.
+ *
+ * A callback's lag is how long it waited for the loop to get around to it:
+ * for a timer, the time between when it was due and when it fired; for the
+ * work queue, the time between the wakeup request and the drain. Long lags
+ * mean that something else is hogging the libevent thread.
+ *
+ * Everything is recorded in the libevent thread and can be read from any thread.
+ */
+class tr_event_loop_stats
+{
+public:
+    static auto constexpr NumCallbacks = size_t(tr_event_loop_callback::N_CALLBACKS);
+
+    struct Callback
+    {
+        tr_latency_histogram::Snapshot duration;
+        tr_latency_histogram::Snapshot lag;
+    };
+
+    struct Snapshot
+    {
+        std::array<Callback, NumCallbacks> callbacks = {};
+        uint64_t work_queue_tasks = 0; // tasks run by all drains
+        uint64_t work_queue_max_depth = 0; // most tasks run by one drain
+    };
+
+    // Times a callback from construction to destruction.
+    class Scope
+    {
+    public:
+        Scope(tr_event_loop_stats& stats, tr_event_loop_callback callback, std::optional<std::chrono::microseconds> lag = {})
+            : stats_{ stats }
+            , callback_{ callback }
+            , begin_{ std::chrono::steady_clock::now() }
+        {
+            if (lag)
+            {
+                stats_.at(callback_).lag.add(*lag);
+            }
+        }
+
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+
+        ~Scope()
+        {
+            using namespace std::chrono;
+            stats_.at(callback_).duration.add(duration_cast<microseconds>(steady_clock::now() - begin_));
+        }
+
+    private:
+        tr_event_loop_stats& stats_;
+        tr_event_loop_callback const callback_;
+        std::chrono::steady_clock::time_point const begin_;
+    };
+
+    // Call this from any thread after asking the libevent thread to drain
+    // its work queue, so that the drain can measure how long it was kept waiting.
+    void onWorkQueueWakeup() noexcept
+    {
+        auto const now = std::chrono::steady_clock::now().time_since_epoch();
+        wakeup_usec_.store(std::chrono::duration_cast<std::chrono::microseconds>(now).count(), std::memory_order_relaxed);
+    }
+
+    // Call this from the libevent thread as a drain begins.
+    [[nodiscard]] std::optional<std::chrono::microseconds> takeWorkQueueLag() noexcept
+    {
+        auto const wakeup_usec = wakeup_usec_.exchange(0, std::memory_order_relaxed);
+        if (wakeup_usec == 0)
+        {
+            return {};
+        }
+
+        auto const now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now) - std::chrono::microseconds{ wakeup_usec };
+    }
+
+    // Call this from the libevent thread after a drain.
+    void onWorkQueueDrained(size_t n_tasks) noexcept
+    {
+        work_queue_tasks_.fetch_add(n_tasks, std::memory_order_relaxed);
+
+        if (n_tasks > work_queue_max_depth_.load(std::memory_order_relaxed))
+        {
+            work_queue_max_depth_.store(n_tasks, std::memory_order_relaxed);
+        }
+    }
+
+    [[nodiscard]] Snapshot snapshot() const noexcept;
+
+    // One line per callback summarizing what happened between two snapshots,
+    // e.g. "rechoke-pulse: 10 runs, 0.4 ms avg, 1.0 ms p99, 2.1 ms avg lag".
+    // Callbacks that didn't run in between are skipped.
+    [[nodiscard]] static std::vector<std::string> describe(Snapshot const& now, Snapshot const& since);
+
+private:
+    struct Histograms
+    {
+        tr_latency_histogram duration;
+        tr_latency_histogram lag;
+    };
+
+    [[nodiscard]] Histograms& at(tr_event_loop_callback callback) noexcept
+    {
+        return histograms_[size_t(callback)];
+    }
+
+    std::array<Histograms, NumCallbacks> histograms_;
+    std::atomic<uint64_t> work_queue_tasks_ = {};
+    std::atomic<uint64_t> work_queue_max_depth_ = {};
+    std::atomic<int64_t> wakeup_usec_ = {};
+};
@@ -862,6 +862,15 @@ bool preallocate_fallocate64(tr_sys_file_t handle, uint64_t size)
 }
 #endif
 
+#if defined(HAVE_FALLOCATE64) && defined(FALLOC_FL_ZERO_RANGE)
+// Some filesystems that refuse a plain fallocate() can still zero a range
+// without the caller writing the zeroes itself.
+bool full_preallocate_zero_range(tr_sys_file_t handle, uint64_t size)
+{
+    return fallocate64(handle, FALLOC_FL_ZERO_RANGE, 0, size) == 0;
+}
+#endif
+
 #ifdef HAVE_XFS_XFS_H
 bool full_preallocate_xfs(tr_sys_file_t handle, uint64_t size)
 {
@@ -942,6 +951,9 @@ bool tr_sys_file_preallocate(tr_sys_file_t handle, uint64_t size, int flags, tr_
         approaches.insert(
             std::end(approaches),
             {
+#if defined(HAVE_FALLOCATE64) && defined(FALLOC_FL_ZERO_RANGE)
+                full_preallocate_zero_range,
+#endif
 #ifdef HAVE_XFS_XFS_H
                 full_preallocate_xfs,
 #endif
@@ -112,10 +112,34 @@ enum handshake_state_t
     AWAITING_VC,
     AWAITING_CRYPTO_SELECT,
     AWAITING_PAD_D,
+    /* both */
+    AWAITING_SECRET,
     /* */
     N_STATES
 };
 
+// The expensive part of the MSE key exchange: the shared secret
+// and the digests of it that the rest of the handshake needs.
+// Computed by a crypto worker when the mediator has one.
+struct tr_handshake_secret
+{
+    explicit tr_handshake_secret(DH const& dh_in)
+        : dh{ dh_in }
+    {
+    }
+
+    void compute(DH::key_bigend_t const& peer_public_key)
+    {
+        dh.setPeerPublicKey(peer_public_key);
+        req1 = tr_sha1::digest("req1"sv, dh.secret());
+        req3 = tr_sha1::digest("req3"sv, dh.secret());
+    }
+
+    DH dh;
+    tr_sha1_digest_t req1 = {}; // HASH('req1', S)
+    tr_sha1_digest_t req3 = {}; // HASH('req3', S)
+};
+
 struct tr_handshake
 {
     tr_handshake(
@@ -124,7 +148,7 @@ struct tr_handshake
         tr_encryption_mode encryption_mode_in)
         : mediator{ std::move(mediator_in) }
         , io{ std::move(io_in) }
-        , dh{ mediator->privateKey() }
+        , dh{ mediator->dh() }
         , encryption_mode{ encryption_mode_in }
     {
     }
@@ -174,6 +198,17 @@ struct tr_handshake
     uint32_t crypto_provide = {};
     std::unique_ptr<libtransmission::Timer> timeout_timer;
 
+    // HASH('req1', S) and HASH('req3', S), once the secret is known
+    tr_sha1_digest_t req1 = {};
+    tr_sha1_digest_t req3 = {};
+
+    // set when a crypto job finishes; consumed by readSecret()
+    std::shared_ptr<tr_handshake_secret> secret;
+
+    // crypto jobs hold a weak_ptr to this, so that a job which finishes
+    // after the handshake was aborted or timed out knows to do nothing
+    std::shared_ptr<tr_handshake*> const alive = std::make_shared<tr_handshake*>(this);
+
     std::optional<tr_peer_id_t> peer_id;
 
     tr_handshake_done_func done_func = nullptr;
@@ -200,7 +235,8 @@ static constexpr std::string_view getStateName(handshake_state_t const state)
         "awaiting yb"sv, /* AWAITING_YB */
         "awaiting vc"sv, /* AWAITING_VC */
         "awaiting crypto select"sv, /* AWAITING_CRYPTO_SELECT */
-        "awaiting pad d"sv /* AWAITING_PAD_D */
+        "awaiting pad d"sv, /* AWAITING_PAD_D */
+        "awaiting secret"sv /* AWAITING_SECRET */
     };
 
     return state < N_STATES ? state_strings[state] : "unknown state"sv;
@@ -340,6 +376,54 @@ static void sendYa(tr_handshake* handshake)
     setReadState(handshake, AWAITING_YB);
 }
 
+static void onSecretComputed(tr_handshake* handshake, std::shared_ptr<tr_handshake_secret> secret)
+{
+    if (handshake->state != AWAITING_SECRET || handshake->secret)
+    {
+        return;
+    }
+
+    handshake->secret = std::move(secret);
+
+    // the peer may have sent more while we were waiting
+    handshake->io->tryRead();
+}
+
+static ReadState readSecret(tr_handshake* handshake, tr_peerIo* peer_io);
+
+// Compute the shared secret from the peer's public key. That's a modular
+// exponentiation plus a couple of SHA1s, so hand it to a crypto worker if
+// there is one and wait in AWAITING_SECRET until readSecret() picks it up.
+static ReadState startSecret(tr_handshake* handshake, tr_peerIo* peer_io, DH::key_bigend_t const& peer_public_key)
+{
+    setState(handshake, AWAITING_SECRET);
+
+    auto job = std::make_shared<tr_handshake_secret>(handshake->dh);
+    auto work = [job, peer_public_key]()
+    {
+        job->compute(peer_public_key);
+    };
+    auto done = [job, alive = std::weak_ptr<tr_handshake*>{ handshake->alive }]()
+    {
+        if (auto const handshake = alive.lock(); handshake)
+        {
+            onSecretComputed(*handshake, job);
+        }
+    };
+
+    if (!handshake->mediator->runCrypto(work, std::move(done)))
+    {
+        // The read loop stops once the inbuf is empty, and the peer may
+        // be waiting on us (e.g. for req1 after an empty PadB), so don't
+        // leave the secret for a readSecret() that might not come.
+        work();
+        handshake->secret = std::move(job);
+        return readSecret(handshake, peer_io);
+    }
+
+    return READ_NOW;
+}
+
 static constexpr uint32_t getCryptoSelect(tr_encryption_mode encryption_mode, uint32_t crypto_provide)
 {
     auto choices = std::array<uint32_t, 2>{};
@@ -400,16 +484,13 @@ static ReadState readYb(tr_handshake* handshake, tr_peerIo* peer_io)
 
     // get the peer's public key
     peer_io->readBytes(std::data(peer_public_key), std::size(peer_public_key));
-    handshake->dh.setPeerPublicKey(peer_public_key);
+    return startSecret(handshake, peer_io, peer_public_key);
+}
 
+static ReadState sendCryptoProvide(tr_handshake* handshake, tr_peerIo* peer_io)
+{
     /* now send these: HASH('req1', S), HASH('req2', SKEY) xor HASH('req3', S),
      * ENCRYPT(VC, crypto_provide, len(PadC), PadC, len(IA)), ENCRYPT(IA) */
-    evbuffer* const outbuf = evbuffer_new();
-
-    /* HASH('req1', S) */
-    auto const req1 = tr_sha1::digest("req1"sv, handshake->dh.secret());
-    evbuffer_add(outbuf, std::data(req1), std::size(req1));
-
     auto const info_hash = peer_io->torrentHash();
     if (!info_hash)
     {
@@ -417,10 +498,15 @@ static ReadState readYb(tr_handshake* handshake, tr_peerIo* peer_io)
         return tr_handshakeDone(handshake, false);
     }
 
+    evbuffer* const outbuf = evbuffer_new();
+
+    /* HASH('req1', S) */
+    evbuffer_add(outbuf, std::data(handshake->req1), std::size(handshake->req1));
+
     /* HASH('req2', SKEY) xor HASH('req3', S) */
     {
         auto const req2 = tr_sha1::digest("req2"sv, *info_hash);
-        auto const req3 = tr_sha1::digest("req3"sv, handshake->dh.secret());
+        auto const& req3 = handshake->req3;
         auto buf = tr_sha1_digest_t{};
         for (size_t i = 0, n = std::size(buf); i < n; ++i)
         {
@@ -448,6 +534,7 @@ static ReadState readYb(tr_handshake* handshake, tr_peerIo* peer_io)
     }
     else
     {
+        evbuffer_free(outbuf);
         return tr_handshakeDone(handshake, false);
     }
 
@@ -692,20 +779,41 @@ static ReadState readYa(tr_handshake* handshake, tr_peerIo* peer_io)
 
     /* read the incoming peer's public key */
     peer_io->readBytes(std::data(peer_public_key), std::size(peer_public_key));
-    handshake->dh.setPeerPublicKey(peer_public_key);
 
-    // send our public key to the peer
+    // send our public key to the peer. Yb doesn't depend on the
+    // secret, so there's no need to wait for that before sending it.
     tr_logAddTraceHand(handshake, "sending B->A: Diffie Hellman Yb, PadB");
     sendPublicKeyAndPad<PadbMaxlen>(handshake);
 
-    setReadState(handshake, AWAITING_PAD_A);
-    return READ_NOW;
+    return startSecret(handshake, peer_io, peer_public_key);
+}
+
+static ReadState readSecret(tr_handshake* handshake, tr_peerIo* peer_io)
+{
+    if (!handshake->secret)
+    {
+        tr_logAddTraceHand(handshake, "waiting for the crypto worker");
+        return READ_LATER;
+    }
+
+    auto const secret = std::move(handshake->secret);
+    handshake->dh = secret->dh;
+    handshake->req1 = secret->req1;
+    handshake->req3 = secret->req3;
+
+    if (handshake->isIncoming())
+    {
+        setReadState(handshake, AWAITING_PAD_A);
+        return READ_NOW;
+    }
+
+    return sendCryptoProvide(handshake, peer_io);
 }
 
 static ReadState readPadA(tr_handshake* handshake, tr_peerIo* peer_io)
 {
     // find the end of PadA by looking for HASH('req1', S)
-    auto const needle = tr_sha1::digest("req1"sv, handshake->dh.secret());
+    auto const& needle = handshake->req1;
 
     for (size_t i = 0; i < PadaMaxlen; ++i)
     {
@@ -753,7 +861,7 @@ static ReadState readCryptoProvide(tr_handshake* handshake, tr_peerIo* peer_io)
     auto req2 = tr_sha1_digest_t{};
     peer_io->readBytes(std::data(req2), std::size(req2));
 
-    auto const req3 = tr_sha1::digest("req3"sv, handshake->dh.secret());
+    auto const& req3 = handshake->req3;
     for (size_t i = 0; i < std::size(obfuscated_hash); ++i)
     {
         obfuscated_hash[i] = req2[i] ^ req3[i];
@@ -995,6 +1103,10 @@ static ReadState canRead(tr_peerIo* peer_io, void* vhandshake, size_t* piece)
             ret = readPadD(handshake, peer_io);
             break;
 
+        case AWAITING_SECRET:
+            ret = readSecret(handshake, peer_io);
+            break;
+
         default:
 #ifdef TR_ENABLE_ASSERTS
             TR_ASSERT_MSG(false, fmt::format(FMT_STRING("unhandled handshake state {:d}"), handshake->state));
@@ -1087,8 +1199,9 @@ static void gotError(tr_peerIo* io, short what, void* vhandshake)
     /* if the error happened while we were sending a public key, we might
      * have encountered a peer that doesn't do encryption... reconnect and
      * try a plaintext handshake */
-    if ((handshake->state == AWAITING_YB || handshake->state == AWAITING_VC) &&
-        handshake->encryption_mode != TR_ENCRYPTION_REQUIRED && handshake->mediator->allowsTCP() &&
+    auto const sent_public_key = handshake->state == AWAITING_YB || handshake->state == AWAITING_VC ||
+        (handshake->state == AWAITING_SECRET && !handshake->isIncoming());
+    if (sent_public_key && handshake->encryption_mode != TR_ENCRYPTION_REQUIRED && handshake->mediator->allowsTCP() &&
         handshake->io->reconnect() == 0)
     {
         auto msg = std::array<uint8_t, HandshakeSize>{};
@@ -10,6 +10,7 @@
 #endif
 
 #include <cstddef> // for size_t
+#include <functional>
 #include <optional>
 #include <memory>
 
@@ -74,6 +75,21 @@ public:
         return tr_message_stream_encryption::DH::randomPrivateKey();
     }
 
+    // The key exchange state for a new handshake.
+    // Override this to hand out keypairs that were generated ahead of time.
+    [[nodiscard]] virtual tr_message_stream_encryption::DH dh() const
+    {
+        return tr_message_stream_encryption::DH{ privateKey() };
+    }
+
+    // Runs `work` on a crypto worker thread and then `done` on the event
+    // thread. Returns false if there's no worker, in which case neither is
+    // called and the handshake does the work inline.
+    virtual bool runCrypto(std::function<void()> /*work*/, std::function<void()> /*done*/)
+    {
+        return false;
+    }
+
     virtual void setUTPFailed(tr_sha1_digest_t const& info_hash, tr_address) = 0;
 };
 
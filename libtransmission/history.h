@@ -31,10 +31,10 @@ public:
      */
     void add(time_t now, SizeType n)
     {
-        if (timestamps_[newest_] != now)
+        if (auto const timestamp = toTimestamp(now); timestamps_[newest_] != timestamp)
         {
             newest_ = (newest_ + 1) % Seconds;
-            timestamps_[newest_] = now;
+            timestamps_[newest_] = timestamp;
             count_[newest_] = {};
         }
 
@@ -63,7 +63,14 @@ public:
     }
 
 private:
-    std::array<time_t, Seconds> timestamps_ = {};
+    // Stored as 32 bits because tr_peer holds several of these per
+    // connection. Unsigned, so this is good until 2106.
+    [[nodiscard]] static constexpr uint32_t toTimestamp(time_t now) noexcept
+    {
+        return now <= 0 ? 0U : static_cast<uint32_t>(now);
+    }
+
+    std::array<uint32_t, Seconds> timestamps_ = {};
     std::array<SizeType, Seconds> count_ = {};
     uint32_t newest_ = 0;
 };
@@ -20,6 +20,7 @@
 #include "log.h"
 #include "torrent.h"
 #include "tr-assert.h"
+#include "tracing.h"
 #include "utils.h"
 
 using namespace std::literals;
@@ -115,6 +116,12 @@ int readOrWriteBytes(
         return 0;
     }
 
+    // the cache holds on to these blocks until the file is ready
+    if (do_write && session->preallocatePrioritize(tor->id(), file_index))
+    {
+        return EAGAIN;
+    }
+
     /***
     ****  Find the fd
     ***/
@@ -129,8 +136,25 @@ int readOrWriteBytes(
     if (!fd) // not in the cache, so open or create it now
     {
         // open (and maybe create) the file
-        auto const prealloc = (!do_write || !tor->fileIsWanted(file_index)) ? TR_PREALLOCATE_NONE :
-                                                                              tor->session->preallocationMode();
+        auto prealloc = (!do_write || !tor->fileIsWanted(file_index)) ? TR_PREALLOCATE_NONE :
+                                                                        tor->session->preallocationMode();
+
+        // creating a fully-preallocated file can take minutes,
+        // so hand it off to the worker thread instead of blocking here
+        if (prealloc == TR_PREALLOCATE_FULL && !session->preallocateFailed(tor->id(), file_index) &&
+            !tr_sys_path_exists(filename))
+        {
+            if (session->canPreallocateInBackground())
+            {
+                session->preallocateAdd(tor->id(), file_index, filename, file_size);
+                return EAGAIN;
+            }
+
+            // This write can't wait for the worker,
+            // so settle for reserving the space sparsely.
+            prealloc = TR_PREALLOCATE_SPARSE;
+        }
+
         fd = session->openFiles().get(tor->id(), file_index, do_write, filename, prealloc, file_size);
         if (fd && do_write)
         {
@@ -214,7 +238,8 @@ int readOrWritePiece(tr_torrent* tor, IoMode io_mode, tr_block_info::Location lo
         buf += bytes_this_pass;
         buflen -= bytes_this_pass;
 
-        if (err != 0 && io_mode == IoMode::Write && tor->error != TR_STAT_LOCAL_ERROR)
+        // EAGAIN means the file is still being preallocated; try again later
+        if (err != 0 && err != EAGAIN && io_mode == IoMode::Write && tor->error != TR_STAT_LOCAL_ERROR)
         {
             auto const path = tr_pathbuf{ tor->downloadDir(), '/', tor->fileSubpath(file_index) };
             tor->setLocalError(fmt::format(FMT_STRING("{:s} ({:s})"), tr_strerror(err), path));
@@ -238,6 +263,7 @@ std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_
     tr_ioPrefetch(tor, loc, bytes_left);
 
     auto sha = tr_sha1::create();
+
     auto buffer = std::vector<uint8_t>(tr_block_info::BlockSize);
     while (bytes_left != 0)
     {
@@ -248,6 +274,7 @@ std::optional<tr_sha1_digest_t> recalculateHash(tr_torrent* tor, tr_piece_index_
         }
 
         sha->add(std::data(buffer), len);
+
         loc = tor->byteLoc(loc.byte + len);
         bytes_left -= len;
     }
@@ -274,6 +301,7 @@ int tr_ioWrite(tr_torrent* tor, tr_block_info::Location loc, uint32_t len, uint8
 
 bool tr_ioTestPiece(tr_torrent* tor, tr_piece_index_t piece)
 {
+    auto const trace = tr_trace_scope{ tr_trace_event::HashCheck, piece };
     auto const hash = recalculateHash(tor, piece);
     return hash && *hash == tor->pieceHash(piece);
 }
@@ -0,0 +1,133 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <mutex>
+
+#include "tr-assert.h"
+
+/**
+ * A recursive mutex that keeps histograms of how long threads waited
+ * to acquire it and how long they held it.
+ *
+ * Times are bucketed by powers of two: bucket 0 counts durations under
+ * 1 µs and bucket N counts durations in [2^(N-1), 2^N) µs. The last
+ * bucket also counts anything longer than that.
+ *
+ * A hold is timed from the outermost lock() to its matching unlock(),
+ * so recursive locking counts as a single hold.
+ */
+class tr_instrumented_recursive_mutex
+{
+public:
+    static auto constexpr NumBuckets = size_t{ 24U };
+
+    using Histogram = std::array<uint64_t, NumBuckets>;
+
+    struct Stats
+    {
+        uint64_t acquisitions = 0;
+        uint64_t contended = 0; // acquisitions that had to wait
+        Histogram wait_usec = {};
+        Histogram hold_usec = {};
+        uint64_t wait_sum_usec = 0;
+        uint64_t hold_sum_usec = 0;
+    };
+
+    void lock()
+    {
+        if (mutex_.try_lock())
+        {
+            onAcquired(false, {}, {});
+            return;
+        }
+
+        auto const begin = Clock::now();
+        mutex_.lock();
+        onAcquired(true, begin, Clock::now());
+    }
+
+    bool try_lock()
+    {
+        if (!mutex_.try_lock())
+        {
+            return false;
+        }
+
+        onAcquired(false, {}, {});
+        return true;
+    }
+
+    void unlock()
+    {
+        TR_ASSERT(depth_ > 0U);
+
+        if (--depth_ == 0U)
+        {
+            addDuration(stats_.hold_usec, stats_.hold_sum_usec, held_since_, Clock::now());
+        }
+
+        mutex_.unlock();
+    }
+
+    [[nodiscard]] Stats stats()
+    {
+        auto const lock = std::lock_guard{ *this };
+        return stats_;
+    }
+
+    [[nodiscard]] static constexpr size_t bucketFor(std::chrono::microseconds duration) noexcept
+    {
+        auto usec = duration.count();
+        auto bucket = size_t{};
+        while (usec > 0 && bucket + 1U < NumBuckets)
+        {
+            usec >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static void addDuration(Histogram& histogram, uint64_t& sum_usec, Clock::time_point begin, Clock::time_point end) noexcept
+    {
+        auto const duration = std::chrono::duration_cast<std::chrono::microseconds>(end - begin);
+        ++histogram[bucketFor(duration)];
+        sum_usec += static_cast<uint64_t>(duration.count());
+    }
+
+    // called with `mutex_` held, so the counters need no atomics
+    void onAcquired(bool contended, Clock::time_point wait_begin, Clock::time_point wait_end)
+    {
+        if (depth_++ != 0U)
+        {
+            return;
+        }
+
+        held_since_ = Clock::now();
+        ++stats_.acquisitions;
+        if (contended)
+        {
+            ++stats_.contended;
+        }
+        addDuration(stats_.wait_usec, stats_.wait_sum_usec, wait_begin, wait_end);
+    }
+
+    std::recursive_mutex mutex_;
+    size_t depth_ = 0;
+    Clock::time_point held_since_;
+    Stats stats_;
+};
@@ -33,6 +33,14 @@ public:
         return !!find(key);
     }
 
+    [[nodiscard]] size_t size() const noexcept
+    {
+        return std::count_if(
+            std::begin(entries_),
+            std::end(entries_),
+            [](auto const& entry) { return entry.sequence_ != InvalidSeq; });
+    }
+
     Val& add(Key&& key)
     {
         auto& entry = getFreeSlot();
@@ -4,7 +4,10 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
-#include <cerrno> // for ENOENT
+#include <cerrno> // for ENOENT, EIO
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <string>
@@ -33,6 +36,9 @@ using namespace std::literals;
 namespace
 {
 
+// When making checksums, read about this many bytes at a time
+auto constexpr ChecksumBatchSize = uint32_t{ 4U * 1024U * 1024U };
+
 namespace find_files_helpers
 {
 
@@ -127,6 +133,94 @@ void walkTree(std::string_view const top, std::string_view const subpath, std::s
 
 } // namespace find_files_helpers
 
+namespace checksum_helpers
+{
+
+// A run of consecutive pieces that's been read from disk and is waiting to be hashed
+struct Batch
+{
+    tr_piece_index_t first_piece = 0;
+    std::vector<std::byte> buf;
+};
+
+// Hands batches from the reader thread to the hashing threads.
+// The queue is bounded so that the reader can read ahead by only a few batches.
+class BatchQueue
+{
+public:
+    explicit BatchQueue(size_t max_size)
+        : max_size_{ max_size }
+    {
+    }
+
+    // Blocks while the queue is full.
+    void push(Batch&& batch)
+    {
+        auto lock = std::unique_lock(mutex_);
+        not_full_.wait(lock, [this]() { return std::size(queue_) < max_size_; });
+        queue_.emplace_back(std::move(batch));
+        not_empty_.notify_one();
+    }
+
+    // Blocks while the queue is empty.
+    // Returns std::nullopt when the queue is empty and closed.
+    [[nodiscard]] std::optional<Batch> pop()
+    {
+        auto lock = std::unique_lock(mutex_);
+        not_empty_.wait(lock, [this]() { return !std::empty(queue_) || closed_; });
+
+        if (std::empty(queue_))
+        {
+            return {};
+        }
+
+        auto batch = std::move(queue_.front());
+        queue_.pop_front();
+        not_full_.notify_one();
+        return batch;
+    }
+
+    // No more batches are coming; wake up the hashers so they can exit.
+    void close()
+    {
+        auto const lock = std::lock_guard(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+    // Hashers give back their buffers so the reader doesn't have to reallocate.
+    void recycle(std::vector<std::byte>&& buf)
+    {
+        auto const lock = std::lock_guard(mutex_);
+        spares_.emplace_back(std::move(buf));
+    }
+
+    [[nodiscard]] std::vector<std::byte> spare()
+    {
+        auto const lock = std::lock_guard(mutex_);
+
+        if (std::empty(spares_))
+        {
+            return {};
+        }
+
+        auto buf = std::move(spares_.back());
+        spares_.pop_back();
+        return buf;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<Batch> queue_;
+    std::vector<std::vector<std::byte>> spares_;
+    size_t const max_size_;
+    bool closed_ = false;
+};
+
+} // namespace checksum_helpers
+
 tr_torrent_files findFiles(std::string_view const top, std::string_view const subpath)
 {
     using namespace find_files_helpers;
@@ -171,6 +265,8 @@ bool tr_metainfo_builder::setPieceSize(uint32_t piece_size) noexcept
 
 bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
 {
+    using namespace checksum_helpers;
+
     checksum_piece_ = 0;
     cancel_ = false;
 
@@ -181,86 +277,146 @@ bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
     }
 
     auto hashes = std::vector<std::byte>(std::size(tr_sha1_digest_t{}) * pieceCount());
-    auto* walk = std::data(hashes);
-    auto sha = tr_sha1::create();
-
-    auto file_index = tr_file_index_t{ 0U };
-    auto piece_index = tr_piece_index_t{ 0U };
-    auto total_remain = totalSize();
-    auto off = uint64_t{ 0U };
-
-    auto buf = std::vector<char>(pieceSize());
-
-    auto const parent = tr_sys_path_dirname(top_);
-    auto fd = tr_sys_file_open(
-        tr_pathbuf{ parent, '/', path(file_index) },
-        TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
-        0,
-        error);
-    if (fd == TR_BAD_SYS_FILE)
-    {
-        return false;
-    }
 
-    while (!cancel_ && (total_remain > 0U))
+    // read and hash several pieces at a time to cut down on syscalls
+    auto const pieces_per_batch = std::max(tr_piece_index_t{ 1U }, tr_piece_index_t(ChecksumBatchSize / pieceSize()));
+    auto const n_threads = checksumThreadCount();
+
+    // the hashing threads: each takes the next batch that's been read,
+    // hashes its pieces, and writes the digests into place by piece index
+    auto queue = BatchQueue{ n_threads * 2U };
+    auto workers = std::vector<std::thread>{};
+    workers.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; ++i)
     {
-        checksum_piece_ = piece_index;
+        workers.emplace_back(
+            [this, &queue, &hashes]()
+            {
+                while (auto batch = queue.pop())
+                {
+                    if (!cancel_)
+                    {
+                        auto const digests = tr_sha1::digestPieces(std::data(batch->buf), std::size(batch->buf), pieceSize());
+                        auto* walk = std::data(hashes) + std::size(tr_sha1_digest_t{}) * batch->first_piece;
+                        for (auto const& digest : digests)
+                        {
+                            walk = std::copy(std::begin(digest), std::end(digest), walk);
+                        }
+
+                        checksum_piece_ += static_cast<tr_piece_index_t>(std::size(digests));
+                    }
 
-        TR_ASSERT(piece_index < pieceCount());
+                    queue.recycle(std::move(batch->buf));
+                }
+            });
+    }
 
-        uint32_t const piece_size = block_info_.pieceSize(piece_index);
-        buf.resize(piece_size);
-        auto* bufptr = std::data(buf);
+    // the reader: walk through the files sequentially, feeding batches to the hashers
+    auto const read_ok = [&]()
+    {
+        auto file_index = tr_file_index_t{ 0U };
+        auto piece_index = tr_piece_index_t{ 0U };
+        auto total_remain = totalSize();
+        auto off = uint64_t{ 0U };
+
+        auto const parent = tr_sys_path_dirname(top_);
+        auto fd = tr_sys_file_open(
+            tr_pathbuf{ parent, '/', path(file_index) },
+            TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
+            0,
+            error);
+        if (fd == TR_BAD_SYS_FILE)
+        {
+            return false;
+        }
 
-        auto left_in_piece = piece_size;
-        while (left_in_piece > 0U)
+        while (!cancel_ && (total_remain > 0U))
         {
-            auto const n_this_pass = std::min(fileSize(file_index) - off, uint64_t{ left_in_piece });
-            auto n_read = uint64_t{};
+            TR_ASSERT(piece_index < pieceCount());
 
-            (void)tr_sys_file_read(fd, bufptr, n_this_pass, &n_read, error);
-            bufptr += n_read;
-            off += n_read;
-            left_in_piece -= n_read;
+            auto const n_pieces = std::min(pieces_per_batch, pieceCount() - piece_index);
+            auto const batch_size = std::min(uint64_t{ n_pieces } * pieceSize(), total_remain);
+            auto batch = Batch{ piece_index, queue.spare() };
+            batch.buf.resize(batch_size);
+            auto* bufptr = std::data(batch.buf);
 
-            if (off == fileSize(file_index))
+            auto left_in_batch = batch_size;
+            while (left_in_batch > 0U)
             {
-                off = 0;
-                tr_sys_file_close(fd);
-                fd = TR_BAD_SYS_FILE;
+                auto const n_this_pass = std::min(fileSize(file_index) - off, left_in_batch);
+                auto n_read = uint64_t{};
+
+                if (!tr_sys_file_read(fd, bufptr, n_this_pass, &n_read, error))
+                {
+                    tr_sys_file_close(fd);
+                    return false;
+                }
 
-                if (++file_index < fileCount())
+                if (n_this_pass > 0U && n_read == 0U) // file got shorter?
                 {
-                    fd = tr_sys_file_open(
-                        tr_pathbuf{ parent, '/', path(file_index) },
-                        TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
-                        0,
-                        error);
-                    if (fd == TR_BAD_SYS_FILE)
+                    tr_sys_file_close(fd);
+                    tr_error_set(error, EIO, tr_strerror(EIO));
+                    return false;
+                }
+
+                bufptr += n_read;
+                off += n_read;
+                left_in_batch -= n_read;
+
+                if (off == fileSize(file_index))
+                {
+                    off = 0;
+                    tr_sys_file_close(fd);
+                    fd = TR_BAD_SYS_FILE;
+
+                    if (++file_index < fileCount())
                     {
-                        return false;
+                        fd = tr_sys_file_open(
+                            tr_pathbuf{ parent, '/', path(file_index) },
+                            TR_SYS_FILE_READ | TR_SYS_FILE_SEQUENTIAL,
+                            0,
+                            error);
+                        if (fd == TR_BAD_SYS_FILE)
+                        {
+                            return false;
+                        }
                     }
                 }
             }
+
+            TR_ASSERT(uint64_t(bufptr - std::data(batch.buf)) == batch_size);
+            TR_ASSERT(left_in_batch == 0);
+            queue.push(std::move(batch));
+
+            total_remain -= batch_size;
+            piece_index += n_pieces;
         }
 
-        TR_ASSERT(bufptr - std::data(buf) == (int)piece_size);
-        TR_ASSERT(left_in_piece == 0);
-        sha->add(std::data(buf), std::size(buf));
-        auto const digest = sha->finish();
-        walk = std::copy(std::begin(digest), std::end(digest), walk);
-        sha->clear();
+        TR_ASSERT(cancel_ || piece_index == pieceCount());
+        TR_ASSERT(cancel_ || total_remain == 0U);
 
-        total_remain -= piece_size;
-        ++piece_index;
+        if (fd != TR_BAD_SYS_FILE)
+        {
+            tr_sys_file_close(fd);
+        }
+
+        return true;
+    }();
+
+    if (!read_ok)
+    {
+        cancel_ = true; // no point in hashing the rest
     }
 
-    TR_ASSERT(cancel_ || size_t(walk - std::data(hashes)) == std::size(hashes));
-    TR_ASSERT(cancel_ || total_remain == 0U);
+    queue.close();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
 
-    if (fd != TR_BAD_SYS_FILE)
+    if (!read_ok)
     {
-        tr_sys_file_close(fd);
+        return false;
     }
 
     if (cancel_)
@@ -269,6 +425,7 @@ bool tr_metainfo_builder::blockingMakeChecksums(tr_error** error)
         return false;
     }
 
+    TR_ASSERT(checksum_piece_ == pieceCount());
     piece_hashes_ = std::move(hashes);
     return true;
 }
@@ -6,11 +6,13 @@
 #pragma once
 
 #include <algorithm> // std::move
+#include <atomic>
 #include <cstddef> // std::byte
 #include <cstdint>
 #include <future>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility> // std::pair
 #include <vector>
 
@@ -34,7 +36,8 @@ public:
 
     // Generate piece checksums asynchronously.
     // - This must be done before calling `benc()` or `save()`.
-    // - Runs in a worker thread because it can be time-consuming.
+    // - Runs in worker threads because it can be time-consuming:
+    //   one thread reads the files and `checksumThreadCount()` threads hash the pieces.
     // - Can be cancelled with `cancelChecksums()` and polled with `checksumStatus()`
     // - Resolves with a `tr_error*` which is set on failure or nullptr on success.
     std::future<tr_error*> makeChecksums()
@@ -50,14 +53,14 @@ public:
     }
 
     // Returns the status of a `makeChecksums()` call:
-    // The current piece being tested and the total number of pieces in the torrent.
-    [[nodiscard]] constexpr std::pair<tr_piece_index_t, tr_piece_index_t> checksumStatus() const noexcept
+    // The number of pieces tested so far and the total number of pieces in the torrent.
+    [[nodiscard]] std::pair<tr_piece_index_t, tr_piece_index_t> checksumStatus() const noexcept
     {
-        return std::make_pair(checksum_piece_, block_info_.pieceCount());
+        return std::make_pair(checksum_piece_.load(), block_info_.pieceCount());
     }
 
-    // Tell the `makeChecksums()` worker thread to cleanly exit ASAP.
-    constexpr void cancelChecksums() noexcept
+    // Tell the `makeChecksums()` worker threads to cleanly exit ASAP.
+    void cancelChecksums() noexcept
     {
         cancel_ = true;
     }
@@ -91,6 +94,12 @@ public:
 
     bool setPieceSize(uint32_t piece_size) noexcept;
 
+    // how many threads to use for hashing pieces in `makeChecksums()`
+    constexpr void setChecksumThreadCount(size_t n_threads) noexcept
+    {
+        checksum_thread_count_ = std::max(size_t{ 1U }, n_threads);
+    }
+
     constexpr void setPrivate(bool is_private) noexcept
     {
         is_private_ = is_private;
@@ -118,6 +127,11 @@ public:
         return anonymize_;
     }
 
+    [[nodiscard]] constexpr auto checksumThreadCount() const noexcept
+    {
+        return checksum_thread_count_;
+    }
+
     [[nodiscard]] constexpr auto const& comment() const noexcept
     {
         return comment_;
@@ -235,9 +249,11 @@ private:
     std::string comment_;
     std::string source_;
 
-    tr_piece_index_t checksum_piece_ = 0;
+    size_t checksum_thread_count_ = std::max(1U, std::thread::hardware_concurrency());
+
+    std::atomic<tr_piece_index_t> checksum_piece_ = 0;
 
     bool is_private_ = false;
     bool anonymize_ = false;
-    bool cancel_ = false;
+    std::atomic<bool> cancel_ = false;
 };
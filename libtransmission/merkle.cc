@@ -0,0 +1,95 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::min
+#include <cstddef> // size_t
+#include <vector>
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "merkle.h"
+#include "tr-assert.h"
+
+namespace tr_merkle
+{
+
+tr_sha256_digest_t padHash(size_t height)
+{
+    auto hash = tr_sha256_digest_t{};
+    if (height == 0)
+    {
+        return hash;
+    }
+
+    auto sha = tr_sha256::create();
+    for (size_t i = 0; i < height; ++i)
+    {
+        sha->clear();
+        sha->add(std::data(hash), std::size(hash));
+        sha->add(std::data(hash), std::size(hash));
+        hash = sha->finish();
+    }
+
+    return hash;
+}
+
+std::vector<tr_sha256_digest_t> blockHashes(void const* data, size_t data_length)
+{
+    auto hashes = std::vector<tr_sha256_digest_t>{};
+    hashes.reserve(blockCount(data_length));
+
+    auto sha = tr_sha256::create();
+    auto const* walk = static_cast<std::byte const*>(data);
+    for (size_t offset = 0; offset < data_length; offset += BlockSize)
+    {
+        sha->clear();
+        sha->add(walk + offset, std::min(BlockSize, data_length - offset));
+        hashes.push_back(sha->finish());
+    }
+
+    return hashes;
+}
+
+tr_sha256_digest_t root(std::vector<tr_sha256_digest_t> layer, size_t width, size_t height)
+{
+    TR_ASSERT(width == widthFor(width));
+    TR_ASSERT(std::size(layer) <= width);
+
+    if (std::empty(layer))
+    {
+        for (; width > 1; width /= 2)
+        {
+            ++height;
+        }
+        return padHash(height);
+    }
+
+    auto pad = padHash(height);
+    auto sha = tr_sha256::create();
+
+    for (; width > 1; width /= 2)
+    {
+        auto const n = std::size(layer);
+        for (size_t i = 0; i < n; i += 2)
+        {
+            auto const& right = i + 1 < n ? layer[i + 1] : pad;
+            sha->clear();
+            sha->add(std::data(layer[i]), std::size(layer[i]));
+            sha->add(std::data(right), std::size(right));
+            layer[i / 2] = sha->finish();
+        }
+        layer.resize((n + 1) / 2);
+
+        sha->clear();
+        sha->add(std::data(pad), std::size(pad));
+        sha->add(std::data(pad), std::size(pad));
+        pad = sha->finish();
+    }
+
+    return layer.front();
+}
+
+} // namespace tr_merkle
@@ -0,0 +1,63 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <vector>
+
+#include "transmission.h" // tr_sha256_digest_t
+
+/**
+ * BitTorrent v2 merkle hash trees.
+ * See http://bittorrent.org/beps/bep_0052.html
+ *
+ * Each file has its own tree. The leaves are SHA-256 hashes of the
+ * file's 16 KiB blocks (the final block is not padded) and the leaf
+ * layer is padded out to a power of two with all-zero hashes.
+ */
+namespace tr_merkle
+{
+
+auto inline constexpr BlockSize = size_t{ 16 * 1024 };
+
+/** @brief Return the smallest power of two that is >= `n`. */
+[[nodiscard]] constexpr size_t widthFor(size_t n) noexcept
+{
+    auto width = size_t{ 1 };
+    while (width < n)
+    {
+        width <<= 1;
+    }
+    return width;
+}
+
+/** @brief Return the number of 16 KiB leaves needed to hold `n_bytes`. */
+[[nodiscard]] constexpr size_t blockCount(uint64_t n_bytes) noexcept
+{
+    return static_cast<size_t>((n_bytes + BlockSize - 1) / BlockSize);
+}
+
+/** @brief Return the hash of a subtree of `height` levels whose leaves are all padding. */
+[[nodiscard]] tr_sha256_digest_t padHash(size_t height);
+
+/** @brief Hash each 16 KiB block of `data`. */
+[[nodiscard]] std::vector<tr_sha256_digest_t> blockHashes(void const* data, size_t data_length);
+
+/**
+ * @brief Reduce a layer of a merkle tree to its root.
+ *
+ * @param layer the nodes of the layer, left to right
+ * @param width the padded width of the layer; a power of two >= `layer.size()`
+ * @param height the layer's height above the leaves, used to pick the padding hash
+ */
+[[nodiscard]] tr_sha256_digest_t root(std::vector<tr_sha256_digest_t> layer, size_t width, size_t height = 0);
+
+} // namespace tr_merkle
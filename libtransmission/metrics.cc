@@ -0,0 +1,470 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <iterator> // std::back_inserter
+#include <string>
+#include <string_view>
+#include <utility> // std::move
+
+#include <fmt/core.h>
+
+#include "transmission.h"
+
+#include "announcer.h"
+#include "cache.h"
+#include "event-loop-stats.h"
+#include "metrics.h"
+#include "open-files.h"
+#include "peer-mgr.h"
+#include "rpcimpl.h"
+#include "session.h"
+#include "torrent.h"
+#include "tr-dht.h"
+#include "utils.h" // tr_time_msec()
+#include "verify.h"
+
+using namespace std::literals;
+
+/***
+****  tr_metrics_writer
+***/
+
+void tr_metrics_writer::family(std::string_view name, Type type, std::string_view help)
+{
+    static auto constexpr TypeNames = std::array<std::string_view, 3>{ "counter"sv, "gauge"sv, "histogram"sv };
+
+    type_ = type;
+    fmt::format_to(std::back_inserter(out_), FMT_STRING("# TYPE {:s} {:s}\n"), name, TypeNames[static_cast<size_t>(type)]);
+    fmt::format_to(std::back_inserter(out_), FMT_STRING("# HELP {:s} {:s}\n"), name, help);
+}
+
+void tr_metrics_writer::sample(std::string_view name, double value, Labels labels)
+{
+    appendSample(name, type_ == Type::Counter ? "_total"sv : ""sv, value, labels);
+}
+
+void tr_metrics_writer::histogramImpl(
+    std::string_view name,
+    uint64_t const* buckets,
+    size_t n_buckets,
+    double unit_sec,
+    double sum_sec,
+    Labels labels)
+{
+    auto count = uint64_t{};
+    auto upper_bound = unit_sec;
+    for (size_t i = 0; i < n_buckets; ++i, upper_bound *= 2)
+    {
+        count += buckets[i];
+
+        auto const le = i + 1U < n_buckets ? fmt::format(FMT_STRING("{}"), upper_bound) : "+Inf"s;
+        appendSample(name, "_bucket"sv, static_cast<double>(count), labels, { "le"sv, le });
+    }
+
+    appendSample(name, "_count"sv, static_cast<double>(count), labels);
+    appendSample(name, "_sum"sv, sum_sec, labels);
+}
+
+void tr_metrics_writer::appendSample(std::string_view name, std::string_view suffix, double value, Labels labels, Label extra)
+{
+    out_ += name;
+    out_ += suffix;
+
+    auto first = true;
+    auto const append_label = [this, &first](Label const& label)
+    {
+        out_ += first ? '{' : ',';
+        first = false;
+
+        out_ += label.first;
+        out_ += "=\"";
+        for (auto const ch : label.second)
+        {
+            switch (ch)
+            {
+            case '\\':
+                out_ += "\\\\";
+                break;
+
+            case '"':
+                out_ += "\\\"";
+                break;
+
+            case '\n':
+                out_ += "\\n";
+                break;
+
+            default:
+                out_ += ch;
+                break;
+            }
+        }
+        out_ += '"';
+    };
+
+    for (auto const& label : labels)
+    {
+        append_label(label);
+    }
+
+    if (!std::empty(extra.first))
+    {
+        append_label(extra);
+    }
+
+    if (!first)
+    {
+        out_ += '}';
+    }
+
+    fmt::format_to(std::back_inserter(out_), FMT_STRING(" {}\n"), value);
+}
+
+std::string tr_metrics_writer::finish()
+{
+    out_ += "# EOF\n";
+    return std::move(out_);
+}
+
+/***
+****  tr_sessionMetrics
+***/
+
+namespace
+{
+
+using Type = tr_metrics_writer::Type;
+
+auto constexpr UsecSec = 1e-6;
+
+void writeTorrentMetrics(tr_metrics_writer& out, tr_session* session)
+{
+    static auto constexpr ActivityNames = std::array<std::string_view, 7>{
+        "stopped"sv, "check_wait"sv, "check"sv, "download_wait"sv, "download"sv, "seed_wait"sv, "seed"sv,
+    };
+
+    auto const& torrents = session->torrents();
+    auto const now = tr_time_msec();
+
+    auto activity_counts = std::array<size_t, std::size(ActivityNames)>{};
+    for (auto const* const tor : torrents)
+    {
+        ++activity_counts[tr_torrentGetActivity(tor)];
+    }
+
+    out.family("transmission_torrents"sv, Type::Gauge, "Torrents in each state"sv);
+    for (size_t i = 0; i < std::size(ActivityNames); ++i)
+    {
+        out.sample("transmission_torrents"sv, activity_counts[i], { { "state"sv, ActivityNames[i] } });
+    }
+
+    out.family("transmission_torrent_download_bytes_per_second"sv, Type::Gauge, "Each torrent's piece data download speed"sv);
+    for (auto const* const tor : torrents)
+    {
+        auto const id = std::to_string(tor->id());
+        out.sample(
+            "transmission_torrent_download_bytes_per_second"sv,
+            tor->bandwidth_.getPieceSpeedBytesPerSecond(now, TR_DOWN),
+            { { "id"sv, id }, { "name"sv, tor->name() } });
+    }
+
+    out.family("transmission_torrent_upload_bytes_per_second"sv, Type::Gauge, "Each torrent's piece data upload speed"sv);
+    for (auto const* const tor : torrents)
+    {
+        auto const id = std::to_string(tor->id());
+        out.sample(
+            "transmission_torrent_upload_bytes_per_second"sv,
+            tor->bandwidth_.getPieceSpeedBytesPerSecond(now, TR_UP),
+            { { "id"sv, id }, { "name"sv, tor->name() } });
+    }
+
+    out.family("transmission_torrent_peers"sv, Type::Gauge, "Each torrent's connected peers"sv);
+    for (auto const* const tor : torrents)
+    {
+        auto const id = std::to_string(tor->id());
+        auto const peer_count = tor->swarm != nullptr ? tr_swarmGetStats(tor->swarm).peer_count : 0U;
+        out.sample("transmission_torrent_peers"sv, peer_count, { { "id"sv, id }, { "name"sv, tor->name() } });
+    }
+
+    out.family("transmission_torrent_verify_progress"sv, Type::Gauge, "How much of each torrent being verified is done"sv);
+    for (auto const* const tor : torrents)
+    {
+        if (auto const progress = tor->verifyProgress(); progress && tr_torrentGetActivity(tor) == TR_STATUS_CHECK)
+        {
+            auto const id = std::to_string(tor->id());
+            out.sample("transmission_torrent_verify_progress"sv, *progress, { { "id"sv, id }, { "name"sv, tor->name() } });
+        }
+    }
+}
+
+void writeBandwidthMetrics(tr_metrics_writer& out, tr_session* session)
+{
+    auto const now = tr_time_msec();
+    auto const stats = session->stats().current();
+
+    out.family("transmission_download_bytes_per_second"sv, Type::Gauge, "Piece data download speed"sv);
+    out.sample("transmission_download_bytes_per_second"sv, session->pieceSpeedBps(TR_DOWN));
+
+    out.family("transmission_upload_bytes_per_second"sv, Type::Gauge, "Piece data upload speed"sv);
+    out.sample("transmission_upload_bytes_per_second"sv, session->pieceSpeedBps(TR_UP));
+
+    out.family("transmission_downloaded_bytes"sv, Type::Counter, "Bytes downloaded since the session started"sv);
+    out.sample("transmission_downloaded_bytes"sv, stats.downloadedBytes);
+
+    out.family("transmission_uploaded_bytes"sv, Type::Counter, "Bytes uploaded since the session started"sv);
+    out.sample("transmission_uploaded_bytes"sv, stats.uploadedBytes);
+
+    out.family("transmission_group_download_bytes_per_second"sv, Type::Gauge, "Each bandwidth group's download speed"sv);
+    for (auto const& [name, group] : session->bandwidth_groups_)
+    {
+        out.sample(
+            "transmission_group_download_bytes_per_second"sv,
+            group->getPieceSpeedBytesPerSecond(now, TR_DOWN),
+            { { "group"sv, name.sv() } });
+    }
+
+    out.family("transmission_group_upload_bytes_per_second"sv, Type::Gauge, "Each bandwidth group's upload speed"sv);
+    for (auto const& [name, group] : session->bandwidth_groups_)
+    {
+        out.sample(
+            "transmission_group_upload_bytes_per_second"sv,
+            group->getPieceSpeedBytesPerSecond(now, TR_UP),
+            { { "group"sv, name.sv() } });
+    }
+}
+
+void writeDiskMetrics(tr_metrics_writer& out, tr_session* session)
+{
+    auto const cache = session->cache->stats();
+
+    out.family("transmission_cache_bytes"sv, Type::Gauge, "Memory used by the write cache"sv);
+    out.sample("transmission_cache_bytes"sv, session->cache->memoryUsage());
+
+    out.family("transmission_cache_blocks"sv, Type::Gauge, "Blocks in the write cache waiting to be written"sv);
+    out.sample("transmission_cache_blocks"sv, cache.blocks);
+
+    out.family("transmission_cache_writes"sv, Type::Counter, "Blocks added to the write cache"sv);
+    out.sample("transmission_cache_writes"sv, cache.cache_writes);
+
+    out.family("transmission_cache_write_bytes"sv, Type::Counter, "Bytes added to the write cache"sv);
+    out.sample("transmission_cache_write_bytes"sv, cache.cache_write_bytes);
+
+    out.family("transmission_cache_flushes"sv, Type::Counter, "Contiguous runs of blocks written from the cache to disk"sv);
+    out.sample("transmission_cache_flushes"sv, cache.disk_writes);
+
+    out.family("transmission_cache_flush_bytes"sv, Type::Counter, "Bytes written from the cache to disk"sv);
+    out.sample("transmission_cache_flush_bytes"sv, cache.disk_write_bytes);
+
+    out.family("transmission_cache_reads"sv, Type::Counter, "Block reads, by whether the cache had the block"sv);
+    out.sample("transmission_cache_reads"sv, cache.read_hits, { { "result"sv, "hit"sv } });
+    out.sample("transmission_cache_reads"sv, cache.read_misses, { { "result"sv, "miss"sv } });
+
+    auto const files = session->openFiles().stats();
+
+    out.family("transmission_open_files"sv, Type::Gauge, "Files held open in the file pool"sv);
+    out.sample("transmission_open_files"sv, files.open);
+
+    out.family("transmission_open_file_lookups"sv, Type::Counter, "File pool lookups, by whether the file was already open"sv);
+    out.sample("transmission_open_file_lookups"sv, files.hits, { { "result"sv, "hit"sv } });
+    out.sample("transmission_open_file_lookups"sv, files.misses, { { "result"sv, "miss"sv } });
+
+    out.family("transmission_open_file_evictions"sv, Type::Counter, "Files closed to make room in the file pool"sv);
+    out.sample("transmission_open_file_evictions"sv, files.evictions);
+
+    auto const verify = session->verifyStats();
+
+    out.family("transmission_verify_queue"sv, Type::Gauge, "Torrents waiting to be verified or being verified"sv);
+    out.sample("transmission_verify_queue"sv, verify.queued);
+
+    out.family("transmission_verify_torrents"sv, Type::Counter, "Torrents verified"sv);
+    out.sample("transmission_verify_torrents"sv, verify.torrents_verified);
+
+    out.family("transmission_verify_pieces"sv, Type::Counter, "Pieces checked while verifying torrents"sv);
+    out.sample("transmission_verify_pieces"sv, verify.pieces_checked);
+
+    out.family("transmission_verify_read_bytes"sv, Type::Counter, "Bytes read while verifying torrents"sv);
+    out.sample("transmission_verify_read_bytes"sv, verify.bytes_read);
+
+    auto const prealloc = session->preallocateStats();
+
+    out.family("transmission_preallocate_queue"sv, Type::Gauge, "Files waiting to be preallocated or being preallocated"sv);
+    out.sample("transmission_preallocate_queue"sv, prealloc.queued);
+
+    out.family("transmission_preallocate_files"sv, Type::Counter, "Files fully preallocated in the background"sv);
+    out.sample("transmission_preallocate_files"sv, prealloc.files_preallocated);
+
+    out.family(
+        "transmission_preallocate_zeroed_bytes"sv,
+        Type::Counter,
+        "Bytes of zeroes written to preallocate files on filesystems that can't reserve space"sv);
+    out.sample("transmission_preallocate_zeroed_bytes"sv, prealloc.bytes_zeroed);
+}
+
+void writePeerMetrics(tr_metrics_writer& out, tr_session* session)
+{
+    static auto constexpr SourceNames = std::array<std::string_view, TR_PEER_FROM__MAX>{
+        "incoming"sv, "lpd"sv, "tracker"sv, "dht"sv, "pex"sv, "resume"sv, "ltep"sv,
+    };
+
+    auto const peers = tr_peerMgrPeerStateStats(session->peerMgr);
+
+    out.family("transmission_peers"sv, Type::Gauge, "Connected peers in each state. A peer can be in several."sv);
+    out.sample("transmission_peers"sv, peers.connected, { { "state"sv, "connected"sv } });
+    out.sample("transmission_peers"sv, peers.handshaking, { { "state"sv, "handshaking"sv } });
+    out.sample("transmission_peers"sv, peers.incoming, { { "state"sv, "incoming"sv } });
+    out.sample("transmission_peers"sv, peers.encrypted, { { "state"sv, "encrypted"sv } });
+    out.sample("transmission_peers"sv, peers.utp, { { "state"sv, "utp"sv } });
+    out.sample("transmission_peers"sv, peers.choking_us, { { "state"sv, "choking_us"sv } });
+    out.sample("transmission_peers"sv, peers.choked_by_us, { { "state"sv, "choked_by_us"sv } });
+    out.sample("transmission_peers"sv, peers.interested_in_us, { { "state"sv, "interested_in_us"sv } });
+    out.sample("transmission_peers"sv, peers.interesting_to_us, { { "state"sv, "interesting_to_us"sv } });
+    out.sample("transmission_peers"sv, peers.uploading_to, { { "state"sv, "uploading_to"sv } });
+    out.sample("transmission_peers"sv, peers.downloading_from, { { "state"sv, "downloading_from"sv } });
+
+    out.family("transmission_peers_by_source"sv, Type::Gauge, "Connected peers, by how we learned of them"sv);
+    for (size_t i = 0; i < std::size(SourceNames); ++i)
+    {
+        out.sample("transmission_peers_by_source"sv, peers.from[i], { { "source"sv, SourceNames[i] } });
+    }
+
+    auto const memory = tr_peerMgrMemoryStats(session->peerMgr);
+    out.family("transmission_peer_memory_bytes"sv, Type::Gauge, "Estimated memory used by connected peers"sv);
+    out.sample("transmission_peer_memory_bytes"sv, memory.object_bytes, { { "kind"sv, "object"sv } });
+    out.sample("transmission_peer_memory_bytes"sv, memory.buffer_bytes, { { "kind"sv, "buffer"sv } });
+    out.sample("transmission_peer_memory_bytes"sv, memory.bitfield_bytes, { { "kind"sv, "bitfield"sv } });
+
+    auto const keys = session->mseKeys().stats();
+    out.family("transmission_mse_keypairs"sv, Type::Counter, "Handshake keypairs taken, by whether one was ready-made"sv);
+    out.sample("transmission_mse_keypairs"sv, keys.hits, { { "result"sv, "hit"sv } });
+    out.sample("transmission_mse_keypairs"sv, keys.misses, { { "result"sv, "miss"sv } });
+
+    auto const crypto = session->cryptoStats();
+    out.family("transmission_crypto_queue"sv, Type::Gauge, "Handshake crypto jobs waiting or running"sv);
+    out.sample("transmission_crypto_queue"sv, crypto.queued);
+    out.family("transmission_crypto_jobs"sv, Type::Counter, "Handshake crypto jobs finished on worker threads"sv);
+    out.sample("transmission_crypto_jobs"sv, crypto.jobs_done);
+}
+
+void writeTrackerMetrics(tr_metrics_writer& out, tr_session* session)
+{
+    auto const tracker = tr_announcerStats(session->announcer);
+
+    out.family("transmission_tracker_lag_seconds"sv, Type::Histogram, "How late announces and scrapes were sent"sv);
+    out.histogram("transmission_tracker_lag_seconds"sv, tracker.announce_lag_sec, 1.0, tracker.announce_lag_sum_sec, { { "request"sv, "announce"sv } });
+    out.histogram("transmission_tracker_lag_seconds"sv, tracker.scrape_lag_sec, 1.0, tracker.scrape_lag_sum_sec, { { "request"sv, "scrape"sv } });
+
+    out.family("transmission_tracker_queued"sv, Type::Gauge, "Requests that are due but waiting for their tracker's budget"sv);
+    out.sample("transmission_tracker_queued"sv, tracker.queued_announces, { { "request"sv, "announce"sv } });
+    out.sample("transmission_tracker_queued"sv, tracker.queued_scrapes, { { "request"sv, "scrape"sv } });
+
+    out.family("transmission_tracker_announces_per_hour"sv, Type::Gauge, "Estimated periodic announces per hour"sv);
+    out.sample("transmission_tracker_announces_per_hour"sv, tracker.announces_per_hour);
+}
+
+void writeDhtMetrics(tr_metrics_writer& out)
+{
+    auto const dht = tr_dhtSchedulerStats();
+
+    out.family("transmission_dht_announce_lag_seconds"sv, Type::Histogram, "How late DHT announces were started"sv);
+    out.histogram("transmission_dht_announce_lag_seconds"sv, dht.lag_sec, 1.0, dht.lag_sum_sec);
+
+    out.family("transmission_dht_announce_queue"sv, Type::Gauge, "DHT announces that are due, by whether they're searching"sv);
+    out.sample("transmission_dht_announce_queue"sv, dht.queued, { { "state"sv, "waiting"sv } });
+    out.sample("transmission_dht_announce_queue"sv, dht.searching, { { "state"sv, "searching"sv } });
+
+    out.family("transmission_dht_announces"sv, Type::Counter, "DHT announces, by whether libdht could start the search"sv);
+    out.sample("transmission_dht_announces"sv, dht.started, { { "result"sv, "started"sv } });
+    out.sample("transmission_dht_announces"sv, dht.failed, { { "result"sv, "refused"sv } });
+}
+
+void writeLatencyMetrics(tr_metrics_writer& out)
+{
+    auto const lock = tr_session::lockStats();
+
+    out.family("transmission_session_lock_wait_seconds"sv, Type::Histogram, "How long threads waited for the session lock"sv);
+    out.histogram("transmission_session_lock_wait_seconds"sv, lock.wait_usec, UsecSec, lock.wait_sum_usec * UsecSec);
+
+    out.family("transmission_session_lock_hold_seconds"sv, Type::Histogram, "How long threads held the session lock"sv);
+    out.histogram("transmission_session_lock_hold_seconds"sv, lock.hold_usec, UsecSec, lock.hold_sum_usec * UsecSec);
+
+    out.family("transmission_session_lock_contended"sv, Type::Counter, "Session lock acquisitions that had to wait"sv);
+    out.sample("transmission_session_lock_contended"sv, lock.contended);
+
+    out.family("transmission_rpc_duration_seconds"sv, Type::Histogram, "How long RPC requests took to answer"sv);
+    for (auto const& [method, latency] : tr_rpcLatencyStats())
+    {
+        out.histogram(
+            "transmission_rpc_duration_seconds"sv,
+            latency.buckets,
+            UsecSec,
+            latency.sum_usec * UsecSec,
+            { { "method"sv, method } });
+    }
+}
+
+void writeEventLoopMetrics(tr_metrics_writer& out, tr_session const* session)
+{
+    auto const stats = session->eventLoopStats().snapshot();
+
+    out.family(
+        "transmission_event_loop_callback_duration_seconds"sv,
+        Type::Histogram,
+        "How long the event loop spent in its periodic callbacks"sv);
+    for (size_t i = 0; i < std::size(stats.callbacks); ++i)
+    {
+        auto const& duration = stats.callbacks[i].duration;
+        out.histogram(
+            "transmission_event_loop_callback_duration_seconds"sv,
+            duration.buckets,
+            UsecSec,
+            duration.sum_usec * UsecSec,
+            { { "callback"sv, TrEventLoopCallbackNames[i] } });
+    }
+
+    out.family(
+        "transmission_event_loop_callback_lag_seconds"sv,
+        Type::Histogram,
+        "How long after they were due the event loop ran its periodic callbacks"sv);
+    for (size_t i = 0; i < std::size(stats.callbacks); ++i)
+    {
+        auto const& lag = stats.callbacks[i].lag;
+        out.histogram(
+            "transmission_event_loop_callback_lag_seconds"sv,
+            lag.buckets,
+            UsecSec,
+            lag.sum_usec * UsecSec,
+            { { "callback"sv, TrEventLoopCallbackNames[i] } });
+    }
+
+    out.family("transmission_event_loop_tasks"sv, Type::Counter, "Tasks posted to the event loop by other threads"sv);
+    out.sample("transmission_event_loop_tasks"sv, stats.work_queue_tasks);
+
+    out.family(
+        "transmission_event_loop_task_queue_max_depth"sv,
+        Type::Gauge,
+        "The most posted tasks the event loop has run at once"sv);
+    out.sample("transmission_event_loop_task_queue_max_depth"sv, stats.work_queue_max_depth);
+}
+
+} // namespace
+
+std::string tr_sessionMetrics(tr_session* session)
+{
+    auto const lock = session->unique_lock();
+
+    auto out = tr_metrics_writer{};
+    writeTorrentMetrics(out, session);
+    writeBandwidthMetrics(out, session);
+    writeDiskMetrics(out, session);
+    writePeerMetrics(out, session);
+    writeTrackerMetrics(out, session);
+    writeDhtMetrics(out);
+    writeLatencyMetrics(out);
+    writeEventLoopMetrics(out, session);
+    return out.finish();
+}
@@ -0,0 +1,138 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <algorithm> // std::max
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility> // std::pair
+
+struct tr_session;
+
+/**
+ * A histogram of durations that any thread can add to without locking.
+ *
+ * Bucket 0 counts durations under 1 µs and bucket N counts durations
+ * in [2^(N-1), 2^N) µs, the same buckets that tr_instrumented_recursive_mutex
+ * uses. The last bucket also counts anything longer than that.
+ */
+class tr_latency_histogram
+{
+public:
+    static auto constexpr NumBuckets = size_t{ 24U };
+
+    struct Snapshot
+    {
+        std::array<uint64_t, NumBuckets> buckets = {};
+        uint64_t count = 0;
+        uint64_t sum_usec = 0;
+    };
+
+    void add(std::chrono::microseconds duration) noexcept
+    {
+        auto const usec = static_cast<uint64_t>(std::max(duration.count(), decltype(duration.count()){}));
+        buckets_[bucketFor(usec)].fetch_add(1U, std::memory_order_relaxed);
+        sum_usec_.fetch_add(usec, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] Snapshot snapshot() const noexcept
+    {
+        auto snapshot = Snapshot{};
+        for (size_t i = 0; i < NumBuckets; ++i)
+        {
+            snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+            snapshot.count += snapshot.buckets[i];
+        }
+        snapshot.sum_usec = sum_usec_.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    [[nodiscard]] static constexpr size_t bucketFor(uint64_t usec) noexcept
+    {
+        auto bucket = size_t{};
+        while (usec > 0U && bucket + 1U < NumBuckets)
+        {
+            usec >>= 1U;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, NumBuckets> buckets_ = {};
+    std::atomic<uint64_t> sum_usec_ = {};
+};
+
+/**
+ * Builds an OpenMetrics text exposition.
+ * https://github.com/OpenObservability/OpenMetrics/blob/main/specification/OpenMetrics.md
+ *
+ * Declare each metric family with family(), then add its samples.
+ * Names are written as given, so callers must pass valid metric and
+ * label names. Label values are escaped.
+ */
+class tr_metrics_writer
+{
+public:
+    using Label = std::pair<std::string_view, std::string_view>;
+    using Labels = std::initializer_list<Label>;
+
+    enum class Type
+    {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    void family(std::string_view name, Type type, std::string_view help);
+
+    // Counters get the `_total` suffix added here.
+    void sample(std::string_view name, double value, Labels labels = {});
+
+    // Write a histogram whose bucket N counts values under 2^N units of
+    // `unit_sec` seconds, and whose last bucket also counts anything
+    // larger, e.g. a tr_latency_histogram with a unit of 1 µs.
+    template<typename Buckets>
+    void histogram(
+        std::string_view name,
+        Buckets const& buckets,
+        double unit_sec,
+        double sum_sec,
+        Labels labels = {})
+    {
+        histogramImpl(name, std::data(buckets), std::size(buckets), unit_sec, sum_sec, labels);
+    }
+
+    // Finish the exposition and return it.
+    [[nodiscard]] std::string finish();
+
+private:
+    void histogramImpl(
+        std::string_view name,
+        uint64_t const* buckets,
+        size_t n_buckets,
+        double unit_sec,
+        double sum_sec,
+        Labels labels);
+
+    void appendSample(std::string_view name, std::string_view suffix, double value, Labels labels, Label extra = {});
+
+    std::string out_;
+    Type type_ = Type::Gauge;
+};
+
+// Render the session's metrics as OpenMetrics text.
+[[nodiscard]] std::string tr_sessionMetrics(tr_session* session);
@@ -18,7 +18,7 @@
 #ifdef _WIN32
 #include <ws2tcpip.h>
 #else
-#include <netinet/tcp.h> /* TCP_CONGESTION */
+#include <netinet/tcp.h> /* TCP_CONGESTION, TCP_NOTSENT_LOWAT */
 #endif
 
 #include <event2/util.h>
@@ -186,6 +186,18 @@ void tr_netSetCongestionControl([[maybe_unused]] tr_socket_t s, [[maybe_unused]]
 #endif
 }
 
+void tr_netSetNotSentLowat([[maybe_unused]] tr_socket_t s, [[maybe_unused]] int n_bytes)
+{
+#ifdef TCP_NOTSENT_LOWAT
+
+    if (setsockopt(s, IPPROTO_TCP, TCP_NOTSENT_LOWAT, reinterpret_cast<char const*>(&n_bytes), sizeof(n_bytes)) == -1)
+    {
+        tr_logAddDebug(fmt::format("Can't set TCP_NOTSENT_LOWAT on socket {}: {}", s, tr_net_strerror(sockerrno)));
+    }
+
+#endif
+}
+
 bool tr_address_from_sockaddr_storage(tr_address* setme_addr, tr_port* setme_port, struct sockaddr_storage const* from)
 {
     if (from->ss_family == AF_INET)
@@ -287,7 +299,7 @@ struct tr_peer_socket tr_netOpenPeerSocket(tr_session* session, tr_address const
         return {};
     }
 
-    if (!tr_address_is_valid_for_peers(addr, port))
+    if (!tr_address_is_valid_for_peers(session, addr, port))
     {
         return {};
     }
@@ -366,7 +378,7 @@ struct tr_peer_socket tr_netOpenPeerUTPSocket(
 {
     auto ret = tr_peer_socket{};
 
-    if (session->utp_context != nullptr && tr_address_is_valid_for_peers(addr, port))
+    if (session->utp_context != nullptr && tr_address_is_valid_for_peers(session, addr, port))
     {
         auto const [ss, sslen] = addr->toSockaddr(port);
         auto* const socket = utp_create_socket(session->utp_context);
@@ -533,30 +545,40 @@ bool tr_net_hasIPv6(tr_port port)
     return result;
 }
 
-tr_socket_t tr_netAccept(tr_session* session, tr_socket_t listening_sockfd, tr_address* addr, tr_port* port)
+tr_socket_t tr_netAccept(tr_socket_t listening_sockfd, tr_address* addr, tr_port* port)
 {
-    TR_ASSERT(session != nullptr);
     TR_ASSERT(addr != nullptr);
     TR_ASSERT(port != nullptr);
 
     // accept the incoming connection
     auto sock = sockaddr_storage{};
     socklen_t len = sizeof(struct sockaddr_storage);
+#ifdef HAVE_ACCEPT4
+    // make the socket unblocking in the same syscall
+    auto const sockfd = accept4(listening_sockfd, (struct sockaddr*)&sock, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
     auto const sockfd = accept(listening_sockfd, (struct sockaddr*)&sock, &len);
+#endif
     if (sockfd == TR_BAD_SOCKET)
     {
         return TR_BAD_SOCKET;
     }
 
-    // get the address and port,
-    // make the socket unblocking,
-    // and confirm we don't have too many peers
-    if (!tr_address_from_sockaddr_storage(addr, port, &sock) || evutil_make_socket_nonblocking(sockfd) == -1 ||
-        !session->incPeerCount())
+    // get the address and port
+    if (!tr_address_from_sockaddr_storage(addr, port, &sock))
+    {
+        tr_netCloseSocket(sockfd);
+        return TR_BAD_SOCKET;
+    }
+
+#ifndef HAVE_ACCEPT4
+    // make the socket unblocking
+    if (evutil_make_socket_nonblocking(sockfd) == -1)
     {
         tr_netCloseSocket(sockfd);
         return TR_BAD_SOCKET;
     }
+#endif
 
     return sockfd;
 }
@@ -791,6 +813,16 @@ bool tr_address_is_valid_for_peers(tr_address const* addr, tr_port port)
         !isMartianAddr(addr);
 }
 
+bool tr_address_is_valid_for_peers(tr_session const* session, tr_address const* addr, tr_port port)
+{
+    if (tr_address_is_valid_for_peers(addr, port))
+    {
+        return true;
+    }
+
+    return session->allowsLoopbackPeers() && !std::empty(port) && tr_address_is_valid(addr) && addr->isLoopback();
+}
+
 struct tr_peer_socket tr_peer_socket_tcp_create(tr_socket_t const handle)
 {
     TR_ASSERT(handle != TR_BAD_SOCKET);
@@ -904,3 +936,18 @@ int tr_address::compare(tr_address const& that) const noexcept // <=>
 {
     return tr_address_compare(this, &that);
 }
+
+bool tr_address::isLoopback() const noexcept
+{
+    switch (type)
+    {
+    case TR_AF_INET:
+        return reinterpret_cast<unsigned char const*>(&addr.addr4)[0] == 127;
+
+    case TR_AF_INET6:
+        return IN6_IS_ADDR_LOOPBACK(&addr.addr6);
+
+    default:
+        return false;
+    }
+}
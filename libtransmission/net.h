@@ -172,6 +172,8 @@ struct tr_address
         return type == TR_AF_INET6;
     }
 
+    [[nodiscard]] bool isLoopback() const noexcept;
+
     // comparisons
 
     [[nodiscard]] int compare(tr_address const& that) const noexcept;
@@ -206,10 +208,15 @@ struct tr_address
 extern tr_address const tr_inaddr_any;
 extern tr_address const tr_in6addr_any;
 
+struct tr_session;
+
 bool tr_address_from_sockaddr_storage(tr_address* setme, tr_port* port, struct sockaddr_storage const* from);
 
 bool tr_address_is_valid_for_peers(tr_address const* addr, tr_port port);
 
+// Also allows loopback addresses if `session` allows loopback peers.
+bool tr_address_is_valid_for_peers(tr_session const* session, tr_address const* addr, tr_port port);
+
 constexpr bool tr_address_is_valid(tr_address const* a)
 {
     return a != nullptr && (a->type == TR_AF_INET || a->type == TR_AF_INET6);
@@ -219,14 +226,19 @@ constexpr bool tr_address_is_valid(tr_address const* a)
  * Sockets
  **********************************************************************/
 
-struct tr_session;
-
 tr_socket_t tr_netBindTCP(tr_address const* addr, tr_port port, bool suppress_msgs);
 
-tr_socket_t tr_netAccept(tr_session* session, tr_socket_t listening_sockfd, tr_address* setme_addr, tr_port* setme_port);
+// Accepts a connection waiting on a nonblocking listening socket and makes it
+// nonblocking too. Returns TR_BAD_SOCKET if none was waiting. The caller is
+// responsible for checking the address and the session's peer limit.
+tr_socket_t tr_netAccept(tr_socket_t listening_sockfd, tr_address* setme_addr, tr_port* setme_port);
 
 void tr_netSetCongestionControl(tr_socket_t s, char const* algorithm);
 
+// limit how many unsent bytes the kernel will queue for a TCP socket,
+// so that the rest waits in our own buffers instead. No-op where unsupported.
+void tr_netSetNotSentLowat(tr_socket_t s, int n_bytes);
+
 void tr_netClose(tr_session* session, tr_socket_t s);
 
 void tr_netCloseSocket(tr_socket_t fd);
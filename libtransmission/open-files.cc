@@ -122,6 +122,7 @@ std::optional<tr_sys_file_t> tr_open_files::get(tr_torrent_id_t tor_id, tr_file_
             return {};
         }
 
+        ++stats_.hits;
         return found->fd_;
     }
 
@@ -142,12 +143,15 @@ std::optional<tr_sys_file_t> tr_open_files::get(
     {
         if (!writable || found->writable_)
         {
+            ++stats_.hits;
             return found->fd_;
         }
 
         pool_.erase(key); // close so we can re-open as writable
     }
 
+    ++stats_.misses;
+
     // create subfolders, if any
     auto const filename = tr_pathbuf{ filename_in };
     tr_error* error = nullptr;
@@ -240,6 +244,11 @@ std::optional<tr_sys_file_t> tr_open_files::get(
     }
 
     // cache it
+    if (pool_.size() == MaxOpenFiles)
+    {
+        ++stats_.evictions;
+    }
+
     auto& entry = pool_.add(std::move(key));
     entry.fd_ = fd;
     entry.writable_ = writable;
@@ -40,6 +40,21 @@ public:
     void closeTorrent(tr_torrent_id_t tor_id);
     void closeFile(tr_torrent_id_t tor_id, tr_file_index_t file_num);
 
+    struct Stats
+    {
+        size_t open = 0; // files currently in the pool
+        uint64_t hits = 0; // lookups that found an open file
+        uint64_t misses = 0; // lookups that had to open the file
+        uint64_t evictions = 0; // files closed to make room for another
+    };
+
+    [[nodiscard]] Stats stats() const noexcept
+    {
+        auto stats = stats_;
+        stats.open = pool_.size();
+        return stats;
+    }
+
 private:
     using Key = std::pair<tr_torrent_id_t, tr_file_index_t>;
 
@@ -71,4 +86,5 @@ private:
 
     static constexpr size_t MaxOpenFiles = 32;
     tr_lru_cache<Key, Val, MaxOpenFiles> pool_;
+    Stats stats_;
 };
@@ -0,0 +1,94 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <algorithm> // std::min, std::max
+#include <cstddef> // size_t
+
+#include "block-info.h"
+#include "tr-assert.h"
+
+/**
+ * A session-wide cap on how many bytes all peers together may have
+ * queued for sending.
+ *
+ * Every peer with queued bytes gets an equal share of the budget. A slow
+ * reader that fills its share has to drain before it gets more, so a burst
+ * of slow peers can't pile up many megabytes each. A peer with nothing
+ * queued can always queue at least MinPeerShare bytes, so that every peer
+ * keeps making progress even when the budget is spent.
+ */
+class tr_outbuf_budget
+{
+public:
+    static auto constexpr DefaultLimit = size_t{ 64U * 1024U * 1024U };
+
+    // room for one block plus the protocol messages around it
+    static auto constexpr MinPeerShare = size_t{ tr_block_info::BlockSize * 2U };
+
+    explicit tr_outbuf_budget(size_t limit = DefaultLimit)
+        : limit_{ limit }
+    {
+    }
+
+    // How many more bytes may a peer that already has `queued` bytes add?
+    [[nodiscard]] size_t space(size_t queued) const noexcept
+    {
+        auto const n_peers = n_queued_peers_ + (queued == 0U ? 1U : 0U);
+        auto const share = std::max(MinPeerShare, limit_ / n_peers);
+        auto const peer_room = share > queued ? share - queued : 0U;
+
+        auto global_room = limit_ > bytes_ ? limit_ - bytes_ : 0U;
+        if (queued == 0U)
+        {
+            global_room = std::max(global_room, MinPeerShare);
+        }
+
+        return std::min(peer_room, global_room);
+    }
+
+    // Call whenever a peer's queue changes size.
+    void update(size_t old_len, size_t new_len) noexcept
+    {
+        TR_ASSERT(bytes_ >= old_len);
+
+        bytes_ = bytes_ - old_len + new_len;
+
+        if (old_len == 0U && new_len != 0U)
+        {
+            ++n_queued_peers_;
+        }
+        else if (old_len != 0U && new_len == 0U)
+        {
+            TR_ASSERT(n_queued_peers_ > 0U);
+            --n_queued_peers_;
+        }
+    }
+
+    [[nodiscard]] constexpr auto bytes() const noexcept
+    {
+        return bytes_;
+    }
+
+    [[nodiscard]] constexpr auto queuedPeerCount() const noexcept
+    {
+        return n_queued_peers_;
+    }
+
+    [[nodiscard]] constexpr auto limit() const noexcept
+    {
+        return limit_;
+    }
+
+private:
+    size_t const limit_;
+    size_t bytes_ = 0;
+    size_t n_queued_peers_ = 0;
+};
@@ -255,6 +255,32 @@ struct tr_swarm_stats
 
 tr_swarm_stats tr_swarmGetStats(tr_swarm const* swarm);
 
+// An estimate of the memory used by connected peers
+struct tr_peer_memory_stats
+{
+    size_t peer_count = 0;
+    size_t object_bytes = 0; // the fixed-size peer and peer-io objects
+    size_t buffer_bytes = 0; // queued messages, requests, and incoming blocks
+    size_t bitfield_bytes = 0; // `have` and `blame` bitfields
+};
+
+// How many connected peers are in each state
+struct tr_peer_state_stats
+{
+    size_t connected = 0;
+    size_t handshaking = 0; // connections still in the BitTorrent handshake
+    size_t incoming = 0;
+    size_t encrypted = 0;
+    size_t utp = 0;
+    size_t choking_us = 0;
+    size_t choked_by_us = 0;
+    size_t interested_in_us = 0; // peers that want data from us
+    size_t interesting_to_us = 0; // peers that we want data from
+    size_t uploading_to = 0; // peers we're actively sending data to
+    size_t downloading_from = 0; // peers we're actively receiving data from
+    std::array<size_t, TR_PEER_FROM__MAX> from = {}; // how we learned of the peer
+};
+
 void tr_swarmIncrementActivePeers(tr_swarm* swarm, tr_direction direction, bool is_active);
 
 /***
@@ -5,10 +5,13 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cerrno>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include <event2/event.h>
 #include <event2/buffer.h>
@@ -24,8 +27,11 @@
 #include "log.h"
 #include "net.h"
 #include "peer-io.h"
+#include "peer-reactor.h"
 #include "tr-assert.h"
 #include "tr-utp.h"
+#include "tracing.h"
+#include "trevent.h"
 #include "utils.h"
 
 #ifdef _WIN32
@@ -43,6 +49,15 @@
 
 static constexpr auto UtpReadBufferSize = 256 * 1024;
 
+/* Limit the input buffer to 256K, so it doesn't grow too large */
+
+static constexpr auto MaxReadBufferSize = size_t{ 256U * 1024U };
+
+/* How many unsent bytes we let the kernel hold for a TCP socket.
+ * Anything past this waits in `outbuf`, where the session's
+ * tr_outbuf_budget can see it. */
+static constexpr auto TcpNotSentLowat = int{ tr_block_info::BlockSize * 4 };
+
 #define tr_logAddErrorIo(io, msg) tr_logAddError(msg, (io)->addrStr())
 #define tr_logAddWarnIo(io, msg) tr_logAddWarn(msg, (io)->addrStr())
 #define tr_logAddDebugIo(io, msg) tr_logAddDebug(msg, (io)->addrStr())
@@ -75,16 +90,21 @@ static constexpr size_t guessPacketOverhead(size_t d)
 ****
 ***/
 
-static void didWriteWrapper(tr_peerIo* io, unsigned int bytes_transferred)
+// Charges the next `n_bytes` of `outbuf` to the bandwidth.
+static void chargeBytesWritten(tr_peerIo* io, size_t n_bytes)
 {
-    while (bytes_transferred != 0 && tr_isPeerIo(io) && !std::empty(io->outbuf_info))
+    uint64_t const now = tr_time_msec();
+
+    for (auto const& [n_bytes_left, is_piece_data] : io->outbuf_info)
     {
-        auto& [n_bytes_left, is_piece_data] = io->outbuf_info.front();
+        if (n_bytes == 0)
+        {
+            break;
+        }
 
-        unsigned int const payload = std::min(uint64_t{ n_bytes_left }, uint64_t{ bytes_transferred });
+        auto const payload = std::min(n_bytes_left, n_bytes);
         /* For uTP sockets, the overhead is computed in utp_on_overhead. */
-        unsigned int const overhead = io->socket.type == TR_PEER_SOCKET_TYPE_TCP ? guessPacketOverhead(payload) : 0;
-        uint64_t const now = tr_time_msec();
+        size_t const overhead = io->socket.type == TR_PEER_SOCKET_TYPE_TCP ? guessPacketOverhead(payload) : 0;
 
         io->bandwidth().notifyBandwidthConsumed(TR_UP, payload, is_piece_data, now);
 
@@ -93,6 +113,18 @@ static void didWriteWrapper(tr_peerIo* io, unsigned int bytes_transferred)
             io->bandwidth().notifyBandwidthConsumed(TR_UP, overhead, false, now);
         }
 
+        n_bytes -= payload;
+    }
+}
+
+static void didWriteWrapper(tr_peerIo* io, unsigned int bytes_transferred)
+{
+    while (bytes_transferred != 0 && tr_isPeerIo(io) && !std::empty(io->outbuf_info))
+    {
+        auto const [n_bytes_left, is_piece_data] = io->outbuf_info.front();
+
+        unsigned int const payload = std::min(uint64_t{ n_bytes_left }, uint64_t{ bytes_transferred });
+
         if (io->didWrite != nullptr)
         {
             io->didWrite(io, payload, is_piece_data, io->userData);
@@ -103,11 +135,15 @@ static void didWriteWrapper(tr_peerIo* io, unsigned int bytes_transferred)
             break;
         }
 
+        // didWrite() may have queued more data, so don't hold a reference across it
         bytes_transferred -= payload;
-        n_bytes_left -= payload;
-        if (n_bytes_left == 0)
+        if (payload == n_bytes_left)
+        {
+            io->outbuf_info.erase(std::begin(io->outbuf_info));
+        }
+        else
         {
-            io->outbuf_info.pop_front();
+            io->outbuf_info.front().first -= payload;
         }
     }
 }
@@ -128,6 +164,9 @@ static void canReadWrapper(tr_peerIo* io_in)
         auto done = bool{ false };
         auto err = bool{ false };
 
+        // a peer reactor's reads were charged when remoteGrantRead() allowed them
+        auto const is_reserved = io->remote != nullptr;
+
         while (!done && !err)
         {
             size_t piece = 0;
@@ -140,12 +179,12 @@ static void canReadWrapper(tr_peerIo* io_in)
             {
                 if (piece != 0)
                 {
-                    io->bandwidth().notifyBandwidthConsumed(TR_DOWN, piece, true, now);
+                    io->bandwidth().notifyBandwidthConsumed(TR_DOWN, piece, true, now, is_reserved);
                 }
 
                 if (used != piece)
                 {
-                    io->bandwidth().notifyBandwidthConsumed(TR_DOWN, used - piece, false, now);
+                    io->bandwidth().notifyBandwidthConsumed(TR_DOWN, used - piece, false, now, is_reserved);
                 }
             }
 
@@ -184,11 +223,8 @@ static void event_read_cb(evutil_socket_t fd, short /*event*/, void* vio)
     TR_ASSERT(tr_isPeerIo(io));
     TR_ASSERT(io->socket.type == TR_PEER_SOCKET_TYPE_TCP);
 
-    /* Limit the input buffer to 256K, so it doesn't grow too large */
     tr_direction const dir = TR_DOWN;
-    unsigned int const max = 256 * 1024;
-
-    io->pendingEvents &= ~EV_READ;
+    unsigned int const max = MaxReadBufferSize;
 
     unsigned int const curlen = evbuffer_get_length(io->inbuf.get());
     unsigned int howmuch = curlen >= max ? 0 : max - curlen;
@@ -203,13 +239,15 @@ static void event_read_cb(evutil_socket_t fd, short /*event*/, void* vio)
         return;
     }
 
+    auto trace = tr_trace_scope{ tr_trace_event::PeerRead };
+
     EVUTIL_SET_SOCKET_ERROR(0);
     auto const res = evbuffer_read(io->inbuf.get(), fd, (int)howmuch);
     int const e = EVUTIL_SOCKET_ERROR();
 
     if (res > 0)
     {
-        io->setEnabled(dir, true);
+        trace.setArg(res);
 
         /* Invoke the user callback - must always be called last */
         canReadWrapper(io);
@@ -226,7 +264,6 @@ static void event_read_cb(evutil_socket_t fd, short /*event*/, void* vio)
         {
             if (e == EAGAIN || e == EINTR)
             {
-                io->setEnabled(dir, true);
                 return;
             }
 
@@ -237,6 +274,9 @@ static void event_read_cb(evutil_socket_t fd, short /*event*/, void* vio)
             io,
             fmt::format("event_read_cb err: res:{}, what:{}, errno:{} ({})", res, what, e, tr_net_strerror(e)));
 
+        // the event is persistent, so stop polling a dead socket
+        io->setEnabled(dir, false);
+
         if (io->gotError != nullptr)
         {
             io->gotError(io, what, io->userData);
@@ -261,8 +301,6 @@ static void event_write_cb(evutil_socket_t fd, short /*event*/, void* vio)
     TR_ASSERT(tr_isPeerIo(io));
     TR_ASSERT(io->socket.type == TR_PEER_SOCKET_TYPE_TCP);
 
-    io->pendingEvents &= ~EV_WRITE;
-
     tr_logAddTraceIo(io, "libevent says this peer is ready to write");
 
     // Write as much as possible. Since the socket is non-blocking, write()
@@ -277,19 +315,23 @@ static void event_write_cb(evutil_socket_t fd, short /*event*/, void* vio)
         return;
     }
 
+    auto trace = tr_trace_scope{ tr_trace_event::PeerWrite };
+
     EVUTIL_SET_SOCKET_ERROR(0);
     auto const n_written = tr_evbuffer_write(io, fd, howmuch); // -1 on err, 0 on EOF
     auto const err = EVUTIL_SOCKET_ERROR();
     auto const should_retry = n_written == -1 && (err == 0 || err == EAGAIN || err == EINTR || err == EINPROGRESS);
 
-    // schedule another write if we have more data to write & think future writes would succeed
-    if ((evbuffer_get_length(io->outbuf.get()) != 0) && (n_written > 0 || should_retry))
+    // keep polling only if we have more data to write & think future writes would succeed
+    if ((evbuffer_get_length(io->outbuf.get()) == 0) || (n_written <= 0 && !should_retry))
     {
-        io->setEnabled(Dir, true);
+        io->setEnabled(Dir, false);
     }
 
     if (n_written > 0)
     {
+        trace.setArg(n_written);
+        chargeBytesWritten(io, n_written);
         didWriteWrapper(io, n_written);
     }
     else
@@ -306,6 +348,374 @@ static void event_write_cb(evutil_socket_t fd, short /*event*/, void* vio)
     }
 }
 
+/***
+**** TCP sockets polled by a tr_peer_reactor
+****
+**** The reactor's thread polls the socket and makes the read() and write()
+**** calls. Everything else -- the buffers, bandwidth, encryption and the
+**** callbacks into peer-msgs and the handshake -- stays on the session
+**** thread. The two threads never share memory; they pass each other
+**** bytes and socket events in tasks.
+***/
+
+// The bytes the session thread lets a reactor read, or gives it to
+// write, at a time. Each hand-off is one task in each direction.
+static constexpr auto RemoteReadChunk = size_t{ 64U * 1024U };
+static constexpr auto RemoteWriteChunk = size_t{ 64U * 1024U };
+
+// The reactor's half of a peer's TCP socket.
+// Once created, only the reactor's thread touches the non-const fields.
+struct tr_peer_io_remote
+{
+    tr_peer_io_remote(tr_peer_reactor& reactor_in, tr_session* session_in, std::weak_ptr<tr_peerIo> io_in, tr_socket_t fd_in)
+        : reactor{ reactor_in }
+        , session{ session_in }
+        , io{ std::move(io_in) }
+        , fd{ fd_in }
+    {
+    }
+
+    tr_peer_reactor& reactor;
+    tr_session* const session;
+    std::weak_ptr<tr_peerIo> const io;
+    tr_socket_t const fd;
+
+    // Tells replies from this socket apart from replies from one that a
+    // reconnect() replaced, without ever touching the old one.
+    uint64_t const id = next_id.fetch_add(1U, std::memory_order_relaxed);
+
+    event* event_read = nullptr;
+    event* event_write = nullptr;
+    bool read_armed = false;
+    bool write_armed = false;
+
+    size_t read_quota = 0;
+    tr_evbuffer_ptr const outbuf = tr_evbuffer_ptr{ evbuffer_new() };
+
+    static inline std::atomic<uint64_t> next_id = {};
+};
+
+static void event_disable(tr_peerIo* io, short event);
+
+// Posts `func(io)` to the session thread.
+// It's dropped if the peer-io is gone or has a different socket by then.
+template<typename Func>
+static void remoteReply(tr_peer_io_remote const* remote, Func&& func)
+{
+    tr_runInEventThread(
+        remote->session,
+        [io = remote->io, id = remote->id, func = std::forward<Func>(func)]() mutable
+        {
+            if (auto const shared = io.lock(); shared && shared->remote != nullptr && shared->remote->id == id)
+            {
+                func(shared.get());
+            }
+        });
+}
+
+static void remoteArm(tr_peer_io_remote* remote, short event, bool armed)
+{
+    TR_ASSERT(remote->reactor.amInThread());
+
+    auto* const ev = event == EV_READ ? remote->event_read : remote->event_write;
+    auto& is_armed = event == EV_READ ? remote->read_armed : remote->write_armed;
+
+    if (is_armed == armed)
+    {
+        return;
+    }
+
+    if (armed)
+    {
+        event_add(ev, nullptr);
+    }
+    else
+    {
+        event_del(ev);
+    }
+
+    is_armed = armed;
+}
+
+static void onRemoteRead(tr_peerIo* io, tr_evbuffer_ptr buf);
+static void onRemoteWrote(tr_peerIo* io, size_t n_written);
+static void onRemoteError(tr_peerIo* io, short what, int err);
+
+// runs on the reactor's thread
+static void remote_read_cb(evutil_socket_t fd, short /*event*/, void* vremote)
+{
+    auto* const remote = static_cast<tr_peer_io_remote*>(vremote);
+
+    if (remote->read_quota == 0)
+    {
+        remoteArm(remote, EV_READ, false);
+        return;
+    }
+
+    auto trace = tr_trace_scope{ tr_trace_event::PeerRead };
+    auto buf = tr_evbuffer_ptr{ evbuffer_new() };
+
+    EVUTIL_SET_SOCKET_ERROR(0);
+    auto const res = evbuffer_read(buf.get(), fd, static_cast<int>(remote->read_quota));
+    int const e = EVUTIL_SOCKET_ERROR();
+
+    if (res > 0)
+    {
+        trace.setArg(res);
+
+        remote->read_quota -= std::min(remote->read_quota, static_cast<size_t>(res));
+        if (remote->read_quota == 0)
+        {
+            remoteArm(remote, EV_READ, false);
+        }
+
+        remoteReply(remote, [buf = std::move(buf)](tr_peerIo* io) mutable { onRemoteRead(io, std::move(buf)); });
+        return;
+    }
+
+    if (res == -1 && (e == EAGAIN || e == EINTR))
+    {
+        return;
+    }
+
+    // stop polling a dead socket
+    remote->read_quota = 0;
+    remoteArm(remote, EV_READ, false);
+
+    short const what = BEV_EVENT_READING | (res == 0 ? BEV_EVENT_EOF : BEV_EVENT_ERROR);
+    remoteReply(remote, [what, e](tr_peerIo* io) { onRemoteError(io, what, e); });
+}
+
+// runs on the reactor's thread
+static void remote_write_cb(evutil_socket_t fd, short /*event*/, void* vremote)
+{
+    auto* const remote = static_cast<tr_peer_io_remote*>(vremote);
+
+    if (evbuffer_get_length(remote->outbuf.get()) == 0)
+    {
+        remoteArm(remote, EV_WRITE, false);
+        return;
+    }
+
+    auto trace = tr_trace_scope{ tr_trace_event::PeerWrite };
+
+    EVUTIL_SET_SOCKET_ERROR(0);
+    auto const n_written = evbuffer_write(remote->outbuf.get(), fd); // -1 on err, 0 on EOF
+    auto const err = EVUTIL_SOCKET_ERROR();
+
+    if (n_written > 0)
+    {
+        trace.setArg(n_written);
+
+        if (evbuffer_get_length(remote->outbuf.get()) == 0)
+        {
+            remoteArm(remote, EV_WRITE, false);
+        }
+
+        remoteReply(remote, [n_written](tr_peerIo* io) { onRemoteWrote(io, n_written); });
+        return;
+    }
+
+    if (n_written == -1 && (err == 0 || err == EAGAIN || err == EINTR || err == EINPROGRESS))
+    {
+        return;
+    }
+
+    remoteArm(remote, EV_WRITE, false);
+    evbuffer_drain(remote->outbuf.get(), evbuffer_get_length(remote->outbuf.get()));
+
+    short const what = BEV_EVENT_WRITING | (n_written == -1 ? BEV_EVENT_ERROR : BEV_EVENT_EOF);
+    remoteReply(remote, [what, err](tr_peerIo* io) { onRemoteError(io, what, err); });
+}
+
+static void remoteAttach(tr_peerIo* io, std::shared_ptr<tr_peer_reactor> reactor)
+{
+    TR_ASSERT(io->socket.type == TR_PEER_SOCKET_TYPE_TCP);
+    TR_ASSERT(io->remote == nullptr);
+
+    auto* const remote = new tr_peer_io_remote{ *reactor, io->session, io->weak_from_this(), io->socket.handle.tcp };
+    tr_logAddTraceIo(io, fmt::format("socket {} is polled by peer reactor {}", remote->fd, fmt::ptr(reactor.get())));
+
+    reactor->onSocketAdded();
+    reactor->run(
+        [remote]()
+        {
+            auto* const base = remote->reactor.eventBase();
+            remote->event_read = event_new(base, remote->fd, EV_READ | EV_PERSIST, remote_read_cb, remote);
+            remote->event_write = event_new(base, remote->fd, EV_WRITE | EV_PERSIST, remote_write_cb, remote);
+        });
+
+    io->reactor = std::move(reactor);
+    io->remote = remote;
+    io->remote_read_granted = 0;
+    io->remote_write_in_flight = 0;
+}
+
+static void remoteClose(tr_peerIo* io)
+{
+    auto* const remote = std::exchange(io->remote, nullptr);
+    auto const reactor = std::exchange(io->reactor, {});
+    TR_ASSERT(remote != nullptr);
+    TR_ASSERT(reactor);
+
+    // whatever the reactor hadn't written yet goes away with the socket
+    for (auto n_lost = std::exchange(io->remote_write_in_flight, 0); n_lost > 0 && !std::empty(io->outbuf_info);)
+    {
+        auto& [n_bytes, is_piece_data] = io->outbuf_info.front();
+        auto const n = std::min(n_bytes, n_lost);
+        n_bytes -= n;
+        n_lost -= n;
+
+        if (n_bytes == 0)
+        {
+            io->outbuf_info.erase(std::begin(io->outbuf_info));
+        }
+    }
+
+    // the peer count lives on the session thread, so settle it here
+    io->session->decPeerCount();
+    reactor->onSocketRemoved();
+    reactor->run(
+        [remote]()
+        {
+            event_free(remote->event_read);
+            event_free(remote->event_write);
+            tr_netCloseSocket(remote->fd);
+            delete remote;
+        });
+}
+
+// Lets the reactor read as much as our read buffer and bandwidth allow,
+// up to RemoteReadChunk ahead of what we've already been given.
+// The grant is charged to the bandwidth now, as remoteHandOver() does
+// for writes; otherwise every grant made before the bytes arrive would
+// be clamped against the same allowance and overshoot the speed limit.
+static void remoteGrantRead(tr_peerIo* io)
+{
+    if (io->remote == nullptr || (io->pendingEvents & EV_READ) == 0)
+    {
+        return;
+    }
+
+    auto const curlen = evbuffer_get_length(io->inbuf.get());
+    auto const want = std::min(curlen >= MaxReadBufferSize ? 0U : MaxReadBufferSize - curlen, RemoteReadChunk);
+    auto const grant = want > io->remote_read_granted ?
+        size_t{ io->bandwidth().clamp(TR_DOWN, static_cast<unsigned int>(want - io->remote_read_granted)) } :
+        size_t{};
+
+    if (grant == 0)
+    {
+        // out of bandwidth or buffer space; like event_read_cb(),
+        // stop reading until the next bandwidth pulse turns it back on
+        if (io->remote_read_granted == 0)
+        {
+            event_disable(io, EV_READ);
+        }
+
+        return;
+    }
+
+    io->bandwidth().reserve(TR_DOWN, grant);
+    io->remote_read_granted += grant;
+    io->reactor->run(
+        [remote = io->remote, grant]()
+        {
+            remote->read_quota += grant;
+            remoteArm(remote, EV_READ, true);
+        });
+}
+
+// Hands up to `limit` bytes from the front of `outbuf` to the reactor.
+// Only one batch is in flight at a time. Its bandwidth is charged now,
+// as it leaves `outbuf`; charging it once it's written would let every
+// other peer spend the same bytes in the meantime.
+// @return the number of bytes handed over
+static size_t remoteHandOver(tr_peerIo* io, size_t limit)
+{
+    if (io->remote == nullptr || io->remote_write_in_flight != 0)
+    {
+        return 0;
+    }
+
+    auto const howmuch = size_t{ io->bandwidth().clamp(
+        TR_UP,
+        static_cast<unsigned int>(std::min(limit, evbuffer_get_length(io->outbuf.get())))) };
+    if (howmuch == 0)
+    {
+        return 0;
+    }
+
+    auto batch = tr_evbuffer_ptr{ evbuffer_new() };
+    evbuffer_remove_buffer(io->outbuf.get(), batch.get(), howmuch);
+    chargeBytesWritten(io, howmuch);
+    io->remote_write_in_flight = howmuch;
+
+    io->reactor->run(
+        [remote = io->remote, batch = std::move(batch)]()
+        {
+            evbuffer_add_buffer(remote->outbuf.get(), batch.get());
+            remoteArm(remote, EV_WRITE, true);
+        });
+
+    return howmuch;
+}
+
+// Keeps writing while EV_WRITE is wanted, or turns it off if there's
+// nothing to write or no bandwidth to write it with, as event_write_cb() does.
+static void remoteWrite(tr_peerIo* io)
+{
+    if (io->remote != nullptr && io->remote_write_in_flight == 0 && (io->pendingEvents & EV_WRITE) != 0 &&
+        remoteHandOver(io, RemoteWriteChunk) == 0)
+    {
+        io->pendingEvents &= ~EV_WRITE;
+    }
+}
+
+static void onRemoteRead(tr_peerIo* io, tr_evbuffer_ptr buf)
+{
+    auto const n_read = evbuffer_get_length(buf.get());
+    tr_logAddTraceIo(io, fmt::format("peer reactor read {} from peer", n_read));
+
+    io->remote_read_granted -= std::min(io->remote_read_granted, n_read);
+    evbuffer_add_buffer(io->inbuf.get(), buf.get());
+
+    canReadWrapper(io);
+    remoteGrantRead(io);
+}
+
+static void onRemoteWrote(tr_peerIo* io, size_t n_written)
+{
+    tr_logAddTraceIo(io, fmt::format("peer reactor wrote {} to peer", n_written));
+
+    io->remote_write_in_flight -= std::min(io->remote_write_in_flight, n_written);
+
+    // the bandwidth was charged in remoteHandOver()
+    didWriteWrapper(io, n_written);
+    remoteWrite(io);
+}
+
+static void onRemoteError(tr_peerIo* io, short what, int err)
+{
+    tr_logAddDebugIo(io, fmt::format("peer reactor got an err. what:{}, errno:{} ({})", what, err, tr_net_strerror(err)));
+
+    // the reactor has already stopped polling in this direction
+    if ((what & BEV_EVENT_READING) != 0)
+    {
+        io->pendingEvents &= ~EV_READ;
+        io->remote_read_granted = 0;
+    }
+    else
+    {
+        io->pendingEvents &= ~EV_WRITE;
+        io->remote_write_in_flight = 0;
+    }
+
+    if (io->gotError != nullptr)
+    {
+        io->gotError(io, what, io->userData);
+    }
+}
+
 /**
 ***
 **/
@@ -318,6 +728,18 @@ static void maybeSetCongestionAlgorithm(tr_socket_t socket, std::string const& a
     }
 }
 
+// keep the session's outbuf budget in sync with this peer's outbuf
+static void outbufChangedCb(evbuffer* /*buf*/, evbuffer_cb_info const* info, void* vio)
+{
+    auto* const io = static_cast<tr_peerIo*>(vio);
+    io->session->outbufBudget().update(info->orig_size, info->orig_size + info->n_added - info->n_deleted);
+}
+
+void tr_peerIo::tryRead()
+{
+    canReadWrapper(this);
+}
+
 #ifdef WITH_UTP
 /* UTP callbacks */
 
@@ -486,12 +908,14 @@ std::shared_ptr<tr_peerIo> tr_peerIo::create(
     {
         session->setSocketTOS(socket.handle.tcp, addr->type);
         maybeSetCongestionAlgorithm(socket.handle.tcp, session->peerCongestionAlgorithm());
+        tr_netSetNotSentLowat(socket.handle.tcp, TcpNotSentLowat);
     }
 
     auto io = std::shared_ptr<tr_peerIo>{
         new tr_peerIo{ session, torrent_hash, is_incoming, *addr, port, is_seed, current_time, parent }
     };
     io->socket = socket;
+    evbuffer_add_cb(io->outbuf.get(), outbufChangedCb, io.get());
     io->bandwidth().setPeer(io);
     tr_logAddTraceIo(io, fmt::format("bandwidth is {}; its parent is {}", fmt::ptr(&io->bandwidth()), fmt::ptr(parent)));
 
@@ -499,8 +923,15 @@ std::shared_ptr<tr_peerIo> tr_peerIo::create(
     {
     case TR_PEER_SOCKET_TYPE_TCP:
         tr_logAddTraceIo(io, fmt::format("socket (tcp) is {}", socket.handle.tcp));
-        io->event_read = event_new(session->eventBase(), socket.handle.tcp, EV_READ, event_read_cb, io.get());
-        io->event_write = event_new(session->eventBase(), socket.handle.tcp, EV_WRITE, event_write_cb, io.get());
+        if (auto const* const reactors = session->peerReactors(); reactors != nullptr)
+        {
+            remoteAttach(io.get(), reactors->pick());
+        }
+        else
+        {
+            io->event_read = event_new(session->eventBase(), socket.handle.tcp, EV_READ | EV_PERSIST, event_read_cb, io.get());
+            io->event_write = event_new(session->eventBase(), socket.handle.tcp, EV_WRITE | EV_PERSIST, event_write_cb, io.get());
+        }
         break;
 
 #ifdef WITH_UTP
@@ -594,7 +1025,7 @@ static void event_enable(tr_peerIo* io, short event)
     TR_ASSERT(io->session != nullptr);
     TR_ASSERT(io->session->events != nullptr);
 
-    bool const need_events = io->socket.type == TR_PEER_SOCKET_TYPE_TCP;
+    bool const need_events = io->socket.type == TR_PEER_SOCKET_TYPE_TCP && io->remote == nullptr;
 
     if (need_events)
     {
@@ -612,6 +1043,7 @@ static void event_enable(tr_peerIo* io, short event)
         }
 
         io->pendingEvents |= EV_READ;
+        remoteGrantRead(io);
     }
 
     if ((event & EV_WRITE) != 0 && (io->pendingEvents & EV_WRITE) == 0)
@@ -624,6 +1056,7 @@ static void event_enable(tr_peerIo* io, short event)
         }
 
         io->pendingEvents |= EV_WRITE;
+        remoteWrite(io);
     }
 }
 
@@ -631,7 +1064,7 @@ static void event_disable(tr_peerIo* io, short event)
 {
     TR_ASSERT(io->session->events != nullptr);
 
-    bool const need_events = io->socket.type == TR_PEER_SOCKET_TYPE_TCP;
+    bool const need_events = io->socket.type == TR_PEER_SOCKET_TYPE_TCP && io->remote == nullptr;
 
     if (need_events)
     {
@@ -648,9 +1081,22 @@ static void event_disable(tr_peerIo* io, short event)
             event_del(io->event_read);
         }
 
+        if (io->remote != nullptr)
+        {
+            io->remote_read_granted = 0;
+            io->reactor->run(
+                [remote = io->remote]()
+                {
+                    remote->read_quota = 0;
+                    remoteArm(remote, EV_READ, false);
+                });
+        }
+
         io->pendingEvents &= ~EV_READ;
     }
 
+    // A batch already handed to a reactor has been paid for,
+    // so it's left to finish. No more are handed over after it.
     if ((event & EV_WRITE) != 0 && (io->pendingEvents & EV_WRITE) != 0)
     {
         tr_logAddTraceIo(io, "disabling ready-to-write polling");
@@ -692,7 +1138,15 @@ static void io_close_socket(tr_peerIo* io)
         break;
 
     case TR_PEER_SOCKET_TYPE_TCP:
-        tr_netClose(io->session, io->socket.handle.tcp);
+        if (io->remote != nullptr)
+        {
+            // the reactor closes it once it has stopped polling it
+            remoteClose(io);
+        }
+        else
+        {
+            tr_netClose(io->session, io->socket.handle.tcp);
+        }
         break;
 
 #ifdef WITH_UTP
@@ -735,6 +1189,9 @@ tr_peerIo::~tr_peerIo()
     tr_logAddTraceIo(this, "in tr_peerIo destructor");
     event_disable(this, EV_READ | EV_WRITE);
     io_close_socket(this);
+
+    // return our unsent bytes to the session's budget
+    evbuffer_drain(outbuf.get(), evbuffer_get_length(outbuf.get()));
 }
 
 std::string tr_peerIo::addrStr() const
@@ -777,12 +1234,20 @@ int tr_peerIo::reconnect()
         return -1;
     }
 
-    this->event_read = event_new(session->eventBase(), this->socket.handle.tcp, EV_READ, event_read_cb, this);
-    this->event_write = event_new(session->eventBase(), this->socket.handle.tcp, EV_WRITE, event_write_cb, this);
+    if (auto const* const reactors = session->peerReactors(); reactors != nullptr)
+    {
+        remoteAttach(this, reactors->pick());
+    }
+    else
+    {
+        this->event_read = event_new(session->eventBase(), this->socket.handle.tcp, EV_READ | EV_PERSIST, event_read_cb, this);
+        this->event_write = event_new(session->eventBase(), this->socket.handle.tcp, EV_WRITE | EV_PERSIST, event_write_cb, this);
+    }
 
     event_enable(this, pending_events);
     this->session->setSocketTOS(this->socket.handle.tcp, addr.type);
     maybeSetCongestionAlgorithm(this->socket.handle.tcp, session->peerCongestionAlgorithm());
+    tr_netSetNotSentLowat(this->socket.handle.tcp, TcpNotSentLowat);
 
     return 0;
 }
@@ -808,7 +1273,8 @@ size_t tr_peerIo::getWriteBufferSpace(uint64_t now) const
 {
     size_t const desired_len = getDesiredOutputBufferSize(this, now);
     size_t const current_len = evbuffer_get_length(outbuf.get());
-    return desired_len > current_len ? desired_len - current_len : 0U;
+    size_t const space = desired_len > current_len ? desired_len - current_len : 0U;
+    return std::min(space, session->outbufBudget().space(current_len));
 }
 
 /**
@@ -964,6 +1430,7 @@ static int tr_peerIoTryRead(tr_peerIo* io, size_t howmuch)
         return 0;
     }
 
+    auto trace = tr_trace_scope{ tr_trace_event::PeerRead };
     auto res = int{};
     switch (io->socket.type)
     {
@@ -985,6 +1452,7 @@ static int tr_peerIoTryRead(tr_peerIo* io, size_t howmuch)
             int const e = EVUTIL_SOCKET_ERROR();
 
             tr_logAddTraceIo(io, fmt::format("read {} from peer ({})", res, res == -1 ? tr_net_strerror(e).c_str() : ""));
+            trace.setArg(std::max(res, 0));
 
             if (evbuffer_get_length(io->inbuf.get()) != 0)
             {
@@ -1029,6 +1497,7 @@ static int tr_peerIoTryWrite(tr_peerIo* io, size_t howmuch)
         return 0;
     }
 
+    auto trace = tr_trace_scope{ tr_trace_event::PeerWrite };
     auto n = int{};
     switch (io->socket.type)
     {
@@ -1038,6 +1507,7 @@ static int tr_peerIoTryWrite(tr_peerIo* io, size_t howmuch)
         if (n > 0)
         {
             evbuffer_drain(io->outbuf.get(), n);
+            chargeBytesWritten(io, n);
             didWriteWrapper(io, n);
         }
 
@@ -1051,6 +1521,7 @@ static int tr_peerIoTryWrite(tr_peerIo* io, size_t howmuch)
 
             if (n > 0)
             {
+                chargeBytesWritten(io, n);
                 didWriteWrapper(io, n);
             }
 
@@ -1071,6 +1542,7 @@ static int tr_peerIoTryWrite(tr_peerIo* io, size_t howmuch)
         tr_logAddDebugIo(io, fmt::format("unsupported peer socket type {}", io->socket.type));
     }
 
+    trace.setArg(std::max(n, 0));
     return n;
 }
 
@@ -1078,7 +1550,18 @@ int tr_peerIo::flush(tr_direction dir, size_t limit)
 {
     TR_ASSERT(tr_isDirection(dir));
 
-    int const bytes_used = dir == TR_DOWN ? tr_peerIoTryRead(this, limit) : tr_peerIoTryWrite(this, limit);
+    auto bytes_used = int{};
+    if (remote != nullptr)
+    {
+        // the reactor reads whenever it has been granted bytes to read,
+        // so all we can do here is give it more to write
+        bytes_used = dir == TR_DOWN ? 0 : static_cast<int>(remoteHandOver(this, limit));
+    }
+    else
+    {
+        bytes_used = dir == TR_DOWN ? tr_peerIoTryRead(this, limit) : tr_peerIoTryWrite(this, limit);
+    }
+
     tr_logAddTraceIo(this, fmt::format("flushing peer-io, direction:{}, limit:{}, byte_used:{}", dir, limit, bytes_used));
     return bytes_used;
 }
@@ -16,11 +16,11 @@
 #include <cstddef> // size_t
 #include <cstdint> // uintX_t
 #include <ctime>
-#include <deque>
 #include <memory>
 #include <optional>
 #include <string>
 #include <utility> // std::make_pair
+#include <vector>
 
 #include <event2/buffer.h>
 
@@ -33,7 +33,9 @@
 #include "tr-assert.h"
 
 class tr_peerIo;
+class tr_peer_reactor;
 struct tr_bandwidth;
+struct tr_peer_io_remote;
 struct struct_utp_context;
 
 /**
@@ -152,6 +154,11 @@ public:
 
     void readBufferAdd(void const* data, size_t n_bytes);
 
+    // Hand whatever's already in the read buffer to the read callback,
+    // e.g. when the callback returned READ_LATER to wait for something
+    // other than more bytes from the peer.
+    void tryRead();
+
     int flushOutgoingProtocolMsgs();
     int flush(tr_direction dir, size_t byte_limit);
 
@@ -159,6 +166,13 @@ public:
     void writeBuf(struct evbuffer* buf, bool is_piece_data);
     size_t getWriteBufferSpace(uint64_t now) const;
 
+    // approximate bytes queued in this peer-io's buffers
+    [[nodiscard]] size_t memoryUsage() const noexcept
+    {
+        return evbuffer_get_length(inbuf.get()) + evbuffer_get_length(outbuf.get()) +
+            outbuf_info.capacity() * sizeof(decltype(outbuf_info)::value_type);
+    }
+
     [[nodiscard]] auto hasBandwidthLeft(tr_direction dir) noexcept
     {
         return bandwidth_.clamp(dir, 1024) > 0;
@@ -255,13 +269,25 @@ public:
     tr_evbuffer_ptr const inbuf = tr_evbuffer_ptr{ evbuffer_new() };
     tr_evbuffer_ptr const outbuf = tr_evbuffer_ptr{ evbuffer_new() };
 
-    std::deque<std::pair<size_t /*n_bytes*/, bool /*is_piece_data*/>> outbuf_info;
+    // This rarely holds more than a handful of entries. It's a vector
+    // instead of a deque because an empty deque still allocates a block.
+    std::vector<std::pair<size_t /*n_bytes*/, bool /*is_piece_data*/>> outbuf_info;
 
     struct event* event_read = nullptr;
     struct event* event_write = nullptr;
 
     short int pendingEvents = 0;
 
+    // When `peer-io-threads` is on, a tr_peer_reactor polls our TCP socket
+    // instead of the session's event loop. `remote` is its half of the
+    // socket; it belongs to the reactor's thread, so we only pass it along
+    // in tasks posted there. See "sockets polled by a tr_peer_reactor" in
+    // peer-io.cc.
+    std::shared_ptr<tr_peer_reactor> reactor;
+    tr_peer_io_remote* remote = nullptr;
+    size_t remote_read_granted = 0; // bytes the reactor may still read for us
+    size_t remote_write_in_flight = 0; // bytes handed to the reactor but not yet written
+
     tr_priority_t priority = TR_PRI_NORMAL;
 
     bool utp_supported_ = false;
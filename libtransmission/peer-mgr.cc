@@ -12,6 +12,7 @@
 #include <cstdint>
 #include <ctime> // time_t
 #include <deque>
+#include <functional>
 #include <iterator> // std::back_inserter
 #include <memory>
 #include <numeric> // std::accumulate
@@ -46,6 +47,7 @@
 #include "tr-assert.h"
 #include "tr-dht.h"
 #include "tr-utp.h"
+#include "tracing.h"
 #include "utils.h"
 #include "webseed.h"
 
@@ -138,6 +140,16 @@ public:
         return len;
     }
 
+    [[nodiscard]] tr_message_stream_encryption::DH dh() const override
+    {
+        return session_.mseKeys().take();
+    }
+
+    bool runCrypto(std::function<void()> work, std::function<void()> done) override
+    {
+        return session_.runCrypto(std::move(work), std::move(done));
+    }
+
 private:
     tr_session& session_;
 };
@@ -299,29 +311,44 @@ private:
 };
 
 // a container for keeping track of tr_handshakes
+// Peers are told apart by address, so that one host can't take up a
+// torrent's connection slots. The exception is loopback peers when the
+// session allows them: they're other sessions on this machine, which all
+// share one address, so they're told apart by port.
+[[nodiscard]] static bool isSamePeer(
+    tr_session const* session,
+    tr_address const& addr,
+    tr_port port,
+    tr_address const& that_addr,
+    tr_port that_port)
+{
+    return addr == that_addr && (port == that_port || !addr.isLoopback() || !session->allowsLoopbackPeers());
+}
+
 class Handshakes
 {
 public:
-    void add(tr_address const& address, tr_handshake* handshake)
+    void add(tr_session const* session, tr_address const& address, tr_port port, tr_handshake* handshake)
     {
-        TR_ASSERT(!contains(address));
+        TR_ASSERT(!contains(session, address, port));
 
-        handshakes_.emplace_back(address, handshake);
+        handshakes_.push_back({ address, port, handshake });
     }
 
-    [[nodiscard]] bool contains(tr_address const& address) const noexcept
+    [[nodiscard]] bool contains(tr_session const* session, tr_address const& address, tr_port port) const noexcept
     {
         return std::any_of(
             std::begin(handshakes_),
             std::end(handshakes_),
-            [&address](auto const& pair) { return pair.first == address; });
+            [session, &address, port](auto const& entry)
+            { return isSamePeer(session, entry.address, entry.port, address, port); });
     }
 
-    void erase(tr_address const& address)
+    void erase(tr_session const* session, tr_address const& address, tr_port port)
     {
         for (auto iter = std::begin(handshakes_), end = std::end(handshakes_); iter != end; ++iter)
         {
-            if (iter->first == address)
+            if (isSamePeer(session, iter->address, iter->port, address, port))
             {
                 handshakes_.erase(iter);
                 return;
@@ -334,21 +361,33 @@ public:
         return std::empty(handshakes_);
     }
 
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(handshakes_);
+    }
+
     void abortAll()
     {
         // make a tmp copy so that calls to tr_handshakeAbort() won't
         // be able to invalidate its loop iteration
         auto tmp = handshakes_;
-        for (auto& [addr, handshake] : tmp)
+        for (auto& entry : tmp)
         {
-            tr_handshakeAbort(handshake);
+            tr_handshakeAbort(entry.handshake);
         }
 
         handshakes_ = {};
     }
 
 private:
-    std::vector<std::pair<tr_address, tr_handshake*>> handshakes_;
+    struct Entry
+    {
+        tr_address address;
+        tr_port port;
+        tr_handshake* handshake;
+    };
+
+    std::vector<Entry> handshakes_;
 };
 
 #define tr_logAddDebugSwarm(swarm, msg) tr_logAddDebugTor((swarm)->tor, msg)
@@ -670,6 +709,18 @@ static tr_swarm* getExistingSwarm(tr_peerMgr* manager, tr_sha1_digest_t const& h
     return tor == nullptr ? nullptr : tor->swarm;
 }
 
+static struct peer_atom* getExistingAtom(tr_swarm const* cswarm, tr_address const& addr, tr_port port)
+{
+    auto* swarm = const_cast<tr_swarm*>(cswarm);
+    auto const test = [session = swarm->manager->session, &addr, port](auto const& atom)
+    {
+        return isSamePeer(session, atom.addr, atom.port, addr, port);
+    };
+    auto const it = std::find_if(std::begin(swarm->pool), std::end(swarm->pool), test);
+    return it != std::end(swarm->pool) ? &*it : nullptr;
+}
+
+// the first peer at `addr`, for callers that only know the address
 static struct peer_atom* getExistingAtom(tr_swarm const* cswarm, tr_address const& addr)
 {
     auto* swarm = const_cast<tr_swarm*>(cswarm);
@@ -686,8 +737,9 @@ static bool peerIsInUse(tr_swarm const* cs, struct peer_atom const* atom)
     auto const* const s = const_cast<tr_swarm*>(cs);
     auto const lock = s->unique_lock();
 
-    return atom->is_connected || s->outgoing_handshakes.contains(atom->addr) ||
-        s->manager->incoming_handshakes.contains(atom->addr);
+    auto const* const session = s->manager->session;
+    return atom->is_connected || s->outgoing_handshakes.contains(session, atom->addr, atom->port) ||
+        s->manager->incoming_handshakes.contains(session, atom->addr, atom->port);
 }
 
 static void swarmFree(tr_swarm* s)
@@ -731,6 +783,68 @@ void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr)
     }
 }
 
+uint64_t tr_peerMgrBytesQueuedToPeers(tr_torrent const* tor)
+{
+    TR_ASSERT(tr_isTorrent(tor));
+    auto const lock = tor->unique_lock();
+
+    auto const& peers = tor->swarm->peers;
+    return std::accumulate(
+        std::begin(peers),
+        std::end(peers),
+        uint64_t{},
+        [](uint64_t sum, auto const* peer) { return sum + peer->bytes_queued_to_peer(); });
+}
+
+tr_peer_memory_stats tr_peerMgrMemoryStats(tr_peerMgr const* mgr)
+{
+    auto const lock = mgr->unique_lock();
+
+    auto stats = tr_peer_memory_stats{};
+    for (auto const* const tor : mgr->session->torrents())
+    {
+        for (auto const* const peer : tor->swarm->peers)
+        {
+            peer->addMemoryStats(stats);
+        }
+    }
+
+    return stats;
+}
+
+tr_peer_state_stats tr_peerMgrPeerStateStats(tr_peerMgr const* mgr)
+{
+    auto const lock = mgr->unique_lock();
+
+    auto stats = tr_peer_state_stats{};
+    stats.handshaking = std::size(mgr->incoming_handshakes);
+    for (auto const* const tor : mgr->session->torrents())
+    {
+        auto const* const swarm = tor->swarm;
+        stats.handshaking += std::size(swarm->outgoing_handshakes);
+        for (int i = 0; i < TR_PEER_FROM__MAX; ++i)
+        {
+            stats.from[i] += swarm->stats.peer_from_count[i];
+        }
+
+        for (auto const* const peer : swarm->peers)
+        {
+            ++stats.connected;
+            stats.incoming += peer->is_incoming_connection() ? 1U : 0U;
+            stats.encrypted += peer->is_encrypted() ? 1U : 0U;
+            stats.utp += peer->is_utp_connection() ? 1U : 0U;
+            stats.choking_us += peer->is_client_choked() ? 1U : 0U;
+            stats.choked_by_us += peer->is_peer_choked() ? 1U : 0U;
+            stats.interested_in_us += peer->is_peer_interested() ? 1U : 0U;
+            stats.interesting_to_us += peer->is_client_interested() ? 1U : 0U;
+            stats.uploading_to += peer->is_active(TR_UP) ? 1U : 0U;
+            stats.downloading_from += peer->is_active(TR_DOWN) ? 1U : 0U;
+        }
+    }
+
+    return stats;
+}
+
 /***
 ****
 ***/
@@ -824,7 +938,7 @@ std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_p
 
         [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t piece) const override
         {
-            return torrent_->pieceIsWanted(piece) && peer_->hasPiece(piece);
+            return torrent_->pieceIsWanted(piece) && peer_->hasPiece(piece) && !isWaitingOnPreallocation(piece);
         }
 
         [[nodiscard]] bool isEndgame() const override
@@ -858,6 +972,20 @@ std::vector<tr_block_span_t> tr_peerMgrGetNextRequests(tr_torrent* torrent, tr_p
         }
 
     private:
+        // Blocks for files that are still being preallocated wait in the
+        // cache. Once it's backed up with them, don't ask for any more.
+        [[nodiscard]] bool isWaitingOnPreallocation(tr_piece_index_t piece) const
+        {
+            auto* const session = torrent_->session;
+            if (!session->cache->isBackedUp())
+            {
+                return false;
+            }
+
+            auto const [file_begin, file_end] = torrent_->filesInPiece(piece);
+            return session->isPreallocating(torrent_->id(), file_begin, file_end);
+        }
+
         tr_torrent const* const torrent_;
         tr_swarm const* const swarm_;
         tr_peer const* const peer_;
@@ -885,6 +1013,9 @@ size_t tr_peerMgrCountActiveRequestsToPeer(tr_torrent const* tor, tr_peer const*
 
 void tr_peerMgr::refillUpkeep() const
 {
+    auto const loop_scope = tr_event_loop_stats::Scope{ session->eventLoopStats(),
+                                                        tr_event_loop_callback::RefillUpkeep,
+                                                        refill_upkeep_timer_->lateness() };
     auto const lock = unique_lock();
 
     for (auto* const tor : session->torrents())
@@ -1091,7 +1222,7 @@ static struct peer_atom* ensureAtomExists(
     TR_ASSERT(tr_address_is_valid(&addr));
     TR_ASSERT(from < TR_PEER_FROM__MAX);
 
-    struct peer_atom* a = getExistingAtom(s, addr);
+    struct peer_atom* a = getExistingAtom(s, addr, port);
 
     if (a == nullptr)
     {
@@ -1155,11 +1286,11 @@ static bool on_handshake_done(tr_handshake_result const& result)
 
     if (result.io->isIncoming())
     {
-        manager->incoming_handshakes.erase(addr);
+        manager->incoming_handshakes.erase(manager->session, addr, port);
     }
     else if (s != nullptr)
     {
-        s->outgoing_handshakes.erase(addr);
+        s->outgoing_handshakes.erase(manager->session, addr, port);
     }
 
     auto const lock = manager->unique_lock();
@@ -1168,7 +1299,7 @@ static bool on_handshake_done(tr_handshake_result const& result)
     {
         if (s != nullptr)
         {
-            struct peer_atom* atom = getExistingAtom(s, addr);
+            struct peer_atom* atom = getExistingAtom(s, addr, port);
 
             if (atom != nullptr)
             {
@@ -1249,7 +1380,7 @@ void tr_peerMgrAddIncoming(tr_peerMgr* manager, tr_address const* addr, tr_port
         tr_logAddTrace(fmt::format("Banned IP address '{}' tried to connect to us", addr->readable(port)));
         tr_netClosePeerSocket(session, socket);
     }
-    else if (manager->incoming_handshakes.contains(*addr))
+    else if (manager->incoming_handshakes.contains(session, *addr, port))
     {
         tr_netClosePeerSocket(session, socket);
     }
@@ -1261,7 +1392,7 @@ void tr_peerMgrAddIncoming(tr_peerMgr* manager, tr_address const* addr, tr_port
             session->encryptionMode(),
             on_handshake_done,
             manager);
-        manager->incoming_handshakes.add(*addr, handshake);
+        manager->incoming_handshakes.add(session, *addr, port, handshake);
     }
 }
 
@@ -1288,7 +1419,8 @@ size_t tr_peerMgrAddPex(tr_torrent* tor, uint8_t from, tr_pex const* pex, size_t
     for (tr_pex const* const end = pex + n_pex; pex != end; ++pex)
     {
         if (tr_isPex(pex) && /* safeguard against corrupt data */
-            !s->manager->session->addressIsBlocked(pex->addr) && tr_address_is_valid_for_peers(&pex->addr, pex->port))
+            !s->manager->session->addressIsBlocked(pex->addr) &&
+            tr_address_is_valid_for_peers(s->manager->session, &pex->addr, pex->port))
         {
             ensureAtomExists(s, pex->addr, pex->port, pex->flags, from);
             ++n_used;
@@ -1718,6 +1850,7 @@ namespace peer_stat_helpers
 
     stats.activeReqsToPeer = peer->activeReqCount(TR_CLIENT_TO_PEER);
     stats.activeReqsToClient = peer->activeReqCount(TR_PEER_TO_CLIENT);
+    stats.bytesQueuedToPeer = peer->bytes_queued_to_peer();
 
     char* pch = stats.flagStr;
 
@@ -2274,6 +2407,9 @@ void tr_peerMgr::rechokePulse() const
     using namespace rechoke_downloads_helpers;
     using namespace rechoke_uploads_helpers;
 
+    auto const loop_scope = tr_event_loop_stats::Scope{ session->eventLoopStats(),
+                                                        tr_event_loop_callback::RechokePulse,
+                                                        rechoke_timer_->lateness() };
     auto const lock = unique_lock();
     auto const now = tr_time_msec();
 
@@ -2487,6 +2623,8 @@ void tr_peerMgr::reconnectPulse()
 {
     using namespace disconnect_helpers;
 
+    // called from bandwidthPulse(), so it has no lag of its own
+    auto const loop_scope = tr_event_loop_stats::Scope{ session->eventLoopStats(), tr_event_loop_callback::ReconnectPulse };
     auto const now_sec = tr_time();
 
     // remove crappy peers
@@ -2528,15 +2666,21 @@ void tr_peerMgr::reconnectPulse()
 namespace bandwidth_helpers
 {
 
-void pumpAllPeers(tr_peerMgr* mgr)
+size_t pumpAllPeers(tr_peerMgr* mgr)
 {
+    auto n_pumped = size_t{};
+
     for (auto* const tor : mgr->session->torrents())
     {
         for (auto* const peer : tor->swarm->peers)
         {
             peer->pulse();
         }
+
+        n_pumped += std::size(tor->swarm->peers);
     }
+
+    return n_pumped;
 }
 
 void queuePulse(tr_session* session, tr_direction dir)
@@ -2563,41 +2707,61 @@ void tr_peerMgr::bandwidthPulse()
 {
     using namespace bandwidth_helpers;
 
-    auto const lock = unique_lock();
+    // Each step below takes the session lock separately, so API calls from
+    // other threads wait for one step rather than for the whole pulse.
+    // No step relies on state left behind by the step before it.
 
-    pumpAllPeers(this);
+    auto trace = tr_trace_scope{ tr_trace_event::BandwidthPulse };
+    auto const loop_scope = tr_event_loop_stats::Scope{ session->eventLoopStats(),
+                                                        tr_event_loop_callback::BandwidthPulse,
+                                                        bandwidth_timer_->lateness() };
+
+    {
+        auto const lock = unique_lock();
+        trace.setArg(pumpAllPeers(this));
+    }
 
     /* allocate bandwidth to the peers */
-    auto const msec = std::chrono::duration_cast<std::chrono::milliseconds>(BandwidthPeriod).count();
-    session->top_bandwidth_.allocate(TR_UP, msec);
-    session->top_bandwidth_.allocate(TR_DOWN, msec);
+    {
+        auto const lock = unique_lock();
+        auto const msec = std::chrono::duration_cast<std::chrono::milliseconds>(BandwidthPeriod).count();
+        session->top_bandwidth_.allocate(TR_UP, msec);
+        session->top_bandwidth_.allocate(TR_DOWN, msec);
+    }
 
     /* torrent upkeep */
-    for (auto* const tor : session->torrents())
     {
-        /* run the completeness check for any torrents that need it */
-        if (tor->swarm->needs_completeness_check)
-        {
-            tor->swarm->needs_completeness_check = false;
-            tor->recheckCompleteness();
-        }
+        auto const lock = unique_lock();
 
-        /* stop torrents that are ready to stop, but couldn't be stopped
-           earlier during the peer-io callback call chain */
-        if (tor->isStopping)
+        for (auto* const tor : session->torrents())
         {
-            tr_torrentStop(tor);
+            /* run the completeness check for any torrents that need it */
+            if (tor->swarm->needs_completeness_check)
+            {
+                tor->swarm->needs_completeness_check = false;
+                tor->recheckCompleteness();
+            }
+
+            /* stop torrents that are ready to stop, but couldn't be stopped
+               earlier during the peer-io callback call chain */
+            if (tor->isStopping)
+            {
+                tr_torrentStop(tor);
+            }
+
+            /* update the torrent's stats */
+            tor->swarm->stats.active_webseed_count = tor->swarm->countActiveWebseeds();
         }
 
-        /* update the torrent's stats */
-        tor->swarm->stats.active_webseed_count = tor->swarm->countActiveWebseeds();
+        /* pump the queues */
+        queuePulse(session, TR_UP);
+        queuePulse(session, TR_DOWN);
     }
 
-    /* pump the queues */
-    queuePulse(session, TR_UP);
-    queuePulse(session, TR_DOWN);
-
-    reconnectPulse();
+    {
+        auto const lock = unique_lock();
+        reconnectPulse();
+    }
 }
 
 /***
@@ -2856,7 +3020,7 @@ void initiateConnection(tr_peerMgr* mgr, tr_swarm* s, peer_atom& atom)
             mgr->session->encryptionMode(),
             on_handshake_done,
             mgr);
-        s->outgoing_handshakes.add(atom.addr, handshake);
+        s->outgoing_handshakes.add(mgr->session, atom.addr, atom.port, handshake);
     }
 
     atom.lastConnectionAttemptAt = now;
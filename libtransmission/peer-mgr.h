@@ -170,6 +170,13 @@ void tr_peerMgrOnTorrentGotMetainfo(tr_torrent* tor);
 
 void tr_peerMgrOnBlocklistChanged(tr_peerMgr* mgr);
 
+[[nodiscard]] tr_peer_memory_stats tr_peerMgrMemoryStats(tr_peerMgr const* mgr);
+
+[[nodiscard]] tr_peer_state_stats tr_peerMgrPeerStateStats(tr_peerMgr const* mgr);
+
+// how many bytes are queued to send to the torrent's peers
+[[nodiscard]] uint64_t tr_peerMgrBytesQueuedToPeers(tr_torrent const* tor);
+
 [[nodiscard]] struct tr_peer_stat* tr_peerMgrPeerStats(tr_torrent const* tor, int* setme_count);
 
 [[nodiscard]] tr_webseed_view tr_peerMgrWebseed(tr_torrent const* tor, size_t i);
@@ -3,64 +3,254 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // std::copy_n
 #include <array>
+#include <cstdint> // uint8_t, uint32_t, uint64_t
+#include <limits>
 #include <memory>
-
-#include <math/wide_integer/uintwide_t.h>
+#include <mutex>
+#include <thread>
 
 #include "transmission.h"
 
 #include "crypto-utils.h" // tr_sha1
 #include "peer-mse.h"
 #include "tr-arc4.h"
+#include "tracing.h" // tr_traceSetThreadName()
 
 using namespace std::literals;
 
-namespace wi
+// Montgomery arithmetic for the one fixed modulus that MSE uses.
+//
+// Handshakes do two modular exponentiations each, so this is hot
+// during connection storms. Because the modulus never changes, its
+// Montgomery constants are computed once. The generator is 2, so
+// computing a public key needs only squarings and cheap doublings.
+namespace montgomery
 {
-using key_t = math::wide_integer::uintwide_t<
-    tr_message_stream_encryption::DH::KeySize * std::numeric_limits<unsigned char>::digits>;
 
-using private_key_t = math::wide_integer::uintwide_t<
-    tr_message_stream_encryption::DH::PrivateKeySize * std::numeric_limits<unsigned char>::digits>;
+#ifdef __SIZEOF_INT128__
+using limb_t = uint64_t;
+using wide_limb_t = unsigned __int128;
+#else
+using limb_t = uint32_t;
+using wide_limb_t = uint64_t;
+#endif
+
+auto constexpr LimbBits = std::numeric_limits<limb_t>::digits;
+auto constexpr LimbBytes = sizeof(limb_t);
+auto constexpr NumLimbs = tr_message_stream_encryption::DH::KeySize / LimbBytes;
+
+// little-endian limbs
+using num_t = std::array<limb_t, NumLimbs>;
 
-template<typename UIntWide>
-auto import_bits(std::array<std::byte, UIntWide::my_width2 / std::numeric_limits<uint8_t>::digits> const& bigend_bin)
+// MSE spec: "P = 0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563"
+auto constexpr PrimeBigend = std::array<uint8_t, tr_message_stream_encryption::DH::KeySize>{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC9, 0x0F, 0xDA, 0xA2, 0x21, 0x68, 0xC2, 0x34,
+    0xC4, 0xC6, 0x62, 0x8B, 0x80, 0xDC, 0x1C, 0xD1, 0x29, 0x02, 0x4E, 0x08, 0x8A, 0x67, 0xCC, 0x74,
+    0x02, 0x0B, 0xBE, 0xA6, 0x3B, 0x13, 0x9B, 0x22, 0x51, 0x4A, 0x08, 0x79, 0x8E, 0x34, 0x04, 0xDD,
+    0xEF, 0x95, 0x19, 0xB3, 0xCD, 0x3A, 0x43, 0x1B, 0x30, 0x2B, 0x0A, 0x6D, 0xF2, 0x5F, 0x14, 0x37,
+    0x4F, 0xE1, 0x35, 0x6D, 0x6D, 0x51, 0xC2, 0x45, 0xE4, 0x85, 0xB5, 0x76, 0x62, 0x5E, 0x7E, 0xC6,
+    0xF4, 0x4C, 0x42, 0xE9, 0xA6, 0x3A, 0x36, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09, 0x05, 0x63,
+};
+
+template<typename Byte, size_t N>
+[[nodiscard]] num_t importBigend(std::array<Byte, N> const& bigend)
 {
-    auto ret = UIntWide{};
-    static_assert(sizeof(UIntWide) == sizeof(bigend_bin));
+    static_assert(N <= NumLimbs * LimbBytes);
 
-    for (auto const walk : bigend_bin)
+    auto ret = num_t{};
+    for (size_t i = 0; i < N; ++i)
     {
-        ret <<= 8;
-        ret += static_cast<uint8_t>(walk);
+        auto const byte = static_cast<limb_t>(static_cast<uint8_t>(bigend[N - 1 - i]));
+        ret[i / LimbBytes] |= byte << (8 * (i % LimbBytes));
     }
-
     return ret;
 }
 
-template<typename UIntWide>
-auto export_bits(UIntWide i)
+[[nodiscard]] tr_message_stream_encryption::DH::key_bigend_t exportBigend(num_t const& num)
 {
-    auto ret = std::array<std::byte, UIntWide::my_width2 / std::numeric_limits<uint8_t>::digits>{};
+    auto ret = tr_message_stream_encryption::DH::key_bigend_t{};
+    for (size_t i = 0, n = std::size(ret); i < n; ++i)
+    {
+        ret[n - 1 - i] = std::byte(static_cast<uint8_t>(num[i / LimbBytes] >> (8 * (i % LimbBytes))));
+    }
+    return ret;
+}
 
-    for (auto walk = std::rbegin(ret), end = std::rend(ret); walk != end; ++walk)
+// @return true if a >= b
+[[nodiscard]] constexpr bool isAtLeast(num_t const& a, num_t const& b) noexcept
+{
+    for (size_t i = NumLimbs; i-- > 0;)
     {
-        *walk = std::byte(static_cast<uint8_t>(i & 0xFF));
-        i >>= 8;
+        if (a[i] != b[i])
+        {
+            return a[i] > b[i];
+        }
     }
 
-    return ret;
+    return true;
+}
+
+// a -= b, ignoring any borrow out
+constexpr void subtract(num_t& a, num_t const& b) noexcept
+{
+    auto borrow = limb_t{};
+    for (size_t i = 0; i < NumLimbs; ++i)
+    {
+        auto const diff = wide_limb_t{ a[i] } - b[i] - borrow;
+        a[i] = static_cast<limb_t>(diff);
+        borrow = static_cast<limb_t>(diff >> LimbBits) & 1U;
+    }
 }
 
-// NOLINTBEGIN(readability-identifier-naming)
-auto WIDE_INTEGER_CONSTEXPR const G = wi::key_t{ "2" };
-auto WIDE_INTEGER_CONSTEXPR const P = wi::key_t{
-    "0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563"
+class Modulus
+{
+public:
+    Modulus() noexcept
+        : p_{ importBigend(PrimeBigend) }
+    {
+        // -p^-1 mod 2^LimbBits, by Newton's method.
+        // Each step doubles the number of correct low bits.
+        auto inv = limb_t{ 1 };
+        for (int i = 0; i < 7; ++i)
+        {
+            inv *= limb_t{ 2 } - p_[0] * inv;
+        }
+        n0_ = limb_t{} - inv;
+
+        // R mod p and R^2 mod p, where R = 2^(NumLimbs * LimbBits)
+        auto x = num_t{ 1 };
+        for (size_t i = 0; i < NumLimbs * LimbBits; ++i)
+        {
+            x = twice(x);
+        }
+        one_ = x;
+        for (size_t i = 0; i < NumLimbs * LimbBits; ++i)
+        {
+            x = twice(x);
+        }
+        r2_ = x;
+    }
+
+    // Montgomery multiplication (CIOS): a * b / R mod p
+    [[nodiscard]] num_t multiply(num_t const& a, num_t const& b) const noexcept
+    {
+        auto t = std::array<limb_t, NumLimbs + 2>{};
+
+        for (size_t i = 0; i < NumLimbs; ++i)
+        {
+            // t += a * b[i]
+            auto carry = limb_t{};
+            for (size_t j = 0; j < NumLimbs; ++j)
+            {
+                auto const sum = wide_limb_t{ t[j] } + wide_limb_t{ a[j] } * b[i] + carry;
+                t[j] = static_cast<limb_t>(sum);
+                carry = static_cast<limb_t>(sum >> LimbBits);
+            }
+            auto sum = wide_limb_t{ t[NumLimbs] } + carry;
+            t[NumLimbs] = static_cast<limb_t>(sum);
+            t[NumLimbs + 1] = static_cast<limb_t>(sum >> LimbBits);
+
+            // t = (t + m * p) / 2^LimbBits, where m makes the low limb zero
+            auto const m = static_cast<limb_t>(t[0] * n0_);
+            sum = wide_limb_t{ t[0] } + wide_limb_t{ m } * p_[0];
+            carry = static_cast<limb_t>(sum >> LimbBits);
+            for (size_t j = 1; j < NumLimbs; ++j)
+            {
+                sum = wide_limb_t{ t[j] } + wide_limb_t{ m } * p_[j] + carry;
+                t[j - 1] = static_cast<limb_t>(sum);
+                carry = static_cast<limb_t>(sum >> LimbBits);
+            }
+            sum = wide_limb_t{ t[NumLimbs] } + carry;
+            t[NumLimbs - 1] = static_cast<limb_t>(sum);
+            t[NumLimbs] = t[NumLimbs + 1] + static_cast<limb_t>(sum >> LimbBits);
+        }
+
+        auto ret = num_t{};
+        std::copy_n(std::begin(t), NumLimbs, std::begin(ret));
+        if (t[NumLimbs] != 0 || isAtLeast(ret, p_))
+        {
+            subtract(ret, p_);
+        }
+        return ret;
+    }
+
+    // 2a mod p, for a < p. Works on both plain and Montgomery values.
+    [[nodiscard]] num_t twice(num_t const& a) const noexcept
+    {
+        auto ret = num_t{};
+        auto carry = limb_t{};
+        for (size_t i = 0; i < NumLimbs; ++i)
+        {
+            ret[i] = (a[i] << 1) | carry;
+            carry = a[i] >> (LimbBits - 1);
+        }
+        if (carry != 0 || isAtLeast(ret, p_))
+        {
+            subtract(ret, p_);
+        }
+        return ret;
+    }
+
+    // 2^exponent mod p
+    template<typename Byte, size_t N>
+    [[nodiscard]] num_t powTwo(std::array<Byte, N> const& exponent_bigend) const noexcept
+    {
+        auto acc = one_;
+        for (auto const byte : exponent_bigend)
+        {
+            for (int bit = 7; bit >= 0; --bit)
+            {
+                acc = multiply(acc, acc);
+                auto const doubled = twice(acc);
+                acc = ((static_cast<uint8_t>(byte) >> bit) & 1U) != 0 ? doubled : acc;
+            }
+        }
+        return multiply(acc, num_t{ 1 });
+    }
+
+    // base^exponent mod p, using a fixed 4-bit window
+    template<typename Byte, size_t N>
+    [[nodiscard]] num_t pow(num_t const& base, std::array<Byte, N> const& exponent_bigend) const noexcept
+    {
+        auto table = std::array<num_t, 16>{};
+        table[0] = one_;
+        table[1] = multiply(base, r2_);
+        for (size_t i = 2; i < std::size(table); ++i)
+        {
+            table[i] = multiply(table[i - 1], table[1]);
+        }
+
+        auto acc = one_;
+        for (auto const byte : exponent_bigend)
+        {
+            for (auto const nibble : { static_cast<uint8_t>(byte) >> 4, static_cast<uint8_t>(byte) & 0xF })
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    acc = multiply(acc, acc);
+                }
+                acc = multiply(acc, table[nibble]);
+            }
+        }
+        return multiply(acc, num_t{ 1 });
+    }
+
+private:
+    num_t const p_;
+    limb_t n0_ = {};
+    num_t one_ = {}; // R mod p, i.e. 1 in Montgomery form
+    num_t r2_ = {}; // R^2 mod p, for converting into Montgomery form
 };
-// NOLINTEND(readability-identifier-naming)
 
-} // namespace wi
+[[nodiscard]] Modulus const& prime()
+{
+    static auto const modulus = Modulus{};
+    return modulus;
+}
+
+} // namespace montgomery
 
 namespace tr_message_stream_encryption
 {
@@ -76,9 +266,8 @@ namespace tr_message_stream_encryption
 
 [[nodiscard]] auto generatePublicKey(DH::private_key_bigend_t const& private_key) noexcept
 {
-    auto const private_key_wi = wi::import_bits<wi::private_key_t>(private_key);
-    auto const public_key_wi = math::wide_integer::powm(wi::G, private_key_wi, wi::P);
-    return wi::export_bits(public_key_wi);
+    // MSE spec: "G = 2"
+    return montgomery::exportBigend(montgomery::prime().powTwo(private_key));
 }
 
 DH::DH(private_key_bigend_t const& private_key) noexcept
@@ -86,6 +275,12 @@ DH::DH(private_key_bigend_t const& private_key) noexcept
 {
 }
 
+DH::DH(private_key_bigend_t const& private_key, key_bigend_t const& public_key) noexcept
+    : private_key_{ private_key }
+    , public_key_{ public_key }
+{
+}
+
 DH::key_bigend_t DH::publicKey() noexcept
 {
     if (public_key_ == key_bigend_t{})
@@ -98,11 +293,103 @@ DH::key_bigend_t DH::publicKey() noexcept
 
 void DH::setPeerPublicKey(key_bigend_t const& peer_public_key)
 {
-    auto const secret = math::wide_integer::powm(
-        wi::import_bits<wi::key_t>(peer_public_key),
-        wi::import_bits<wi::private_key_t>(private_key_),
-        wi::P);
-    secret_ = wi::export_bits(secret);
+    auto const& prime = montgomery::prime();
+    secret_ = montgomery::exportBigend(prime.pow(montgomery::importBigend(peer_public_key), private_key_));
+}
+
+/// KeyPool
+
+KeyPool::KeyPool(size_t capacity)
+    : capacity_{ capacity }
+{
+    auto const lock = std::lock_guard(mutex_);
+    keys_.reserve(capacity_);
+    startFillThread();
+}
+
+KeyPool::~KeyPool()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+    }
+
+    if (fill_thread_.joinable())
+    {
+        fill_thread_.join();
+    }
+}
+
+void KeyPool::startFillThread()
+{
+    if (!is_filling_ && !stopping_ && std::size(keys_) < capacity_)
+    {
+        // the last fill thread is done, or just about to return
+        if (fill_thread_.joinable())
+        {
+            fill_thread_.join();
+        }
+
+        is_filling_ = true;
+        fill_thread_ = std::thread(&KeyPool::fillThreadFunc, this);
+    }
+}
+
+void KeyPool::fillThreadFunc()
+{
+    tr_traceSetThreadName("mse-keys");
+
+    for (;;)
+    {
+        {
+            auto const lock = std::lock_guard(mutex_);
+
+            if (stopping_ || std::size(keys_) >= capacity_)
+            {
+                is_filling_ = false;
+                return;
+            }
+        }
+
+        auto const private_key = DH::randomPrivateKey();
+        auto const public_key = generatePublicKey(private_key);
+
+        auto const lock = std::lock_guard(mutex_);
+        keys_.emplace_back(private_key, public_key);
+    }
+}
+
+DH KeyPool::take()
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    // refill before the pool runs dry
+    if (std::size(keys_) <= capacity_ / 2)
+    {
+        startFillThread();
+    }
+
+    if (std::empty(keys_))
+    {
+        ++misses_;
+        return DH{};
+    }
+
+    ++hits_;
+    auto const [private_key, public_key] = keys_.back();
+    keys_.pop_back();
+    return DH{ private_key, public_key };
+}
+
+KeyPool::Stats KeyPool::stats()
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto stats = Stats{};
+    stats.ready = std::size(keys_);
+    stats.hits = hits_;
+    stats.misses = misses_;
+    return stats;
 }
 
 /// Filter
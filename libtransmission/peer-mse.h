@@ -13,7 +13,12 @@
 
 #include <array>
 #include <cstddef> // size_t, std::byte
+#include <cstdint> // uint64_t
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <utility> // std::pair
+#include <vector>
 
 #include "tr-macros.h" // tr_sha1_digest_t
 #include "tr-assert.h"
@@ -51,6 +56,9 @@ public:
     // Providing a predefined one is useful for reproducible unit tests.
     DH(private_key_bigend_t const& private_key = randomPrivateKey()) noexcept;
 
+    // Use a keypair whose public key was computed ahead of time.
+    DH(private_key_bigend_t const& private_key, key_bigend_t const& public_key) noexcept;
+
     // Returns our own public key to be shared with a peer.
     [[nodiscard]] key_bigend_t publicKey() noexcept;
 
@@ -67,11 +75,57 @@ public:
     [[nodiscard]] static private_key_bigend_t randomPrivateKey() noexcept;
 
 private:
-    private_key_bigend_t const private_key_;
+    private_key_bigend_t private_key_;
     key_bigend_t public_key_ = {};
     key_bigend_t secret_ = {};
 };
 
+/**
+ * Generates DH keypairs in a worker thread ahead of time,
+ * so that a handshake only has to compute the shared secret.
+ */
+class KeyPool
+{
+public:
+    static auto constexpr DefaultCapacity = size_t{ 64 };
+
+    explicit KeyPool(size_t capacity = DefaultCapacity);
+    ~KeyPool();
+
+    KeyPool(KeyPool&&) = delete;
+    KeyPool(KeyPool const&) = delete;
+    KeyPool& operator=(KeyPool&&) = delete;
+    KeyPool& operator=(KeyPool const&) = delete;
+
+    // Returns a DH with a ready-made public key, or if the pool
+    // is empty, one that computes its public key when asked.
+    [[nodiscard]] DH take();
+
+    struct Stats
+    {
+        size_t ready = 0; // keypairs waiting to be used
+        uint64_t hits = 0; // handshakes that got a ready-made keypair
+        uint64_t misses = 0; // handshakes that found the pool empty
+    };
+
+    [[nodiscard]] Stats stats();
+
+private:
+    void startFillThread();
+    void fillThreadFunc();
+
+    std::mutex mutex_;
+    std::vector<std::pair<DH::private_key_bigend_t, DH::key_bigend_t>> keys_;
+    size_t const capacity_;
+
+    std::thread fill_thread_;
+    bool is_filling_ = false;
+    bool stopping_ = false;
+
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
 /// arc4 encryption for both incoming and outgoing stream
 class Filter
 {
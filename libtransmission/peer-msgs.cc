@@ -12,7 +12,6 @@
 #include <map>
 #include <memory> // std::unique_ptr
 #include <optional>
-#include <queue>
 #include <utility>
 #include <vector>
 
@@ -415,6 +414,11 @@ public:
         return io->time_created < timestamp;
     }
 
+    [[nodiscard]] size_t bytes_queued_to_peer() const noexcept override
+    {
+        return evbuffer_get_length(io->outbuf.get()) + evbuffer_get_length(outMessages);
+    }
+
     [[nodiscard]] std::pair<tr_address, tr_port> socketAddress() const override
     {
         return io->socketAddress();
@@ -426,6 +430,23 @@ public:
         return addr.readable(port);
     }
 
+    void addMemoryStats(tr_peer_memory_stats& stats) const override
+    {
+        ++stats.peer_count;
+        stats.object_bytes += sizeof(*this) + sizeof(*io);
+
+        stats.buffer_bytes += io->memoryUsage() + evbuffer_get_length(outMessages);
+        stats.buffer_bytes += peer_requested_.capacity() * sizeof(QueuedPeerRequest);
+        stats.buffer_bytes += (pex.capacity() + pex6.capacity()) * sizeof(tr_pex);
+        stats.buffer_bytes += peerAskedForMetadata.capacity() * sizeof(int);
+        for (auto const& [block, buf] : incoming.block_buf)
+        {
+            stats.buffer_bytes += buf ? buf->capacity() : 0U;
+        }
+
+        stats.bitfield_bytes += have_.memoryUsage() + blame.memoryUsage();
+    }
+
     [[nodiscard]] bool isSeed() const noexcept override
     {
         return have_.hasAll();
@@ -726,7 +747,8 @@ public:
     std::vector<tr_pex> pex;
     std::vector<tr_pex> pex6;
 
-    std::queue<int> peerAskedForMetadata;
+    // at most MetadataReqQ entries; a vector because an empty deque still allocates
+    std::vector<int> peerAskedForMetadata;
 
     time_t clientSentAnythingAt = 0;
 
@@ -892,7 +914,7 @@ static bool popNextMetadataRequest(tr_peerMsgsImpl* msgs, int* setme)
 
     auto& reqs = msgs->peerAskedForMetadata;
     *setme = reqs.front();
-    reqs.pop();
+    reqs.erase(std::begin(reqs));
     return true;
 }
 
@@ -1172,7 +1194,7 @@ static void parseUtMetadata(tr_peerMsgsImpl* msgs, uint32_t msglen)
         if (piece >= 0 && msgs->torrent->hasMetainfo() && msgs->torrent->isPublic() &&
             std::size(msgs->peerAskedForMetadata) < MetadataReqQ)
         {
-            msgs->peerAskedForMetadata.push(piece);
+            msgs->peerAskedForMetadata.push_back(piece);
         }
         else
         {
@@ -2111,7 +2133,9 @@ static size_t fillOutputBuffer(tr_peerMsgsImpl* msgs, time_t now)
             if (!err)
             {
                 err = !msgs->torrent->ensurePieceIsChecked(req.index);
-                if (err)
+
+                // if the piece was dropped to be downloaded again, it's not an error
+                if (err && msgs->torrent->hasPiece(req.index))
                 {
                     msgs->torrent->setLocalError(
                         fmt::format(FMT_STRING("Please Verify Local Data! Piece #{:d} is corrupt."), req.index));
@@ -51,6 +51,9 @@ public:
 
     [[nodiscard]] virtual bool is_connection_older_than(time_t time) const noexcept = 0;
 
+    // bytes waiting to be sent to the peer
+    [[nodiscard]] virtual size_t bytes_queued_to_peer() const noexcept = 0;
+
     [[nodiscard]] virtual std::pair<tr_address, tr_port> socketAddress() const = 0;
 
     virtual void cancel_block_request(tr_block_index_t block) = 0;
@@ -66,6 +69,8 @@ public:
 
     virtual void on_piece_completed(tr_piece_index_t) = 0;
 
+    virtual void addMemoryStats(tr_peer_memory_stats& stats) const = 0;
+
     // The client name. This is the app name derived from the `v' string in LTEP's handshake dictionary
     tr_interned_string client;
 
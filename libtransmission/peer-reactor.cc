@@ -0,0 +1,103 @@
+// This file Copyright 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include <event2/event.h>
+
+#include "transmission.h"
+
+#include "peer-reactor.h"
+#include "tr-assert.h"
+#include "tracing.h"
+#include "trevent.h" // tr_evthread_init()
+
+namespace
+{
+
+auto makeEventBase()
+{
+    tr_evthread_init();
+
+    // as with the session's event base, coalesce the enable and
+    // disable calls made on each socket into one epoll_ctl() per loop
+    auto* const config = event_config_new();
+    event_config_set_flag(config, EVENT_BASE_FLAG_EPOLL_USE_CHANGELIST);
+    auto* const base = event_base_new_with_config(config);
+    event_config_free(config);
+
+    return std::unique_ptr<event_base, void (*)(event_base*)>{ base, event_base_free };
+}
+
+} // namespace
+
+tr_peer_reactor::tr_peer_reactor()
+    : base_{ makeEventBase() }
+    , work_queue_event_{ event_new(base_.get(), -1, 0, onWorkAvailable, this) }
+{
+    thread_ = std::thread{ &tr_peer_reactor::threadFunc, this };
+}
+
+tr_peer_reactor::~tr_peer_reactor()
+{
+    // Tasks run in order, so this runs after everything already posted,
+    // e.g. the tasks that close the sockets of peers that were just freed.
+    run([this]() { event_base_loopbreak(base_.get()); });
+    thread_.join();
+
+    // nothing should be posted after this point, but don't leak if it was
+    work_queue_.drain();
+
+    event_free(work_queue_event_);
+}
+
+void tr_peer_reactor::run(tr_task&& task)
+{
+    if (work_queue_.push(std::move(task)))
+    {
+        event_active(work_queue_event_, 0, {});
+    }
+}
+
+void tr_peer_reactor::onWorkAvailable(evutil_socket_t /*fd*/, short /*flags*/, void* vself)
+{
+    auto* const self = static_cast<tr_peer_reactor*>(vself);
+    TR_ASSERT(self->amInThread());
+
+    self->work_queue_.drain();
+}
+
+void tr_peer_reactor::threadFunc()
+{
+    tr_traceSetThreadName("peer-io");
+
+    event_base_loop(base_.get(), EVLOOP_NO_EXIT_ON_EMPTY);
+}
+
+// ---
+
+tr_peer_reactors::tr_peer_reactors(size_t n_reactors)
+{
+    n_reactors = std::clamp(n_reactors, size_t{ 1U }, MaxReactors);
+
+    reactors_.reserve(n_reactors);
+    for (size_t i = 0; i < n_reactors; ++i)
+    {
+        reactors_.emplace_back(std::make_shared<tr_peer_reactor>());
+    }
+}
+
+std::shared_ptr<tr_peer_reactor> tr_peer_reactors::pick() const
+{
+    TR_ASSERT(!std::empty(reactors_));
+
+    auto const iter = std::min_element(
+        std::begin(reactors_),
+        std::end(reactors_),
+        [](auto const& a, auto const& b) { return a->socketCount() < b->socketCount(); });
+    return *iter;
+}
@@ -0,0 +1,119 @@
+// This file Copyright 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <atomic>
+#include <cstddef> // size_t
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <event2/util.h> // evutil_socket_t
+
+#include "task-queue.h"
+
+struct event;
+struct event_base;
+
+/**
+ * An extra event loop, running on its own thread, that polls TCP peer
+ * sockets and makes their read() and write() calls.
+ *
+ * Only the sockets live here. The tr_peerIo that owns each socket, along
+ * with its buffers, bandwidth and callbacks, stays on the session thread.
+ * The two sides hand bytes and socket events to each other by posting
+ * tasks: `run()` to get onto the reactor, tr_runInEventThread() to get
+ * back to the session.
+ */
+class tr_peer_reactor
+{
+public:
+    tr_peer_reactor();
+
+    // Runs any tasks that are still queued, then stops the thread.
+    ~tr_peer_reactor();
+
+    tr_peer_reactor(tr_peer_reactor&&) = delete;
+    tr_peer_reactor(tr_peer_reactor const&) = delete;
+    tr_peer_reactor& operator=(tr_peer_reactor&&) = delete;
+    tr_peer_reactor& operator=(tr_peer_reactor const&) = delete;
+
+    // Safe to call from any thread.
+    // Tasks posted by one thread run in the order they were posted.
+    void run(tr_task&& task);
+
+    [[nodiscard]] bool amInThread() const noexcept
+    {
+        return std::this_thread::get_id() == thread_.get_id();
+    }
+
+    // Only use this from tasks passed to `run()`.
+    [[nodiscard]] event_base* eventBase() noexcept
+    {
+        return base_.get();
+    }
+
+    // how many peer sockets this reactor is polling
+    [[nodiscard]] size_t socketCount() const noexcept
+    {
+        return n_sockets_.load(std::memory_order_relaxed);
+    }
+
+    void onSocketAdded() noexcept
+    {
+        n_sockets_.fetch_add(1U, std::memory_order_relaxed);
+    }
+
+    void onSocketRemoved() noexcept
+    {
+        n_sockets_.fetch_sub(1U, std::memory_order_relaxed);
+    }
+
+private:
+    static void onWorkAvailable(evutil_socket_t fd, short flags, void* vself);
+
+    void threadFunc();
+
+    std::unique_ptr<event_base, void (*)(event_base*)> const base_;
+    tr_task_queue work_queue_;
+    event* work_queue_event_ = nullptr;
+
+    std::atomic<size_t> n_sockets_ = {};
+
+    std::thread thread_;
+};
+
+/**
+ * The session's peer reactors.
+ *
+ * Off by default. With `peer-io-threads` set to N, each new TCP peer
+ * connection is given to whichever of the N reactors has the fewest.
+ *
+ * Each connection keeps a reference to its reactor, so replacing or
+ * freeing the pool doesn't pull the thread out from under sockets
+ * that are still open; a reactor stops once its last socket is closed.
+ */
+class tr_peer_reactors
+{
+public:
+    explicit tr_peer_reactors(size_t n_reactors);
+
+    [[nodiscard]] std::shared_ptr<tr_peer_reactor> pick() const;
+
+    [[nodiscard]] auto size() const noexcept
+    {
+        return std::size(reactors_);
+    }
+
+    static size_t constexpr MaxReactors = 64U;
+
+private:
+    std::vector<std::shared_ptr<tr_peer_reactor>> reactors_;
+};
@@ -0,0 +1,348 @@
+// This file Copyright 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cerrno> // ECANCELED
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "transmission.h"
+
+#include "error-types.h"
+#include "error.h"
+#include "file.h"
+#include "log.h"
+#include "preallocate.h"
+#include "tracing.h"
+#include "tr-strbuf.h"
+#include "utils.h" // _(), tr_wait_msec()
+
+namespace
+{
+
+// Used when the filesystem can't reserve space itself.
+// Large, aligned writes keep the zero-fill from being a long
+// series of tiny syscalls on slow NAS and FUSE mounts.
+auto constexpr ZeroChunkSize = size_t{ 1024 * 1024 };
+
+} // namespace
+
+bool tr_preallocate_worker::writeZeroes(tr_sys_file_t fd, uint64_t begin, uint64_t file_size, tr_error** error)
+{
+    auto const zeroes = std::vector<uint8_t>(ZeroChunkSize);
+
+    current_done_.store(begin, std::memory_order_relaxed);
+
+    for (uint64_t offset = begin; offset < file_size;)
+    {
+        if (stop_current_)
+        {
+            tr_error_set(error, ECANCELED, tr_strerror(ECANCELED));
+            return false;
+        }
+
+        auto const this_pass = std::min(file_size - offset, uint64_t{ ZeroChunkSize });
+        auto n_written = uint64_t{};
+        if (!tr_sys_file_write_at(fd, std::data(zeroes), this_pass, offset, &n_written, error))
+        {
+            return false;
+        }
+
+        offset += n_written;
+        bytes_zeroed_.fetch_add(n_written, std::memory_order_relaxed);
+        current_done_.store(offset, std::memory_order_relaxed);
+    }
+
+    return true;
+}
+
+int tr_preallocate_worker::preallocate(Job const& job)
+{
+    auto const trace = tr_trace_scope{ tr_trace_event::Preallocate, static_cast<uint64_t>(job.key.first) };
+    auto const filename = tr_pathbuf{ job.filename };
+
+    // Only new files get preallocated, same as tr_open_files::get().
+    // A file that's shorter than it should be is what's left of a job
+    // that was cancelled or interrupted, so pick up where that one left off.
+    auto const info = tr_sys_path_get_info(filename);
+    if (info && info->size >= job.file_size)
+    {
+        return 0;
+    }
+
+    auto const existing_size = info ? info->size : uint64_t{};
+
+    tr_error* error = nullptr;
+    auto dir = tr_pathbuf{ filename.sv() };
+    dir.popdir();
+    if (!tr_sys_dir_create(dir, TR_SYS_DIR_CREATE_PARENTS, 0777, &error))
+    {
+        auto const err = error->code;
+        tr_logAddError(fmt::format(
+            _("Couldn't create '{path}': {error} ({error_code})"),
+            fmt::arg("path", dir),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_free(error);
+        return err;
+    }
+
+    auto const fd = tr_sys_file_open(filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE, 0666, &error);
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        auto const err = error->code;
+        tr_logAddError(fmt::format(
+            _("Couldn't open '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_free(error);
+        return err;
+    }
+
+    auto success = job.file_size == 0 || tr_sys_file_preallocate(fd, job.file_size, 0, &error);
+
+    if (!success && !TR_ERROR_IS_ENOSPC(error->code))
+    {
+        tr_logAddDebug(fmt::format("Full preallocation failed: {} ({})", error->message, error->code));
+        tr_error_clear(&error);
+
+        // fallback: the old-fashioned way
+        success = writeZeroes(fd, existing_size, job.file_size, &error);
+    }
+
+    tr_sys_file_close(fd);
+
+    if (success)
+    {
+        current_done_.store(job.file_size, std::memory_order_relaxed);
+        tr_logAddDebug(fmt::format("Preallocated file '{}' (full, size: {})", filename, job.file_size));
+        return 0;
+    }
+
+    auto const err = error->code;
+    if (err != ECANCELED)
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't preallocate '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+    }
+    tr_error_free(error);
+    return err;
+}
+
+void tr_preallocate_worker::workerThreadFunc()
+{
+    tr_traceSetThreadName("preallocate");
+
+    for (;;)
+    {
+        auto job = Job{};
+
+        {
+            auto const lock = std::lock_guard(mutex_);
+
+            stop_current_ = false;
+            if (std::empty(todo_))
+            {
+                current_key_.reset();
+                worker_thread_id_.reset();
+                return;
+            }
+
+            job = std::move(todo_.front());
+            todo_.pop_front();
+            current_key_ = job.key;
+            current_done_.store(0U, std::memory_order_relaxed);
+            current_size_.store(job.file_size, std::memory_order_relaxed);
+        }
+
+        auto const error = preallocate(job);
+        bool const stopped = stop_current_;
+
+        {
+            auto const lock = std::lock_guard(mutex_);
+
+            busy_.erase(job.key);
+            current_key_.reset();
+
+            if (error != 0 && !stopped)
+            {
+                failed_.insert(job.key);
+            }
+        }
+
+        if (stopped)
+        {
+            continue;
+        }
+
+        if (error == 0)
+        {
+            files_preallocated_.fetch_add(1U, std::memory_order_relaxed);
+        }
+
+        callCallback(job.key, error);
+    }
+}
+
+void tr_preallocate_worker::add(tr_torrent_id_t tor_id, tr_file_index_t file_num, std::string_view filename, uint64_t file_size)
+{
+    auto const key = Key{ tor_id, file_num };
+
+    auto const lock = std::lock_guard(mutex_);
+
+    failed_.erase(key);
+
+    if (current_key_ == key)
+    {
+        return;
+    }
+
+    if (auto const iter = std::find_if(
+            std::begin(todo_),
+            std::end(todo_),
+            [&key](auto const& job) { return job.key == key; });
+        iter != std::end(todo_))
+    {
+        todo_.splice(std::begin(todo_), todo_, iter);
+        return;
+    }
+
+    tr_logAddTrace(fmt::format("Queued '{}' for preallocation", filename));
+    todo_.push_back(Job{ key, std::string{ filename }, file_size });
+    busy_.insert(key);
+
+    if (!worker_thread_id_)
+    {
+        auto thread = std::thread(&tr_preallocate_worker::workerThreadFunc, this);
+        worker_thread_id_ = thread.get_id();
+        thread.detach();
+    }
+}
+
+bool tr_preallocate_worker::prioritize(tr_torrent_id_t tor_id, tr_file_index_t file_num)
+{
+    auto const key = Key{ tor_id, file_num };
+
+    auto const lock = std::lock_guard(mutex_);
+
+    if (current_key_ == key)
+    {
+        return true;
+    }
+
+    auto const iter = std::find_if(std::begin(todo_), std::end(todo_), [&key](auto const& job) { return job.key == key; });
+    if (iter == std::end(todo_))
+    {
+        return false;
+    }
+
+    todo_.splice(std::begin(todo_), todo_, iter);
+    return true;
+}
+
+void tr_preallocate_worker::remove(tr_torrent_id_t tor_id)
+{
+    auto lock = std::unique_lock(mutex_);
+
+    todo_.remove_if(
+        [this, tor_id](auto const& job)
+        {
+            if (job.key.first != tor_id)
+            {
+                return false;
+            }
+
+            busy_.erase(job.key);
+            return true;
+        });
+
+    auto const is_current = [this, tor_id]()
+    {
+        return current_key_ && current_key_->first == tor_id;
+    };
+
+    if (is_current())
+    {
+        stop_current_ = true;
+
+        while (is_current())
+        {
+            lock.unlock();
+            tr_wait_msec(20);
+            lock.lock();
+        }
+    }
+}
+
+bool tr_preallocate_worker::isBusy(tr_torrent_id_t tor_id, tr_file_index_t file_begin, tr_file_index_t file_end)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    auto const iter = busy_.lower_bound(Key{ tor_id, file_begin });
+    return iter != std::end(busy_) && iter->first == tor_id && iter->second < file_end;
+}
+
+bool tr_preallocate_worker::hasFailed(tr_torrent_id_t tor_id, tr_file_index_t file_num)
+{
+    auto const lock = std::lock_guard(mutex_);
+
+    return failed_.count(Key{ tor_id, file_num }) != 0U;
+}
+
+std::optional<float> tr_preallocate_worker::progress(tr_torrent_id_t tor_id, tr_file_index_t file_num)
+{
+    auto const key = Key{ tor_id, file_num };
+
+    auto const lock = std::lock_guard(mutex_);
+
+    if (current_key_ == key)
+    {
+        auto const size = current_size_.load(std::memory_order_relaxed);
+        return size == 0U ? 1.0F : static_cast<float>(current_done_.load(std::memory_order_relaxed)) / size;
+    }
+
+    if (busy_.count(key) != 0U)
+    {
+        return 0.0F;
+    }
+
+    return {};
+}
+
+tr_preallocate_worker::Stats tr_preallocate_worker::stats()
+{
+    auto stats = Stats{};
+    stats.files_preallocated = files_preallocated_.load(std::memory_order_relaxed);
+    stats.bytes_zeroed = bytes_zeroed_.load(std::memory_order_relaxed);
+
+    auto const lock = std::lock_guard(mutex_);
+    stats.queued = std::size(todo_) + (current_key_ ? 1U : 0U);
+    return stats;
+}
+
+tr_preallocate_worker::~tr_preallocate_worker()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stop_current_ = true;
+        todo_.clear();
+        busy_.clear();
+    }
+
+    while (worker_thread_id_.has_value())
+    {
+        tr_wait_msec(20);
+    }
+}
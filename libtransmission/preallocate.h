@@ -0,0 +1,126 @@
+// This file Copyright 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <atomic>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility> // std::pair
+
+#include "transmission.h" // tr_file_index_t, tr_torrent_id_t
+
+#include "file.h" // tr_sys_file_t
+
+// Fully preallocates new files in a worker thread.
+//
+// When the filesystem can't reserve space natively, full preallocation
+// means writing zeroes across the whole file, which can take minutes for
+// a large file. Doing that on the event thread would stall the session,
+// so files are handed off here when a torrent starts and any blocks bound
+// for them wait in the cache until the file is ready.
+class tr_preallocate_worker
+{
+public:
+    // `error` is 0 on success, or an errno value on failure.
+    // Called from the worker thread. Not called for cancelled jobs.
+    using callback_func = std::function<void(tr_torrent_id_t, tr_file_index_t, int error)>;
+
+    ~tr_preallocate_worker();
+
+    void addCallback(callback_func callback)
+    {
+        callbacks_.emplace_back(std::move(callback));
+    }
+
+    // Queue `filename` to be created and preallocated to `file_size` bytes.
+    // Files that already exist are left alone unless they're short, e.g.
+    // from a job that was cancelled. If the file is already queued, it's
+    // moved to the front since something is waiting on it.
+    void add(tr_torrent_id_t tor_id, tr_file_index_t file_num, std::string_view filename, uint64_t file_size);
+
+    // If the file is queued or being preallocated, move it to the front
+    // of the queue, since something is waiting on it, and return true.
+    [[nodiscard]] bool prioritize(tr_torrent_id_t tor_id, tr_file_index_t file_num);
+
+    // Cancel all of a torrent's queued jobs, and wait for its
+    // current job (if any) to stop. A cancelled file is left short.
+    void remove(tr_torrent_id_t tor_id);
+
+    // @return true if any file in [file_begin, file_end) is queued or being preallocated
+    [[nodiscard]] bool isBusy(tr_torrent_id_t tor_id, tr_file_index_t file_begin, tr_file_index_t file_end);
+
+    [[nodiscard]] bool isBusy(tr_torrent_id_t tor_id, tr_file_index_t file_num)
+    {
+        return isBusy(tor_id, file_num, file_num + 1);
+    }
+
+    // @return true if the last attempt to preallocate this file failed
+    [[nodiscard]] bool hasFailed(tr_torrent_id_t tor_id, tr_file_index_t file_num);
+
+    // @return how much of the file has been preallocated, in [0..1],
+    // or nullopt if the file isn't queued or being preallocated
+    [[nodiscard]] std::optional<float> progress(tr_torrent_id_t tor_id, tr_file_index_t file_num);
+
+    struct Stats
+    {
+        size_t queued = 0; // files waiting or being preallocated
+        uint64_t files_preallocated = 0;
+        uint64_t bytes_zeroed = 0; // written by the fallback when the filesystem can't reserve space
+    };
+
+    [[nodiscard]] Stats stats();
+
+private:
+    using Key = std::pair<tr_torrent_id_t, tr_file_index_t>;
+
+    struct Job
+    {
+        Key key;
+        std::string filename;
+        uint64_t file_size = 0;
+    };
+
+    void callCallback(Key const& key, int error)
+    {
+        for (auto& callback : callbacks_)
+        {
+            callback(key.first, key.second, error);
+        }
+    }
+
+    void workerThreadFunc();
+    [[nodiscard]] int preallocate(Job const& job);
+    [[nodiscard]] bool writeZeroes(tr_sys_file_t fd, uint64_t begin, uint64_t file_size, struct tr_error** error);
+
+    std::list<callback_func> callbacks_;
+    std::mutex mutex_;
+
+    std::list<Job> todo_;
+    std::set<Key> busy_; // keys in `todo_` plus `current_key_`
+    std::set<Key> failed_;
+    std::optional<Key> current_key_;
+
+    std::optional<std::thread::id> worker_thread_id_;
+    std::atomic<bool> stop_current_ = false;
+
+    // updated by the worker thread, so readers needn't take `mutex_`
+    std::atomic<uint64_t> current_done_ = {};
+    std::atomic<uint64_t> current_size_ = {};
+    std::atomic<uint64_t> files_preallocated_ = {};
+    std::atomic<uint64_t> bytes_zeroed_ = {};
+};
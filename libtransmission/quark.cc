@@ -18,7 +18,8 @@ using namespace std::literals;
 namespace
 {
 
-auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
+auto constexpr MyStatic = std::array<std::string_view, 427>{ ""sv,
+                                                             "acquisitions"sv,
                                                              "activeTorrentCount"sv,
                                                              "activity-date"sv,
                                                              "activityDate"sv,
@@ -40,6 +41,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "announce-ip"sv,
                                                              "announce-ip-enabled"sv,
                                                              "announce-list"sv,
+                                                             "announceLagHistogram"sv,
                                                              "announceState"sv,
                                                              "anti-brute-force-enabled"sv,
                                                              "anti-brute-force-threshold"sv,
@@ -57,7 +59,11 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "blocklist-url"sv,
                                                              "blocks"sv,
                                                              "bytesCompleted"sv,
+                                                             "bytesQueuedToPeer"sv,
+                                                             "bytesQueuedToPeers"sv,
                                                              "cache-size-mb"sv,
+                                                             "cacheBytes"sv,
+                                                             "callbacks"sv,
                                                              "clientIsChoked"sv,
                                                              "clientIsInterested"sv,
                                                              "clientName"sv,
@@ -66,6 +72,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "compact-view"sv,
                                                              "complete"sv,
                                                              "config-dir"sv,
+                                                             "contendedAcquisitions"sv,
                                                              "cookies"sv,
                                                              "corrupt"sv,
                                                              "corruptEver"sv,
@@ -104,14 +111,18 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "downloading-time-seconds"sv,
                                                              "dropped"sv,
                                                              "dropped6"sv,
+                                                             "durationHistogram"sv,
                                                              "e"sv,
                                                              "editDate"sv,
                                                              "encoding"sv,
                                                              "encryption"sv,
                                                              "error"sv,
                                                              "errorString"sv,
+                                                             "estimatedAnnouncesPerHour"sv,
                                                              "eta"sv,
                                                              "etaIdle"sv,
+                                                             "event-loop-stats"sv,
+                                                             "event-loop-stats-log-interval"sv,
                                                              "fields"sv,
                                                              "file-count"sv,
                                                              "fileStats"sv,
@@ -141,6 +152,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "have"sv,
                                                              "haveUnchecked"sv,
                                                              "haveValid"sv,
+                                                             "holdTimeHistogram"sv,
                                                              "honorsSessionLimits"sv,
                                                              "host"sv,
                                                              "id"sv,
@@ -166,6 +178,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "isUTP"sv,
                                                              "isUploadingTo"sv,
                                                              "labels"sv,
+                                                             "lagHistogram"sv,
                                                              "lastAnnouncePeerCount"sv,
                                                              "lastAnnounceResult"sv,
                                                              "lastAnnounceStartTime"sv,
@@ -181,6 +194,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "leftUntilDone"sv,
                                                              "length"sv,
                                                              "location"sv,
+                                                             "lock-stats"sv,
                                                              "lpd-enabled"sv,
                                                              "m"sv,
                                                              "magnetLink"sv,
@@ -194,6 +208,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "max-peers"sv,
                                                              "maxConnectedPeers"sv,
                                                              "memory-bytes"sv,
+                                                             "memory-stats"sv,
                                                              "memory-units"sv,
                                                              "message-level"sv,
                                                              "metadataPercentComplete"sv,
@@ -218,6 +233,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "pausedTorrentCount"sv,
                                                              "peer-congestion-algorithm"sv,
                                                              "peer-id-ttl-hours"sv,
+                                                             "peer-io-threads"sv,
                                                              "peer-limit"sv,
                                                              "peer-limit-global"sv,
                                                              "peer-limit-per-torrent"sv,
@@ -226,8 +242,12 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "peer-port-random-low"sv,
                                                              "peer-port-random-on-start"sv,
                                                              "peer-socket-tos"sv,
+                                                             "peerBitfieldBytes"sv,
+                                                             "peerBufferBytes"sv,
+                                                             "peerCount"sv,
                                                              "peerIsChoked"sv,
                                                              "peerIsInterested"sv,
+                                                             "peerObjectBytes"sv,
                                                              "peers"sv,
                                                              "peers2"sv,
                                                              "peers2-6"sv,
@@ -265,6 +285,8 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "queue-stalled-enabled"sv,
                                                              "queue-stalled-minutes"sv,
                                                              "queuePosition"sv,
+                                                             "queuedAnnounces"sv,
+                                                             "queuedScrapes"sv,
                                                              "rateDownload"sv,
                                                              "rateToClient"sv,
                                                              "rateToPeer"sv,
@@ -309,6 +331,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "rpc-whitelist-enabled"sv,
                                                              "scrape"sv,
                                                              "scrape-paused-torrents-enabled"sv,
+                                                             "scrapeLagHistogram"sv,
                                                              "scrapeState"sv,
                                                              "script-torrent-added-enabled"sv,
                                                              "script-torrent-added-filename"sv,
@@ -380,6 +403,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "torrents"sv,
                                                              "totalSize"sv,
                                                              "total_size"sv,
+                                                             "tracker-stats"sv,
                                                              "trackerAdd"sv,
                                                              "trackerList"sv,
                                                              "trackerRemove"sv,
@@ -389,6 +413,7 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "trash-can-enabled"sv,
                                                              "trash-original-torrent-files"sv,
                                                              "umask"sv,
+                                                             "unadjustedAnnouncesPerHour"sv,
                                                              "units"sv,
                                                              "upload-slots-per-torrent"sv,
                                                              "uploadLimit"sv,
@@ -412,11 +437,14 @@ auto constexpr MyStatic = std::array<std::string_view, 399>{ ""sv,
                                                              "utp-enabled"sv,
                                                              "v"sv,
                                                              "version"sv,
+                                                             "waitTimeHistogram"sv,
                                                              "wanted"sv,
                                                              "watch-dir"sv,
                                                              "watch-dir-enabled"sv,
                                                              "webseeds"sv,
-                                                             "webseedsSendingToUs"sv };
+                                                             "webseedsSendingToUs"sv,
+                                                             "workQueueMaxDepth"sv,
+                                                             "workQueueTasks"sv };
 
 bool constexpr quarks_are_sorted()
 {
@@ -22,6 +22,7 @@ using tr_quark = size_t;
 enum
 {
     TR_KEY_NONE, /* represented as an empty string */
+    TR_KEY_acquisitions,
     TR_KEY_activeTorrentCount, /* rpc */
     TR_KEY_activity_date, /* resume file */
     TR_KEY_activityDate, /* rpc */
@@ -43,6 +44,7 @@ enum
     TR_KEY_announce_ip, /* metainfo, settings */
     TR_KEY_announce_ip_enabled, /* metainfo, settings */
     TR_KEY_announce_list, /* metainfo */
+    TR_KEY_announceLagHistogram,
     TR_KEY_announceState, /* rpc */
     TR_KEY_anti_brute_force_enabled, /* rpc */
     TR_KEY_anti_brute_force_threshold, /* rpc */
@@ -60,7 +62,11 @@ enum
     TR_KEY_blocklist_url,
     TR_KEY_blocks,
     TR_KEY_bytesCompleted,
+    TR_KEY_bytesQueuedToPeer,
+    TR_KEY_bytesQueuedToPeers,
     TR_KEY_cache_size_mb,
+    TR_KEY_cacheBytes,
+    TR_KEY_callbacks,
     TR_KEY_clientIsChoked,
     TR_KEY_clientIsInterested,
     TR_KEY_clientName,
@@ -69,6 +75,7 @@ enum
     TR_KEY_compact_view,
     TR_KEY_complete,
     TR_KEY_config_dir,
+    TR_KEY_contendedAcquisitions,
     TR_KEY_cookies,
     TR_KEY_corrupt,
     TR_KEY_corruptEver,
@@ -107,14 +114,18 @@ enum
     TR_KEY_downloading_time_seconds,
     TR_KEY_dropped,
     TR_KEY_dropped6,
+    TR_KEY_durationHistogram,
     TR_KEY_e,
     TR_KEY_editDate,
     TR_KEY_encoding,
     TR_KEY_encryption,
     TR_KEY_error,
     TR_KEY_errorString,
+    TR_KEY_estimatedAnnouncesPerHour,
     TR_KEY_eta,
     TR_KEY_etaIdle,
+    TR_KEY_event_loop_stats,
+    TR_KEY_event_loop_stats_log_interval,
     TR_KEY_fields,
     TR_KEY_file_count,
     TR_KEY_fileStats,
@@ -144,6 +155,7 @@ enum
     TR_KEY_have,
     TR_KEY_haveUnchecked,
     TR_KEY_haveValid,
+    TR_KEY_holdTimeHistogram,
     TR_KEY_honorsSessionLimits,
     TR_KEY_host,
     TR_KEY_id,
@@ -169,6 +181,7 @@ enum
     TR_KEY_isUTP,
     TR_KEY_isUploadingTo,
     TR_KEY_labels,
+    TR_KEY_lagHistogram,
     TR_KEY_lastAnnouncePeerCount,
     TR_KEY_lastAnnounceResult,
     TR_KEY_lastAnnounceStartTime,
@@ -184,6 +197,7 @@ enum
     TR_KEY_leftUntilDone,
     TR_KEY_length,
     TR_KEY_location,
+    TR_KEY_lock_stats,
     TR_KEY_lpd_enabled,
     TR_KEY_m,
     TR_KEY_magnetLink,
@@ -197,6 +211,7 @@ enum
     TR_KEY_max_peers,
     TR_KEY_maxConnectedPeers,
     TR_KEY_memory_bytes,
+    TR_KEY_memory_stats,
     TR_KEY_memory_units,
     TR_KEY_message_level,
     TR_KEY_metadataPercentComplete,
@@ -221,6 +236,7 @@ enum
     TR_KEY_pausedTorrentCount,
     TR_KEY_peer_congestion_algorithm,
     TR_KEY_peer_id_ttl_hours,
+    TR_KEY_peer_io_threads,
     TR_KEY_peer_limit,
     TR_KEY_peer_limit_global,
     TR_KEY_peer_limit_per_torrent,
@@ -229,8 +245,12 @@ enum
     TR_KEY_peer_port_random_low,
     TR_KEY_peer_port_random_on_start,
     TR_KEY_peer_socket_tos,
+    TR_KEY_peerBitfieldBytes,
+    TR_KEY_peerBufferBytes,
+    TR_KEY_peerCount,
     TR_KEY_peerIsChoked,
     TR_KEY_peerIsInterested,
+    TR_KEY_peerObjectBytes,
     TR_KEY_peers,
     TR_KEY_peers2,
     TR_KEY_peers2_6,
@@ -268,6 +288,8 @@ enum
     TR_KEY_queue_stalled_enabled,
     TR_KEY_queue_stalled_minutes,
     TR_KEY_queuePosition,
+    TR_KEY_queuedAnnounces,
+    TR_KEY_queuedScrapes,
     TR_KEY_rateDownload,
     TR_KEY_rateToClient,
     TR_KEY_rateToPeer,
@@ -312,6 +334,7 @@ enum
     TR_KEY_rpc_whitelist_enabled,
     TR_KEY_scrape,
     TR_KEY_scrape_paused_torrents_enabled,
+    TR_KEY_scrapeLagHistogram,
     TR_KEY_scrapeState,
     TR_KEY_script_torrent_added_enabled,
     TR_KEY_script_torrent_added_filename,
@@ -383,6 +406,7 @@ enum
     TR_KEY_torrents,
     TR_KEY_totalSize,
     TR_KEY_total_size,
+    TR_KEY_tracker_stats,
     TR_KEY_trackerAdd,
     TR_KEY_trackerList,
     TR_KEY_trackerRemove,
@@ -392,6 +416,7 @@ enum
     TR_KEY_trash_can_enabled,
     TR_KEY_trash_original_torrent_files,
     TR_KEY_umask,
+    TR_KEY_unadjustedAnnouncesPerHour,
     TR_KEY_units,
     TR_KEY_upload_slots_per_torrent,
     TR_KEY_uploadLimit,
@@ -415,11 +440,14 @@ enum
     TR_KEY_utp_enabled,
     TR_KEY_v,
     TR_KEY_version,
+    TR_KEY_waitTimeHistogram,
     TR_KEY_wanted,
     TR_KEY_watch_dir,
     TR_KEY_watch_dir_enabled,
     TR_KEY_webseeds,
     TR_KEY_webseedsSendingToUs,
+    TR_KEY_workQueueMaxDepth,
+    TR_KEY_workQueueTasks,
     TR_N_KEYS
 };
 
@@ -0,0 +1,733 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef> // std::byte, size_t
+#include <iterator> // std::back_inserter
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "transmission.h"
+
+#include "benc.h"
+#include "error.h"
+#include "file.h"
+#include "log.h"
+#include "quark.h"
+#include "resume-journal.h"
+#include "tr-strbuf.h"
+#include "utils.h"
+#include "variant.h"
+
+using namespace std::literals;
+
+namespace
+{
+
+// Wait this long for more records before writing a batch,
+// so that a burst of saves shares a single fsync.
+auto constexpr BatchDelay = 100ms;
+
+// Don't bother compacting journals smaller than this.
+auto constexpr MinCompactSize = uint64_t{ 1024U * 1024U };
+
+auto constexpr MaxBencDepth = 32;
+
+// Imported `.resume` files are renamed to `.resume.bak`.
+auto constexpr LegacyBackupSuffix = ".bak"sv;
+
+auto constexpr HashKey = "hash"sv;
+auto constexpr PiecesKey = "pieces"sv;
+auto constexpr ProgressKey = "progress"sv;
+auto constexpr RemoveKey = "remove"sv;
+auto constexpr SetKey = "set"sv;
+auto constexpr UnsetKey = "unset"sv;
+
+void appendString(std::string& out, std::string_view str)
+{
+    fmt::format_to(std::back_inserter(out), FMT_STRING("{:d}:"), std::size(str));
+    out += str;
+}
+
+[[nodiscard]] std::string_view toStringView(tr_sha1_digest_t const& info_hash)
+{
+    return { reinterpret_cast<char const*>(std::data(info_hash)), std::size(info_hash) };
+}
+
+
+[[nodiscard]] std::string makeRecord(
+    tr_sha1_digest_t const& info_hash,
+    tr_resume_journal::Fields const& set,
+    std::vector<std::string> const& unset = {},
+    std::vector<tr_piece_index_t> const& completed_pieces = {})
+{
+    auto record = std::string{ "d" };
+    appendString(record, HashKey);
+    appendString(record, toStringView(info_hash));
+
+    if (!std::empty(completed_pieces))
+    {
+        appendString(record, PiecesKey);
+        record += 'l';
+        for (auto const piece : completed_pieces)
+        {
+            fmt::format_to(std::back_inserter(record), FMT_STRING("i{:d}e"), piece);
+        }
+        record += 'e';
+    }
+
+    appendString(record, SetKey);
+    record += 'd';
+    for (auto const& [key, value] : set)
+    {
+        appendString(record, key);
+        record += value;
+    }
+    record += 'e';
+
+    if (!std::empty(unset))
+    {
+        appendString(record, UnsetKey);
+        record += 'l';
+        for (auto const& key : unset)
+        {
+            appendString(record, key);
+        }
+        record += 'e';
+    }
+
+    record += 'e';
+    return record;
+}
+
+[[nodiscard]] std::string makePieceRecord(tr_sha1_digest_t const& info_hash, tr_piece_index_t piece)
+{
+    auto record = std::string{ "d" };
+    appendString(record, HashKey);
+    appendString(record, toStringView(info_hash));
+    appendString(record, PiecesKey);
+    fmt::format_to(std::back_inserter(record), FMT_STRING("li{:d}eee"), piece);
+    return record;
+}
+
+[[nodiscard]] std::string makeRemoveRecord(tr_sha1_digest_t const& info_hash)
+{
+    auto record = std::string{ "d" };
+    appendString(record, HashKey);
+    appendString(record, toStringView(info_hash));
+    appendString(record, RemoveKey);
+    record += "i1ee";
+    return record;
+}
+
+// Parses a single record without building a tr_variant,
+// since tr_variant's quarks can't be created outside the session thread.
+struct RecordHandler final : public transmission::benc::BasicHandler<MaxBencDepth>
+{
+    using BasicHandler = transmission::benc::BasicHandler<MaxBencDepth>;
+
+    std::string_view info_hash;
+    bool remove = false;
+    tr_resume_journal::Fields set;
+    std::vector<std::string> unset;
+    std::vector<tr_piece_index_t> pieces;
+
+    bool Int64(int64_t value, Context const& context) override
+    {
+        if (depth() == 1 && currentKey() == RemoveKey)
+        {
+            remove = value != 0;
+        }
+        else if (depth() == 2 && key(1) == PiecesKey && value >= 0)
+        {
+            pieces.push_back(static_cast<tr_piece_index_t>(value));
+        }
+        else if (isSetValue())
+        {
+            set.insert_or_assign(std::string{ currentKey() }, std::string{ context.raw() });
+        }
+
+        return true;
+    }
+
+    bool String(std::string_view value, Context const& context) override
+    {
+        if (depth() == 1 && currentKey() == HashKey)
+        {
+            info_hash = value;
+        }
+        else if (isSetValue())
+        {
+            set.insert_or_assign(std::string{ currentKey() }, std::string{ context.raw() });
+        }
+        else if (depth() == 2 && key(1) == UnsetKey)
+        {
+            unset.emplace_back(value);
+        }
+
+        return true;
+    }
+
+    bool StartDict(Context const& context) override
+    {
+        startValue(context);
+        return BasicHandler::StartDict(context);
+    }
+
+    bool EndDict(Context const& context) override
+    {
+        BasicHandler::EndDict(context);
+        endValue(context);
+        return true;
+    }
+
+    bool StartArray(Context const& context) override
+    {
+        startValue(context);
+        return BasicHandler::StartArray(context);
+    }
+
+    bool EndArray(Context const& context) override
+    {
+        BasicHandler::EndArray(context);
+        endValue(context);
+        return true;
+    }
+
+private:
+    [[nodiscard]] bool isSetValue() const noexcept
+    {
+        return depth() == 2 && key(1) == SetKey;
+    }
+
+    void startValue(Context const& context)
+    {
+        if (isSetValue())
+        {
+            value_begin_ = std::data(context.raw());
+        }
+    }
+
+    void endValue(Context const& context)
+    {
+        if (isSetValue())
+        {
+            auto const* const value_end = std::data(context.raw()) + 1;
+            set.insert_or_assign(std::string{ currentKey() }, std::string{ value_begin_, value_end });
+        }
+    }
+
+    char const* value_begin_ = nullptr;
+};
+
+// Make a rename in `dirname` durable. Windows has no way to
+// do this, but NTFS journals its metadata changes anyway.
+void syncDir([[maybe_unused]] std::string_view dirname)
+{
+#ifndef _WIN32
+    if (auto const fd = tr_sys_file_open(tr_pathbuf{ dirname }.c_str(), TR_SYS_FILE_READ, 0); fd != TR_BAD_SYS_FILE)
+    {
+        tr_sys_file_flush(fd);
+        tr_sys_file_close(fd);
+    }
+#endif
+}
+
+[[nodiscard]] tr_sys_file_t openForAppend(std::string const& filename, tr_error** error = nullptr)
+{
+    tr_error* my_error = nullptr;
+    auto const fd = tr_sys_file_open(
+        filename.c_str(),
+        TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE | TR_SYS_FILE_APPEND,
+        0600,
+        &my_error);
+
+    if (fd == TR_BAD_SYS_FILE)
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't open '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename),
+            fmt::arg("error", my_error->message),
+            fmt::arg("error_code", my_error->code)));
+        tr_error_propagate(error, &my_error);
+    }
+
+    return fd;
+}
+
+} // namespace
+
+size_t tr_resume_journal::replay(std::string_view journal, State& state)
+{
+    auto const* const begin = std::data(journal);
+    auto const* valid_end = begin;
+    auto stack = transmission::benc::ParserStack<MaxBencDepth>{};
+
+    while (!std::empty(journal))
+    {
+        auto handler = RecordHandler{};
+        char const* end = nullptr;
+        if (!transmission::benc::parse(journal, stack, handler, &end) ||
+            std::size(handler.info_hash) != std::tuple_size_v<tr_sha1_digest_t>)
+        {
+            break;
+        }
+
+        journal.remove_prefix(end - std::data(journal));
+        valid_end = end;
+
+        auto info_hash = tr_sha1_digest_t{};
+        std::copy_n(reinterpret_cast<std::byte const*>(std::data(handler.info_hash)), std::size(info_hash), std::begin(info_hash));
+
+        if (handler.remove)
+        {
+            state.erase(info_hash);
+            continue;
+        }
+
+        auto& entry = state[info_hash];
+        auto& fields = entry.fields;
+        if (handler.set.count(ProgressKey) != 0)
+        {
+            entry.completed_pieces.clear();
+        }
+        for (auto& [key, value] : handler.set)
+        {
+            fields.insert_or_assign(key, std::move(value));
+        }
+        for (auto const& key : handler.unset)
+        {
+            if (auto const it = fields.find(key); it != std::end(fields))
+            {
+                fields.erase(it);
+            }
+        }
+
+        auto& completed = entry.completed_pieces;
+        completed.insert(std::end(completed), std::begin(handler.pieces), std::end(handler.pieces));
+    }
+
+    return static_cast<size_t>(valid_end - begin);
+}
+
+tr_resume_journal::tr_resume_journal(std::string_view resume_dir, WriteFailedFunc on_write_failed)
+    : filename_{ tr_pathbuf{ resume_dir, "/resume.journal"sv }.sv() }
+    , on_write_failed_{ std::move(on_write_failed) }
+{
+    auto contents = std::vector<char>{};
+    if (tr_error* error = nullptr; tr_sys_path_exists(filename_) && !tr_loadFile(filename_, contents, &error))
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't read '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename_),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+    }
+
+    auto const valid_size = replay({ std::data(contents), std::size(contents) }, loaded_);
+
+    auto live_size = size_t{};
+    for (auto const& [info_hash, entry] : loaded_)
+    {
+        saved_.try_emplace(info_hash, entry.fields);
+        for (auto const& [key, value] : entry.fields)
+        {
+            live_size += std::size(key) + std::size(value);
+        }
+        live_size += std::size(entry.completed_pieces) * sizeof(tr_piece_index_t);
+    }
+
+    file_size_ = std::size(contents);
+    compacted_size_ = live_size;
+
+    // Rewrite the journal if it ends with a torn record,
+    // or if most of it has been superseded.
+    if (valid_size != std::size(contents))
+    {
+        tr_logAddWarn(fmt::format(
+            _("Discarding {count} bytes of incomplete records from '{path}'"),
+            fmt::arg("count", std::size(contents) - valid_size),
+            fmt::arg("path", filename_)));
+    }
+
+    auto const torn = valid_size != std::size(contents);
+    auto const rewritten = (torn || file_size_ > std::max(MinCompactSize, uint64_t{ live_size } * 2U)) && rewrite(loaded_);
+
+    if (!rewritten)
+    {
+        fd_ = openForAppend(filename_);
+
+        if (torn && fd_ != TR_BAD_SYS_FILE && tr_sys_file_truncate(fd_, valid_size))
+        {
+            file_size_ = valid_size;
+        }
+    }
+
+    writer_thread_ = std::thread(&tr_resume_journal::writerThreadFunc, this);
+}
+
+tr_resume_journal::~tr_resume_journal()
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        stopping_ = true;
+    }
+    queued_cv_.notify_one();
+    writer_thread_.join();
+
+    if (fd_ != TR_BAD_SYS_FILE)
+    {
+        tr_sys_file_close(fd_);
+    }
+}
+
+bool tr_resume_journal::load(
+    tr_sha1_digest_t const& info_hash,
+    tr_variant* setme,
+    std::vector<tr_piece_index_t>* setme_completed_pieces)
+{
+    auto entry = Entry{};
+
+    if (auto node = loaded_.extract(info_hash); !node.empty())
+    {
+        entry = std::move(node.mapped());
+    }
+    else if (saved_.count(info_hash) != 0)
+    {
+        // it was saved earlier in this session, so read it back
+        flush();
+
+        auto contents = std::vector<char>{};
+        if (!tr_loadFile(filename_, contents))
+        {
+            return false;
+        }
+
+        auto state = State{};
+        replay({ std::data(contents), std::size(contents) }, state);
+        if (auto state_node = state.extract(info_hash); !state_node.empty())
+        {
+            entry = std::move(state_node.mapped());
+        }
+    }
+
+    if (std::empty(entry.fields) && std::empty(entry.completed_pieces))
+    {
+        return false;
+    }
+
+    if (setme_completed_pieces != nullptr)
+    {
+        *setme_completed_pieces = std::move(entry.completed_pieces);
+    }
+
+    auto benc = std::string{ "d" };
+    for (auto const& [key, value] : entry.fields)
+    {
+        appendString(benc, key);
+        benc += value;
+    }
+    benc += 'e';
+
+    return tr_variantFromBuf(setme, TR_VARIANT_PARSE_BENC, benc);
+}
+
+std::string tr_resume_journal::diff(tr_sha1_digest_t const& info_hash, tr_variant* dict)
+{
+    auto& saved = saved_[info_hash];
+    auto changed = Fields{};
+    auto present = std::vector<std::string_view>{};
+
+    auto key = tr_quark{};
+    tr_variant* child = nullptr;
+    for (size_t i = 0; tr_variantDictChild(dict, i, &key, &child); ++i)
+    {
+        auto const name = tr_quark_get_string_view(key);
+        present.push_back(name);
+
+        auto value = tr_variantToStr(child, TR_VARIANT_FMT_BENC);
+        if (auto const it = saved.find(name); it == std::end(saved) || it->second != value)
+        {
+            changed.insert_or_assign(std::string{ name }, value);
+            saved.insert_or_assign(std::string{ name }, std::move(value));
+        }
+    }
+
+    auto unset = std::vector<std::string>{};
+    for (auto it = std::begin(saved); it != std::end(saved);)
+    {
+        if (std::find(std::begin(present), std::end(present), it->first) == std::end(present))
+        {
+            unset.push_back(it->first);
+            it = saved.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (std::empty(changed) && std::empty(unset))
+    {
+        return {};
+    }
+
+    return makeRecord(info_hash, changed, unset);
+}
+
+void tr_resume_journal::save(tr_sha1_digest_t const& info_hash, tr_variant* dict)
+{
+    if (auto record = diff(info_hash, dict); !std::empty(record))
+    {
+        enqueue(info_hash, std::move(record));
+    }
+}
+
+void tr_resume_journal::import(tr_sha1_digest_t const& info_hash, tr_variant* dict, std::string_view legacy_filename)
+{
+    saved_.erase(info_hash);
+
+    auto record = diff(info_hash, dict);
+    if (std::empty(record))
+    {
+        record = makeRecord(info_hash, {});
+    }
+
+    enqueue(info_hash, std::move(record), legacy_filename);
+}
+
+void tr_resume_journal::addCompletedPiece(tr_sha1_digest_t const& info_hash, tr_piece_index_t piece)
+{
+    saved_.try_emplace(info_hash);
+    enqueue(info_hash, makePieceRecord(info_hash, piece));
+}
+
+void tr_resume_journal::remove(tr_sha1_digest_t const& info_hash)
+{
+    loaded_.erase(info_hash);
+    saved_.erase(info_hash);
+    enqueue(info_hash, makeRemoveRecord(info_hash));
+}
+
+void tr_resume_journal::markUnsaved(tr_sha1_digest_t const& info_hash)
+{
+    // Keep the names so that fields which have since been dropped are
+    // still unset. No bencoded value is empty, so every field differs.
+    if (auto const it = saved_.find(info_hash); it != std::end(saved_))
+    {
+        for (auto& [key, value] : it->second)
+        {
+            value.clear();
+        }
+    }
+}
+
+void tr_resume_journal::flush()
+{
+    auto lock = std::unique_lock(mutex_);
+    auto const seq = queued_seq_;
+    ++flush_waiters_;
+    queued_cv_.notify_one();
+    synced_cv_.wait(lock, [this, seq]() { return synced_seq_ >= seq; });
+    --flush_waiters_;
+}
+
+void tr_resume_journal::enqueue(tr_sha1_digest_t const& info_hash, std::string&& record, std::string_view retire_after_sync)
+{
+    {
+        auto const lock = std::lock_guard(mutex_);
+        queued_ += record;
+        queued_hashes_.push_back(info_hash);
+        if (!std::empty(retire_after_sync))
+        {
+            queued_retires_.emplace_back(retire_after_sync);
+        }
+        ++queued_seq_;
+    }
+
+    queued_cv_.notify_one();
+}
+
+void tr_resume_journal::writerThreadFunc()
+{
+    auto lock = std::unique_lock(mutex_);
+
+    for (;;)
+    {
+        queued_cv_.wait(lock, [this]() { return stopping_ || !std::empty(queued_); });
+        if (std::empty(queued_))
+        {
+            break; // stopping
+        }
+
+        queued_cv_.wait_for(lock, BatchDelay, [this]() { return stopping_ || flush_waiters_ > 0; });
+
+        auto batch = std::string{};
+        std::swap(batch, queued_);
+        auto hashes = std::vector<tr_sha1_digest_t>{};
+        std::swap(hashes, queued_hashes_);
+        auto retires = std::vector<std::string>{};
+        std::swap(retires, queued_retires_);
+        auto const seq = queued_seq_;
+        lock.unlock();
+
+        tr_error* error = nullptr;
+        if (!writeBatch(batch, &error))
+        {
+            // The batch is gone, so the torrents in it need to be saved in full.
+            // Their legacy files stay where they are, to be imported again.
+            if (on_write_failed_)
+            {
+                std::sort(std::begin(hashes), std::end(hashes));
+                hashes.erase(std::unique(std::begin(hashes), std::end(hashes)), std::end(hashes));
+                on_write_failed_(hashes, error != nullptr ? error->message : "");
+            }
+
+            tr_error_clear(&error);
+        }
+        else if (!std::empty(retires))
+        {
+            // Keep the legacy files around as backups, so that users
+            // can still go back to a version without the journal.
+            for (auto const& filename : retires)
+            {
+                tr_sys_path_rename(filename, tr_pathbuf{ filename, LegacyBackupSuffix });
+            }
+
+            syncDir(tr_sys_path_dirname(filename_));
+        }
+
+        if (file_size_ > std::max(MinCompactSize, compacted_size_ * 2U))
+        {
+            compact();
+        }
+
+        lock.lock();
+        synced_seq_ = seq;
+        synced_cv_.notify_all();
+    }
+}
+
+bool tr_resume_journal::writeBatch(std::string_view batch, tr_error** error)
+{
+    if (fd_ == TR_BAD_SYS_FILE)
+    {
+        fd_ = openForAppend(filename_, error);
+    }
+
+    if (fd_ == TR_BAD_SYS_FILE)
+    {
+        return false;
+    }
+
+    auto const old_size = file_size_;
+    auto ok = true;
+    while (ok && !std::empty(batch))
+    {
+        auto n_written = uint64_t{};
+        ok = tr_sys_file_write(fd_, std::data(batch), std::size(batch), &n_written, error);
+        batch.remove_prefix(n_written);
+        file_size_ += n_written;
+    }
+
+    ok = ok && tr_sys_file_flush(fd_, error);
+
+    if (!ok)
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename_),
+            fmt::arg("error", *error != nullptr ? (*error)->message : ""),
+            fmt::arg("error_code", *error != nullptr ? (*error)->code : 0)));
+
+        // don't leave a torn record for later records to be appended to
+        if (tr_sys_file_truncate(fd_, old_size))
+        {
+            file_size_ = old_size;
+        }
+    }
+
+    return ok;
+}
+
+void tr_resume_journal::compact()
+{
+    auto contents = std::vector<char>{};
+    if (!tr_loadFile(filename_, contents))
+    {
+        return;
+    }
+
+    auto state = State{};
+    replay({ std::data(contents), std::size(contents) }, state);
+    rewrite(state);
+}
+
+bool tr_resume_journal::rewrite(State const& state)
+{
+    auto contents = std::string{};
+    for (auto const& [info_hash, entry] : state)
+    {
+        contents += makeRecord(info_hash, entry.fields, {}, entry.completed_pieces);
+    }
+
+    tr_error* error = nullptr;
+    auto tmp = tr_pathbuf{ filename_, ".tmp.XXXXXX"sv };
+    auto const fd = tr_sys_file_open_temp(std::data(tmp), &error);
+    auto ok = fd != TR_BAD_SYS_FILE;
+
+    auto walk = std::string_view{ contents };
+    while (ok && !std::empty(walk))
+    {
+        auto n_written = uint64_t{};
+        ok = tr_sys_file_write(fd, std::data(walk), std::size(walk), &n_written, &error);
+        walk.remove_prefix(n_written);
+    }
+
+    ok = ok && tr_sys_file_flush(fd, &error);
+
+    if (fd != TR_BAD_SYS_FILE)
+    {
+        ok = tr_sys_file_close(fd, ok ? &error : nullptr) && ok;
+    }
+
+    ok = ok && tr_sys_path_rename(tmp, filename_, &error);
+
+    if (ok)
+    {
+        syncDir(tr_sys_path_dirname(filename_));
+    }
+
+    if (!ok)
+    {
+        tr_logAddError(fmt::format(
+            _("Couldn't save '{path}': {error} ({error_code})"),
+            fmt::arg("path", filename_),
+            fmt::arg("error", error != nullptr ? error->message : ""),
+            fmt::arg("error_code", error != nullptr ? error->code : 0)));
+        tr_error_clear(&error);
+        tr_sys_path_remove(tmp);
+        return false;
+    }
+
+    if (fd_ != TR_BAD_SYS_FILE)
+    {
+        tr_sys_file_close(fd_);
+    }
+
+    fd_ = openForAppend(filename_);
+    file_size_ = std::size(contents);
+    compacted_size_ = file_size_;
+    return true;
+}
@@ -0,0 +1,147 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <condition_variable>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <functional> // std::function, std::less
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "transmission.h" // tr_sha1_digest_t
+
+#include "file.h" // tr_sys_file_t
+
+struct tr_error;
+struct tr_variant;
+
+/**
+ * An append-only store for every torrent's resume data.
+ *
+ * Saving a torrent appends one record that holds only the fields which
+ * changed since that torrent was last saved. Pieces that pass their
+ * checksum test are logged as they complete, so that a crash between
+ * saves doesn't lose them. Records are bencoded dicts:
+ *
+ *   d 4:hash 20:<info hash> 3:set d <changed fields> e 5:unset l <dropped field names> e e
+ *   d 4:hash 20:<info hash> 6:pieces l <completed piece indices> e e
+ *   d 4:hash 20:<info hash> 6:remove i1e e
+ *
+ * Completed pieces are replayed on top of the 'progress' field and are
+ * forgotten whenever a newer 'progress' is saved.
+ *
+ * Records are written by a background thread that fsyncs once per batch.
+ * When superseded records make up most of the file, that thread rewrites
+ * the journal with one record per torrent. If a batch can't be written,
+ * the torrents in it are passed to the `on_write_failed` callback, which
+ * should call markUnsaved() so that their next save() sends every field.
+ *
+ * Legacy per-torrent `.resume` files are imported the first time they are
+ * read. Once the imported record is safely on disk, each one is renamed to
+ * `.resume.bak` so that going back to an older version is still possible.
+ */
+class tr_resume_journal
+{
+public:
+    // Called from the writer thread with the torrents whose records were lost.
+    using WriteFailedFunc = std::function<void(std::vector<tr_sha1_digest_t> const& info_hashes, std::string_view error)>;
+
+    explicit tr_resume_journal(std::string_view resume_dir, WriteFailedFunc on_write_failed = {});
+    ~tr_resume_journal();
+
+    tr_resume_journal(tr_resume_journal const&) = delete;
+    tr_resume_journal& operator=(tr_resume_journal const&) = delete;
+
+    // Get a torrent's saved fields and the pieces completed since
+    // its 'progress' was saved. Returns false if the journal has none.
+    [[nodiscard]] bool load(
+        tr_sha1_digest_t const& info_hash,
+        tr_variant* setme,
+        std::vector<tr_piece_index_t>* setme_completed_pieces = nullptr);
+
+    // Queue the fields in `dict` that changed since the torrent was last saved.
+    void save(tr_sha1_digest_t const& info_hash, tr_variant* dict);
+
+    // Queue all of `dict` and rename `legacy_filename` to
+    // `legacy_filename.bak` once it's on disk.
+    void import(tr_sha1_digest_t const& info_hash, tr_variant* dict, std::string_view legacy_filename);
+
+    // Queue a record of a piece that just passed its checksum test.
+    void addCompletedPiece(tr_sha1_digest_t const& info_hash, tr_piece_index_t piece);
+
+    void remove(tr_sha1_digest_t const& info_hash);
+
+    // Forget which fields were saved, so that the next save() sends all of them.
+    void markUnsaved(tr_sha1_digest_t const& info_hash);
+
+    // Block until every queued record is on disk.
+    void flush();
+
+    [[nodiscard]] constexpr auto const& filename() const noexcept
+    {
+        return filename_;
+    }
+
+    // name -> bencoded value
+    using Fields = std::map<std::string, std::string, std::less<>>;
+
+    struct Entry
+    {
+        Fields fields;
+        std::vector<tr_piece_index_t> completed_pieces;
+    };
+
+    using State = std::map<tr_sha1_digest_t, Entry>;
+
+    // Apply the records in `journal` to `state`.
+    // Returns the number of bytes of complete, well-formed records.
+    static size_t replay(std::string_view journal, State& state);
+
+private:
+    [[nodiscard]] std::string diff(tr_sha1_digest_t const& info_hash, tr_variant* dict);
+    void enqueue(tr_sha1_digest_t const& info_hash, std::string&& record, std::string_view retire_after_sync = {});
+
+    void writerThreadFunc();
+    bool writeBatch(std::string_view batch, tr_error** error);
+    void compact();
+    bool rewrite(State const& state);
+
+    std::string const filename_;
+    WriteFailedFunc const on_write_failed_;
+
+    // Only used in the session thread.
+    // `loaded_` is the state read at startup; entries are dropped as torrents load them.
+    // `saved_` is each field's last-saved value.
+    State loaded_;
+    std::map<tr_sha1_digest_t, Fields> saved_;
+
+    // Only used in the writer thread, or before it starts.
+    tr_sys_file_t fd_ = TR_BAD_SYS_FILE;
+    uint64_t file_size_ = 0;
+    uint64_t compacted_size_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable queued_cv_;
+    std::condition_variable synced_cv_;
+    std::string queued_;
+    std::vector<tr_sha1_digest_t> queued_hashes_;
+    std::vector<std::string> queued_retires_;
+    uint64_t queued_seq_ = 0;
+    uint64_t synced_seq_ = 0;
+    size_t flush_waiters_ = 0;
+    bool stopping_ = false;
+
+    std::thread writer_thread_;
+};
@@ -639,6 +639,33 @@ static auto loadProgress(tr_variant* dict, tr_torrent* tor)
     return tr_resume::fields_t{};
 }
 
+// Pieces that passed their checksum test after 'progress' was last saved.
+// They were logged without waiting for their data to reach the disk, so
+// a crash may have lost some of it. Restore them as unchecked journaled
+// pieces, so each one is verified before it's uploaded and is dropped
+// and downloaded again if bad; see tr_torrent::ensurePieceIsChecked().
+static void loadCompletedPieces(tr_torrent* tor, std::vector<tr_piece_index_t> const& pieces)
+{
+    auto const n_pieces = tor->pieceCount();
+    auto n_restored = size_t{};
+
+    for (auto const piece : pieces)
+    {
+        if (piece < n_pieces)
+        {
+            tor->setHasPiece(piece, true);
+            tor->checked_pieces_.set(piece, false);
+            tor->journaled_pieces_.set(piece, true);
+            ++n_restored;
+        }
+    }
+
+    if (n_restored > 0)
+    {
+        tr_logAddDebugTor(tor, fmt::format("Restored {} pieces completed since the last save", n_restored));
+    }
+}
+
 /***
 ****
 ***/
@@ -650,29 +677,45 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load, bo
     TR_ASSERT(tr_isTorrent(tor));
     auto const was_dirty = tor->isDirty;
 
-    auto const migrated = tr_torrent_metainfo::migrateFile(
-        tor->session->resumeDir(),
-        tor->name(),
-        tor->infoHashString(),
-        ".resume"sv);
     if (did_migrate_filename != nullptr)
     {
-        *did_migrate_filename = migrated;
+        *did_migrate_filename = false;
     }
 
-    auto const filename = tor->resumeFile();
+    auto& journal = tor->session->resumeJournal();
     auto buf = std::vector<char>{};
-    tr_error* error = nullptr;
     auto top = tr_variant{};
-    if (!tr_loadFile(filename, buf, &error) ||
-        !tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, buf, nullptr, &error))
+    auto completed_pieces = std::vector<tr_piece_index_t>{};
+    if (journal.load(tor->infoHash(), &top, &completed_pieces))
     {
-        tr_logAddDebugTor(tor, fmt::format("Couldn't read '{}': {}", filename, error->message));
-        tr_error_clear(&error);
-        return fields_loaded;
+        tr_logAddDebugTor(tor, fmt::format("Read resume data from '{}'", journal.filename()));
     }
+    else
+    {
+        // no journal entry yet, so import the legacy .resume file if there is one
+        auto const migrated = tr_torrent_metainfo::migrateFile(
+            tor->session->resumeDir(),
+            tor->name(),
+            tor->infoHashString(),
+            ".resume"sv);
+        if (did_migrate_filename != nullptr)
+        {
+            *did_migrate_filename = migrated;
+        }
+
+        auto const filename = tor->resumeFile();
+        tr_error* error = nullptr;
+        if (!tr_loadFile(filename, buf, &error) ||
+            !tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, buf, nullptr, &error))
+        {
+            tr_logAddDebugTor(tor, fmt::format("Couldn't read '{}': {}", filename, error->message));
+            tr_error_clear(&error);
+            return fields_loaded;
+        }
 
-    tr_logAddDebugTor(tor, fmt::format("Read resume file '{}'", filename));
+        tr_logAddDebugTor(tor, fmt::format("Read resume file '{}'", filename));
+        journal.import(tor->infoHash(), &top, filename);
+    }
 
     auto i = int64_t{};
     auto sv = std::string_view{};
@@ -789,6 +832,7 @@ static auto loadFromFile(tr_torrent* tor, tr_resume::fields_t fields_to_load, bo
     if ((fields_to_load & tr_resume::Progress) != 0)
     {
         fields_loaded |= loadProgress(&top, tor);
+        loadCompletedPieces(tor, completed_pieces);
     }
 
     if (!tor->isDone() && (fields_to_load & tr_resume::FilePriorities) != 0)
@@ -943,11 +987,9 @@ void save(tr_torrent* tor)
     saveLabels(&top, tor);
     saveGroup(&top, tor);
 
-    auto const resume_file = tor->resumeFile();
-    if (auto const err = tr_variantToFile(&top, TR_VARIANT_FMT_BENC, resume_file); err != 0)
-    {
-        tor->setLocalError(fmt::format(FMT_STRING("Unable to save resume file: {:s}"), tr_strerror(err)));
-    }
+    // written in the background; if that fails, the session
+    // sets a local error and marks the torrent dirty again
+    tor->session->resumeJournal().save(tor->infoHash(), &top);
 
     tr_variantClear(&top);
 }
@@ -35,6 +35,7 @@
 #include "crypto-utils.h" /* tr_rand_buffer(), tr_ssha1_matches() */
 #include "error.h"
 #include "log.h"
+#include "metrics.h"
 #include "net.h"
 #include "platform.h" /* tr_getWebClientDir() */
 #include "quark.h"
@@ -325,6 +326,20 @@ static void handle_rpc(struct evhttp_request* req, tr_rpc_server* server)
     send_simple_response(req, 405, nullptr);
 }
 
+static void handle_metrics(struct evhttp_request* req, tr_rpc_server* server)
+{
+    if (req->type != EVHTTP_REQ_GET)
+    {
+        send_simple_response(req, 405, nullptr);
+        return;
+    }
+
+    auto* const response = make_response(req, server, tr_sessionMetrics(server->session));
+    evhttp_add_header(req->output_headers, "Content-Type", "application/openmetrics-text; version=1.0.0; charset=utf-8");
+    evhttp_send_reply(req, HTTP_OK, "OK", response);
+    evbuffer_free(response);
+}
+
 static bool isAddressAllowed(tr_rpc_server const* server, char const* address)
 {
     if (!server->isWhitelistEnabled())
@@ -506,6 +521,11 @@ static void handle_request(struct evhttp_request* req, void* arg)
                 "attacks.</p>";
             send_simple_response(req, 421, tmp);
         }
+        // read-only, so metrics scrapers needn't do the session-id dance
+        else if (location == "metrics"sv)
+        {
+            handle_metrics(req, server);
+        }
 #ifdef REQUIRE_SESSION_ID
         else if (!test_session_id(server, req))
         {
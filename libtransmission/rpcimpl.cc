@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <array>
 #include <cerrno>
+#include <chrono>
 #include <ctime>
 #include <iterator>
 #include <memory>
@@ -25,6 +26,7 @@
 #include "completion.h"
 #include "crypto-utils.h"
 #include "error.h"
+#include "event-loop-stats.h"
 #include "file.h"
 #include "log.h"
 #include "peer-mgr.h"
@@ -36,6 +38,7 @@
 #include "tr-assert.h"
 #include "tr-macros.h"
 #include "tr-strbuf.h"
+#include "tracing.h"
 #include "utils.h"
 #include "variant.h"
 #include "version.h"
@@ -69,15 +72,23 @@ struct tr_rpc_idle_data
     tr_variant* args_out = nullptr;
     tr_rpc_response_func callback = nullptr;
     void* callback_user_data = nullptr;
+    tr_latency_histogram* latency = nullptr;
+    std::chrono::steady_clock::time_point begin;
 };
 
 static auto constexpr SuccessResult = "success"sv;
 
+static void recordLatency(tr_latency_histogram& latency, std::chrono::steady_clock::time_point begin)
+{
+    latency.add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin));
+}
+
 static void tr_idle_function_done(struct tr_rpc_idle_data* data, std::string_view result)
 {
     tr_variantDictAddStr(&data->response, TR_KEY_result, result);
 
     (*data->callback)(data->session, &data->response, data->callback_user_data);
+    recordLatency(*data->latency, data->begin);
 
     tr_variantClear(&data->response);
     delete data;
@@ -435,9 +446,10 @@ static void addPeers(tr_torrent const* tor, tr_variant* list)
 
     for (int i = 0; i < peer_count; ++i)
     {
-        tr_variant* d = tr_variantListAddDict(list, 16);
+        tr_variant* d = tr_variantListAddDict(list, 17);
         tr_peer_stat const* peer = peers + i;
         tr_variantDictAddStr(d, TR_KEY_address, peer->addr);
+        tr_variantDictAddInt(d, TR_KEY_bytesQueuedToPeer, peer->bytesQueuedToPeer);
         tr_variantDictAddStr(d, TR_KEY_clientName, peer->client);
         tr_variantDictAddBool(d, TR_KEY_clientIsChoked, peer->clientIsChoked);
         tr_variantDictAddBool(d, TR_KEY_clientIsInterested, peer->clientIsInterested);
@@ -482,6 +494,10 @@ static void initField(tr_torrent const* const tor, tr_stat const* const st, tr_v
         tr_variantInitInt(initme, tr_torrentGetPriority(tor));
         break;
 
+    case TR_KEY_bytesQueuedToPeers:
+        tr_variantInitInt(initme, tr_peerMgrBytesQueuedToPeers(tor));
+        break;
+
     case TR_KEY_comment:
         tr_variantInitStr(initme, tor->comment());
         break;
@@ -2073,6 +2089,68 @@ static char const* sessionStats(
     tr_variantDictAddInt(d, TR_KEY_sessionCount, stats.sessionCount);
     tr_variantDictAddInt(d, TR_KEY_uploadedBytes, stats.uploadedBytes);
 
+    auto const memory = tr_peerMgrMemoryStats(session->peerMgr);
+    d = tr_variantDictAddDict(args_out, TR_KEY_memory_stats, 5);
+    tr_variantDictAddInt(d, TR_KEY_cacheBytes, session->cache->memoryUsage());
+    tr_variantDictAddInt(d, TR_KEY_peerBitfieldBytes, memory.bitfield_bytes);
+    tr_variantDictAddInt(d, TR_KEY_peerBufferBytes, memory.buffer_bytes);
+    tr_variantDictAddInt(d, TR_KEY_peerCount, memory.peer_count);
+    tr_variantDictAddInt(d, TR_KEY_peerObjectBytes, memory.object_bytes);
+
+    auto const lock_stats = tr_session::lockStats();
+    d = tr_variantDictAddDict(args_out, TR_KEY_lock_stats, 4);
+    tr_variantDictAddInt(d, TR_KEY_acquisitions, lock_stats.acquisitions);
+    tr_variantDictAddInt(d, TR_KEY_contendedAcquisitions, lock_stats.contended);
+    auto* list = tr_variantDictAddList(d, TR_KEY_holdTimeHistogram, std::size(lock_stats.hold_usec));
+    for (auto const count : lock_stats.hold_usec)
+    {
+        tr_variantListAddInt(list, count);
+    }
+    list = tr_variantDictAddList(d, TR_KEY_waitTimeHistogram, std::size(lock_stats.wait_usec));
+    for (auto const count : lock_stats.wait_usec)
+    {
+        tr_variantListAddInt(list, count);
+    }
+
+    auto const tracker_stats = tr_announcerStats(session->announcer);
+    d = tr_variantDictAddDict(args_out, TR_KEY_tracker_stats, 6);
+    list = tr_variantDictAddList(d, TR_KEY_announceLagHistogram, std::size(tracker_stats.announce_lag_sec));
+    for (auto const count : tracker_stats.announce_lag_sec)
+    {
+        tr_variantListAddInt(list, count);
+    }
+    tr_variantDictAddReal(d, TR_KEY_estimatedAnnouncesPerHour, tracker_stats.announces_per_hour);
+    tr_variantDictAddInt(d, TR_KEY_queuedAnnounces, tracker_stats.queued_announces);
+    tr_variantDictAddInt(d, TR_KEY_queuedScrapes, tracker_stats.queued_scrapes);
+    list = tr_variantDictAddList(d, TR_KEY_scrapeLagHistogram, std::size(tracker_stats.scrape_lag_sec));
+    for (auto const count : tracker_stats.scrape_lag_sec)
+    {
+        tr_variantListAddInt(list, count);
+    }
+    tr_variantDictAddReal(d, TR_KEY_unadjustedAnnouncesPerHour, tracker_stats.unadjusted_announces_per_hour);
+
+    auto const loop_stats = session->eventLoopStats().snapshot();
+    d = tr_variantDictAddDict(args_out, TR_KEY_event_loop_stats, 3);
+    list = tr_variantDictAddList(d, TR_KEY_callbacks, std::size(loop_stats.callbacks));
+    for (size_t i = 0; i < std::size(loop_stats.callbacks); ++i)
+    {
+        auto const& callback = loop_stats.callbacks[i];
+        auto* const callback_dict = tr_variantListAddDict(list, 3);
+        tr_variantDictAddStrView(callback_dict, TR_KEY_name, TrEventLoopCallbackNames[i]);
+        auto* histogram = tr_variantDictAddList(callback_dict, TR_KEY_durationHistogram, std::size(callback.duration.buckets));
+        for (auto const count : callback.duration.buckets)
+        {
+            tr_variantListAddInt(histogram, count);
+        }
+        histogram = tr_variantDictAddList(callback_dict, TR_KEY_lagHistogram, std::size(callback.lag.buckets));
+        for (auto const count : callback.lag.buckets)
+        {
+            tr_variantListAddInt(histogram, count);
+        }
+    }
+    tr_variantDictAddInt(d, TR_KEY_workQueueMaxDepth, loop_stats.work_queue_max_depth);
+    tr_variantDictAddInt(d, TR_KEY_workQueueTasks, loop_stats.work_queue_tasks);
+
     return nullptr;
 }
 
@@ -2414,6 +2492,32 @@ static char const* sessionClose(
 ****
 ***/
 
+static char const* traceDump(
+    tr_session* session,
+    tr_variant* /*args_in*/,
+    tr_variant* args_out,
+    tr_rpc_idle_data* /*idle_data*/)
+{
+    tr_error* error = nullptr;
+    auto const path = tr_sessionDumpTrace(session, &error);
+    if (error != nullptr)
+    {
+        tr_logAddWarn(fmt::format(
+            _("Couldn't save trace: {error} ({error_code})"),
+            fmt::arg("error", error->message),
+            fmt::arg("error_code", error->code)));
+        tr_error_clear(&error);
+        return "couldn't save trace";
+    }
+
+    tr_variantDictAddStr(args_out, TR_KEY_path, path);
+    return nullptr;
+}
+
+/***
+****
+***/
+
 using handler = char const* (*)(tr_session*, tr_variant*, tr_variant*, struct tr_rpc_idle_data*);
 
 struct rpc_method
@@ -2423,7 +2527,7 @@ struct rpc_method
     handler func;
 };
 
-static auto constexpr Methods = std::array<rpc_method, 24>{ {
+static auto constexpr Methods = std::array<rpc_method, 25>{ {
     { "blocklist-update"sv, false, blocklistUpdate },
     { "free-space"sv, true, freeSpace },
     { "group-get"sv, true, groupGet },
@@ -2448,8 +2552,21 @@ static auto constexpr Methods = std::array<rpc_method, 24>{ {
     { "torrent-start-now"sv, true, torrentStartNow },
     { "torrent-stop"sv, true, torrentStop },
     { "torrent-verify"sv, true, torrentVerify },
+    { "trace-dump"sv, true, traceDump },
 } };
 
+// indexed the same as `Methods`
+static auto method_latencies = std::array<tr_latency_histogram, std::size(Methods)>{};
+
+// so that trace dumps can show which method a RpcRequest's index refers to
+static void nameMethodsInTraces()
+{
+    for (size_t i = 0; i < std::size(Methods); ++i)
+    {
+        tr_traceSetArgName(tr_trace_event::RpcRequest, i, Methods[i].name);
+    }
+}
+
 static void noop_response_callback(tr_session* /*session*/, tr_variant* /*response*/, void* /*user_data*/)
 {
 }
@@ -2460,6 +2577,8 @@ void tr_rpc_request_exec_json(
     tr_rpc_response_func callback,
     void* callback_user_data)
 {
+    [[maybe_unused]] static auto const methods_named = (nameMethodsInTraces(), true);
+
     auto* const mutable_request = const_cast<tr_variant*>(request);
     tr_variant* args_in = tr_variantDictFind(mutable_request, TR_KEY_arguments);
     char const* result = nullptr;
@@ -2508,6 +2627,9 @@ void tr_rpc_request_exec_json(
     }
     else if (method->immediate)
     {
+        auto const method_index = static_cast<size_t>(method - std::data(Methods));
+        auto const trace = tr_trace_scope{ tr_trace_event::RpcRequest, method_index };
+        auto const begin = std::chrono::steady_clock::now();
         auto response = tr_variant{};
         tr_variantInitDict(&response, 3);
         tr_variant* const args_out = tr_variantDictAddDict(&response, TR_KEY_arguments, 0);
@@ -2526,11 +2648,13 @@ void tr_rpc_request_exec_json(
         }
 
         (*callback)(session, &response, callback_user_data);
+        recordLatency(method_latencies[method_index], begin);
 
         tr_variantClear(&response);
     }
     else
     {
+        auto const method_index = static_cast<size_t>(method - std::data(Methods));
         auto* const data = new tr_rpc_idle_data{};
         data->session = session;
         tr_variantInitDict(&data->response, 3);
@@ -2543,6 +2667,9 @@ void tr_rpc_request_exec_json(
         data->args_out = tr_variantDictAddDict(&data->response, TR_KEY_arguments, 0);
         data->callback = callback;
         data->callback_user_data = callback_user_data;
+        data->latency = &method_latencies[method_index];
+        data->begin = std::chrono::steady_clock::now();
+        auto const trace = tr_trace_scope{ tr_trace_event::RpcRequest, method_index };
         result = (*method->func)(session, args_in, data->args_out, data);
 
         /* Async operation failed prematurely? Invoke callback or else client will not get a reply */
@@ -2553,6 +2680,17 @@ void tr_rpc_request_exec_json(
     }
 }
 
+std::vector<std::pair<std::string_view, tr_latency_histogram::Snapshot>> tr_rpcLatencyStats()
+{
+    auto stats = std::vector<std::pair<std::string_view, tr_latency_histogram::Snapshot>>{};
+    stats.reserve(std::size(Methods));
+    for (size_t i = 0; i < std::size(Methods); ++i)
+    {
+        stats.emplace_back(Methods[i].name, method_latencies[i].snapshot());
+    }
+    return stats;
+}
+
 /**
  * Munge the URI into a usable form.
  *
@@ -6,9 +6,13 @@
 #pragma once
 
 #include <string_view>
+#include <utility> // std::pair
+#include <vector>
 
 #include "transmission.h"
 
+#include "metrics.h"
+
 /***
 ****  RPC processing
 ***/
@@ -25,3 +29,6 @@ void tr_rpc_request_exec_json(
     void* callback_user_data);
 
 void tr_rpc_parse_list_str(tr_variant* setme, std::string_view str);
+
+// How long each RPC method took to answer, by method name
+[[nodiscard]] std::vector<std::pair<std::string_view, tr_latency_histogram::Snapshot>> tr_rpcLatencyStats();
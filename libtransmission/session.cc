@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm> // std::partial_sort(), std::min(), std::max()
+#include <atomic>
 #include <climits> /* INT_MAX */
 #include <condition_variable>
 #include <csignal>
@@ -56,6 +57,7 @@
 #include "tr-lpd.h"
 #include "tr-strbuf.h"
 #include "tr-utp.h"
+#include "tracing.h"
 #include "trevent.h"
 #include "utils.h"
 #include "variant.h"
@@ -65,7 +67,7 @@
 
 using namespace std::literals;
 
-std::recursive_mutex tr_session::session_mutex_;
+tr_instrumented_recursive_mutex tr_session::session_mutex_;
 
 static auto constexpr DefaultBindAddressIpv4 = "0.0.0.0"sv;
 static auto constexpr DefaultBindAddressIpv6 = "::"sv;
@@ -283,16 +285,41 @@ void tr_bindinfo::close()
     }
 }
 
-static void acceptIncomingPeer(evutil_socket_t fd, short /*what*/, void* vsession)
+// A popular torrent can bring thousands of incoming connections per second,
+// so accept everything that's waiting instead of one per wakeup. The cap keeps
+// a flood of them from starving the rest of the event loop.
+static auto constexpr MaxAcceptsPerWakeup = int{ 32 };
+
+static void acceptIncomingPeers(evutil_socket_t fd, short /*what*/, void* vsession)
 {
     auto* session = static_cast<tr_session*>(vsession);
 
-    auto client_addr = tr_address{};
-    auto client_port = tr_port{};
-    auto const client_socket = tr_netAccept(session, fd, &client_addr, &client_port);
-
-    if (client_socket != TR_BAD_SOCKET)
+    for (int i = 0; i < MaxAcceptsPerWakeup; ++i)
     {
+        auto client_addr = tr_address{};
+        auto client_port = tr_port{};
+        auto const client_socket = tr_netAccept(fd, &client_addr, &client_port);
+        if (client_socket == TR_BAD_SOCKET)
+        {
+            break;
+        }
+
+        auto const lock = session->unique_lock();
+
+        // drop the connections we'd refuse anyway before allocating anything for them
+        if (session->addressIsBlocked(client_addr))
+        {
+            tr_logAddTrace(fmt::format("Banned IP address '{}' tried to connect to us", client_addr.readable(client_port)));
+            tr_netCloseSocket(client_socket);
+            continue;
+        }
+
+        if (!session->incPeerCount())
+        {
+            tr_netCloseSocket(client_socket);
+            continue;
+        }
+
         tr_logAddTrace(fmt::format("new incoming connection {} ({})", client_socket, client_addr.readable(client_port)));
 
         tr_peerMgrAddIncoming(session->peerMgr, &client_addr, client_port, tr_peer_socket_tcp_create(client_socket));
@@ -310,7 +337,7 @@ void tr_bindinfo::bindAndListenForIncomingPeers(tr_session* session)
         tr_logAddInfo(fmt::format(
             _("Listening to incoming peer connections on {hostport}"),
             fmt::arg("hostport", addr_.readable(session->private_peer_port))));
-        ev_ = event_new(session->eventBase(), socket_, EV_READ | EV_PERSIST, acceptIncomingPeer, session);
+        ev_ = event_new(session->eventBase(), socket_, EV_READ | EV_PERSIST, acceptIncomingPeers, session);
         event_add(ev_, nullptr);
     }
 }
@@ -377,6 +404,7 @@ void tr_sessionGetDefaultSettings(tr_variant* setme_dictionary)
     tr_variantDictAddInt(d, TR_KEY_speed_limit_down, 100);
     tr_variantDictAddBool(d, TR_KEY_speed_limit_down_enabled, false);
     tr_variantDictAddInt(d, TR_KEY_encryption, TR_DEFAULT_ENCRYPTION);
+    tr_variantDictAddInt(d, TR_KEY_event_loop_stats_log_interval, 0);
     tr_variantDictAddInt(d, TR_KEY_idle_seeding_limit, 30);
     tr_variantDictAddBool(d, TR_KEY_idle_seeding_limit_enabled, false);
     tr_variantDictAddStr(d, TR_KEY_incomplete_dir, download_dir);
@@ -396,6 +424,7 @@ void tr_sessionGetDefaultSettings(tr_variant* setme_dictionary)
     tr_variantDictAddInt(d, TR_KEY_preallocation, TR_PREALLOCATE_SPARSE);
     tr_variantDictAddBool(d, TR_KEY_prefetch_enabled, DefaultPrefetchEnabled);
     tr_variantDictAddInt(d, TR_KEY_peer_id_ttl_hours, 6);
+    tr_variantDictAddInt(d, TR_KEY_peer_io_threads, 0);
     tr_variantDictAddBool(d, TR_KEY_queue_stalled_enabled, true);
     tr_variantDictAddInt(d, TR_KEY_queue_stalled_minutes, 30);
     tr_variantDictAddReal(d, TR_KEY_ratio_limit, 2.0);
@@ -463,6 +492,7 @@ void tr_sessionGetSettings(tr_session const* s, tr_variant* setme_dictionary)
     tr_variantDictAddInt(d, TR_KEY_speed_limit_down, tr_sessionGetSpeedLimit_KBps(s, TR_DOWN));
     tr_variantDictAddBool(d, TR_KEY_speed_limit_down_enabled, s->isSpeedLimited(TR_DOWN));
     tr_variantDictAddInt(d, TR_KEY_encryption, s->encryptionMode());
+    tr_variantDictAddInt(d, TR_KEY_event_loop_stats_log_interval, s->eventLoopStatsLogInterval().count());
     tr_variantDictAddInt(d, TR_KEY_idle_seeding_limit, s->idleLimitMinutes());
     tr_variantDictAddBool(d, TR_KEY_idle_seeding_limit_enabled, s->isIdleLimited());
     tr_variantDictAddStr(d, TR_KEY_incomplete_dir, tr_sessionGetIncompleteDir(s));
@@ -481,6 +511,7 @@ void tr_sessionGetSettings(tr_session const* s, tr_variant* setme_dictionary)
     tr_variantDictAddInt(d, TR_KEY_preallocation, s->preallocationMode());
     tr_variantDictAddBool(d, TR_KEY_prefetch_enabled, s->allowsPrefetch());
     tr_variantDictAddInt(d, TR_KEY_peer_id_ttl_hours, s->peerIdTTLHours());
+    tr_variantDictAddInt(d, TR_KEY_peer_io_threads, s->peerIoThreads());
     tr_variantDictAddBool(d, TR_KEY_queue_stalled_enabled, s->queueStalledEnabled());
     tr_variantDictAddInt(d, TR_KEY_queue_stalled_minutes, s->queueStalledMinutes());
     tr_variantDictAddReal(d, TR_KEY_ratio_limit, s->desiredRatio());
@@ -664,6 +695,29 @@ tr_session* tr_sessionInit(char const* config_dir, bool message_queueing_enabled
     return session;
 }
 
+// The journal couldn't write these torrents' latest resume records.
+// Save them again in full, and let the user know.
+void tr_session::onResumeSaveFailed(std::vector<tr_sha1_digest_t> const& info_hashes, std::string_view error)
+{
+    auto const lock = unique_lock();
+
+    if (!resume_journal_)
+    {
+        return;
+    }
+
+    for (auto const& info_hash : info_hashes)
+    {
+        resume_journal_->markUnsaved(info_hash);
+
+        if (auto* const tor = torrents().get(info_hash); tor != nullptr)
+        {
+            tor->setLocalError(fmt::format(FMT_STRING("Unable to save resume file: {:s}"), error));
+            tor->setDirty();
+        }
+    }
+}
+
 static void turtleCheckClock(tr_session* s, struct tr_turtle_info* t);
 
 void tr_session::onNowTimer()
@@ -707,6 +761,51 @@ void tr_session::onNowTimer()
     now_timer_->setInterval(std::chrono::duration_cast<std::chrono::milliseconds>(target_interval));
 }
 
+void tr_session::setPeerIoThreads(size_t n_threads)
+{
+    n_threads = std::min(n_threads, tr_peer_reactors::MaxReactors);
+
+    if (n_threads == peerIoThreads())
+    {
+        return;
+    }
+
+    // Connected peers keep the reactor they're on, so this
+    // only changes where new connections are polled.
+    peer_reactors_ = n_threads > 0U ? std::make_unique<tr_peer_reactors>(n_threads) : nullptr;
+}
+
+void tr_session::setEventLoopStatsLogInterval(std::chrono::seconds interval)
+{
+    event_loop_stats_log_interval_ = interval;
+
+    if (interval <= 0s)
+    {
+        event_loop_stats_timer_.reset();
+        return;
+    }
+
+    if (!event_loop_stats_timer_)
+    {
+        event_loop_stats_timer_ = timerMaker().create([this]() { onEventLoopStatsTimer(); });
+        event_loop_stats_logged_ = event_loop_stats_.snapshot();
+    }
+
+    event_loop_stats_timer_->startRepeating(interval);
+}
+
+void tr_session::onEventLoopStatsTimer()
+{
+    auto const now = event_loop_stats_.snapshot();
+
+    for (auto const& line : tr_event_loop_stats::describe(now, event_loop_stats_logged_))
+    {
+        tr_logAddInfo(fmt::format("Event loop: {}", line));
+    }
+
+    event_loop_stats_logged_ = now;
+}
+
 void tr_session::initImpl(init_data& data)
 {
     auto lock = unique_lock();
@@ -886,6 +985,16 @@ void tr_session::setImpl(init_data& data)
         this->peer_id_ttl_hours_ = i;
     }
 
+    if (tr_variantDictFindInt(settings, TR_KEY_peer_io_threads, &i))
+    {
+        setPeerIoThreads(static_cast<size_t>(std::max(i, int64_t{})));
+    }
+
+    if (tr_variantDictFindInt(settings, TR_KEY_event_loop_stats_log_interval, &i))
+    {
+        setEventLoopStatsLogInterval(std::chrono::seconds{ std::max(i, int64_t{}) });
+    }
+
     /* torrent queues */
     if (tr_variantDictFindInt(settings, TR_KEY_queue_stalled_minutes, &i))
     {
@@ -1198,6 +1307,25 @@ char const* tr_sessionGetConfigDir(tr_session const* session)
     return session->configDir().c_str();
 }
 
+std::string tr_sessionDumpTrace(tr_session* session, tr_error** error)
+{
+    TR_ASSERT(session != nullptr);
+
+    // the counter keeps names unique when dumps come faster than the clock ticks
+    static auto n_dumps = std::atomic<unsigned>{};
+    auto const filename = tr_pathbuf{
+        session->configDir(),
+        fmt::format(FMT_STRING("/trace-{:d}-{:d}.trtrace"), tr_time_msec(), ++n_dumps),
+    };
+    if (!tr_traceDump(filename, error))
+    {
+        return {};
+    }
+
+    tr_logAddInfo(fmt::format(_("Wrote trace to '{path}'"), fmt::arg("path", filename)));
+    return std::string{ filename.sv() };
+}
+
 /***
 ****
 ***/
@@ -1811,8 +1939,12 @@ void tr_session::closeImplStart()
 
     save_timer_.reset();
     now_timer_.reset();
+    event_loop_stats_timer_.reset();
 
     verifier_.reset();
+    // the torrents' cached blocks will be written without the worker
+    preallocator_.reset();
+    crypto_worker_.reset();
     port_forwarding_.reset();
 
     close_incoming_peer_port(this);
@@ -1879,7 +2011,9 @@ void tr_session::closeImplFinish()
     this->udp_core_.reset();
 
     stats().saveIfDirty();
+    resume_journal_.reset();
     tr_peerMgrFree(peerMgr);
+    peer_reactors_.reset();
     tr_utpClose(this);
     blocklists_.clear();
     openFiles().closeAll();
@@ -2735,7 +2869,13 @@ static int bandwidthGroupWrite(tr_session const* session, std::string_view confi
 
 void tr_session::closeTorrentFiles(tr_torrent* tor) noexcept
 {
+    // Stop preallocating, then write out the blocks that were waiting on it.
+    // They're already counted as downloaded, so they can't be dropped, and
+    // their files can't be queued again; see canPreallocateInBackground().
+    preallocateRemove(tor->id());
+    is_closing_torrent_files_ = true;
     this->cache->flushTorrent(tor);
+    is_closing_torrent_files_ = false;
     openFiles().closeTorrent(tor->id());
 }
 
@@ -2815,7 +2955,16 @@ auto makeTorrentDir(std::string_view config_dir)
 auto makeEventBase()
 {
     tr_evthread_init();
-    return std::unique_ptr<event_base, void (*)(event_base*)>{ event_base_new(), event_base_free };
+
+    // Peers' events get enabled and disabled many times per loop iteration
+    // as bandwidth is handed out. With epoll, queue those changes up and
+    // make one epoll_ctl() call per socket per iteration instead.
+    auto* const config = event_config_new();
+    event_config_set_flag(config, EVENT_BASE_FLAG_EPOLL_USE_CHANGELIST);
+    auto* const base = event_base_new_with_config(config);
+    event_config_free(config);
+
+    return std::unique_ptr<event_base, void (*)(event_base*)>{ base, event_base_free };
 }
 
 } // namespace
@@ -2834,16 +2983,28 @@ tr_session::tr_session(std::string_view config_dir)
     , resume_dir_{ makeResumeDir(config_dir) }
     , torrent_dir_{ makeTorrentDir(config_dir) }
     , session_stats_{ config_dir, time(nullptr) }
+    , resume_journal_{ std::make_unique<tr_resume_journal>(
+          resume_dir_,
+          [this](std::vector<tr_sha1_digest_t> const& info_hashes, std::string_view error)
+          {
+              tr_runInEventThread(
+                  this,
+                  [this, info_hashes, error = std::string{ error }]() { onResumeSaveFailed(info_hashes, error); });
+          }) }
 {
     now_timer_ = timerMaker().create([this]() { onNowTimer(); });
     now_timer_->startRepeating(1s);
 
-    // Periodically save the .resume files of any torrents whose
+    // Periodically save the resume data of any torrents whose
     // status has recently changed. This prevents loss of metadata
     // in the case of a crash, unclean shutdown, clumsy user, etc.
     save_timer_ = timerMaker().create(
         [this]()
         {
+            auto const loop_scope = tr_event_loop_stats::Scope{ event_loop_stats_,
+                                                                tr_event_loop_callback::SessionSave,
+                                                                save_timer_->lateness() };
+
             for (auto* const tor : torrents())
             {
                 tr_torrentSave(tor);
@@ -2854,4 +3015,9 @@ tr_session::tr_session(std::string_view config_dir)
     save_timer_->startRepeating(SaveIntervalSecs);
 
     verifier_->addCallback(tr_torrentOnVerifyDone);
+    preallocator_->addCallback([this](tr_torrent_id_t tor_id, tr_file_index_t file_num, int error)
+                               { tr_torrentOnPreallocateDone(this, tor_id, file_num, error); });
+
+    crypto_worker_ = std::make_unique<tr_crypto_worker>([this](tr_crypto_worker::func_t func)
+                                                        { tr_runInEventThread(this, std::move(func)); });
 }
@@ -12,8 +12,10 @@
 #define TR_NAME "Transmission"
 
 #include <array>
+#include <chrono>
 #include <cstddef> // size_t
 #include <cstdint> // uintX_t
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -29,11 +31,19 @@
 #include "bandwidth.h"
 #include "bitfield.h"
 #include "cache.h"
+#include "crypto-worker.h"
+#include "event-loop-stats.h"
+#include "instrumented-mutex.h"
 #include "interned-string.h"
 #include "net.h" // tr_socket_t
 #include "open-files.h"
+#include "outbuf-budget.h"
+#include "peer-mse.h"
+#include "peer-reactor.h"
 #include "port-forwarding.h"
+#include "preallocate.h"
 #include "quark.h"
+#include "resume-journal.h"
 #include "session-id.h"
 #include "stats.h"
 #include "torrents.h"
@@ -176,6 +186,12 @@ public:
         return std::unique_lock(session_mutex_);
     }
 
+    // how long threads wait for, and hold, the lock returned by unique_lock()
+    [[nodiscard]] static auto lockStats()
+    {
+        return session_mutex_.stats();
+    }
+
     // paths
 
     [[nodiscard]] constexpr auto const& configDir() const noexcept
@@ -316,6 +332,16 @@ public:
         tr_netSetTOS(sock, peer_socket_tos_, type);
     }
 
+    [[nodiscard]] constexpr auto& outbufBudget() noexcept
+    {
+        return outbuf_budget_;
+    }
+
+    [[nodiscard]] constexpr auto const& outbufBudget() const noexcept
+    {
+        return outbuf_budget_;
+    }
+
     [[nodiscard]] constexpr bool incPeerCount() noexcept
     {
         if (this->peer_count_ >= this->peer_limit_)
@@ -335,6 +361,20 @@ public:
         }
     }
 
+    // the threads that poll TCP peer sockets, or nullptr if
+    // they're polled by the event thread like everything else
+    [[nodiscard]] tr_peer_reactors const* peerReactors() const noexcept
+    {
+        return peer_reactors_.get();
+    }
+
+    [[nodiscard]] size_t peerIoThreads() const noexcept
+    {
+        return peer_reactors_ ? peer_reactors_->size() : 0U;
+    }
+
+    void setPeerIoThreads(size_t n_threads);
+
     // bandwidth
 
     [[nodiscard]] tr_bandwidth& getBandwidthGroup(std::string_view name);
@@ -349,6 +389,25 @@ public:
     void closeTorrentFiles(tr_torrent* tor) noexcept;
     void closeTorrentFile(tr_torrent* tor, tr_file_index_t file_num) noexcept;
 
+    // keypairs for encrypted peer handshakes
+
+    [[nodiscard]] constexpr auto& mseKeys() noexcept
+    {
+        return mse_keys_;
+    }
+
+    // Runs `work` on a crypto worker thread, then `done` on the event thread.
+    // @return false if there's no worker, e.g. because the session is closing
+    [[nodiscard]] bool runCrypto(std::function<void()> work, std::function<void()> done)
+    {
+        return crypto_worker_ && crypto_worker_->add(std::move(work), std::move(done));
+    }
+
+    [[nodiscard]] tr_crypto_worker::Stats cryptoStats()
+    {
+        return crypto_worker_ ? crypto_worker_->stats() : tr_crypto_worker::Stats{};
+    }
+
     // announce ip
 
     [[nodiscard]] constexpr auto const& announceIP() const noexcept
@@ -445,6 +504,13 @@ public:
         }
     }
 
+    /// resume
+
+    [[nodiscard]] auto& resumeJournal() noexcept
+    {
+        return *resume_journal_;
+    }
+
     /// stats
 
     [[nodiscard]] constexpr auto& stats() noexcept
@@ -457,6 +523,24 @@ public:
         return session_stats_;
     }
 
+    [[nodiscard]] constexpr auto& eventLoopStats() noexcept
+    {
+        return event_loop_stats_;
+    }
+
+    [[nodiscard]] constexpr auto const& eventLoopStats() const noexcept
+    {
+        return event_loop_stats_;
+    }
+
+    // how often to log a summary of eventLoopStats(), or 0s to never log it
+    [[nodiscard]] constexpr auto eventLoopStatsLogInterval() const noexcept
+    {
+        return event_loop_stats_log_interval_;
+    }
+
+    void setEventLoopStatsLogInterval(std::chrono::seconds interval);
+
     void addUploaded(uint32_t n_bytes) noexcept
     {
         session_stats_.addUploaded(n_bytes);
@@ -667,6 +751,19 @@ public:
 
     [[nodiscard]] bool allowsUTP() const noexcept;
 
+    // Off by default. Lets several sessions on one machine, e.g. in
+    // benchmarks, be each other's peers over 127.0.0.1. Loopback peers
+    // are told apart by port, since they all share one address.
+    [[nodiscard]] constexpr auto allowsLoopbackPeers() const noexcept
+    {
+        return is_loopback_peers_enabled_;
+    }
+
+    constexpr void setAllowsLoopbackPeers(bool enabled) noexcept
+    {
+        is_loopback_peers_enabled_ = enabled;
+    }
+
     [[nodiscard]] constexpr auto allowsPrefetch() const noexcept
     {
         return is_prefetch_enabled_;
@@ -771,6 +868,56 @@ public:
         }
     }
 
+    [[nodiscard]] tr_verify_worker::Stats verifyStats()
+    {
+        return verifier_ ? verifier_->stats() : tr_verify_worker::Stats{};
+    }
+
+    void preallocateAdd(tr_torrent_id_t tor_id, tr_file_index_t file_num, std::string_view filename, uint64_t file_size)
+    {
+        if (preallocator_)
+        {
+            preallocator_->add(tor_id, file_num, filename, file_size);
+        }
+    }
+
+    void preallocateRemove(tr_torrent_id_t tor_id)
+    {
+        if (preallocator_)
+        {
+            preallocator_->remove(tor_id);
+        }
+    }
+
+    [[nodiscard]] bool isPreallocating(tr_torrent_id_t tor_id, tr_file_index_t file_begin, tr_file_index_t file_end)
+    {
+        return preallocator_ && preallocator_->isBusy(tor_id, file_begin, file_end);
+    }
+
+    // @return true if the file is still being preallocated, after moving it
+    // to the front of the worker's queue since something is waiting on it
+    [[nodiscard]] bool preallocatePrioritize(tr_torrent_id_t tor_id, tr_file_index_t file_num)
+    {
+        return preallocator_ && preallocator_->prioritize(tor_id, file_num);
+    }
+
+    // False once the worker is gone, or while a torrent's files are being
+    // closed: those writes can't wait for the worker to get to them.
+    [[nodiscard]] bool canPreallocateInBackground() const noexcept
+    {
+        return preallocator_ && !is_closing_ && !is_closing_torrent_files_;
+    }
+
+    [[nodiscard]] bool preallocateFailed(tr_torrent_id_t tor_id, tr_file_index_t file_num)
+    {
+        return preallocator_ && preallocator_->hasFailed(tor_id, file_num);
+    }
+
+    [[nodiscard]] tr_preallocate_worker::Stats preallocateStats()
+    {
+        return preallocator_ ? preallocator_->stats() : tr_preallocate_worker::Stats{};
+    }
+
 private:
     [[nodiscard]] tr_port randomPort() const;
 
@@ -829,7 +976,7 @@ private:
     friend void tr_sessionSetSpeedLimit_Bps(tr_session* session, tr_direction dir, unsigned int bytes_per_second);
     friend void tr_sessionSetUTPEnabled(tr_session* session, bool enabled);
 
-    static std::recursive_mutex session_mutex_;
+    static tr_instrumented_recursive_mutex session_mutex_;
 
     std::vector<std::unique_ptr<BlocklistFile>> blocklists_;
 
@@ -877,12 +1024,14 @@ private:
 
     bool is_closing_ = false;
     bool is_closed_ = false;
+    bool is_closing_torrent_files_ = false;
 
     bool is_utp_enabled_ = false;
     bool is_pex_enabled_ = false;
     bool is_dht_enabled_ = false;
     bool is_lpd_enabled_ = false;
     bool is_tcp_enabled_ = true;
+    bool is_loopback_peers_enabled_ = false;
 
     bool is_idle_limited_ = false;
     bool is_prefetch_enabled_ = false;
@@ -996,12 +1145,21 @@ private:
     void onNowTimer();
     std::unique_ptr<libtransmission::Timer> now_timer_;
 
+    void onResumeSaveFailed(std::vector<tr_sha1_digest_t> const& info_hashes, std::string_view error);
+
     std::unique_ptr<libtransmission::Timer> save_timer_;
 
+    void onEventLoopStatsTimer();
+    std::unique_ptr<libtransmission::Timer> event_loop_stats_timer_;
+    std::chrono::seconds event_loop_stats_log_interval_ = {};
+    tr_event_loop_stats::Snapshot event_loop_stats_logged_;
+
     tr_torrents torrents_;
 
     std::unique_ptr<tr_verify_worker> verifier_ = std::make_unique<tr_verify_worker>();
 
+    std::unique_ptr<tr_preallocate_worker> preallocator_ = std::make_unique<tr_preallocate_worker>();
+
     std::array<std::string, TR_SCRIPT_N_TYPES> scripts_;
 
     std::string const config_dir_;
@@ -1014,8 +1172,14 @@ private:
     std::string default_trackers_str_;
     std::string peer_congestion_algorithm_;
 
+    tr_outbuf_budget outbuf_budget_;
+
     tr_stats session_stats_;
 
+    tr_event_loop_stats event_loop_stats_;
+
+    std::unique_ptr<tr_resume_journal> resume_journal_;
+
     std::optional<tr_address> external_ip_;
 
     queue_start_callback_t queue_start_callback_ = nullptr;
@@ -1039,6 +1203,12 @@ private:
 
     tr_open_files open_files_;
 
+    tr_message_stream_encryption::KeyPool mse_keys_;
+
+    std::unique_ptr<tr_crypto_worker> crypto_worker_;
+
+    std::unique_ptr<tr_peer_reactors> peer_reactors_;
+
     std::string announce_ip_;
     bool announce_ip_enabled_ = false;
 
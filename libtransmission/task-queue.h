@@ -0,0 +1,334 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <atomic>
+#include <cstddef> // size_t, std::byte, std::max_align_t
+#include <iterator> // std::make_move_iterator
+#include <memory> // std::unique_ptr
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tr-assert.h"
+
+/**
+ * A move-only `void()` callable, like a `std::function` that doesn't
+ * allocate for small closures.
+ *
+ * Closures up to InlineSize bytes that can be moved without throwing
+ * are stored in the object itself; anything else goes on the heap.
+ */
+class tr_task
+{
+public:
+    static auto constexpr InlineSize = size_t{ 64U };
+
+    tr_task() noexcept = default;
+
+    template<typename Func, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Func>, tr_task>>>
+    tr_task(Func&& func) // NOLINT(google-explicit-constructor, bugprone-forwarding-reference-overload)
+    {
+        using Fn = std::decay_t<Func>;
+
+        if constexpr (fitsInline<Fn>())
+        {
+            new (&storage_) Fn(std::forward<Func>(func));
+            ops_ = &InlineOps<Fn>;
+        }
+        else
+        {
+            new (&storage_) Fn*(new Fn(std::forward<Func>(func)));
+            ops_ = &HeapOps<Fn>;
+        }
+    }
+
+    tr_task(tr_task&& that) noexcept
+    {
+        moveFrom(that);
+    }
+
+    tr_task& operator=(tr_task&& that) noexcept
+    {
+        if (this != &that)
+        {
+            reset();
+            moveFrom(that);
+        }
+
+        return *this;
+    }
+
+    tr_task(tr_task const&) = delete;
+    tr_task& operator=(tr_task const&) = delete;
+
+    ~tr_task()
+    {
+        reset();
+    }
+
+    void operator()()
+    {
+        TR_ASSERT(ops_ != nullptr);
+        ops_->run(&storage_);
+    }
+
+    [[nodiscard]] explicit operator bool() const noexcept
+    {
+        return ops_ != nullptr;
+    }
+
+    // True if the closure is stored in this object instead of on the heap.
+    [[nodiscard]] bool isInline() const noexcept
+    {
+        return ops_ != nullptr && ops_->is_inline;
+    }
+
+    void reset() noexcept
+    {
+        if (ops_ != nullptr)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops
+    {
+        void (*run)(void* storage);
+        void (*move)(void* from, void* to);
+        void (*destroy)(void* storage);
+        bool is_inline;
+    };
+
+    template<typename Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= InlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+            std::is_nothrow_move_constructible_v<Fn>;
+    }
+
+    template<typename Fn>
+    static inline Ops const InlineOps = {
+        [](void* storage) { (*static_cast<Fn*>(storage))(); },
+        [](void* from, void* to)
+        {
+            new (to) Fn(std::move(*static_cast<Fn*>(from)));
+            static_cast<Fn*>(from)->~Fn();
+        },
+        [](void* storage) { static_cast<Fn*>(storage)->~Fn(); },
+        true,
+    };
+
+    template<typename Fn>
+    static inline Ops const HeapOps = {
+        [](void* storage) { (**static_cast<Fn**>(storage))(); },
+        [](void* from, void* to) { new (to) Fn*(*static_cast<Fn**>(from)); },
+        [](void* storage) { delete *static_cast<Fn**>(storage); },
+        false,
+    };
+
+    void moveFrom(tr_task& that) noexcept
+    {
+        if (that.ops_ != nullptr)
+        {
+            that.ops_->move(&that.storage_, &storage_);
+            ops_ = that.ops_;
+            that.ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) std::byte storage_[InlineSize];
+    Ops const* ops_ = nullptr;
+};
+
+/**
+ * A queue of tasks posted by any number of threads and run by one.
+ *
+ * Posting a task is lock-free as long as there's room in the ring buffer.
+ * If the consumer falls so far behind that the ring fills up, tasks go to
+ * a mutex-guarded overflow list until the consumer catches up, so posting
+ * never blocks waiting for the consumer. Either way, each producer's tasks
+ * are run in the order they were posted.
+ *
+ * `push()` returns true only when the consumer needs to be woken up, so a
+ * burst of posts between two drains costs a single wakeup.
+ *
+ * Tasks still queued when the queue is destroyed are destroyed unrun.
+ */
+class tr_task_queue
+{
+public:
+    static auto constexpr DefaultCapacity = size_t{ 1024U };
+
+    explicit tr_task_queue(size_t capacity = DefaultCapacity)
+        : cells_{ std::make_unique<Cell[]>(capacity) }
+        , mask_{ capacity - 1U }
+    {
+        TR_ASSERT(capacity >= 2U);
+        TR_ASSERT((capacity & mask_) == 0U); // must be a power of two
+
+        for (size_t i = 0; i < capacity; ++i)
+        {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    tr_task_queue(tr_task_queue const&) = delete;
+    tr_task_queue& operator=(tr_task_queue const&) = delete;
+
+    // Safe to call from any thread.
+    // Returns true if the consumer should be woken up to drain the queue.
+    [[nodiscard]] bool push(tr_task&& task)
+    {
+        if (has_overflow_.load(std::memory_order_acquire) || !tryPush(task))
+        {
+            auto const lock = std::lock_guard{ overflow_mutex_ };
+            overflow_.emplace_back(std::move(task));
+            has_overflow_.store(true, std::memory_order_release);
+        }
+
+        return !wakeup_pending_.exchange(true, std::memory_order_acq_rel);
+    }
+
+    // Only call this from the consumer thread.
+    // Runs every task that was posted before the call.
+    // Returns how many tasks were run.
+    size_t drain()
+    {
+        // any push that finishes after this will ask for another wakeup
+        wakeup_pending_.exchange(false, std::memory_order_acq_rel);
+
+        auto n_run = size_t{};
+
+        while (auto task = pop())
+        {
+            task();
+            ++n_run;
+        }
+
+        if (!has_overflow_.load(std::memory_order_acquire))
+        {
+            return n_run;
+        }
+
+        auto batch = std::vector<tr_task>{};
+
+        {
+            auto const lock = std::lock_guard{ overflow_mutex_ };
+
+            // Tasks that made it into the ring before the overflow began
+            // must run first. Wait out any push still filling its cell.
+            for (;;)
+            {
+                if (auto task = pop(); task)
+                {
+                    batch.emplace_back(std::move(task));
+                }
+                else if (enqueue_pos_.load(std::memory_order_acquire) == dequeue_pos_)
+                {
+                    break;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            batch.insert(
+                std::end(batch),
+                std::make_move_iterator(std::begin(overflow_)),
+                std::make_move_iterator(std::end(overflow_)));
+            overflow_.clear();
+            has_overflow_.store(false, std::memory_order_release);
+        }
+
+        for (auto& task : batch)
+        {
+            task();
+        }
+
+        return n_run + std::size(batch);
+    }
+
+    [[nodiscard]] constexpr auto capacity() const noexcept
+    {
+        return mask_ + 1U;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq = {};
+        tr_task task;
+    };
+
+    // Dmitry Vyukov's bounded MPMC queue, used here with a single consumer.
+    // Each cell's `seq` says whose turn it is: a producer may fill the cell
+    // when `seq == pos`, and the consumer may empty it when `seq == pos + 1`.
+    bool tryPush(tr_task& task)
+    {
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            auto& cell = cells_[pos & mask_];
+            auto const seq = cell.seq.load(std::memory_order_acquire);
+
+            if (seq == pos)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1U, std::memory_order_relaxed))
+                {
+                    cell.task = std::move(task);
+                    cell.seq.store(pos + 1U, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (seq < pos)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns an empty task if the next cell isn't filled yet.
+    tr_task pop()
+    {
+        auto& cell = cells_[dequeue_pos_ & mask_];
+        if (cell.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1U)
+        {
+            return {};
+        }
+
+        auto task = std::move(cell.task);
+        cell.seq.store(dequeue_pos_ + mask_ + 1U, std::memory_order_release);
+        ++dequeue_pos_;
+        return task;
+    }
+
+    std::unique_ptr<Cell[]> const cells_;
+    size_t const mask_;
+
+    alignas(64) std::atomic<size_t> enqueue_pos_ = {};
+    alignas(64) size_t dequeue_pos_ = 0;
+
+    std::atomic<bool> wakeup_pending_ = false;
+    std::atomic<bool> has_overflow_ = false;
+    std::mutex overflow_mutex_;
+    std::vector<tr_task> overflow_;
+};
@@ -3,6 +3,7 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm> // std::max
 #include <chrono>
 #include <memory>
 #include <utility>
@@ -75,6 +76,11 @@ public:
         return is_repeating_;
     }
 
+    [[nodiscard]] std::chrono::microseconds lateness() const noexcept override
+    {
+        return lateness_;
+    }
+
     void setRepeating(bool repeating) override
     {
         is_repeating_ = repeating;
@@ -100,6 +106,7 @@ private:
         tv.tv_sec = secs.count();
         tv.tv_usec = duration_cast<microseconds>(interval_ - secs).count();
         evtimer_add(evtimer_, &tv);
+        due_ = steady_clock::now() + interval_;
     }
 
     static void onTimer(evutil_socket_t /*unused*/, short /*unused*/, void* vself)
@@ -107,8 +114,23 @@ private:
         static_cast<EvTimer*>(vself)->handleTimer();
     }
 
-    void handleTimer() const
+    void handleTimer()
     {
+        using namespace std::chrono;
+        auto const now = steady_clock::now();
+        lateness_ = std::max(duration_cast<microseconds>(now - due_), microseconds{});
+
+        // libevent reschedules persistent timers the same way
+        if (is_repeating_)
+        {
+            due_ += interval_;
+            if (due_ < now)
+            {
+                due_ = now + interval_;
+            }
+        }
+
+        // the callback may destroy this timer, so it must be the last thing we do
         TR_ASSERT(callback_);
         callback_();
     }
@@ -118,6 +140,8 @@ private:
 
     std::function<void()> callback_;
     std::chrono::milliseconds interval_ = 100ms;
+    std::chrono::steady_clock::time_point due_;
+    std::chrono::microseconds lateness_ = {};
     bool is_repeating_ = true;
 };
 
@@ -0,0 +1,241 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <algorithm> // std::max, std::move
+#include <array>
+#include <cstddef> // size_t
+#include <cstdint> // uint64_t
+#include <ctime> // time_t
+#include <iterator> // std::back_inserter
+#include <utility> // std::move
+#include <vector>
+
+/**
+ * A hierarchical timer wheel: a queue of items that come due at a given
+ * second. Adding an item is O(1) and each item is touched at most once
+ * per level on its way out, no matter how many other items are queued.
+ *
+ * There are four levels of 64 slots. A level 0 slot is one second wide,
+ * and each level's slots are 64 times wider than the level below's, so
+ * the wheel spans about 194 days. When time reaches a higher level slot,
+ * its items are redistributed into the lower levels. Advancing skips
+ * straight over empty stretches of time, so a jump in the clock costs
+ * no more than the items it passes.
+ *
+ * Items can't be removed. To reschedule something, add it again and
+ * ignore the stale copy when it comes due.
+ */
+template<typename T>
+class tr_timer_wheel
+{
+public:
+    explicit tr_timer_wheel(time_t now)
+        : now_{ now }
+    {
+    }
+
+    void add(time_t at, T value)
+    {
+        ++size_;
+
+        if (at <= now_)
+        {
+            due_.push_back(Entry{ at, std::move(value) });
+        }
+        else
+        {
+            place(Entry{ at, std::move(value) });
+        }
+    }
+
+    // Advance the wheel to `now` and call `func` with each item that has
+    // come due. `func` may add more items.
+    template<typename Func>
+    void advance(time_t now, Func&& func)
+    {
+        auto due = std::vector<Entry>{};
+        std::swap(due, due_);
+
+        if (size_ == std::size(due))
+        {
+            // nothing is waiting in the slots, so skip ahead
+            now_ = std::max(now_, now);
+        }
+
+        if (now - now_ >= static_cast<time_t>(Span))
+        {
+            // the clock jumped past everything the wheel can tell apart
+            drainAll(now, due);
+        }
+
+        while (now_ < now)
+        {
+            now_ = nextStop(now);
+            cascade();
+
+            auto& slot = levels_[0][index(now_, 0)];
+            for (auto& entry : slot)
+            {
+                due.push_back(std::move(entry));
+            }
+            slot.clear();
+        }
+
+        size_ -= std::size(due);
+
+        for (auto& entry : due)
+        {
+            func(entry.value);
+        }
+    }
+
+    [[nodiscard]] constexpr auto now() const noexcept
+    {
+        return now_;
+    }
+
+    [[nodiscard]] constexpr auto size() const noexcept
+    {
+        return size_;
+    }
+
+    [[nodiscard]] constexpr bool empty() const noexcept
+    {
+        return size_ == 0U;
+    }
+
+private:
+    static auto constexpr NumLevels = size_t{ 4U };
+    static auto constexpr SlotBits = 6U;
+    static auto constexpr SlotsPerLevel = size_t{ 1U } << SlotBits;
+    static auto constexpr Span = uint64_t{ 1U } << (SlotBits * NumLevels);
+
+    struct Entry
+    {
+        time_t at;
+        T value;
+    };
+
+    [[nodiscard]] static constexpr size_t index(time_t t, size_t level) noexcept
+    {
+        return static_cast<size_t>((static_cast<uint64_t>(t) >> (SlotBits * level)) & (SlotsPerLevel - 1U));
+    }
+
+    // the lowest level whose slots are wide enough that `at` and `now_`
+    // fall in the same slot of the level above it
+    [[nodiscard]] size_t levelFor(time_t at) const noexcept
+    {
+        auto const a = static_cast<uint64_t>(at);
+        auto const n = static_cast<uint64_t>(now_);
+
+        for (size_t level = 0; level + 1U < NumLevels; ++level)
+        {
+            if ((a >> (SlotBits * (level + 1U))) == (n >> (SlotBits * (level + 1U))))
+            {
+                return level;
+            }
+        }
+
+        // Too far off for the wheel to tell apart. It'll land in a slot that
+        // comes up early and be redistributed again when it does.
+        return NumLevels - 1U;
+    }
+
+    void place(Entry&& entry)
+    {
+        auto const level = levelFor(entry.at);
+        levels_[level][index(entry.at, level)].push_back(std::move(entry));
+    }
+
+    // If `now_` just reached the start of a higher level slot,
+    // spread that slot's items out into the lower levels.
+    void cascade()
+    {
+        for (size_t level = NumLevels - 1U; level > 0U; --level)
+        {
+            auto const span_mask = (uint64_t{ 1U } << (SlotBits * level)) - 1U;
+            if ((static_cast<uint64_t>(now_) & span_mask) != 0U)
+            {
+                continue;
+            }
+
+            auto entries = std::vector<Entry>{};
+            std::swap(entries, levels_[level][index(now_, level)]);
+            for (auto& entry : entries)
+            {
+                place(std::move(entry));
+            }
+        }
+    }
+
+    // The next second after `now_`, up to `now`, at which there's work to do:
+    // either a level 0 slot with items, or the start of a higher level slot
+    // with items to cascade. The seconds in between can be skipped.
+    [[nodiscard]] time_t nextStop(time_t now) const noexcept
+    {
+        auto stop = static_cast<uint64_t>(now);
+        auto const n = static_cast<uint64_t>(now_);
+
+        for (size_t level = 0; level < NumLevels; ++level)
+        {
+            auto const shift = SlotBits * level;
+            for (uint64_t i = 1U; i <= SlotsPerLevel; ++i)
+            {
+                auto const slot_begin = ((n >> shift) + i) << shift;
+                if (slot_begin >= stop)
+                {
+                    break;
+                }
+
+                if (!std::empty(levels_[level][index(static_cast<time_t>(slot_begin), level)]))
+                {
+                    stop = slot_begin;
+                    break;
+                }
+            }
+        }
+
+        return static_cast<time_t>(stop);
+    }
+
+    // Jump straight to `now`, moving every item that's due by then into `due`.
+    void drainAll(time_t now, std::vector<Entry>& due)
+    {
+        auto entries = std::vector<Entry>{};
+        for (auto& level : levels_)
+        {
+            for (auto& slot : level)
+            {
+                std::move(std::begin(slot), std::end(slot), std::back_inserter(entries));
+                slot.clear();
+            }
+        }
+
+        now_ = now;
+
+        for (auto& entry : entries)
+        {
+            if (entry.at <= now_)
+            {
+                due.push_back(std::move(entry));
+            }
+            else
+            {
+                place(std::move(entry));
+            }
+        }
+    }
+
+    std::array<std::array<std::vector<Entry>, SlotsPerLevel>, NumLevels> levels_;
+    std::vector<Entry> due_;
+    time_t now_;
+    size_t size_ = 0;
+};
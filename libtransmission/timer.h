@@ -33,6 +33,13 @@ public:
     [[nodiscard]] virtual std::chrono::milliseconds interval() const noexcept = 0;
     [[nodiscard]] virtual bool isRepeating() const noexcept = 0;
 
+    // How much later than it was due the timer fired most recently.
+    // Read this from the callback to measure event loop scheduling lag.
+    [[nodiscard]] virtual std::chrono::microseconds lateness() const noexcept
+    {
+        return {};
+    }
+
     void start(std::chrono::milliseconds msec)
     {
         setInterval(msec);
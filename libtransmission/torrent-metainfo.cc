@@ -6,6 +6,8 @@
 #include <algorithm>
 #include <array>
 #include <cerrno> // for EINVAL
+#include <map>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -21,6 +23,7 @@
 #include "error.h"
 #include "file.h"
 #include "log.h"
+#include "merkle.h"
 #include "quark.h"
 #include "torrent-metainfo.h"
 #include "tr-assert.h"
@@ -74,6 +77,19 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
     std::string_view pieces_root_;
     int64_t file_length_ = 0;
 
+    // bittorrent v2 'file tree' entries, in order
+    struct FileTreeEntry
+    {
+        std::string subpath;
+        int64_t length;
+        std::string_view pieces_root;
+    };
+    std::vector<FileTreeEntry> file_tree_;
+    std::vector<size_t> file_tree_subpath_sizes_;
+
+    // bittorrent v2 'piece layers', keyed by pieces root
+    std::map<std::string_view, std::string_view> piece_layers_;
+
     enum class State
     {
         UsePath,
@@ -98,11 +114,16 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
     {
         if (state_ == State::FileTree)
         {
-            if (!std::empty(file_subpath_))
+            // an empty key holds a file's properties; anything else is a path component
+            if (auto const key = currentKey(); !std::empty(key))
             {
-                file_subpath_ += '/';
+                file_tree_subpath_sizes_.push_back(std::size(file_subpath_));
+                if (!std::empty(file_subpath_))
+                {
+                    file_subpath_ += '/';
+                }
+                tr_torrent_files::makeSubpathPortable(key, file_subpath_);
             }
-            tr_torrent_files::makeSubpathPortable(currentKey(), file_subpath_);
         }
         else if (pathIs(InfoKey))
         {
@@ -113,7 +134,9 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
         {
             state_ = State::FileTree;
             file_subpath_.clear();
+            file_tree_subpath_sizes_.clear();
             file_length_ = 0;
+            pieces_root_ = {};
         }
         else if (pathIs(PieceLayersKey))
         {
@@ -139,9 +162,25 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
 
         if (state_ == State::FileTree) // bittorrent v2 format
         {
-            // v2, ignore for today
-            tr_logAddInfo("'file tree' is ignored");
-            state_ = State::UsePath;
+            if (pathIs(InfoKey, FileTreeKey))
+            {
+                state_ = State::UsePath;
+            }
+            else if (std::empty(currentKey()))
+            {
+                if (file_length_ > 0)
+                {
+                    file_tree_.push_back({ std::string{ file_subpath_.sv() }, file_length_, pieces_root_ });
+                }
+
+                file_length_ = 0;
+                pieces_root_ = {};
+            }
+            else if (!std::empty(file_tree_subpath_sizes_))
+            {
+                file_subpath_.resize(file_tree_subpath_sizes_.back());
+                file_tree_subpath_sizes_.pop_back();
+            }
         }
         else if (state_ == State::Files) // bittorrent v1 format
         {
@@ -277,7 +316,11 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
         }
         else if (state_ == State::FileTree)
         {
-            if (current_key == AttrKey || current_key == PiecesRootKey)
+            if (current_key == PiecesRootKey)
+            {
+                pieces_root_ = value;
+            }
+            else if (current_key == AttrKey)
             {
                 // currently unused. TODO support for bittorrent v2
                 // TODO https://github.com/transmission/transmission/issues/458
@@ -366,10 +409,9 @@ struct MetainfoHandler final : public transmission::benc::BasicHandler<MaxBencDe
                 unhandled = true;
             }
         }
-        else if (pathStartsWith(PieceLayersKey))
+        else if (state_ == State::PieceLayers && curdepth == 2)
         {
-            // currently unused. TODO support for bittorrent v2
-            // TODO https://github.com/transmission/transmission/issues/458
+            piece_layers_.try_emplace(current_key, value);
         }
         else if (pathStartsWith(AnnounceListKey))
         {
@@ -524,9 +566,107 @@ private:
         }
 
         tm_.block_info_.initSizes(tm_.files_.totalSize(), piece_size_);
+        finishFileTree();
         return true;
     }
 
+    // Match the v2 'file tree' to the v1 file list and
+    // validate each file's 'piece layers' against its 'pieces root'.
+    // Any inconsistency drops the v2 hashes and leaves the torrent as v1-only.
+    // 'piece layers' lives outside of the info dict, so it's simply absent
+    // from the metadata of magnet links; that just means no piece hashes.
+    void finishFileTree()
+    {
+        if (std::empty(file_tree_))
+        {
+            return;
+        }
+
+        if (auto const error = buildFileHashes2(); !std::empty(error))
+        {
+            tr_logAddWarn(fmt::format("ignoring bittorrent v2 hashes: {}", error), tm_.name());
+            tm_.files2_.clear();
+        }
+    }
+
+    [[nodiscard]] std::string buildFileHashes2()
+    {
+        auto const piece_size = static_cast<uint64_t>(piece_size_);
+        if (piece_size < tr_merkle::BlockSize || tr_merkle::widthFor(piece_size) != piece_size)
+        {
+            return fmt::format("invalid piece size: {}", piece_size);
+        }
+
+        auto layer_height = size_t{ 0 };
+        for (auto n = piece_size / tr_merkle::BlockSize; n > 1; n /= 2)
+        {
+            ++layer_height;
+        }
+
+        auto const n_files = tm_.fileCount();
+        auto file = tr_file_index_t{ 0 };
+        auto offset = uint64_t{ 0 };
+        for (auto const& entry : file_tree_)
+        {
+            // hybrid torrents list the same files in the same order in 'files',
+            // plus padding files that align each file to a piece boundary
+            auto const length = static_cast<uint64_t>(entry.length);
+            auto const matches = [&](tr_file_index_t i)
+            {
+                auto const v1_path = tm_.fileSubpath(i);
+                auto const& v2_path = entry.subpath;
+                return tm_.fileSize(i) == length && tr_strvEndsWith(v1_path, v2_path) &&
+                    (std::size(v1_path) == std::size(v2_path) || v1_path[std::size(v1_path) - std::size(v2_path) - 1] == '/');
+            };
+            while (file < n_files && !matches(file))
+            {
+                offset += tm_.fileSize(file++);
+            }
+
+            if (file == n_files)
+            {
+                return fmt::format("'file tree' entry '{}' not found in 'files'", entry.subpath);
+            }
+
+            if (offset % piece_size != 0)
+            {
+                return fmt::format("'{}' is not aligned to a piece boundary", entry.subpath);
+            }
+
+            if (std::size(entry.pieces_root) != sizeof(tr_sha256_digest_t))
+            {
+                return fmt::format("invalid 'pieces root' for '{}'", entry.subpath);
+            }
+
+            auto hashes = tr_torrent_metainfo::FileHashes2{ file, offset, length, {}, {} };
+            std::copy_n(std::data(entry.pieces_root), sizeof(tr_sha256_digest_t), reinterpret_cast<char*>(&hashes.pieces_root));
+
+            if (length > piece_size && !std::empty(piece_layers_))
+            {
+                auto const it = piece_layers_.find(entry.pieces_root);
+                auto const n_pieces = (length + piece_size - 1) / piece_size;
+                if (it == std::end(piece_layers_) || std::size(it->second) != n_pieces * sizeof(tr_sha256_digest_t))
+                {
+                    return fmt::format("missing or invalid 'piece layers' for '{}'", entry.subpath);
+                }
+
+                hashes.piece_layer.resize(n_pieces);
+                std::copy_n(std::data(it->second), std::size(it->second), reinterpret_cast<char*>(std::data(hashes.piece_layer)));
+
+                auto const width = tr_merkle::widthFor(n_pieces);
+                if (tr_merkle::root(hashes.piece_layer, width, layer_height) != hashes.pieces_root)
+                {
+                    return fmt::format("'piece layers' for '{}' do not match its 'pieces root'", entry.subpath);
+                }
+            }
+
+            tm_.files2_.push_back(std::move(hashes));
+            offset += tm_.fileSize(file++);
+        }
+
+        return {};
+    }
+
     static constexpr std::string_view AcodecKey = "acodec"sv;
     static constexpr std::string_view AnnounceKey = "announce"sv;
     static constexpr std::string_view AnnounceListKey = "announce-list"sv;
@@ -636,6 +776,56 @@ tr_sha1_digest_t const& tr_torrent_metainfo::pieceHash(tr_piece_index_t piece) c
     return this->pieces_[piece];
 }
 
+std::optional<tr_torrent_metainfo::PieceHash2> tr_torrent_metainfo::pieceHash2(tr_piece_index_t piece) const
+{
+    auto const piece_begin = uint64_t{ piece } * pieceSize();
+    auto it = std::upper_bound(
+        std::begin(files2_),
+        std::end(files2_),
+        piece_begin,
+        [](uint64_t offset, FileHashes2 const& file) { return offset < file.offset; });
+    if (it == std::begin(files2_))
+    {
+        return {};
+    }
+
+    --it;
+    auto const file_end = it->offset + it->length;
+    if (piece_begin >= file_end)
+    {
+        return {}; // padding
+    }
+
+    auto const length = static_cast<uint32_t>(std::min(uint64_t{ pieceSize() }, file_end - piece_begin));
+
+    if (std::empty(it->piece_layer))
+    {
+        if (it->length > pieceSize()) // no 'piece layers'
+        {
+            return {};
+        }
+
+        // the whole file fits in this piece
+        return PieceHash2{ it->pieces_root, length, tr_merkle::widthFor(tr_merkle::blockCount(length)) };
+    }
+
+    auto const& hash = it->piece_layer[(piece_begin - it->offset) / pieceSize()];
+    return PieceHash2{ hash, length, pieceSize() / tr_merkle::BlockSize };
+}
+
+std::optional<tr_sha256_digest_t> tr_torrent_metainfo::piecesRoot(tr_file_index_t file) const
+{
+    for (auto const& hashes : files2_)
+    {
+        if (hashes.file == file)
+        {
+            return hashes.pieces_root;
+        }
+    }
+
+    return {};
+}
+
 tr_pathbuf tr_torrent_metainfo::makeFilename(
     std::string_view dirname,
     std::string_view name,
@@ -5,8 +5,10 @@
 
 #pragma once
 
+#include <cstddef> // size_t
 #include <cstdint> // uint32_t, uint64_t
 #include <ctime>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -142,6 +144,28 @@ public:
         return is_v2_;
     }
 
+    // BitTorrent v2 merkle hash of the part of `piece` that belongs to a single file.
+    // Only available in hybrid torrents, where each file is aligned to a piece boundary,
+    // and only for multi-piece files if the torrent came with its 'piece layers'.
+    // This is metadata only: pieces are still checked against their v1 SHA1 hashes.
+    // See http://bittorrent.org/beps/bep_0052.html
+    struct PieceHash2
+    {
+        tr_sha256_digest_t hash;
+
+        // number of bytes at the front of the piece that belong to the file.
+        // The rest of the piece, if any, is padding.
+        uint32_t length;
+
+        // padded number of 16 KiB leaves beneath `hash`
+        size_t leaf_count;
+    };
+
+    [[nodiscard]] std::optional<PieceHash2> pieceHash2(tr_piece_index_t piece) const;
+
+    // the v2 'pieces root' of a file, or nullopt if the file has none
+    [[nodiscard]] std::optional<tr_sha256_digest_t> piecesRoot(tr_file_index_t file) const;
+
     [[nodiscard]] constexpr auto const& dateCreated() const noexcept
     {
         return date_created_;
@@ -224,6 +248,21 @@ private:
 
     std::vector<tr_sha1_digest_t> pieces_;
 
+    struct FileHashes2
+    {
+        tr_file_index_t file;
+        uint64_t offset; // byte offset of the file in the torrent
+        uint64_t length;
+        tr_sha256_digest_t pieces_root;
+
+        // one hash per piece; empty if the file fits in a single piece
+        // or if the torrent has no 'piece layers', e.g. from a magnet link
+        std::vector<tr_sha256_digest_t> piece_layer;
+    };
+
+    // sorted by offset
+    std::vector<FileHashes2> files2_;
+
     std::string comment_;
     std::string creator_;
     std::string source_;
@@ -48,6 +48,7 @@
 #include "torrent-metainfo.h"
 #include "torrent.h"
 #include "tr-assert.h"
+#include "tr-dht.h"
 #include "trevent.h" /* tr_runInEventThread() */
 #include "utils.h"
 #include "version.h"
@@ -577,6 +578,7 @@ static void torrentInitFromInfoDict(tr_torrent* tor)
     tor->file_priorities_.reset(&tor->fpm_);
     tor->files_wanted_.reset(&tor->fpm_);
     tor->checked_pieces_ = tr_bitfield{ size_t(tor->pieceCount()) };
+    tor->journaled_pieces_ = tr_bitfield{ size_t(tor->pieceCount()) };
 }
 
 void tr_torrent::setMetainfo(tr_torrent_metainfo const& tm)
@@ -1345,6 +1347,31 @@ static void freeTorrent(tr_torrent* tor)
 
 static void torrentSetQueued(tr_torrent* tor, bool queued);
 
+// Full preallocation may mean writing zeroes across every file,
+// so new files are handed to a worker thread now instead of being
+// preallocated on the event thread when their first block arrives.
+// Sparse preallocation is quick enough to stay in tr_open_files::get().
+static void torrentPreallocateFiles(tr_torrent* const tor)
+{
+    if (tor->session->preallocationMode() != TR_PREALLOCATE_FULL || tor->isDone())
+    {
+        return;
+    }
+
+    auto const base = tor->currentDir();
+    auto const suffix = tor->session->isIncompleteFileNamingEnabled() ? tr_torrent_files::PartialFileSuffix : ""sv;
+
+    for (tr_file_index_t i = 0, n = tor->fileCount(); i < n; ++i)
+    {
+        // files that have some data are already on disk
+        if (auto const file_size = tor->fileSize(i);
+            file_size != 0 && tor->fileIsWanted(i) && tor->completion.countHasBytesInSpan(tor->byteSpan(i)) == 0)
+        {
+            tor->session->preallocateAdd(tor->id(), i, tr_pathbuf{ base, '/', tor->fileSubpath(i), suffix }, file_size);
+        }
+    }
+}
+
 static void torrentStartImpl(tr_torrent* const tor)
 {
     auto const lock = tor->unique_lock();
@@ -1365,10 +1392,10 @@ static void torrentStartImpl(tr_torrent* const tor)
 
     tr_torrentResetTransferStats(tor);
     tr_announcerTorrentStarted(tor);
-    tor->dhtAnnounceAt = now + tr_rand_int_weak(20);
-    tor->dhtAnnounce6At = now + tr_rand_int_weak(20);
+    tr_dhtTorrentStarted(tor);
     tor->lpdAnnounceAt = now;
     tr_peerMgrStartTorrent(tor);
+    torrentPreallocateFiles(tor);
 }
 
 static bool torrentShouldQueue(tr_torrent const* const tor)
@@ -1489,6 +1516,39 @@ void tr_torrentOnVerifyDone(tr_torrent* tor, bool aborted)
     tr_runInEventThread(tor->session, onVerifyDoneThreadFunc, tor);
 }
 
+static void onPreallocateDoneThreadFunc(tr_session* session, tr_torrent_id_t tor_id, tr_file_index_t file_num, int error)
+{
+    TR_ASSERT(tr_amInEventThread(session));
+
+    auto* const tor = session->torrents().get(tor_id);
+    if (tor == nullptr || tor->isDeleting)
+    {
+        return;
+    }
+
+    auto const lock = tor->unique_lock();
+
+    if (error != 0)
+    {
+        if (tor->error != TR_STAT_LOCAL_ERROR)
+        {
+            auto const path = tr_pathbuf{ tor->currentDir(), '/', tor->fileSubpath(file_num) };
+            tor->setLocalError(fmt::format(FMT_STRING("{:s} ({:s})"), tr_strerror(error), path));
+            tr_torrentStop(tor);
+        }
+
+        return;
+    }
+
+    // write out the blocks that the cache held while the file was being preallocated
+    session->cache->flushFile(tor, file_num);
+}
+
+void tr_torrentOnPreallocateDone(tr_session* session, tr_torrent_id_t tor_id, tr_file_index_t file_num, int error)
+{
+    tr_runInEventThread(session, onPreallocateDoneThreadFunc, session, tor_id, file_num, error);
+}
+
 static void verifyTorrent(tr_torrent* const tor)
 {
     TR_ASSERT(tr_amInEventThread(tor->session));
@@ -1551,6 +1611,7 @@ static void stopTorrent(tr_torrent* const tor)
 
     tr_peerMgrStopTorrent(tor);
     tr_announcerTorrentStopped(tor);
+    tr_dhtTorrentStopped(tor);
 
     tor->session->closeTorrentFiles(tor);
 
@@ -1605,6 +1666,8 @@ static void closeTorrent(tr_torrent* const tor)
         tr_torrent_metainfo::removeFile(tor->session->torrentDir(), tor->name(), tor->infoHashString(), ".torrent"sv);
         tr_torrent_metainfo::removeFile(tor->session->torrentDir(), tor->name(), tor->infoHashString(), ".magnet"sv);
         tr_torrent_metainfo::removeFile(tor->session->resumeDir(), tor->name(), tor->infoHashString(), ".resume"sv);
+        tr_torrent_metainfo::removeFile(tor->session->resumeDir(), tor->name(), tor->infoHashString(), ".resume.bak"sv);
+        tor->session->resumeJournal().remove(tor->infoHash());
     }
 
     tor->isRunning = false;
@@ -2298,6 +2361,11 @@ void tr_torrentGotBlock(tr_torrent* tor, tr_block_index_t block)
         {
             if (tor->checkPiece(piece))
             {
+                // The piece may still be in the write cache, or in the OS's,
+                // so the journal only says that we have it, not that it's
+                // been checked. See loadCompletedPieces().
+                tor->session->resumeJournal().addCompletedPiece(tor->infoHash(), piece);
+
                 tr_torrentPieceCompleted(tor, piece);
             }
             else
@@ -2751,6 +2819,21 @@ void tr_torrent::setBlocks(tr_bitfield blocks)
     this->setDirty();
 
     checked_pieces_.set(piece, checked);
+
+    // A piece restored from the resume journal may not have reached
+    // the disk before a crash. That's not corruption; just get it again.
+    if (journaled_pieces_.test(piece))
+    {
+        journaled_pieces_.unset(piece);
+
+        if (!checked)
+        {
+            tr_logAddDebugTor(this, fmt::format("Piece #{} from the resume journal is bad; downloading it again", piece));
+            setHasPiece(piece, false);
+            recheckCompleteness();
+        }
+    }
+
     return checked;
 }
 
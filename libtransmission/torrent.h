@@ -69,7 +69,7 @@ tr_block_span_t tr_torGetFileBlockSpan(tr_torrent const* tor, tr_file_index_t fi
 
 void tr_torrentCheckSeedLimit(tr_torrent* tor);
 
-/** save a torrent's .resume file if it's changed since the last time it was saved */
+/** save a torrent's resume data if it's changed since the last time it was saved */
 void tr_torrentSave(tr_torrent* tor);
 
 enum tr_verify_state : uint8_t
@@ -271,6 +271,11 @@ public:
         return fpm_.pieceSpan(file);
     }
 
+    [[nodiscard]] auto filesInPiece(tr_piece_index_t piece) const
+    {
+        return fpm_.fileSpan(piece);
+    }
+
     [[nodiscard]] auto fileOffset(tr_block_info::Location loc) const
     {
         return fpm_.fileOffset(loc.byte);
@@ -631,6 +636,10 @@ public:
     // it means that piece needs to be checked before its data is used.
     tr_bitfield checked_pieces_ = tr_bitfield{ 0 };
 
+    // Pieces restored from the resume journal that haven't been checked yet.
+    // If one fails its check, ensurePieceIsChecked() drops it to be downloaded again.
+    tr_bitfield journaled_pieces_ = tr_bitfield{ 0 };
+
     tr_file_piece_map fpm_ = tr_file_piece_map{ metainfo_ };
     tr_file_priorities file_priorities_{ &fpm_ };
     tr_files_wanted files_wanted_{ &fpm_ };
@@ -667,9 +676,6 @@ public:
 
     time_t peer_id_creation_time_ = 0;
 
-    time_t dhtAnnounceAt = 0;
-    time_t dhtAnnounce6At = 0;
-
     time_t lpdAnnounceAt = 0;
 
     time_t activityDate = 0;
@@ -783,6 +789,8 @@ tr_torrent::labels_t const& tr_ctorGetLabels(tr_ctor const* ctor);
 
 void tr_torrentOnVerifyDone(tr_torrent* tor, bool aborted);
 
+void tr_torrentOnPreallocateDone(tr_session* session, tr_torrent_id_t tor_id, tr_file_index_t file_num, int error);
+
 #define tr_logAddCriticalTor(tor, msg) tr_logAddCritical(msg, (tor)->name())
 #define tr_logAddErrorTor(tor, msg) tr_logAddError(msg, (tor)->name())
 #define tr_logAddWarnTor(tor, msg) tr_logAddWarn(msg, (tor)->name())
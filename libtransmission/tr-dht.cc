@@ -3,15 +3,19 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <array>
 #include <cerrno>
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib> // for abort()
 #include <cstring> // for memcpy()
 #include <ctime>
 #include <fstream>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -38,16 +42,19 @@
 #include "transmission.h"
 
 #include "crypto-utils.h"
+#include "dht-scheduler.h"
 #include "file.h"
 #include "log.h"
 #include "net.h"
+#include "peer-common.h" // tr_swarmGetStats()
 #include "peer-mgr.h"
 #include "session.h"
-#include "timer.h"
 #include "torrent.h"
 #include "tr-assert.h"
 #include "tr-dht.h"
 #include "tr-strbuf.h"
+#include "tracing.h" // tr_traceSetThreadName()
+#include "trevent.h" // tr_runInEventThread()
 #include "variant.h"
 #include "utils.h" // tr_time(), _()
 
@@ -55,82 +62,203 @@ using namespace std::literals;
 
 namespace
 {
-struct Impl
+class SchedulerMediator final : public tr_dht_scheduler::Mediator
 {
-    std::unique_ptr<libtransmission::Timer> timer;
-    std::array<unsigned char, 20> id = {};
-    tr_socket_t udp4_socket = TR_BAD_SOCKET;
-    tr_socket_t udp6_socket = TR_BAD_SOCKET;
-    tr_session* session = nullptr;
-};
+public:
+    [[nodiscard]] bool isReady(tr_address_type type) const override
+    {
+        return ready[type];
+    }
 
-Impl impl = {};
-} // namespace
+    [[nodiscard]] std::optional<size_t> peerCount(tr_torrent_id_t tor_id) const override;
 
-// mutex-locked wrapper around libdht's API
-namespace locked_dht
-{
-namespace
-{
+    [[nodiscard]] bool startSearch(tr_torrent_id_t tor_id, tr_address_type type) override;
 
-[[nodiscard]] auto unique_lock()
+    // refreshed before each pulse from the DHT thread's node counts
+    std::array<bool, NUM_TR_AF_INET_TYPES> ready = {};
+};
+
+// libdht keeps its state in globals and isn't thread-safe, so every call
+// into it is made on this one thread. The event thread hands it incoming
+// packets and the work it needs done, and what it learns goes back to the
+// session with tr_runInEventThread(). That way a busy DHT, which can see
+// thousands of packets a second, never waits on the session lock.
+class DhtThread
 {
-    static std::recursive_mutex dht_mutex;
-    return std::unique_lock(dht_mutex);
-}
+public:
+    using func_t = std::function<void()>;
 
-} // namespace
+    DhtThread()
+        : thread_{ &DhtThread::threadFunc, this }
+    {
+    }
 
-auto getNodes(struct sockaddr_in* sin, int* num, struct sockaddr_in6* sin6, int* num6)
-{
-    auto lock = unique_lock();
-    return dht_get_nodes(sin, num, sin6, num6);
-}
+    ~DhtThread()
+    {
+        {
+            auto const lock = std::lock_guard(mutex_);
+            stopping_ = true;
+        }
 
-auto init(int s, int s6, unsigned char const* id, unsigned char const* v)
-{
-    auto lock = unique_lock();
-    return dht_init(s, s6, id, v);
-}
+        cv_.notify_one();
+        thread_.join();
+    }
 
-auto nodes(int af, int* good_return, int* dubious_return, int* cached_return, int* incoming_return)
-{
-    auto lock = unique_lock();
-    return dht_nodes(af, good_return, dubious_return, cached_return, incoming_return);
-}
+    DhtThread(DhtThread&&) = delete;
+    DhtThread(DhtThread const&) = delete;
+    DhtThread& operator=(DhtThread&&) = delete;
+    DhtThread& operator=(DhtThread const&) = delete;
 
-auto periodic(
-    void const* buf,
-    size_t buflen,
-    struct sockaddr const* from,
-    int fromlen,
-    time_t* tosleep,
-    dht_callback_t* callback,
-    void* closure)
-{
-    auto lock = unique_lock();
-    return dht_periodic(buf, buflen, from, fromlen, tosleep, callback, closure);
-}
+    // Queue a packet that arrived on the UDP socket.
+    // If the thread is too far behind, the packet is dropped;
+    // the DHT is built to cope with lost UDP packets.
+    void addPacket(unsigned char const* buf, size_t buflen, struct sockaddr const* from, socklen_t fromlen)
+    {
+        auto packet = Packet{};
+        packet.buf.assign(buf, buf + buflen);
+        packet.buf.push_back('\0'); // required by libdht
+        memcpy(&packet.from, from, std::min(size_t(fromlen), sizeof(packet.from)));
+        packet.fromlen = fromlen;
+
+        auto lock = std::unique_lock(mutex_);
+        if (std::size(packets_) >= MaxQueuedPackets)
+        {
+            return;
+        }
 
-auto ping_node(struct sockaddr const* sa, int salen)
-{
-    auto lock = unique_lock();
-    return dht_ping_node(sa, salen);
-}
+        auto const was_idle = std::empty(packets_) && std::empty(funcs_);
+        packets_.push_back(std::move(packet));
+        lock.unlock();
+
+        if (was_idle)
+        {
+            cv_.notify_one();
+        }
+    }
+
+    // Call `func` on the DHT thread. Called from any thread.
+    void run(func_t func)
+    {
+        auto lock = std::unique_lock(mutex_);
+        auto const was_idle = std::empty(packets_) && std::empty(funcs_);
+        funcs_.push_back(std::move(func));
+        lock.unlock();
+
+        if (was_idle)
+        {
+            cv_.notify_one();
+        }
+    }
+
+    // Like dht_nodes(), but from the counts the DHT thread last saw.
+    void nodes(int af, int* good_return, int* dubious_return, int* incoming_return) const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        auto const& counts = af == AF_INET6 ? nodes6_ : nodes4_;
+        *good_return = counts.good;
+        *dubious_return = counts.dubious;
+        *incoming_return = counts.incoming;
+    }
+
+private:
+    struct Packet
+    {
+        std::vector<unsigned char> buf;
+        sockaddr_storage from = {};
+        socklen_t fromlen = 0;
+    };
+
+    struct NodeCounts
+    {
+        int good = 0;
+        int dubious = 0;
+        int incoming = 0;
+    };
+
+    static auto constexpr MaxQueuedPackets = size_t{ 2048 };
+
+    void threadFunc();
+    [[nodiscard]] std::chrono::steady_clock::time_point periodic(Packet const* packet);
+    void refreshNodeCounts();
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Packet> packets_;
+    std::vector<func_t> funcs_;
+    NodeCounts nodes4_;
+    NodeCounts nodes6_;
+    bool stopping_ = false;
+
+    // last, so that everything else is ready when the thread starts
+    std::thread thread_;
+};
 
-auto search(unsigned char const* id, int port, int af, dht_callback_t* callback, void* closure)
+// Pings bootstrap nodes until the DHT knows enough nodes of its own.
+// It naps between pings, so it gets a thread of its own. It talks to the
+// DHT thread, so tr_dhtUninit() stops it and waits for it to finish
+// before that one goes away. A DNS lookup that's underway can't be
+// interrupted, but the naps can.
+class Bootstrapper
 {
-    auto lock = unique_lock();
-    return dht_search(id, port, af, callback, closure);
-}
+public:
+    Bootstrapper(std::string config_dir, std::vector<uint8_t> nodes4, std::vector<uint8_t> nodes6);
+
+    ~Bootstrapper()
+    {
+        {
+            auto const lock = std::lock_guard(mutex_);
+            stopping_ = true;
+        }
+
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    Bootstrapper(Bootstrapper&&) = delete;
+    Bootstrapper(Bootstrapper const&) = delete;
+    Bootstrapper& operator=(Bootstrapper&&) = delete;
+    Bootstrapper& operator=(Bootstrapper const&) = delete;
+
+    // Wait for about `roughly_sec` seconds.
+    // @return false if bootstrapping should stop.
+    [[nodiscard]] bool nap(int roughly_sec)
+    {
+        int const roughly_msec = roughly_sec * 1000;
+        int const msec = roughly_msec / 2 + tr_rand_int_weak(roughly_msec);
+
+        auto lock = std::unique_lock(mutex_);
+        return !cv_.wait_for(lock, std::chrono::milliseconds{ msec }, [this]() { return stopping_; });
+    }
+
+    [[nodiscard]] bool isStopping() const
+    {
+        auto const lock = std::lock_guard(mutex_);
+        return stopping_;
+    }
 
-auto uninit()
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+
+    // last, so that everything else is ready when the thread starts
+    std::thread thread_;
+};
+
+struct Impl
 {
-    auto lock = unique_lock();
-    return dht_uninit();
-}
+    std::unique_ptr<DhtThread> dht_thread;
+    std::unique_ptr<Bootstrapper> bootstrapper; // after dht_thread, so it's destroyed first
+    std::unique_ptr<SchedulerMediator> scheduler_mediator;
+    std::unique_ptr<tr_dht_scheduler> scheduler;
+    std::array<unsigned char, 20> id = {};
+    tr_socket_t udp4_socket = TR_BAD_SOCKET;
+    tr_socket_t udp6_socket = TR_BAD_SOCKET;
+    tr_session* session = nullptr;
+};
 
-} // namespace locked_dht
+Impl impl = {};
+} // namespace
 
 enum class Status
 {
@@ -187,7 +315,7 @@ static constexpr auto getUdpSocket(int af)
 
 static auto getStatus(int af, int* const setme_node_count = nullptr)
 {
-    if (getUdpSocket(af) == TR_BAD_SOCKET)
+    if (getUdpSocket(af) == TR_BAD_SOCKET || !impl.dht_thread)
     {
         if (setme_node_count != nullptr)
         {
@@ -200,7 +328,7 @@ static auto getStatus(int af, int* const setme_node_count = nullptr)
     int good = 0;
     int dubious = 0;
     int incoming = 0;
-    locked_dht::nodes(af, &good, &dubious, nullptr, &incoming);
+    impl.dht_thread->nodes(af, &good, &dubious, &incoming);
 
     if (setme_node_count != nullptr)
     {
@@ -225,6 +353,19 @@ static auto getStatus(int af, int* const setme_node_count = nullptr)
     return Status::Good;
 }
 
+static void pingNode(struct sockaddr const* sa, socklen_t salen)
+{
+    if (!impl.dht_thread)
+    {
+        return;
+    }
+
+    auto ss = sockaddr_storage{};
+    salen = std::min(salen, socklen_t(sizeof(ss)));
+    memcpy(&ss, sa, salen);
+    impl.dht_thread->run([ss, salen]() { dht_ping_node(reinterpret_cast<struct sockaddr const*>(&ss), salen); });
+}
+
 static constexpr auto isReady(Status const status)
 {
     return status >= Status::Firewalled;
@@ -246,13 +387,6 @@ static bool isBootstrapDone(int af = 0)
     return status == Status::Stopped || isReady(status);
 }
 
-static void nap(int roughly_sec)
-{
-    int const roughly_msec = roughly_sec * 1000;
-    int const msec = roughly_msec / 2 + tr_rand_int_weak(roughly_msec);
-    tr_wait_msec(msec);
-}
-
 static int getBootstrappedAF()
 {
     if (isBootstrapDone(AF_INET6))
@@ -268,7 +402,7 @@ static int getBootstrappedAF()
     return 0;
 }
 
-static void bootstrapFromName(char const* name, tr_port port, int af)
+static void bootstrapFromName(Bootstrapper& bootstrapper, char const* name, tr_port port, int af)
 {
     auto hints = addrinfo{};
     hints.ai_socktype = SOCK_DGRAM;
@@ -292,11 +426,9 @@ static void bootstrapFromName(char const* name, tr_port port, int af)
     addrinfo* infop = info;
     while (infop != nullptr)
     {
-        locked_dht::ping_node(infop->ai_addr, infop->ai_addrlen);
-
-        nap(15);
+        pingNode(infop->ai_addr, infop->ai_addrlen);
 
-        if (isBootstrapDone(af))
+        if (!bootstrapper.nap(15) || isBootstrapDone(af))
         {
             break;
         }
@@ -307,7 +439,7 @@ static void bootstrapFromName(char const* name, tr_port port, int af)
     freeaddrinfo(info);
 }
 
-static void bootstrapFromFile(std::string_view config_dir)
+static void bootstrapFromFile(Bootstrapper& bootstrapper, std::string_view config_dir)
 {
     if (isBootstrapDone())
     {
@@ -324,7 +456,7 @@ static void bootstrapFromFile(std::string_view config_dir)
     // format is each line has address, a space char, and port number
     tr_logAddTrace("Attempting manual bootstrap");
     auto line = std::string{};
-    while (!isBootstrapDone() && std::getline(in, line))
+    while (!bootstrapper.isStopping() && !isBootstrapDone() && std::getline(in, line))
     {
         auto line_stream = std::istringstream{ line };
         auto addrstr = std::string{};
@@ -337,12 +469,16 @@ static void bootstrapFromFile(std::string_view config_dir)
         }
         else
         {
-            bootstrapFromName(addrstr.c_str(), tr_port::fromHost(hport), getBootstrappedAF());
+            bootstrapFromName(bootstrapper, addrstr.c_str(), tr_port::fromHost(hport), getBootstrappedAF());
         }
     }
 }
 
-static void bootstrapStart(std::string_view config_dir, std::vector<uint8_t> nodes4, std::vector<uint8_t> nodes6)
+static void bootstrapStart(
+    Bootstrapper& bootstrapper,
+    std::string const& config_dir,
+    std::vector<uint8_t> const& nodes4,
+    std::vector<uint8_t> const& nodes6)
 {
     if (!tr_dhtEnabled())
     {
@@ -386,13 +522,9 @@ static void bootstrapStart(std::string_view config_dir, std::vector<uint8_t> nod
         /* Our DHT code is able to take up to 9 nodes in a row without
            dropping any. After that, it takes some time to split buckets.
            So ping the first 8 nodes quickly, then slow down. */
-        if (i < 8U)
+        if (!bootstrapper.nap(i < 8U ? 2 : 15))
         {
-            nap(2);
-        }
-        else
-        {
-            nap(15);
+            return;
         }
 
         if (isBootstrapDone())
@@ -403,7 +535,7 @@ static void bootstrapStart(std::string_view config_dir, std::vector<uint8_t> nod
 
     if (!isBootstrapDone())
     {
-        bootstrapFromFile(config_dir);
+        bootstrapFromFile(bootstrapper, config_dir);
     }
 
     if (!isBootstrapDone())
@@ -414,7 +546,10 @@ static void bootstrapStart(std::string_view config_dir, std::vector<uint8_t> nod
                slow.  The initial wait is to give other nodes a chance
                to contact us before we attempt to contact a bootstrap
                node, for example because we've just been restarted. */
-            nap(40);
+            if (!bootstrapper.nap(40))
+            {
+                return;
+            }
 
             if (isBootstrapDone())
             {
@@ -426,13 +561,18 @@ static void bootstrapStart(std::string_view config_dir, std::vector<uint8_t> nod
                 tr_logAddDebug("Attempting bootstrap from dht.transmissionbt.com");
             }
 
-            bootstrapFromName("dht.transmissionbt.com", tr_port::fromHost(6881), getBootstrappedAF());
+            bootstrapFromName(bootstrapper, "dht.transmissionbt.com", tr_port::fromHost(6881), getBootstrappedAF());
         }
     }
 
     tr_logAddTrace("Finished bootstrapping");
 }
 
+Bootstrapper::Bootstrapper(std::string config_dir, std::vector<uint8_t> nodes4, std::vector<uint8_t> nodes6)
+    : thread_{ bootstrapStart, std::ref(*this), std::move(config_dir), std::move(nodes4), std::move(nodes6) }
+{
+}
+
 int tr_dhtInit(tr_session* session, tr_socket_t udp4_socket, tr_socket_t udp6_socket)
 {
     if (impl.session != nullptr) /* already initialized */
@@ -492,7 +632,7 @@ int tr_dhtInit(tr_session* session, tr_socket_t udp4_socket, tr_socket_t udp6_so
         tr_rand_buffer(std::data(impl.id), std::size(impl.id));
     }
 
-    if (locked_dht::init(udp4_socket, udp6_socket, std::data(impl.id), nullptr) < 0)
+    if (dht_init(udp4_socket, udp6_socket, std::data(impl.id), nullptr) < 0)
     {
         auto const errcode = errno;
         tr_logAddDebug(fmt::format("DHT initialization failed: {} ({})", tr_strerror(errcode), errcode));
@@ -502,16 +642,20 @@ int tr_dhtInit(tr_session* session, tr_socket_t udp4_socket, tr_socket_t udp6_so
 
     impl.session = session;
     impl.udp4_socket = udp4_socket;
-    impl.udp6_socket = udp4_socket;
+    impl.udp6_socket = udp6_socket;
+    impl.dht_thread = std::make_unique<DhtThread>();
 
-    std::thread(bootstrapStart, std::string{ session->configDir() }, nodes, nodes6).detach();
+    impl.scheduler_mediator = std::make_unique<SchedulerMediator>();
+    impl.scheduler = std::make_unique<tr_dht_scheduler>(*impl.scheduler_mediator, tr_time());
+    for (auto const* const tor : session->torrents())
+    {
+        tr_dhtTorrentStarted(tor);
+    }
 
-    static auto constexpr MinInterval = 10ms;
-    static auto constexpr MaxInterval = 1s;
-    auto const random_percent = tr_rand_int_weak(1000) / 1000.0;
-    auto interval = MinInterval + random_percent * (MaxInterval - MinInterval);
-    impl.timer = session->timerMaker().create([]() { tr_dhtCallback(nullptr, 0, nullptr, 0); });
-    impl.timer->startSingleShot(std::chrono::duration_cast<std::chrono::milliseconds>(interval));
+    impl.bootstrapper = std::make_unique<Bootstrapper>(
+        std::string{ session->configDir() },
+        std::move(nodes),
+        std::move(nodes6));
 
     tr_logAddDebug("DHT initialized");
 
@@ -524,11 +668,17 @@ void tr_dhtUninit()
 
     tr_logAddTrace("Uninitializing DHT");
 
-    impl.timer.reset();
-
     /* Since we only save known good nodes,
      * avoid erasing older data if we don't know enough nodes. */
-    if (!isReady(AF_INET) && !isReady(AF_INET6))
+    auto const save_nodes = isReady(AF_INET) || isReady(AF_INET6);
+
+    // the bootstrapper uses the DHT thread, so it has to stop first
+    impl.bootstrapper.reset();
+
+    // once the DHT thread is gone, it's safe to call libdht from here
+    impl.dht_thread.reset();
+
+    if (!save_nodes)
     {
         tr_logAddTrace("Not saving nodes, DHT not ready");
     }
@@ -545,7 +695,7 @@ void tr_dhtUninit()
         auto sins6 = std::array<struct sockaddr_in6, MaxNodes>{};
         int num = MaxNodes;
         int num6 = MaxNodes;
-        int const n = locked_dht::getNodes(std::data(sins), &num, std::data(sins6), &num6);
+        int const n = dht_get_nodes(std::data(sins), &num, std::data(sins6), &num6);
         tr_logAddTrace(fmt::format("Saving {} ({} + {}) nodes", n, num, num6));
 
         tr_variant benc;
@@ -586,7 +736,7 @@ void tr_dhtUninit()
         tr_variantClear(&benc);
     }
 
-    locked_dht::uninit();
+    dht_uninit();
 
     tr_logAddTrace("Done uninitializing DHT");
 
@@ -624,7 +774,7 @@ bool tr_dhtAddNode(tr_address addr, tr_port port, bool bootstrap)
         sin.sin_family = AF_INET;
         sin.sin_addr = addr.addr.addr4;
         sin.sin_port = port.network();
-        locked_dht::ping_node((struct sockaddr*)&sin, sizeof(sin));
+        pingNode((struct sockaddr*)&sin, sizeof(sin));
         return true;
     }
 
@@ -634,47 +784,200 @@ bool tr_dhtAddNode(tr_address addr, tr_port port, bool bootstrap)
         sin6.sin6_family = AF_INET6;
         sin6.sin6_addr = addr.addr.addr6;
         sin6.sin6_port = port.network();
-        locked_dht::ping_node((struct sockaddr*)&sin6, sizeof(sin6));
+        pingNode((struct sockaddr*)&sin6, sizeof(sin6));
         return true;
     }
 
     return false;
 }
 
-static void callback(void* vsession, int event, unsigned char const* info_hash, void const* data, size_t data_len)
+// The rest of the session runs on the event thread,
+// so what the DHT finds is handed over to it to deal with.
+
+static void onPeersFound(tr_sha1_digest_t const& hash, std::vector<tr_pex> const& pex, bool ipv6)
+{
+    if (!tr_dhtEnabled())
+    {
+        return;
+    }
+
+    auto const lock = impl.session->unique_lock();
+    auto* const tor = impl.session->torrents().get(hash);
+
+    if (tor != nullptr && tor->allowsDht())
+    {
+        tr_peerMgrAddPex(tor, TR_PEER_FROM_DHT, std::data(pex), std::size(pex));
+        tr_logAddDebugTor(tor, fmt::format("Learned {} {} peers from DHT", std::size(pex), ipv6 ? "IPv6" : "IPv4"));
+    }
+}
+
+static void onSearchDone(tr_sha1_digest_t const& hash, tr_address_type type)
+{
+    if (!tr_dhtEnabled())
+    {
+        return;
+    }
+
+    auto const lock = impl.session->unique_lock();
+
+    if (auto const* const tor = impl.session->torrents().get(hash); tor != nullptr)
+    {
+        impl.scheduler->searchDone(tor->id(), type);
+        tr_logAddTraceTor(tor, fmt::format("{} DHT announce done", type == TR_AF_INET6 ? "IPv6" : "IPv4"));
+    }
+}
+
+static void onSearchFailed(tr_torrent_id_t tor_id, int af, int error_code)
+{
+    if (!tr_dhtEnabled())
+    {
+        return;
+    }
+
+    auto const lock = impl.session->unique_lock();
+
+    if (auto const* const tor = impl.session->torrents().get(tor_id); tor != nullptr)
+    {
+        tr_logAddWarnTor(
+            tor,
+            fmt::format(
+                _("Unable to announce torrent in DHT with {type}: {error} ({error_code}); state is {state}"),
+                fmt::arg("type", af == AF_INET6 ? "IPv6" : "IPv4"),
+                fmt::arg("state", printableStatus(getStatus(af))),
+                fmt::arg("error_code", error_code),
+                fmt::arg("error", tr_strerror(error_code))));
+    }
+
+    impl.scheduler->searchFailed(tor_id, af == AF_INET6 ? TR_AF_INET6 : TR_AF_INET, tr_time());
+}
+
+// libdht calls this from the DHT thread
+static void callback(void* /*closure*/, int event, unsigned char const* info_hash, void const* data, size_t data_len)
 {
-    auto* const session = static_cast<tr_session*>(vsession);
     auto hash = tr_sha1_digest_t{};
     std::copy_n(reinterpret_cast<std::byte const*>(info_hash), std::size(hash), std::data(hash));
-    auto const lock = session->unique_lock();
-    auto* const tor = session->torrents().get(hash);
 
     if (event == DHT_EVENT_VALUES || event == DHT_EVENT_VALUES6)
     {
-        if (tor != nullptr && tor->allowsDht())
-        {
-            auto const pex = event == DHT_EVENT_VALUES ? tr_peerMgrCompactToPex(data, data_len, nullptr, 0) :
-                                                         tr_peerMgrCompact6ToPex(data, data_len, nullptr, 0);
-            tr_peerMgrAddPex(tor, TR_PEER_FROM_DHT, std::data(pex), std::size(pex));
-            tr_logAddDebugTor(
-                tor,
-                fmt::format("Learned {} {} peers from DHT", std::size(pex), event == DHT_EVENT_VALUES6 ? "IPv6" : "IPv4"));
-        }
+        auto const ipv6 = event == DHT_EVENT_VALUES6;
+        auto pex = ipv6 ? tr_peerMgrCompact6ToPex(data, data_len, nullptr, 0) :
+                          tr_peerMgrCompactToPex(data, data_len, nullptr, 0);
+        tr_runInEventThread(impl.session, [hash, pex = std::move(pex), ipv6]() { onPeersFound(hash, pex, ipv6); });
     }
     else if (event == DHT_EVENT_SEARCH_DONE || event == DHT_EVENT_SEARCH_DONE6)
     {
-        if (tor != nullptr)
+        auto const type = event == DHT_EVENT_SEARCH_DONE ? TR_AF_INET : TR_AF_INET6;
+        tr_runInEventThread(impl.session, [hash, type]() { onSearchDone(hash, type); });
+    }
+}
+
+void DhtThread::threadFunc()
+{
+    tr_traceSetThreadName("dht");
+
+    auto next_periodic = std::chrono::steady_clock::now();
+    auto next_refresh = next_periodic;
+    auto packets = std::vector<Packet>{};
+    auto funcs = std::vector<func_t>{};
+
+    for (;;)
+    {
         {
-            if (event == DHT_EVENT_SEARCH_DONE)
+            auto lock = std::unique_lock(mutex_);
+            cv_.wait_until(
+                lock,
+                next_periodic,
+                [this]() { return stopping_ || !std::empty(packets_) || !std::empty(funcs_); });
+
+            if (stopping_)
             {
-                tr_logAddTraceTor(tor, "IPv4 DHT announce done");
+                return;
             }
-            else
+
+            // swap, rather than move, to reuse the buffers' capacity
+            std::swap(packets, packets_);
+            std::swap(funcs, funcs_);
+        }
+
+        for (auto& func : funcs)
+        {
+            func();
+        }
+        funcs.clear();
+
+        for (auto const& packet : packets)
+        {
+            next_periodic = periodic(&packet);
+        }
+        packets.clear();
+
+        auto const now = std::chrono::steady_clock::now();
+        if (next_periodic <= now)
+        {
+            next_periodic = periodic(nullptr);
+        }
+
+        // dht_nodes() walks every bucket, so don't do it for every packet
+        if (next_refresh <= now)
+        {
+            refreshNodeCounts();
+            next_refresh = now + 1s;
+        }
+    }
+}
+
+// Let libdht handle `packet`, if there is one, and whatever
+// else it needs to do. Returns when it next needs to run.
+std::chrono::steady_clock::time_point DhtThread::periodic(Packet const* packet)
+{
+    time_t tosleep = 0;
+    int const rc = packet == nullptr ?
+        dht_periodic(nullptr, 0, nullptr, 0, &tosleep, callback, nullptr) :
+        dht_periodic(
+            std::data(packet->buf),
+            std::size(packet->buf) - 1U, // not counting the '\0'
+            reinterpret_cast<struct sockaddr const*>(&packet->from),
+            packet->fromlen,
+            &tosleep,
+            callback,
+            nullptr);
+
+    if (rc < 0)
+    {
+        if (errno == EINTR)
+        {
+            tosleep = 0;
+        }
+        else
+        {
+            auto const errcode = errno;
+            tr_logAddDebug(fmt::format("dht_periodic failed: {} ({})", tr_strerror(errcode), errcode));
+            if (errcode == EINVAL || errcode == EFAULT)
             {
-                tr_logAddTraceTor(tor, "IPv6 DHT announce done");
+                // TODO: maybe just turn it off instead of crashing?
+                abort();
             }
+
+            tosleep = 1;
         }
     }
+
+    // Being slightly late is fine,
+    // and has the added benefit of adding some jitter.
+    auto const jitter = std::chrono::milliseconds{ tr_rand_int_weak(1000) };
+    return std::chrono::steady_clock::now() + std::chrono::seconds{ tosleep } + jitter;
+}
+
+void DhtThread::refreshNodeCounts()
+{
+    auto counts4 = NodeCounts{};
+    auto counts6 = NodeCounts{};
+    dht_nodes(AF_INET, &counts4.good, &counts4.dubious, nullptr, &counts4.incoming);
+    dht_nodes(AF_INET6, &counts6.good, &counts6.dubious, nullptr, &counts6.incoming);
+
+    auto const lock = std::lock_guard(mutex_);
+    nodes4_ = counts4;
+    nodes6_ = counts6;
 }
 
 static bool announceTorrent(tr_torrent const* const tor, int af, bool announce, tr_port incoming_peer_port)
@@ -701,22 +1004,21 @@ static bool announceTorrent(tr_torrent const* const tor, int af, bool announce,
         return false;
     }
 
-    auto const* dht_hash = reinterpret_cast<unsigned char const*>(std::data(tor->infoHash()));
+    // libdht reports back through callback() when the search is done,
+    // or through onSearchFailed() if it can't start it
+    auto const tor_id = tor->id();
+    auto const hash = tor->infoHash();
     auto const hport = announce ? incoming_peer_port.host() : 0;
-    int const rc = locked_dht::search(dht_hash, hport, af, callback, impl.session);
-    if (rc < 0)
-    {
-        auto const error_code = errno;
-        tr_logAddWarnTor(
-            tor,
-            fmt::format(
-                _("Unable to announce torrent in DHT with {type}: {error} ({error_code}); state is {state}"),
-                fmt::arg("type", af == AF_INET6 ? "IPv6" : "IPv4"),
-                fmt::arg("state", printableStatus(status)),
-                fmt::arg("error_code", error_code),
-                fmt::arg("error", tr_strerror(error_code))));
-        return false;
-    }
+    impl.dht_thread->run(
+        [tor_id, hash, hport, af]()
+        {
+            auto const* dht_hash = reinterpret_cast<unsigned char const*>(std::data(hash));
+            if (dht_search(dht_hash, hport, af, callback, nullptr) < 0)
+            {
+                auto const error_code = errno;
+                tr_runInEventThread(impl.session, [tor_id, af, error_code]() { onSearchFailed(tor_id, af, error_code); });
+            }
+        });
 
     tr_logAddTraceTor(
         tor,
@@ -729,74 +1031,76 @@ static bool announceTorrent(tr_torrent const* const tor, int af, bool announce,
     return true;
 }
 
-void tr_dhtUpkeep()
+std::optional<size_t> SchedulerMediator::peerCount(tr_torrent_id_t tor_id) const
 {
-    TR_ASSERT(impl.session != nullptr);
+    auto const* const tor = impl.session->torrents().get(tor_id);
+    if (tor == nullptr || !tor->isRunning || !tor->allowsDht())
+    {
+        return {};
+    }
 
-    auto lock = impl.session->unique_lock();
-    auto const now = tr_time();
-    auto const incoming_peer_port = impl.session->peerPort();
+    return tr_swarmGetStats(tor->swarm).peer_count;
+}
 
-    for (auto* const tor : impl.session->torrents())
+bool SchedulerMediator::startSearch(tr_torrent_id_t tor_id, tr_address_type type)
+{
+    auto const* const tor = impl.session->torrents().get(tor_id);
+    return tor != nullptr && announceTorrent(tor, type == TR_AF_INET ? AF_INET : AF_INET6, true, impl.session->peerPort());
+}
+
+void tr_dhtTorrentStarted(tr_torrent const* tor)
+{
+    if (!tr_dhtEnabled() || !tor->isRunning || !tor->allowsDht())
     {
-        if (!tor->isRunning || !tor->allowsDht())
-        {
-            continue;
-        }
+        return;
+    }
 
-        if (tor->dhtAnnounceAt <= now)
-        {
-            auto const ok = announceTorrent(tor, AF_INET, true, incoming_peer_port);
-            auto const interval = ok ? 25 * 60 + tr_rand_int_weak(3 * 60) : 5 + tr_rand_int_weak(5);
-            tor->dhtAnnounceAt = now + interval;
-        }
+    auto const now = tr_time();
 
-        if (tor->dhtAnnounce6At <= now)
-        {
-            auto const ok = announceTorrent(tor, AF_INET6, true, incoming_peer_port);
-            auto const interval = ok ? 25 * 60 + tr_rand_int_weak(3 * 60) : 5 + tr_rand_int_weak(5);
-            tor->dhtAnnounce6At = now + interval;
-        }
+    if (getUdpSocket(AF_INET) != TR_BAD_SOCKET)
+    {
+        impl.scheduler->add(tor->id(), TR_AF_INET, now);
+    }
+
+    if (getUdpSocket(AF_INET6) != TR_BAD_SOCKET)
+    {
+        impl.scheduler->add(tor->id(), TR_AF_INET6, now);
     }
 }
 
-void tr_dhtCallback(unsigned char* buf, int buflen, struct sockaddr* from, socklen_t fromlen)
+void tr_dhtTorrentStopped(tr_torrent const* tor)
 {
-    if (!tr_dhtEnabled())
+    if (tr_dhtEnabled())
     {
-        return;
+        impl.scheduler->remove(tor->id());
     }
+}
 
-    time_t tosleep = 0;
-    int const rc = locked_dht::periodic(buf, buflen, from, fromlen, &tosleep, callback, impl.session);
+tr_dht_scheduler::Stats tr_dhtSchedulerStats()
+{
+    return tr_dhtEnabled() ? impl.scheduler->stats() : tr_dht_scheduler::Stats{};
+}
 
-    if (rc < 0)
-    {
-        if (errno == EINTR)
-        {
-            tosleep = 0;
-        }
-        else
-        {
-            auto const errcode = errno;
-            tr_logAddDebug(fmt::format("dht_periodic failed: {} ({})", tr_strerror(errcode), errcode));
-            if (errcode == EINVAL || errcode == EFAULT)
-            {
-                // TODO: maybe just turn it off instead of crashing?
-                abort();
-            }
+void tr_dhtUpkeep()
+{
+    TR_ASSERT(impl.session != nullptr);
 
-            tosleep = 1;
-        }
+    auto lock = impl.session->unique_lock();
+
+    auto& mediator = *impl.scheduler_mediator;
+    mediator.ready[TR_AF_INET] = getStatus(AF_INET) >= Status::Poor;
+    mediator.ready[TR_AF_INET6] = getStatus(AF_INET6) >= Status::Poor;
+    impl.scheduler->pulse(tr_time());
+}
+
+void tr_dhtCallback(unsigned char* buf, int buflen, struct sockaddr* from, socklen_t fromlen)
+{
+    if (!tr_dhtEnabled())
+    {
+        return;
     }
 
-    // Being slightly late is fine,
-    // and has the added benefit of adding some jitter.
-    auto const random_percent = tr_rand_int_weak(1000) / 1000.0;
-    auto const min_interval = std::chrono::seconds{ tosleep };
-    auto const max_interval = std::chrono::seconds{ tosleep + 1 };
-    auto const interval = min_interval + random_percent * (max_interval - min_interval);
-    impl.timer->startSingleShot(std::chrono::duration_cast<std::chrono::milliseconds>(interval));
+    impl.dht_thread->addPacket(buf, buflen, from, fromlen);
 }
 
 extern "C"
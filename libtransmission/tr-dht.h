@@ -13,6 +13,7 @@
 
 #include "transmission.h"
 
+#include "dht-scheduler.h"
 #include "net.h" // tr_port
 
 int tr_dhtInit(tr_session*, tr_socket_t udp4_socket, tr_socket_t udp6_socket);
@@ -23,5 +24,10 @@ bool tr_dhtEnabled();
 std::optional<tr_port> tr_dhtPort();
 
 bool tr_dhtAddNode(tr_address, tr_port, bool bootstrap);
+
+void tr_dhtTorrentStarted(tr_torrent const* tor);
+void tr_dhtTorrentStopped(tr_torrent const* tor);
+tr_dht_scheduler::Stats tr_dhtSchedulerStats();
+
 void tr_dhtUpkeep();
 void tr_dhtCallback(unsigned char* buf, int buflen, struct sockaddr* from, socklen_t fromlen);
@@ -0,0 +1,305 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // size_t
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility> // std::make_pair
+#include <vector>
+
+#include "transmission.h"
+
+#include "tracing.h"
+#include "utils.h" // tr_saveFile()
+
+using namespace std::literals;
+
+std::atomic<bool> tr_trace_impl::enabled = true;
+
+namespace
+{
+
+/*
+ * Trace file format. All integers are little-endian.
+ *
+ *   char[8]  magic: "TRTRACE2"
+ *   uint32   number of event names, followed by that many names,
+ *            each a uint16 length and then the name. Event N's name
+ *            is the Nth in the list.
+ *   uint32   number of thread names, followed by that many entries,
+ *            each a uint32 thread id, a uint16 length, and the name
+ *   uint32   number of argument names, followed by that many entries,
+ *            each a uint8 event, a uint64 argument, a uint16 length,
+ *            and the name of that event's argument value
+ *   uint64   number of records, followed by that many records,
+ *            sorted by start time. Each is three uint64s:
+ *              - start time, in microseconds since tracing started
+ *              - duration in microseconds << 32 | thread id << 8 | event
+ *              - the event's argument
+ */
+auto constexpr FileMagic = "TRTRACE2"sv;
+
+using Record = std::array<uint64_t, 3>;
+
+[[nodiscard]] constexpr uint64_t packRecord(uint64_t duration_usec, uint32_t thread_id, tr_trace_event event) noexcept
+{
+    auto constexpr MaxDuration = uint64_t{ std::numeric_limits<uint32_t>::max() };
+    return std::min(duration_usec, MaxDuration) << 32U | uint64_t{ thread_id & 0xFFFFFFU } << 8U |
+        static_cast<uint64_t>(event);
+}
+
+// A single-writer ring of the writer thread's most recent records.
+// Anyone may read it, though records overwritten during a read are dropped.
+class Ring
+{
+public:
+    static auto constexpr Capacity = size_t{ 1U } << 16U;
+
+    void push(Record const& record) noexcept
+    {
+        auto const pos = head_.load(std::memory_order_relaxed);
+        auto& slot = slots_[pos & (Capacity - 1U)];
+
+        // pairs with the acquire fence in forEach(): a reader that sees any
+        // of these stores will also see that `head_` has reached `pos`
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < std::size(record); ++i)
+        {
+            slot[i].store(record[i], std::memory_order_relaxed);
+        }
+
+        head_.store(pos + 1U, std::memory_order_release);
+    }
+
+    void copyTo(std::vector<Record>& setme) const
+    {
+        auto const end = head_.load(std::memory_order_acquire);
+        auto const begin = end > Capacity ? end - Capacity : uint64_t{};
+
+        auto records = std::vector<Record>{};
+        records.reserve(end - begin);
+        for (auto pos = begin; pos < end; ++pos)
+        {
+            auto const& slot = slots_[pos & (Capacity - 1U)];
+            auto& record = records.emplace_back();
+            for (size_t i = 0; i < std::size(record); ++i)
+            {
+                record[i] = slot[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        // Drop the records that the writer may have overwritten while we were
+        // copying, including one it may be in the middle of writing now.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto const head_now = head_.load(std::memory_order_relaxed);
+        auto const first_intact = head_now >= Capacity ? head_now - Capacity + 1U : uint64_t{};
+        auto const n_dropped = std::min(std::size(records), static_cast<size_t>(std::max(first_intact, begin) - begin));
+
+        setme.insert(std::end(setme), std::begin(records) + n_dropped, std::end(records));
+    }
+
+private:
+    std::array<std::array<std::atomic<uint64_t>, std::tuple_size_v<Record>>, Capacity> slots_ = {};
+    std::atomic<uint64_t> head_ = {};
+};
+
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::vector<Ring*> unused_rings;
+    std::map<uint32_t, std::string> thread_names;
+    std::map<std::pair<tr_trace_event, uint64_t>, std::string> arg_names;
+    uint32_t next_thread_id = 1;
+};
+
+// Never destroyed, since threads may still record events during shutdown.
+Registry& registry()
+{
+    static auto* const instance = new Registry{};
+    return *instance;
+}
+
+// The calling thread's ring. When the thread exits, its ring is kept
+// around for dumps and reused by the next new thread.
+class ThreadRing
+{
+public:
+    ThreadRing() = default;
+    ThreadRing(ThreadRing const&) = delete;
+    ThreadRing& operator=(ThreadRing const&) = delete;
+
+    ~ThreadRing()
+    {
+        if (ring_ != nullptr)
+        {
+            auto& reg = registry();
+            auto const lock = std::lock_guard{ reg.mutex };
+            reg.unused_rings.push_back(ring_);
+        }
+    }
+
+    [[nodiscard]] Ring& ring()
+    {
+        if (ring_ == nullptr)
+        {
+            attach();
+        }
+
+        return *ring_;
+    }
+
+    [[nodiscard]] uint32_t threadId()
+    {
+        if (ring_ == nullptr)
+        {
+            attach();
+        }
+
+        return thread_id_;
+    }
+
+private:
+    void attach()
+    {
+        auto& reg = registry();
+        auto const lock = std::lock_guard{ reg.mutex };
+
+        thread_id_ = reg.next_thread_id++;
+
+        if (!std::empty(reg.unused_rings))
+        {
+            ring_ = reg.unused_rings.back();
+            reg.unused_rings.pop_back();
+        }
+        else
+        {
+            ring_ = reg.rings.emplace_back(std::make_unique<Ring>()).get();
+        }
+    }
+
+    Ring* ring_ = nullptr;
+    uint32_t thread_id_ = 0;
+};
+
+thread_local ThreadRing thread_ring;
+
+void appendLE(std::string& out, uint64_t value, size_t n_bytes)
+{
+    for (size_t i = 0; i < n_bytes; ++i)
+    {
+        out.push_back(static_cast<char>((value >> (8U * i)) & 0xFFU));
+    }
+}
+
+void appendString(std::string& out, std::string_view str)
+{
+    appendLE(out, std::size(str), 2);
+    out.append(str);
+}
+
+} // namespace
+
+void tr_traceSetEnabled(bool enabled) noexcept
+{
+    tr_trace_impl::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+uint64_t tr_traceNow() noexcept
+{
+    using Clock = std::chrono::steady_clock;
+    static auto const epoch = Clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - epoch).count();
+}
+
+void tr_traceRecord(tr_trace_event event, uint64_t begin_usec, uint64_t arg) noexcept
+{
+    if (!tr_traceIsEnabled())
+    {
+        return;
+    }
+
+    auto const end_usec = tr_traceNow();
+    auto const duration_usec = end_usec > begin_usec ? end_usec - begin_usec : uint64_t{};
+    thread_ring.ring().push({ begin_usec, packRecord(duration_usec, thread_ring.threadId(), event), arg });
+}
+
+void tr_traceSetThreadName(std::string_view name)
+{
+    auto const thread_id = thread_ring.threadId();
+
+    auto& reg = registry();
+    auto const lock = std::lock_guard{ reg.mutex };
+    reg.thread_names.insert_or_assign(thread_id, std::string{ name });
+}
+
+void tr_traceSetArgName(tr_trace_event event, uint64_t arg, std::string_view name)
+{
+    auto& reg = registry();
+    auto const lock = std::lock_guard{ reg.mutex };
+    reg.arg_names.insert_or_assign(std::make_pair(event, arg), std::string{ name });
+}
+
+bool tr_traceDump(std::string_view filename, tr_error** error)
+{
+    auto records = std::vector<Record>{};
+    auto out = std::string{ FileMagic };
+
+    appendLE(out, std::size(TrTraceEventNames), 4);
+    for (auto const& name : TrTraceEventNames)
+    {
+        appendString(out, name);
+    }
+
+    {
+        auto& reg = registry();
+        auto const lock = std::lock_guard{ reg.mutex };
+
+        appendLE(out, std::size(reg.thread_names), 4);
+        for (auto const& [thread_id, name] : reg.thread_names)
+        {
+            appendLE(out, thread_id, 4);
+            appendString(out, name);
+        }
+
+        appendLE(out, std::size(reg.arg_names), 4);
+        for (auto const& [key, name] : reg.arg_names)
+        {
+            auto const& [event, arg] = key;
+            appendLE(out, static_cast<uint64_t>(event), 1);
+            appendLE(out, arg, 8);
+            appendString(out, name);
+        }
+
+        for (auto const& ring : reg.rings)
+        {
+            ring->copyTo(records);
+        }
+    }
+
+    std::sort(std::begin(records), std::end(records));
+
+    out.reserve(std::size(out) + 8U + std::size(records) * sizeof(Record));
+    appendLE(out, std::size(records), 8);
+    for (auto const& record : records)
+    {
+        for (auto const word : record)
+        {
+            appendLE(out, word, 8);
+        }
+    }
+
+    return tr_saveFile(filename, out, error);
+}
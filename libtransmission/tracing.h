@@ -0,0 +1,111 @@
+// This file Copyright © 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#ifndef __TRANSMISSION__
+#error only libtransmission should #include this header.
+#endif
+
+#include <array>
+#include <atomic>
+#include <cstdint> // uint64_t
+#include <string_view>
+
+struct tr_error;
+
+/**
+ * Always-on tracing of the events that matter when hunting latency spikes.
+ *
+ * Each thread records fixed-size binary records into its own ring buffer,
+ * so recording an event is a clock read and a few stores with no locks,
+ * allocation, or formatting. The rings keep the most recent events and
+ * can be written to a file on demand with tr_traceDump(), e.g. from the
+ * `trace-dump` RPC method or by sending SIGUSR1 to transmission-daemon.
+ * extras/trace-to-chrome.py converts the file to the Chrome trace JSON
+ * that chrome://tracing and ui.perfetto.dev read.
+ */
+
+// Don't renumber these: the IDs are written to trace files.
+enum class tr_trace_event : uint8_t
+{
+    PeerRead, // arg: bytes read
+    PeerWrite, // arg: bytes written
+    CacheFlush, // arg: blocks written
+    HashCheck, // arg: piece index
+    RpcRequest, // arg: index of the RPC method
+    Announce, // arg: torrent id
+    BandwidthPulse, // arg: peers pumped
+    Verify, // arg: torrent id
+    Preallocate, // arg: torrent id
+};
+
+auto inline constexpr TrTraceEventNames = std::array<std::string_view, 9>{
+    "peer-read", "peer-write",      "cache-flush", "hash-check",  "rpc-request",
+    "announce",  "bandwidth-pulse", "verify",      "preallocate",
+};
+
+namespace tr_trace_impl
+{
+extern std::atomic<bool> enabled;
+} // namespace tr_trace_impl
+
+[[nodiscard]] inline bool tr_traceIsEnabled() noexcept
+{
+    return tr_trace_impl::enabled.load(std::memory_order_relaxed);
+}
+
+void tr_traceSetEnabled(bool enabled) noexcept;
+
+// Microseconds since tracing started, on a monotonic clock.
+[[nodiscard]] uint64_t tr_traceNow() noexcept;
+
+// Record an event that began at `begin_usec` and just ended.
+void tr_traceRecord(tr_trace_event event, uint64_t begin_usec, uint64_t arg = 0) noexcept;
+
+// Label the calling thread's events in trace files.
+void tr_traceSetThreadName(std::string_view name);
+
+// Label `event`'s records whose argument is `arg` in trace files,
+// e.g. to name the RPC method that a RpcRequest's index refers to.
+void tr_traceSetArgName(tr_trace_event event, uint64_t arg, std::string_view name);
+
+// Write every thread's recent events to `filename`.
+bool tr_traceDump(std::string_view filename, tr_error** error = nullptr);
+
+// Records an event spanning the scope's lifetime.
+class tr_trace_scope
+{
+public:
+    explicit tr_trace_scope(tr_trace_event event, uint64_t arg = 0) noexcept
+        : enabled_{ tr_traceIsEnabled() }
+        , event_{ event }
+        , begin_usec_{ enabled_ ? tr_traceNow() : 0U }
+        , arg_{ arg }
+    {
+    }
+
+    ~tr_trace_scope()
+    {
+        if (enabled_)
+        {
+            tr_traceRecord(event_, begin_usec_, arg_);
+        }
+    }
+
+    tr_trace_scope(tr_trace_scope const&) = delete;
+    tr_trace_scope& operator=(tr_trace_scope const&) = delete;
+
+    void setArg(uint64_t arg) noexcept
+    {
+        arg_ = arg;
+    }
+
+private:
+    bool const enabled_;
+    tr_trace_event const event_;
+    uint64_t const begin_usec_;
+    uint64_t arg_;
+};
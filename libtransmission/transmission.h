@@ -242,6 +242,15 @@ void tr_sessionClose(tr_session*);
  */
 char const* tr_sessionGetConfigDir(tr_session const*);
 
+/**
+ * @brief Write the most recent trace events to a file in the config dir.
+ *
+ * The file can be converted to Chrome trace JSON with extras/trace-to-chrome.py.
+ *
+ * @return the file's name, or an empty string on error
+ */
+[[nodiscard]] std::string tr_sessionDumpTrace(tr_session* session, tr_error** error = nullptr);
+
 /**
  * @brief Set the per-session default download folder for new torrents.
  * @see tr_sessionInit()
@@ -1288,6 +1297,9 @@ struct tr_peer_stat
 
     /* how many requests we've made and are currently awaiting a response for */
     int activeReqsToPeer;
+
+    /* how many bytes are queued to send to this peer */
+    uint64_t bytesQueuedToPeer;
 };
 
 tr_peer_stat* tr_torrentPeers(tr_torrent const* torrent, int* peer_count);
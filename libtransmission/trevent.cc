@@ -6,7 +6,6 @@
 #include <chrono>
 #include <condition_variable>
 #include <functional>
-#include <list>
 #include <mutex>
 #include <shared_mutex>
 #include <thread>
@@ -26,7 +25,9 @@
 #include "log.h"
 #include "net.h"
 #include "session.h"
+#include "task-queue.h"
 #include "tr-assert.h"
+#include "tracing.h"
 #include "trevent.h"
 #include "utils.h"
 
@@ -146,14 +147,13 @@ void tr_evthread_init()
 
 struct tr_event_handle
 {
-    using callback = std::function<void(void)>;
-
-    using work_queue_t = std::list<callback>;
-    work_queue_t work_queue;
-    std::condition_variable work_queue_cv;
-    std::mutex work_queue_mutex;
+    tr_task_queue work_queue;
     event* work_queue_event = nullptr;
 
+    // used to wait for the libevent thread to start
+    std::condition_variable started_cv;
+    std::mutex started_mutex;
+
     tr_session* session = nullptr;
     std::thread::id thread_id;
 };
@@ -164,18 +164,9 @@ static void onWorkAvailable(evutil_socket_t /*fd*/, short /*flags*/, void* vsess
     auto* const session = static_cast<tr_session*>(vsession);
     TR_ASSERT(tr_amInEventThread(session));
 
-    // steal the work queue
-    auto* events = session->events;
-    auto work_queue_lock = std::unique_lock(events->work_queue_mutex);
-    auto work_queue = tr_event_handle::work_queue_t{};
-    std::swap(work_queue, events->work_queue);
-    work_queue_lock.unlock();
-
-    // process the work queue
-    for (auto const& func : work_queue)
-    {
-        func();
-    }
+    auto& stats = session->eventLoopStats();
+    auto const loop_scope = tr_event_loop_stats::Scope{ stats, tr_event_loop_callback::WorkQueue, stats.takeWorkQueueLag() };
+    stats.onWorkQueueDrained(session->events->work_queue.drain());
 }
 
 static void libeventThreadFunc(tr_event_handle* events)
@@ -186,6 +177,7 @@ static void libeventThreadFunc(tr_event_handle* events)
 #endif
 
     tr_evthread_init();
+    tr_traceSetThreadName("event");
 
     // create the libevent base
     auto* base = events->session->eventBase();
@@ -196,7 +188,7 @@ static void libeventThreadFunc(tr_event_handle* events)
 
     // tell the thread that's waiting in tr_eventInit()
     // that this thread is ready for business
-    events->work_queue_cv.notify_one();
+    events->started_cv.notify_one();
 
     // loop until `tr_eventClose()` kills the loop
     event_base_loop(base, EVLOOP_NO_EXIT_ON_EMPTY);
@@ -215,12 +207,12 @@ void tr_eventInit(tr_session* session)
     auto* const events = new tr_event_handle();
     events->session = session;
 
-    auto lock = std::unique_lock(events->work_queue_mutex);
+    auto lock = std::unique_lock(events->started_mutex);
     auto thread = std::thread(libeventThreadFunc, events);
     events->thread_id = thread.get_id();
     thread.detach();
     // wait until the libevent thread is running
-    events->work_queue_cv.wait(lock, [session] { return session->events != nullptr; });
+    events->started_cv.wait(lock, [session] { return session->events != nullptr; });
 }
 
 void tr_eventClose(tr_session* session)
@@ -254,7 +246,7 @@ bool tr_amInEventThread(tr_session const* session)
 ***
 **/
 
-void tr_runInEventThread(tr_session* session, std::function<void(void)>&& func)
+void tr_runInEventThread(tr_session* session, tr_task&& task)
 {
     TR_ASSERT(session != nullptr);
     auto* events = session->events;
@@ -262,14 +254,12 @@ void tr_runInEventThread(tr_session* session, std::function<void(void)>&& func)
 
     if (tr_amInEventThread(session))
     {
-        func();
+        task();
     }
-    else
+    else if (events->work_queue.push(std::move(task)))
     {
-        auto lock = std::unique_lock(events->work_queue_mutex);
-        events->work_queue.emplace_back(std::move(func));
-        lock.unlock();
-
+        // only the first post since the last drain needs to wake the loop
+        session->eventLoopStats().onWorkQueueWakeup();
         event_active(events->work_queue_event, 0, {});
     }
 }
@@ -9,10 +9,10 @@
 #error only libtransmission should #include this header.
 #endif
 
-#include <functional>
 #include <tuple>
 #include <utility>
 
+#include "task-queue.h"
 #include "tr-macros.h"
 
 struct tr_session;
@@ -25,15 +25,22 @@ void tr_eventClose(tr_session* session);
 
 bool tr_amInEventThread(tr_session const* session);
 
-void tr_runInEventThread(tr_session* session, std::function<void(void)>&& func);
+void tr_runInEventThread(tr_session* session, tr_task&& task);
 
 template<typename Func, typename... Args>
 void tr_runInEventThread(tr_session* session, Func&& func, Args&&... args)
 {
-    tr_runInEventThread(
-        session,
-        std::function<void(void)>{ [func = std::forward<Func&&>(func), args = std::make_tuple(std::forward<Args>(args)...)]()
-                                   {
-                                       std::apply(std::move(func), std::move(args));
-                                   } });
+    if constexpr (sizeof...(Args) == 0)
+    {
+        tr_runInEventThread(session, tr_task{ std::forward<Func>(func) });
+    }
+    else
+    {
+        tr_runInEventThread(
+            session,
+            tr_task{ [func = std::forward<Func&&>(func), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+                     {
+                         std::apply(std::move(func), std::move(args));
+                     } });
+    }
 }
@@ -21,6 +21,7 @@
 #include "log.h"
 #include "torrent.h"
 #include "tr-assert.h"
+#include "tracing.h"
 #include "utils.h" // tr_time(), tr_wait_msec()
 #include "verify.h"
 
@@ -58,6 +59,7 @@ int tr_verify_worker::Node::compare(tr_verify_worker::Node const& that) const
 
 bool tr_verify_worker::verifyTorrent(tr_torrent* tor, bool const* stop_flag)
 {
+    auto const trace = tr_trace_scope{ tr_trace_event::Verify, static_cast<uint64_t>(tor->id()) };
     auto const begin = tr_time();
 
     tr_sys_file_t fd = TR_BAD_SYS_FILE;
@@ -105,6 +107,7 @@ bool tr_verify_worker::verifyTorrent(tr_torrent* tor, bool const* stop_flag)
             if (tr_sys_file_read_at(fd, std::data(buffer), bytes_this_pass, file_pos, &num_read) && num_read > 0)
             {
                 bytes_this_pass = num_read;
+                bytes_read_.fetch_add(num_read, std::memory_order_relaxed);
                 sha->add(std::data(buffer), bytes_this_pass);
                 tr_sys_file_advise(fd, file_pos, bytes_this_pass, TR_SYS_FILE_ADVICE_DONT_NEED);
             }
@@ -139,6 +142,7 @@ bool tr_verify_worker::verifyTorrent(tr_torrent* tor, bool const* stop_flag)
             }
 
             sha->clear();
+            pieces_checked_.fetch_add(1U, std::memory_order_relaxed);
             ++piece;
             tor->setVerifyProgress(piece / float(tor->pieceCount()));
             piece_pos = 0;
@@ -179,6 +183,8 @@ bool tr_verify_worker::verifyTorrent(tr_torrent* tor, bool const* stop_flag)
 
 void tr_verify_worker::verifyThreadFunc()
 {
+    tr_traceSetThreadName("verify");
+
     for (;;)
     {
         {
@@ -202,6 +208,7 @@ void tr_verify_worker::verifyThreadFunc()
         tor->setVerifyState(TR_VERIFY_NOW);
         auto const changed = verifyTorrent(tor, &stop_current_);
         tor->setVerifyState(TR_VERIFY_NONE);
+        torrents_verified_.fetch_add(1U, std::memory_order_relaxed);
         TR_ASSERT(tr_isTorrent(tor));
 
         if (!stop_current_ && changed)
@@ -213,6 +220,18 @@ void tr_verify_worker::verifyThreadFunc()
     }
 }
 
+tr_verify_worker::Stats tr_verify_worker::stats()
+{
+    auto stats = Stats{};
+    stats.torrents_verified = torrents_verified_.load(std::memory_order_relaxed);
+    stats.pieces_checked = pieces_checked_.load(std::memory_order_relaxed);
+    stats.bytes_read = bytes_read_.load(std::memory_order_relaxed);
+
+    auto const lock = std::lock_guard(verify_mutex_);
+    stats.queued = std::size(todo_) + (current_node_ ? 1U : 0U);
+    return stats;
+}
+
 void tr_verify_worker::add(tr_torrent* tor)
 {
     TR_ASSERT(tr_isTorrent(tor));
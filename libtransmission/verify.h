@@ -9,6 +9,8 @@
 #error only libtransmission should #include this header.
 #endif
 
+#include <atomic>
+#include <cstddef> // size_t
 #include <cstdint>
 #include <functional>
 #include <list>
@@ -36,6 +38,16 @@ public:
 
     void remove(tr_torrent* tor);
 
+    struct Stats
+    {
+        size_t queued = 0; // torrents waiting or being verified
+        uint64_t torrents_verified = 0;
+        uint64_t pieces_checked = 0;
+        uint64_t bytes_read = 0;
+    };
+
+    [[nodiscard]] Stats stats();
+
 private:
     struct Node
     {
@@ -59,7 +71,7 @@ private:
     }
 
     void verifyThreadFunc();
-    [[nodiscard]] static bool verifyTorrent(tr_torrent* tor, bool const* stop_flag);
+    [[nodiscard]] bool verifyTorrent(tr_torrent* tor, bool const* stop_flag);
 
     std::list<callback_func> callbacks_;
     std::mutex verify_mutex_;
@@ -69,4 +81,9 @@ private:
 
     std::optional<std::thread::id> verify_thread_id_;
     bool stop_current_ = false;
+
+    // updated by the verify thread, so readers needn't take `verify_mutex_`
+    std::atomic<uint64_t> torrents_verified_ = {};
+    std::atomic<uint64_t> pieces_checked_ = {};
+    std::atomic<uint64_t> bytes_read_ = {};
 };
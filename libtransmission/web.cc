@@ -30,6 +30,7 @@
 #include "log.h"
 #include "peer-io.h"
 #include "tr-assert.h"
+#include "tracing.h"
 #include "utils.h"
 #include "web.h"
 
@@ -466,6 +467,8 @@ public:
     // the thread started by Impl.curl_thread runs this function
     static void curlThreadFunc(Impl* impl)
     {
+        tr_traceSetThreadName("web");
+
         auto const multi = std::unique_ptr<CURLM, CURLMcode (*)(CURLM*)>(curl_multi_init(), curl_multi_cleanup);
 
         auto running_tasks = int{ 0 };
@@ -4,6 +4,7 @@
 // License text can be found in the licenses/ folder.
 
 #include <algorithm>
+#include <atomic>
 #include <iterator>
 #include <memory>
 #include <numeric> // std::accumulate()
@@ -69,6 +70,9 @@ public:
     // the current position in the task; i.e., the next block to save
     tr_block_info::Location loc;
 
+    // piece data that the web thread has received but not yet reported
+    std::atomic<size_t> unreported_bytes = {};
+
     bool dead = false;
 };
 
@@ -407,17 +411,36 @@ void useFetchedBlocks(tr_webseed_task* task)
 ****
 ***/
 
+// The web thread posts this before it posts the fetch's done callback,
+// so `task` hasn't been deleted yet when this runs.
+void reportPieceData(tr_webseed_task* task)
+{
+    auto const n_bytes = task->unreported_bytes.exchange(0U);
+    if (n_bytes == 0U || task->dead)
+    {
+        return;
+    }
+
+    auto const lock = task->session->unique_lock();
+    task->webseed->gotPieceData(static_cast<uint32_t>(n_bytes));
+}
+
+// Called in the web thread each time curl adds data to the task's buffer.
+// Rather than taking the session lock for every chunk, hand the byte count
+// to the session thread; only the first chunk since the last report posts.
 void onBufferGotData(evbuffer* /*buf*/, evbuffer_cb_info const* info, void* vtask)
 {
     size_t const n_added = info->n_added;
     auto* const task = static_cast<tr_webseed_task*>(vtask);
-    if (n_added == 0 || task->dead)
+    if (n_added == 0)
     {
         return;
     }
 
-    auto const lock = task->session->unique_lock();
-    task->webseed->gotPieceData(n_added);
+    if (task->unreported_bytes.fetch_add(n_added) == 0U)
+    {
+        tr_runInEventThread(task->session, reportPieceData, task);
+    }
 }
 
 void on_idle(tr_webseed* webseed)
@@ -0,0 +1,356 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// The announcer at scale: a session starts many torrents at once, and the
+// clock runs until the stand-in tracker (or DHT swarm) has heard about all
+// of them. Each run also reports how late the announcer sent its requests,
+// and the CPU time and memory that it took to get through them.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime> // std::clock()
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h> // sysconf()
+#endif
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "transmission.h"
+
+#include "announcer.h"
+#include "session.h"
+#include "torrent.h"
+#include "trevent.h"
+#include "tr-strbuf.h"
+#include "variant.h"
+
+#include "benchmark-fixtures.h"
+#include "tracker-stand-ins.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+
+auto constexpr AnnounceTimeout = std::chrono::minutes{ 30 };
+
+enum Protocol : int64_t
+{
+    HTTP,
+    UDP
+};
+
+// The process's resident set size, or 0 if it can't be found.
+uint64_t residentBytes()
+{
+#ifdef __linux__
+    auto statm = std::ifstream{ "/proc/self/statm" };
+    auto size_pages = uint64_t{};
+    auto resident_pages = uint64_t{};
+    if (statm >> size_pages >> resident_pages)
+    {
+        return resident_pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+#endif
+
+    return 0U;
+}
+
+// An upper bound on the 99th percentile of a tr_announcer_stats::LagHistogram:
+// the top of the bucket it falls in.
+double p99Sec(tr_announcer_stats::LagHistogram const& histogram)
+{
+    auto total = uint64_t{};
+    for (auto const count : histogram)
+    {
+        total += count;
+    }
+
+    auto const target = total - total / 100U;
+    auto seen = uint64_t{};
+    for (size_t i = 0; i < std::size(histogram); ++i)
+    {
+        seen += histogram[i];
+        if (seen >= target)
+        {
+            return static_cast<double>(uint64_t{ 1 } << i);
+        }
+    }
+    return static_cast<double>(uint64_t{ 1 } << (std::size(histogram) - 1U));
+}
+
+// What a session needs to know to use a stand-in, and when the stand-in
+// has heard from all of the session's torrents.
+
+std::string announceUrl(TrackerStandIn const& tracker)
+{
+    return tracker.announceUrl();
+}
+
+std::string announceUrl(DhtSwarmStandIn const& /*swarm*/)
+{
+    return {};
+}
+
+void bootstrap(TrackerStandIn const& /*tracker*/, std::string_view /*config_dir*/)
+{
+}
+
+void bootstrap(DhtSwarmStandIn const& swarm, std::string_view config_dir)
+{
+    swarm.writeBootstrapFile(config_dir);
+}
+
+bool isDone(TrackerStandIn const& tracker, size_t n_torrents)
+{
+    return tracker.announced() >= n_torrents && tracker.scraped() >= n_torrents;
+}
+
+bool isDone(DhtSwarmStandIn const& swarm, size_t n_torrents)
+{
+    return swarm.announced() >= n_torrents;
+}
+
+// A session with `n_torrents` paused torrents that all announce to `stand_in`.
+// Torrents without a tracker use the DHT.
+class AnnouncingSession
+{
+public:
+    template<typename StandIn>
+    AnnouncingSession(size_t n_torrents, StandIn const& stand_in)
+    {
+        auto const announce_url = announceUrl(stand_in);
+        bootstrap(stand_in, sandbox_.path());
+
+        auto settings = tr_variant{};
+        tr_variantInitDict(&settings, 12);
+        tr_variantDictAddStr(&settings, TR_KEY_download_dir, tr_pathbuf{ sandbox_.path(), "/Downloads"sv });
+        tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, std::empty(announce_url));
+        tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_pex_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_utp_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_peer_port_random_on_start, true);
+        tr_variantDictAddBool(&settings, TR_KEY_download_queue_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_seed_queue_enabled, false);
+        tr_variantDictAddInt(&settings, TR_KEY_message_level, TR_LOG_CRITICAL);
+        session_ = tr_sessionInit(sandbox_.path().c_str(), false, &settings);
+        tr_variantClear(&settings);
+
+        torrents_.reserve(n_torrents);
+        for (size_t i = 0; i < n_torrents; ++i)
+        {
+            auto const name = fmt::format(FMT_STRING("announcing-{:06d}"), i);
+            auto const metainfo = makeMetainfo(name, 1U, 4U, 16U * 1024U, announce_url);
+            auto* const ctor = tr_ctorNew(session_);
+            tr_ctorSetMetainfo(ctor, std::data(metainfo), std::size(metainfo), nullptr);
+            tr_ctorSetPaused(ctor, TR_FORCE, true);
+            torrents_.push_back(tr_torrentNew(ctor, nullptr));
+            tr_ctorFree(ctor);
+        }
+
+        cancelVerifications(session_, torrents_);
+    }
+
+    ~AnnouncingSession()
+    {
+        tr_sessionClose(session_);
+    }
+
+    AnnouncingSession(AnnouncingSession const&) = delete;
+    AnnouncingSession& operator=(AnnouncingSession const&) = delete;
+
+    void startAll()
+    {
+        for (auto* const tor : torrents_)
+        {
+            tr_torrentStart(tor);
+        }
+    }
+
+    [[nodiscard]] tr_announcer_stats announcerStats() const
+    {
+        auto stats = std::promise<tr_announcer_stats>{};
+        tr_runInEventThread(session_, [this, &stats]() { stats.set_value(tr_announcerStats(session_->announcer)); });
+        return stats.get_future().get();
+    }
+
+private:
+    Sandbox sandbox_;
+    tr_session* session_ = nullptr;
+    std::vector<tr_torrent*> torrents_;
+};
+
+// Times a session starting `n_torrents` at once until the stand-in that
+// `make_stand_in()` returns has heard from all of them. Each iteration gets
+// a new stand-in, which outlives that iteration's session.
+template<typename StandIn>
+void runAnnounces(benchmark::State& state, size_t n_torrents, std::function<std::unique_ptr<StandIn>()> const& make_stand_in)
+{
+    static auto constexpr Tick = 10ms;
+
+    auto cpu_ticks = std::clock_t{};
+    auto rss_per_torrent = uint64_t{};
+    auto stats = tr_announcer_stats{};
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto const stand_in = make_stand_in();
+        auto const rss_before = residentBytes();
+        auto session = std::make_unique<AnnouncingSession>(n_torrents, *stand_in);
+        auto const cpu_before = std::clock();
+        state.ResumeTiming();
+
+        session->startAll();
+
+        auto const deadline = std::chrono::steady_clock::now() + AnnounceTimeout;
+        while (!isDone(*stand_in, n_torrents))
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                state.SkipWithError("timed out");
+                return;
+            }
+
+            std::this_thread::sleep_for(Tick);
+        }
+
+        state.PauseTiming();
+        cpu_ticks += std::clock() - cpu_before;
+        auto const rss_after = residentBytes();
+        rss_per_torrent = rss_after > rss_before ? (rss_after - rss_before) / n_torrents : 0U;
+        stats = session->announcerStats();
+        session.reset();
+        state.ResumeTiming();
+    }
+
+    // std::clock() is the CPU time of the whole process: the session *and* the stand-ins
+    auto const cpu_sec = static_cast<double>(cpu_ticks) / CLOCKS_PER_SEC;
+    auto const n_announced = static_cast<double>(state.iterations() * n_torrents);
+    state.SetItemsProcessed(state.iterations() * n_torrents);
+    state.counters["cpu_ms_per_1k_torrents"] = cpu_sec * 1000.0 / (n_announced / 1000.0);
+    state.counters["rss_B_per_torrent"] = static_cast<double>(rss_per_torrent);
+    state.counters["announce_lag_p99_s"] = p99Sec(stats.announce_lag_sec);
+    state.counters["scrape_lag_p99_s"] = p99Sec(stats.scrape_lag_sec);
+}
+
+std::unique_ptr<TrackerStandIn> makeTracker(Protocol protocol, TrackerBehavior const& behavior)
+{
+    if (protocol == UDP)
+    {
+        return std::make_unique<UdpTrackerStandIn>(behavior);
+    }
+
+    return std::make_unique<HttpTrackerStandIn>(behavior);
+}
+
+// Starts `n_torrents` that use one tracker and waits until it has heard from all of them.
+void runTracker(benchmark::State& state, size_t n_torrents, Protocol protocol, TrackerBehavior const& behavior)
+{
+    runAnnounces<TrackerStandIn>(state, n_torrents, [protocol, &behavior]() { return makeTracker(protocol, behavior); });
+}
+
+// A tracker that answers every request right away
+void BM_AnnounceStartup(benchmark::State& state)
+{
+    runTracker(state, static_cast<size_t>(state.range(1)), static_cast<Protocol>(state.range(0)), {});
+}
+
+// A tracker that takes `delay_ms` to answer each request
+void BM_AnnounceSlowTracker(benchmark::State& state)
+{
+    auto behavior = TrackerBehavior{};
+    behavior.delay = std::chrono::milliseconds{ state.range(1) };
+    runTracker(state, 10000U, static_cast<Protocol>(state.range(0)), behavior);
+}
+
+// A tracker that answers `error_pct`% of requests with a failure reason
+void BM_AnnounceFlakyTracker(benchmark::State& state)
+{
+    auto behavior = TrackerBehavior{};
+    behavior.error_rate = static_cast<double>(state.range(1)) / 100.0;
+    runTracker(state, 10000U, static_cast<Protocol>(state.range(0)), behavior);
+}
+
+// A tracker that refuses scrapes for more than `multiscrape_max` torrents at
+// once, so the announcer has to find its limit.
+void BM_AnnounceMultiscrapeLimit(benchmark::State& state)
+{
+    auto behavior = TrackerBehavior{};
+    behavior.multiscrape_max = static_cast<size_t>(state.range(1));
+    runTracker(state, 10000U, static_cast<Protocol>(state.range(0)), behavior);
+}
+
+// Trackerless torrents, announced to a swarm of `nodes` DHT nodes
+void BM_AnnounceDht(benchmark::State& state)
+{
+    auto const& addresses = localPeerAddresses();
+    auto const it = std::find_if(
+        std::begin(addresses),
+        std::end(addresses),
+        [](auto const& addr) { return addr.isIPv4(); });
+    if (it == std::end(addresses))
+    {
+        state.SkipWithError("needs an IPv4 address other than loopback for its DHT nodes");
+        return;
+    }
+
+    auto const address = *it;
+    auto const n_nodes = static_cast<size_t>(state.range(0));
+    auto const n_torrents = static_cast<size_t>(state.range(1));
+    runAnnounces<DhtSwarmStandIn>(
+        state,
+        n_torrents,
+        [&address, n_nodes]() { return std::make_unique<DhtSwarmStandIn>(address, n_nodes); });
+}
+
+// protocol: 0 = HTTP, 1 = UDP
+BENCHMARK(BM_AnnounceStartup)
+    ->ArgsProduct({ { HTTP, UDP }, { 1000, 10000, 100000 } })
+    ->ArgNames({ "protocol", "torrents" })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AnnounceSlowTracker)
+    ->ArgsProduct({ { HTTP, UDP }, { 200, 2000 } })
+    ->ArgNames({ "protocol", "delay_ms" })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AnnounceFlakyTracker)
+    ->ArgsProduct({ { HTTP, UDP }, { 10, 50 } })
+    ->ArgNames({ "protocol", "error_pct" })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AnnounceMultiscrapeLimit)
+    ->ArgsProduct({ { HTTP, UDP }, { 10 } })
+    ->ArgNames({ "protocol", "multiscrape_max" })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AnnounceDht)
+    ->ArgsProduct({ { 32, 256 }, { 100, 1000 } })
+    ->ArgNames({ "nodes", "torrents" })
+    ->Iterations(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
@@ -0,0 +1,311 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#pragma once
+
+#include <cstddef> // size_t
+#include <cstdint>
+#include <cstdlib> // getenv()
+#include <cstring> // std::memcpy()
+#include <functional> // std::hash
+#include <future>
+#include <iterator> // std::rbegin()
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <tuple> // std::tuple_size_v
+#include <vector>
+
+#ifndef _WIN32
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "transmission.h"
+
+#include "error.h"
+#include "file.h"
+#include "log.h"
+#include "net.h"
+#include "quark.h"
+#include "session.h"
+#include "torrent.h"
+#include "trevent.h"
+#include "tr-strbuf.h"
+#include "utils.h"
+#include "variant.h"
+
+namespace libtransmission
+{
+
+namespace bench
+{
+
+using namespace std::literals;
+
+// Every benchmark uses the same seed so that runs are comparable.
+inline auto makeRandomEngine()
+{
+    return std::mt19937_64{ 20221017U };
+}
+
+// A temporary directory that's removed, with everything in it, on destruction.
+class Sandbox
+{
+public:
+    Sandbox()
+    {
+        auto const* const tmpdir = getenv("TMPDIR");
+        path_ = fmt::format(FMT_STRING("{:s}/transmission-benchmark-XXXXXX"), tmpdir != nullptr ? tmpdir : "/tmp");
+        tr_sys_dir_create_temp(std::data(path_));
+    }
+
+    ~Sandbox()
+    {
+        rimraf(path_);
+    }
+
+    Sandbox(Sandbox const&) = delete;
+    Sandbox& operator=(Sandbox const&) = delete;
+
+    [[nodiscard]] std::string const& path() const noexcept
+    {
+        return path_;
+    }
+
+private:
+    static void rimraf(std::string const& path)
+    {
+        if (auto const info = tr_sys_path_get_info(path); info && info->isFolder())
+        {
+            if (auto const odir = tr_sys_dir_open(path.c_str()); odir != TR_BAD_SYS_DIR)
+            {
+                for (char const* name = nullptr; (name = tr_sys_dir_read_name(odir)) != nullptr;)
+                {
+                    if ("."sv != name && ".."sv != name)
+                    {
+                        rimraf(fmt::format(FMT_STRING("{:s}/{:s}"), path, name));
+                    }
+                }
+
+                tr_sys_dir_close(odir);
+            }
+        }
+
+        tr_sys_path_remove(path.c_str());
+    }
+
+    std::string path_;
+};
+
+// Bencoded metainfo for a torrent with `n_files` files of roughly the same
+// size and `n_pieces` pieces of `piece_size` bytes. The piece hashes are
+// random, so the torrent's data can't be verified, only described.
+// If `announce_url` is set, that's the torrent's only tracker.
+inline std::string makeMetainfo(
+    std::string_view name,
+    size_t n_files,
+    size_t n_pieces,
+    uint32_t piece_size,
+    std::string_view announce_url = {})
+{
+    auto rng = makeRandomEngine();
+    rng.seed(std::hash<std::string_view>{}(name));
+
+    auto pieces = std::string(n_pieces * std::tuple_size_v<tr_sha1_digest_t>, '\0');
+    for (auto& ch : pieces)
+    {
+        ch = static_cast<char>(rng());
+    }
+
+    auto top = tr_variant{};
+    tr_variantInitDict(&top, 2);
+    if (!std::empty(announce_url))
+    {
+        tr_variantDictAddStr(&top, TR_KEY_announce, announce_url);
+    }
+    auto* const info = tr_variantDictAddDict(&top, TR_KEY_info, 4);
+    tr_variantDictAddStr(info, TR_KEY_name, name);
+    tr_variantDictAddInt(info, TR_KEY_piece_length, piece_size);
+    tr_variantDictAddRaw(info, TR_KEY_pieces, std::data(pieces), std::size(pieces));
+
+    auto const total_size = uint64_t{ n_pieces } * piece_size;
+    if (n_files <= 1U)
+    {
+        tr_variantDictAddInt(info, TR_KEY_length, total_size);
+    }
+    else
+    {
+        auto* const files = tr_variantDictAddList(info, TR_KEY_files, n_files);
+        auto const file_size = total_size / n_files;
+        for (size_t i = 0; i < n_files; ++i)
+        {
+            auto* const file = tr_variantListAddDict(files, 2);
+            auto const is_last = i + 1U == n_files;
+            tr_variantDictAddInt(file, TR_KEY_length, is_last ? total_size - file_size * i : file_size);
+            auto* const path = tr_variantDictAddList(file, TR_KEY_path, 2);
+            tr_variantListAddStr(path, fmt::format(FMT_STRING("dir-{:03d}"), i / 100U));
+            tr_variantListAddStr(path, fmt::format(FMT_STRING("file-{:06d}.bin"), i));
+        }
+    }
+
+    auto benc = tr_variantToStr(&top, TR_VARIANT_FMT_BENC);
+    tr_variantClear(&top);
+    return benc;
+}
+
+// Newly-added torrents with no local data still get queued for verification,
+// and the verifier sleeps for a moment per torrent, so adding thousands of them
+// means a long wait for nothing. Cancel those verifications and wait for them
+// to go away. Call this after adding the torrents.
+inline void cancelVerifications(tr_session* session, std::vector<tr_torrent*> const& torrents)
+{
+    // This runs after the torrents' own verify requests in the libevent thread.
+    // Go newest-first: the verifier works oldest-first, and cancelling the
+    // torrent that it's working on means waiting for it to notice.
+    auto cancelled = std::promise<void>{};
+    tr_runInEventThread(
+        session,
+        [session, &torrents, &cancelled]()
+        {
+            for (auto it = std::rbegin(torrents), end = std::rend(torrents); it != end; ++it)
+            {
+                session->verifyRemove(*it);
+            }
+
+            cancelled.set_value();
+        });
+    cancelled.get_future().wait();
+}
+
+// Every local address that libtransmission is willing to connect to.
+inline std::vector<tr_address> const& localPeerAddresses()
+{
+    static auto const addresses = []()
+    {
+        auto ret = std::vector<tr_address>{};
+
+#ifndef _WIN32
+        ifaddrs* ifaddr = nullptr;
+        if (getifaddrs(&ifaddr) != 0)
+        {
+            return ret;
+        }
+
+        for (auto const* ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next)
+        {
+            if (ifa->ifa_addr == nullptr)
+            {
+                continue;
+            }
+
+            auto const family = ifa->ifa_addr->sa_family;
+            if (family != AF_INET && family != AF_INET6)
+            {
+                continue;
+            }
+
+            auto ss = sockaddr_storage{};
+            std::memcpy(&ss, ifa->ifa_addr, family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
+
+            auto addr = tr_address{};
+            auto port = tr_port{};
+            if (tr_address_from_sockaddr_storage(&addr, &port, &ss) &&
+                tr_address_is_valid_for_peers(&addr, tr_port::fromHost(1)))
+            {
+                ret.push_back(addr);
+            }
+        }
+
+        freeifaddrs(ifaddr);
+#endif
+
+        return ret;
+    }();
+
+    return addresses;
+}
+
+// A session with `n_torrents` paused, single-file torrents, all of them
+// missing their data, in its own sandbox. Creating a large session takes
+// a while, so benchmarks should share one with SyntheticSession::get().
+class SyntheticSession
+{
+public:
+    explicit SyntheticSession(size_t n_torrents)
+    {
+        auto settings = tr_variant{};
+        tr_variantInitDict(&settings, 10);
+        tr_variantDictAddStr(&settings, TR_KEY_download_dir, tr_pathbuf{ sandbox_.path(), "/Downloads"sv });
+        tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_utp_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+        tr_variantDictAddBool(&settings, TR_KEY_peer_port_random_on_start, true);
+        tr_variantDictAddInt(&settings, TR_KEY_message_level, TR_LOG_CRITICAL);
+        session_ = tr_sessionInit(sandbox_.path().c_str(), false, &settings);
+        tr_variantClear(&settings);
+
+        torrents_.reserve(n_torrents);
+        for (size_t i = 0; i < n_torrents; ++i)
+        {
+            auto const metainfo = makeMetainfo(fmt::format(FMT_STRING("synthetic-{:06d}"), i), 1U, 64U, 256U * 1024U);
+            auto* const ctor = tr_ctorNew(session_);
+            tr_ctorSetMetainfo(ctor, std::data(metainfo), std::size(metainfo), nullptr);
+            tr_ctorSetPaused(ctor, TR_FORCE, true);
+            torrents_.push_back(tr_torrentNew(ctor, nullptr));
+            tr_ctorFree(ctor);
+        }
+
+        // don't let the new torrents' verifications skew the measurements
+        cancelVerifications(session_, torrents_);
+    }
+
+    ~SyntheticSession()
+    {
+        tr_sessionClose(session_);
+    }
+
+    SyntheticSession(SyntheticSession const&) = delete;
+    SyntheticSession& operator=(SyntheticSession const&) = delete;
+
+    [[nodiscard]] tr_session* session() const noexcept
+    {
+        return session_;
+    }
+
+    [[nodiscard]] std::vector<tr_torrent*> const& torrents() const noexcept
+    {
+        return torrents_;
+    }
+
+    // Keeps the most recently requested session alive between benchmarks.
+    static SyntheticSession& get(size_t n_torrents)
+    {
+        static auto instance = std::unique_ptr<SyntheticSession>{};
+
+        if (!instance || std::size(instance->torrents()) != n_torrents)
+        {
+            instance.reset();
+            instance = std::make_unique<SyntheticSession>(n_torrents);
+        }
+
+        return *instance;
+    }
+
+private:
+    Sandbox sandbox_;
+    tr_session* session_ = nullptr;
+    std::vector<tr_torrent*> torrents_;
+};
+
+} // namespace bench
+
+} // namespace libtransmission
@@ -0,0 +1,134 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::min()
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "transmission.h"
+
+#include "bitfield.h"
+
+#include "benchmark-fixtures.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+
+// A bitfield with about half of its bits set, in runs, like a
+// partially-downloaded torrent's blocks.
+tr_bitfield makeHalfFullBitfield(size_t bit_count)
+{
+    auto rng = makeRandomEngine();
+    auto raw = std::vector<uint8_t>((bit_count + 7U) / 8U);
+    for (size_t begin = 0; begin < bit_count;)
+    {
+        auto const end = std::min(bit_count, begin + 1U + rng() % 64U);
+        if (rng() % 2U == 0U)
+        {
+            for (auto bit = begin; bit < end; ++bit)
+            {
+                raw[bit / 8U] |= 0x80U >> (bit % 8U);
+            }
+        }
+        begin = end;
+    }
+
+    auto bitfield = tr_bitfield{ bit_count };
+    bitfield.setRaw(std::data(raw), std::size(raw));
+    return bitfield;
+}
+
+void BM_BitfieldTest(benchmark::State& state)
+{
+    auto const bit_count = static_cast<size_t>(state.range(0));
+    auto const bitfield = makeHalfFullBitfield(bit_count);
+    auto rng = makeRandomEngine();
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(bitfield.test(rng() % bit_count));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_BitfieldSet(benchmark::State& state)
+{
+    auto const bit_count = static_cast<size_t>(state.range(0));
+    auto bitfield = makeHalfFullBitfield(bit_count);
+    auto rng = makeRandomEngine();
+
+    for (auto _ : state)
+    {
+        auto const bit = rng();
+        bitfield.set(bit % bit_count, (bit >> 32U) % 2U == 0U);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// e.g. marking a piece's blocks as received
+void BM_BitfieldSetSpan(benchmark::State& state)
+{
+    static auto constexpr SpanSize = size_t{ 64U };
+    auto const bit_count = static_cast<size_t>(state.range(0));
+    auto bitfield = tr_bitfield{ bit_count };
+    auto rng = makeRandomEngine();
+
+    for (auto _ : state)
+    {
+        auto const begin = rng() % (bit_count - SpanSize);
+        bitfield.setSpan(begin, begin + SpanSize, begin % 2U == 0U);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// e.g. counting how many of a file's blocks we have
+void BM_BitfieldCountRange(benchmark::State& state)
+{
+    auto const bit_count = static_cast<size_t>(state.range(0));
+    auto const bitfield = makeHalfFullBitfield(bit_count);
+    auto rng = makeRandomEngine();
+
+    for (auto _ : state)
+    {
+        auto const begin = rng() % bit_count;
+        auto const end = begin + 1U + rng() % (bit_count - begin);
+        benchmark::DoNotOptimize(bitfield.count(begin, end));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// e.g. a peer's BITFIELD message, in and out
+void BM_BitfieldRawRoundTrip(benchmark::State& state)
+{
+    auto const bit_count = static_cast<size_t>(state.range(0));
+    auto const raw = makeHalfFullBitfield(bit_count).raw();
+    auto bitfield = tr_bitfield{ bit_count };
+
+    for (auto _ : state)
+    {
+        bitfield.setRaw(std::data(raw), std::size(raw));
+        benchmark::DoNotOptimize(bitfield.raw());
+    }
+
+    state.SetBytesProcessed(state.iterations() * std::size(raw));
+}
+
+// 1 Ki to 4 Mi bits, i.e. the blocks of torrents from 16 MiB to 64 GiB
+BENCHMARK(BM_BitfieldTest)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_BitfieldSet)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_BitfieldSetSpan)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_BitfieldCountRange)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_BitfieldRawRoundTrip)->RangeMultiplier(16)->Range(1 << 10, 1 << 22);
+
+} // namespace
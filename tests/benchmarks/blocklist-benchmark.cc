@@ -0,0 +1,145 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator> // std::back_inserter()
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "transmission.h"
+
+#include "blocklist.h"
+#include "file.h"
+#include "net.h"
+#include "tr-strbuf.h"
+
+#include "benchmark-fixtures.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+
+// A P2P-format blocklist with `n_ranges` random IPv4 ranges, about the size
+// of the large public lists.
+class SyntheticBlocklist
+{
+public:
+    explicit SyntheticBlocklist(size_t n_ranges)
+        : text_filename_{ sandbox_.path(), "/level1.txt"sv }
+        , bin_filename_{ sandbox_.path(), "/level1.bin"sv }
+        , n_ranges_{ n_ranges }
+    {
+        auto rng = makeRandomEngine();
+        auto contents = std::string{};
+        auto const stride = UINT32_MAX / n_ranges;
+        for (size_t i = 0; i < n_ranges; ++i)
+        {
+            auto const begin = static_cast<uint32_t>(stride * i + rng() % (stride / 2U));
+            auto const end = begin + static_cast<uint32_t>(rng() % (stride / 2U));
+            fmt::format_to(
+                std::back_inserter(contents),
+                FMT_STRING("Range {:d}:{:d}.{:d}.{:d}.{:d}-{:d}.{:d}.{:d}.{:d}\n"),
+                i,
+                begin >> 24U,
+                (begin >> 16U) & 0xFFU,
+                (begin >> 8U) & 0xFFU,
+                begin & 0xFFU,
+                end >> 24U,
+                (end >> 16U) & 0xFFU,
+                (end >> 8U) & 0xFFU,
+                end & 0xFFU);
+        }
+
+        tr_saveFile(text_filename_, contents);
+    }
+
+    [[nodiscard]] auto const& textFilename() const noexcept
+    {
+        return text_filename_;
+    }
+
+    [[nodiscard]] auto const& binFilename() const noexcept
+    {
+        return bin_filename_;
+    }
+
+    static SyntheticBlocklist& get(size_t n_ranges)
+    {
+        static auto instance = std::unique_ptr<SyntheticBlocklist>{};
+
+        if (!instance || instance->n_ranges_ != n_ranges)
+        {
+            instance.reset();
+            instance = std::make_unique<SyntheticBlocklist>(n_ranges);
+        }
+
+        return *instance;
+    }
+
+private:
+    Sandbox sandbox_;
+    tr_pathbuf const text_filename_;
+    tr_pathbuf const bin_filename_;
+    size_t const n_ranges_;
+};
+
+// Parsing, sorting, and merging a downloaded blocklist.
+void BM_BlocklistSetContent(benchmark::State& state)
+{
+    auto const& fixture = SyntheticBlocklist::get(static_cast<size_t>(state.range(0)));
+
+    for (auto _ : state)
+    {
+        auto blocklist = BlocklistFile{ fixture.binFilename(), true };
+        benchmark::DoNotOptimize(blocklist.setContent(fixture.textFilename()));
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Checking each incoming or outgoing peer's address.
+void BM_BlocklistHasAddress(benchmark::State& state)
+{
+    auto const& fixture = SyntheticBlocklist::get(static_cast<size_t>(state.range(0)));
+    auto blocklist = BlocklistFile{ fixture.binFilename(), true };
+    blocklist.setContent(fixture.textFilename());
+
+    auto rng = makeRandomEngine();
+    auto addresses = std::vector<tr_address>{};
+    addresses.reserve(4096U);
+    for (size_t i = 0; i < 4096U; ++i)
+    {
+        auto compact = std::array<uint8_t, 4>{};
+        for (auto& byte : compact)
+        {
+            byte = static_cast<uint8_t>(rng());
+        }
+        addresses.push_back(tr_address::fromCompact4(std::data(compact)).first);
+    }
+
+    auto n_blocked = size_t{};
+    auto i = size_t{};
+    for (auto _ : state)
+    {
+        n_blocked += blocklist.hasAddress(addresses[i++ % std::size(addresses)]) ? 1U : 0U;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.counters["blocked"] = benchmark::Counter(static_cast<double>(n_blocked) / state.iterations());
+}
+
+BENCHMARK(BM_BlocklistSetContent)->Arg(10000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_BlocklistHasAddress)->Arg(10000)->Arg(1000000);
+
+} // namespace
@@ -0,0 +1,157 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm> // std::shuffle()
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility> // std::pair
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "transmission.h"
+
+#include "block-info.h"
+#include "cache.h"
+#include "session.h"
+#include "torrent.h"
+
+#include "benchmark-fixtures.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+
+auto constexpr NumTorrents = size_t{ 64U };
+
+// `n_blocks` blocks spread across the session's torrents, in random order,
+// like blocks arriving from many peers in many swarms.
+std::vector<std::pair<tr_torrent*, tr_block_index_t>> makeBlocks(SyntheticSession const& fixture, size_t n_blocks)
+{
+    auto blocks = std::vector<std::pair<tr_torrent*, tr_block_index_t>>{};
+    blocks.reserve(n_blocks);
+    for (size_t i = 0; std::size(blocks) < n_blocks; ++i)
+    {
+        auto* const tor = fixture.torrents()[i % std::size(fixture.torrents())];
+        auto const block = static_cast<tr_block_index_t>(i / std::size(fixture.torrents()));
+        if (block < tor->blockCount())
+        {
+            blocks.emplace_back(tor, block);
+        }
+    }
+
+    auto rng = makeRandomEngine();
+    std::shuffle(std::begin(blocks), std::end(blocks), rng);
+    return blocks;
+}
+
+// A cache big enough to hold `n_blocks` blocks without writing any to disk.
+auto makeCache(SyntheticSession const& fixture, size_t n_blocks)
+{
+    return std::make_unique<Cache>(fixture.session()->torrents(), int64_t(n_blocks + 1U) * tr_block_info::BlockSize);
+}
+
+auto makeBlockData()
+{
+    return std::make_unique<std::vector<uint8_t>>(tr_block_info::BlockSize, uint8_t{ 0xAA });
+}
+
+// Adding blocks to a cache that's big enough to hold them all.
+void BM_CacheWriteBlock(benchmark::State& state)
+{
+    auto const& fixture = SyntheticSession::get(NumTorrents);
+    auto const n_blocks = static_cast<size_t>(state.range(0));
+    auto const blocks = makeBlocks(fixture, n_blocks);
+    auto const lock = fixture.session()->unique_lock();
+
+    for (auto _ : state)
+    {
+        auto cache = makeCache(fixture, n_blocks);
+
+        for (auto const& [tor, block] : blocks)
+        {
+            auto data = makeBlockData();
+            cache->writeBlock(tor->id(), block, data);
+        }
+
+        // don't time the blocks being freed
+        state.PauseTiming();
+        cache.reset();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * n_blocks);
+    state.SetBytesProcessed(state.iterations() * n_blocks * tr_block_info::BlockSize);
+}
+
+// Serving peers' requests for blocks that are still in the cache.
+void BM_CacheReadBlockHit(benchmark::State& state)
+{
+    auto const& fixture = SyntheticSession::get(NumTorrents);
+    auto const n_blocks = static_cast<size_t>(state.range(0));
+    auto const blocks = makeBlocks(fixture, n_blocks);
+    auto const lock = fixture.session()->unique_lock();
+
+    auto const cache = makeCache(fixture, n_blocks);
+    for (auto const& [tor, block] : blocks)
+    {
+        auto data = makeBlockData();
+        cache->writeBlock(tor->id(), block, data);
+    }
+
+    auto buf = std::vector<uint8_t>(tr_block_info::BlockSize);
+    auto i = size_t{};
+    for (auto _ : state)
+    {
+        auto const& [tor, block] = blocks[i++ % n_blocks];
+        if (cache->readBlock(tor, tor->blockLoc(block), tr_block_info::BlockSize, std::data(buf)) != 0)
+        {
+            state.SkipWithError("readBlock() failed");
+            break;
+        }
+        benchmark::DoNotOptimize(std::data(buf));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * tr_block_info::BlockSize);
+}
+
+// Writing a whole torrent's worth of cached blocks to disk.
+void BM_CacheFlushTorrent(benchmark::State& state)
+{
+    auto const& fixture = SyntheticSession::get(NumTorrents);
+    auto* const tor = fixture.torrents().front();
+    auto const n_blocks = tor->blockCount();
+    auto const lock = fixture.session()->unique_lock();
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto const cache = makeCache(fixture, n_blocks);
+        for (tr_block_index_t block = 0; block < n_blocks; ++block)
+        {
+            auto data = makeBlockData();
+            cache->writeBlock(tor->id(), block, data);
+        }
+        state.ResumeTiming();
+
+        if (cache->flushTorrent(tor) != 0)
+        {
+            state.SkipWithError("flushTorrent() failed");
+            break;
+        }
+    }
+
+    state.SetBytesProcessed(state.iterations() * n_blocks * tr_block_info::BlockSize);
+}
+
+// Up to 64 MiB of 16 KiB blocks
+BENCHMARK(BM_CacheWriteBlock)->RangeMultiplier(8)->Range(64, 4096)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_CacheReadBlockHit)->RangeMultiplier(8)->Range(64, 4096);
+BENCHMARK(BM_CacheFlushTorrent)->Unit(benchmark::kMillisecond);
+
+} // namespace
@@ -0,0 +1,104 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "peer-mse.h"
+
+#include "benchmark-fixtures.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+
+std::vector<uint8_t> makeRandomData(size_t n_bytes)
+{
+    auto rng = makeRandomEngine();
+    auto data = std::vector<uint8_t>(n_bytes);
+    for (auto& byte : data)
+    {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return data;
+}
+
+// Checking one piece, e.g. when a download finishes it.
+void BM_Sha1Digest(benchmark::State& state)
+{
+    auto const data = makeRandomData(static_cast<size_t>(state.range(0)));
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(tr_sha1::digest(data));
+    }
+
+    state.SetBytesProcessed(state.iterations() * std::size(data));
+}
+
+// Checking a run of pieces read in one go, e.g. when verifying a torrent.
+void BM_Sha1DigestPieces(benchmark::State& state)
+{
+    static auto constexpr BufferSize = size_t{ 16U * 1024U * 1024U };
+    auto const piece_size = static_cast<size_t>(state.range(0));
+    auto const data = makeRandomData(BufferSize);
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(tr_sha1::digestPieces(std::data(data), std::size(data), piece_size));
+    }
+
+    state.SetBytesProcessed(state.iterations() * std::size(data));
+    state.SetItemsProcessed(state.iterations() * (BufferSize / piece_size));
+}
+
+// Our side of an encrypted handshake: send our public key, then
+// compute the shared secret from the peer's. items_per_second is
+// handshakes per second on the thread doing them. With `pooled`,
+// public keys come from a KeyPool that fills in another thread.
+void BM_MseHandshake(benchmark::State& state)
+{
+    auto peer = tr_message_stream_encryption::DH{};
+    auto const peer_public_key = peer.publicKey();
+
+    auto pool = std::optional<tr_message_stream_encryption::KeyPool>{};
+    if (state.range(0) != 0)
+    {
+        pool.emplace();
+    }
+
+    for (auto _ : state)
+    {
+        auto dh = pool ? pool->take() : tr_message_stream_encryption::DH{};
+        benchmark::DoNotOptimize(dh.publicKey());
+        dh.setPeerPublicKey(peer_public_key);
+        benchmark::DoNotOptimize(dh.secret());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+
+    if (pool)
+    {
+        auto const stats = pool->stats();
+        state.counters["pool_hit_ratio"] = static_cast<double>(stats.hits) / std::max(stats.hits + stats.misses, uint64_t{ 1 });
+    }
+}
+
+// from one block to a large piece
+BENCHMARK(BM_Sha1Digest)->Arg(16 * 1024)->Arg(256 * 1024)->Arg(4 * 1024 * 1024);
+BENCHMARK(BM_Sha1DigestPieces)->Arg(256 * 1024)->Arg(4 * 1024 * 1024)->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_MseHandshake)->ArgName("pooled")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+} // namespace
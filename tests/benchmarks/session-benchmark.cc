@@ -0,0 +1,73 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+
+#include <benchmark/benchmark.h>
+
+#include "transmission.h"
+
+#include "rpcimpl.h"
+#include "variant.h"
+
+#include "benchmark-fixtures.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+
+// What a client does each time it refreshes its list of torrents.
+void BM_TorrentStat(benchmark::State& state)
+{
+    auto const& fixture = SyntheticSession::get(static_cast<size_t>(state.range(0)));
+
+    for (auto _ : state)
+    {
+        for (auto* const tor : fixture.torrents())
+        {
+            benchmark::DoNotOptimize(tr_torrentStat(tor));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * std::size(fixture.torrents()));
+}
+
+// The same refresh for a remote client, e.g. the web client's torrent list.
+void BM_RpcTorrentGet(benchmark::State& state)
+{
+    auto const& fixture = SyntheticSession::get(static_cast<size_t>(state.range(0)));
+
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 2);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "torrent-get");
+    auto* const args = tr_variantDictAddDict(&request, TR_KEY_arguments, 1);
+    auto* const fields = tr_variantDictAddList(args, TR_KEY_fields, 8);
+    for (auto const* const field :
+         { "id", "name", "status", "percentDone", "rateDownload", "rateUpload", "eta", "uploadRatio" })
+    {
+        tr_variantListAddStrView(fields, field);
+    }
+
+    auto const on_response = [](tr_session* /*session*/, tr_variant* response, void* vn_bytes)
+    {
+        *static_cast<size_t*>(vn_bytes) += std::size(tr_variantToStr(response, TR_VARIANT_FMT_JSON_LEAN));
+    };
+
+    auto n_bytes = size_t{};
+    for (auto _ : state)
+    {
+        tr_rpc_request_exec_json(fixture.session(), &request, on_response, &n_bytes);
+    }
+
+    tr_variantClear(&request);
+    state.SetItemsProcessed(state.iterations() * std::size(fixture.torrents()));
+    state.SetBytesProcessed(n_bytes);
+}
+
+BENCHMARK(BM_TorrentStat)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RpcTorrentGet)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+} // namespace
@@ -0,0 +1,513 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// End-to-end transfers between sessions on this machine.
+//
+// A seed session is the session under test. The other side of each transfer
+// is a "synthetic peer": a bare-bones session of its own that downloads
+// everything the seed has. Since both sides are libtransmission, every
+// transfer goes through peer-io, peer-msgs, bandwidth, and the cache twice.
+//
+// Every session binds to 127.0.0.1 on a port of its own and allows loopback
+// peers, which libtransmission tells apart by port, so any number of peers
+// can run on one machine. Latency can be added with netem, e.g.
+// `tc qdisc add dev lo root netem delay 20ms`.
+
+#include <algorithm> // std::all_of()
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime> // std::clock()
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility> // std::pair
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "transmission.h"
+
+#include "error.h"
+#include "event-loop-stats.h"
+#include "file.h"
+#include "makemeta.h"
+#include "metrics.h"
+#include "net.h"
+#include "peer-mgr.h"
+#include "session.h"
+#include "torrent.h"
+#include "tr-strbuf.h"
+#include "variant.h"
+
+#include "benchmark-fixtures.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+
+auto constexpr KiB = uint64_t{ 1024U };
+auto constexpr MiB = KiB * 1024U;
+auto constexpr GiB = MiB * 1024U;
+
+auto constexpr TransferTimeout = std::chrono::hours{ 1 };
+
+enum Transport : int64_t
+{
+    TCP,
+    MSE, // TCP with encryption required
+    UTP
+};
+
+// Lets sessions on this machine be each other's peers.
+void allowLoopbackPeers(tr_session* session)
+{
+    auto const lock = session->unique_lock();
+    session->setAllowsLoopbackPeers(true);
+}
+
+tr_variant makeSettings(std::string_view download_dir)
+{
+    auto settings = tr_variant{};
+    tr_variantInitDict(&settings, 16);
+    tr_variantDictAddStr(&settings, TR_KEY_download_dir, download_dir);
+    tr_variantDictAddStr(&settings, TR_KEY_bind_address_ipv4, "127.0.0.1"sv);
+    tr_variantDictAddBool(&settings, TR_KEY_dht_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_lpd_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_port_forwarding_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_peer_port_random_on_start, true);
+    tr_variantDictAddBool(&settings, TR_KEY_download_queue_enabled, false);
+    tr_variantDictAddBool(&settings, TR_KEY_seed_queue_enabled, false);
+    tr_variantDictAddInt(&settings, TR_KEY_peer_limit_global, 10000);
+    tr_variantDictAddInt(&settings, TR_KEY_message_level, TR_LOG_CRITICAL);
+    return settings;
+}
+
+// `n_torrents` single-file torrents of `torrent_size` random bytes each.
+class SeedContent
+{
+public:
+    SeedContent(size_t n_torrents, uint64_t torrent_size)
+        : dir_{ sandbox_.path(), "/Content"sv }
+        , n_torrents_{ n_torrents }
+        , torrent_size_{ torrent_size }
+    {
+        tr_sys_dir_create(dir_, TR_SYS_DIR_CREATE_PARENTS, 0700);
+
+        auto rng = makeRandomEngine();
+        auto buf = std::vector<uint64_t>(MiB / sizeof(uint64_t));
+        for (size_t i = 0; i < n_torrents; ++i)
+        {
+            auto const filename = tr_pathbuf{ dir_, fmt::format(FMT_STRING("/swarm-{:06d}.bin"), i) };
+            auto const fd = tr_sys_file_open(filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_CREATE | TR_SYS_FILE_TRUNCATE, 0600);
+            for (uint64_t left = torrent_size; left > 0U;)
+            {
+                for (auto& word : buf)
+                {
+                    word = rng();
+                }
+
+                auto const n_bytes = std::min(left, uint64_t{ std::size(buf) * sizeof(uint64_t) });
+                tr_sys_file_write(fd, std::data(buf), n_bytes, nullptr);
+                left -= n_bytes;
+            }
+            tr_sys_file_close(fd);
+
+            auto builder = tr_metainfo_builder{ filename.sv() };
+            if (auto* error = builder.makeChecksums().get(); error != nullptr)
+            {
+                tr_error_free(error);
+                continue;
+            }
+            metainfos_.push_back(builder.benc());
+        }
+
+        // Wait for the clock to tick over, so that the seed sees that the files
+        // were there before its torrents were added and doesn't verify them.
+        auto const written_at = time(nullptr);
+        while (time(nullptr) <= written_at + 1)
+        {
+            std::this_thread::sleep_for(50ms);
+        }
+    }
+
+    [[nodiscard]] auto const& dir() const noexcept
+    {
+        return dir_;
+    }
+
+    [[nodiscard]] auto const& metainfos() const noexcept
+    {
+        return metainfos_;
+    }
+
+    [[nodiscard]] uint64_t totalSize() const noexcept
+    {
+        return std::size(metainfos_) * torrent_size_;
+    }
+
+    static SeedContent const& get(size_t n_torrents, uint64_t torrent_size)
+    {
+        static auto instance = std::unique_ptr<SeedContent>{};
+
+        if (!instance || instance->n_torrents_ != n_torrents || instance->torrent_size_ != torrent_size)
+        {
+            instance.reset();
+            instance = std::make_unique<SeedContent>(n_torrents, torrent_size);
+        }
+
+        return *instance;
+    }
+
+private:
+    Sandbox sandbox_;
+    tr_pathbuf const dir_;
+    size_t const n_torrents_;
+    uint64_t const torrent_size_;
+    std::vector<std::string> metainfos_;
+};
+
+[[nodiscard]] bool isTorrentDone(tr_torrent* tor)
+{
+    return tr_torrentStat(tor)->leftUntilDone == 0U;
+}
+
+// The session under test, seeding all of a SeedContent's torrents.
+class Seed
+{
+public:
+    Seed(SeedContent const& content, unsigned int upload_limit_KBps)
+    {
+        auto settings = makeSettings(content.dir());
+        tr_variantDictAddBool(&settings, TR_KEY_utp_enabled, true);
+        session_ = tr_sessionInit(sandbox_.path().c_str(), false, &settings);
+        tr_variantClear(&settings);
+        allowLoopbackPeers(session_);
+
+        if (upload_limit_KBps != 0U)
+        {
+            tr_sessionSetSpeedLimit_KBps(session_, TR_UP, upload_limit_KBps);
+            tr_sessionLimitSpeed(session_, TR_UP, true);
+        }
+
+        for (auto const& metainfo : content.metainfos())
+        {
+            auto* const ctor = tr_ctorNew(session_);
+            tr_ctorSetMetainfo(ctor, std::data(metainfo), std::size(metainfo), nullptr);
+            auto* const tor = tr_torrentNew(ctor, nullptr);
+            tr_ctorFree(ctor);
+            tr_torrentStart(tor);
+            torrents_.push_back(tor);
+        }
+    }
+
+    ~Seed()
+    {
+        tr_sessionClose(session_);
+    }
+
+    Seed(Seed const&) = delete;
+    Seed& operator=(Seed const&) = delete;
+
+    [[nodiscard]] tr_session* session() const noexcept
+    {
+        return session_;
+    }
+
+    [[nodiscard]] bool isReady() const
+    {
+        return std::all_of(
+            std::begin(torrents_),
+            std::end(torrents_),
+            [](auto* tor) { return tr_torrentStat(tor)->activity == TR_STATUS_SEED; });
+    }
+
+    // How a peer should reach the seed.
+    [[nodiscard]] tr_pex pexFor(Transport transport) const
+    {
+        auto flags = uint8_t{ ADDED_F_SEED_FLAG | ADDED_F_CONNECTABLE };
+        if (transport == UTP)
+        {
+            flags |= ADDED_F_UTP_FLAGS;
+        }
+        if (transport == MSE)
+        {
+            flags |= ADDED_F_ENCRYPTION_FLAG;
+        }
+        return tr_pex{ *tr_address::fromString("127.0.0.1"sv), tr_port::fromHost(tr_sessionGetPeerPort(session_)), flags };
+    }
+
+private:
+    Sandbox sandbox_;
+    tr_session* session_ = nullptr;
+    std::vector<tr_torrent*> torrents_;
+};
+
+// A synthetic peer that downloads all of the seed's torrents.
+class Leecher
+{
+public:
+    Leecher(SeedContent const& content, Seed const& seed, Transport transport)
+        : seed_pex_{ seed.pexFor(transport) }
+    {
+        auto settings = makeSettings(tr_pathbuf{ sandbox_.path(), "/Downloads"sv });
+        tr_variantDictAddBool(&settings, TR_KEY_utp_enabled, transport == UTP);
+        tr_variantDictAddBool(&settings, TR_KEY_tcp_enabled, transport != UTP);
+        tr_variantDictAddInt(&settings, TR_KEY_encryption, transport == MSE ? TR_ENCRYPTION_REQUIRED : TR_ENCRYPTION_PREFERRED);
+        session_ = tr_sessionInit(sandbox_.path().c_str(), false, &settings);
+        tr_variantClear(&settings);
+        allowLoopbackPeers(session_);
+
+        for (auto const& metainfo : content.metainfos())
+        {
+            auto* const ctor = tr_ctorNew(session_);
+            tr_ctorSetMetainfo(ctor, std::data(metainfo), std::size(metainfo), nullptr);
+            tr_ctorSetPaused(ctor, TR_FORCE, true);
+            torrents_.push_back(tr_torrentNew(ctor, nullptr));
+            tr_ctorFree(ctor);
+        }
+
+        cancelVerifications(session_, torrents_);
+    }
+
+    ~Leecher()
+    {
+        tr_sessionClose(session_);
+    }
+
+    Leecher(Leecher const&) = delete;
+    Leecher& operator=(Leecher const&) = delete;
+
+    [[nodiscard]] auto const& torrents() const noexcept
+    {
+        return torrents_;
+    }
+
+    void start(tr_torrent* tor)
+    {
+        tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, &seed_pex_, 1);
+        tr_torrentStart(tor);
+    }
+
+    // Starts the next torrent once the previous one has connected to the seed.
+    // A peer that started thousands of torrents at once would flood the seed
+    // with handshakes, and the ones it dropped would wait minutes to retry.
+    void startNext()
+    {
+        if (n_started_ == std::size(torrents_))
+        {
+            return;
+        }
+
+        if (n_started_ > 0U)
+        {
+            auto const* const prev = tr_torrentStat(torrents_[n_started_ - 1U]);
+            if (prev->peersConnected == 0 && prev->leftUntilDone != 0U)
+            {
+                return;
+            }
+        }
+
+        start(torrents_[n_started_++]);
+    }
+
+    [[nodiscard]] bool isDone() const
+    {
+        return std::all_of(std::begin(torrents_), std::end(torrents_), isTorrentDone);
+    }
+
+private:
+    Sandbox sandbox_;
+    tr_pex const seed_pex_;
+    tr_session* session_ = nullptr;
+    std::vector<tr_torrent*> torrents_;
+    size_t n_started_ = 0;
+};
+
+// The seed's scheduling lag across all of its event loop callbacks.
+void addLag(tr_latency_histogram::Snapshot& total, tr_event_loop_stats::Snapshot const& now, tr_event_loop_stats::Snapshot const& since)
+{
+    for (size_t i = 0; i < std::size(now.callbacks); ++i)
+    {
+        auto const& lag_now = now.callbacks[i].lag;
+        auto const& lag_since = since.callbacks[i].lag;
+        for (size_t bucket = 0; bucket < std::size(total.buckets); ++bucket)
+        {
+            total.buckets[bucket] += lag_now.buckets[bucket] - lag_since.buckets[bucket];
+        }
+        total.count += lag_now.count - lag_since.count;
+        total.sum_usec += lag_now.sum_usec - lag_since.sum_usec;
+    }
+}
+
+// An upper bound on the 99th percentile: the top of the bucket it falls in.
+double p99Msec(tr_latency_histogram::Snapshot const& histogram)
+{
+    auto const target = histogram.count - histogram.count / 100U;
+    auto seen = uint64_t{};
+    for (size_t i = 0; i < std::size(histogram.buckets); ++i)
+    {
+        seen += histogram.buckets[i];
+        if (seen >= target)
+        {
+            return static_cast<double>(uint64_t{ 1 } << i) / 1000.0;
+        }
+    }
+    return static_cast<double>(uint64_t{ 1 } << (std::size(histogram.buckets) - 1U)) / 1000.0;
+}
+
+// Times `n_leechers` synthetic peers downloading all of `content` from a seed.
+// If `churn` is set, a random downloading torrent is stopped every few
+// seconds and restarted a few seconds later, as if peers were coming and going.
+void runSwarm(
+    benchmark::State& state,
+    SeedContent const& content,
+    Transport transport,
+    size_t n_leechers,
+    unsigned int upload_limit_KBps = 0U,
+    bool churn = false)
+{
+    static auto constexpr Tick = 10ms;
+    static auto constexpr ChurnTicks = 200;
+
+    auto const seed = Seed{ content, upload_limit_KBps };
+    if (transport == UTP && !tr_sessionIsUTPEnabled(seed.session()))
+    {
+        state.SkipWithError("built without uTP support");
+        return;
+    }
+
+    while (!seed.isReady())
+    {
+        std::this_thread::sleep_for(Tick);
+    }
+
+    auto rng = makeRandomEngine();
+    auto lag = tr_latency_histogram::Snapshot{};
+    auto cpu_ticks = std::clock_t{};
+    auto n_restarts = uint64_t{};
+    auto n_bytes = uint64_t{};
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto leechers = std::vector<std::unique_ptr<Leecher>>{};
+        for (size_t i = 0; i < n_leechers; ++i)
+        {
+            leechers.push_back(std::make_unique<Leecher>(content, seed, transport));
+        }
+        auto const lag_before = seed.session()->eventLoopStats().snapshot();
+        auto const cpu_before = std::clock();
+        state.ResumeTiming();
+
+        auto const deadline = std::chrono::steady_clock::now() + TransferTimeout;
+        auto stopped = std::optional<std::pair<Leecher*, tr_torrent*>>{};
+        for (int tick = 1;; ++tick)
+        {
+            if (std::all_of(std::begin(leechers), std::end(leechers), [](auto const& leecher) { return leecher->isDone(); }))
+            {
+                break;
+            }
+
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                state.SkipWithError("timed out");
+                return;
+            }
+
+            for (auto& leecher : leechers)
+            {
+                leecher->startNext();
+            }
+
+            if (churn && tick % ChurnTicks == 0)
+            {
+                if (stopped)
+                {
+                    stopped->first->start(stopped->second);
+                    stopped.reset();
+                }
+                else
+                {
+                    auto& leecher = leechers[rng() % std::size(leechers)];
+                    auto* const tor = leecher->torrents()[rng() % std::size(leecher->torrents())];
+                    // Only stop torrents that are receiving data. Peers that leave
+                    // before getting any are counted as failed connections, and
+                    // the backoff would keep them from coming back for minutes.
+                    if (auto const* const st = tr_torrentStat(tor); st->activity == TR_STATUS_DOWNLOAD && st->peersSendingToUs > 0)
+                    {
+                        tr_torrentStop(tor);
+                        stopped.emplace(leecher.get(), tor);
+                        ++n_restarts;
+                    }
+                }
+            }
+
+            std::this_thread::sleep_for(Tick);
+        }
+
+        state.PauseTiming();
+        cpu_ticks += std::clock() - cpu_before;
+        addLag(lag, seed.session()->eventLoopStats().snapshot(), lag_before);
+        n_bytes += content.totalSize() * n_leechers;
+        leechers.clear();
+        state.ResumeTiming();
+    }
+
+    // std::clock() is the CPU time of the whole process: the seed *and* its peers
+    auto const cpu_sec = static_cast<double>(cpu_ticks) / CLOCKS_PER_SEC;
+    state.SetBytesProcessed(n_bytes);
+    state.counters["cpu_s_per_GiB"] = cpu_sec / (static_cast<double>(n_bytes) / GiB);
+    state.counters["seed_lag_p99_ms"] = p99Msec(lag);
+    if (churn)
+    {
+        state.counters["restarts"] = static_cast<double>(n_restarts);
+    }
+}
+
+// One peer downloading one big torrent, over each transport
+void BM_SwarmOneLargeTorrent(benchmark::State& state)
+{
+    auto const& content = SeedContent::get(1U, 128U * MiB);
+    runSwarm(state, content, static_cast<Transport>(state.range(0)), 1U, static_cast<unsigned int>(state.range(1)));
+}
+
+// One peer downloading thousands of small torrents
+void BM_SwarmManySmallTorrents(benchmark::State& state)
+{
+    auto const& content = SeedContent::get(static_cast<size_t>(state.range(0)), 256U * KiB);
+    runSwarm(state, content, TCP, 1U);
+}
+
+// Many peers downloading the same torrent from one seed
+void BM_SwarmManyLeechers(benchmark::State& state)
+{
+    auto const& content = SeedContent::get(1U, 64U * MiB);
+    runSwarm(state, content, TCP, static_cast<size_t>(state.range(0)));
+}
+
+// Many peers downloading the same torrent while some leave and come back
+void BM_SwarmChurn(benchmark::State& state)
+{
+    auto const& content = SeedContent::get(1U, 64U * MiB);
+    runSwarm(state, content, TCP, static_cast<size_t>(state.range(0)), 0U, true);
+}
+
+// transport: 0 = TCP, 1 = MSE, 2 = uTP; upload_KBps: the seed's speed limit, or 0 for none
+BENCHMARK(BM_SwarmOneLargeTorrent)
+    ->ArgsProduct({ { TCP, MSE, UTP }, { 0, 50 * 1024 } })
+    ->ArgNames({ "transport", "upload_KBps" })
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SwarmManySmallTorrents)->Arg(100)->Arg(1000)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SwarmManyLeechers)->Arg(2)->Arg(8)->Arg(32)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SwarmChurn)->Arg(2)->Arg(8)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+} // namespace
@@ -0,0 +1,169 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include <benchmark/benchmark.h>
+
+#include "transmission.h"
+
+#include "task-queue.h"
+
+namespace
+{
+
+// How tr_runInEventThread() used to queue work: a std::function per post
+// in a mutex-guarded std::list, with a wakeup for every post.
+class MutexListQueue
+{
+public:
+    [[nodiscard]] bool push(std::function<void()>&& func)
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        queue_.emplace_back(std::move(func));
+        return true;
+    }
+
+    void drain()
+    {
+        auto lock = std::unique_lock{ mutex_ };
+        auto queue = std::list<std::function<void()>>{};
+        std::swap(queue, queue_);
+        lock.unlock();
+
+        for (auto const& func : queue)
+        {
+            func();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::list<std::function<void()>> queue_;
+};
+
+// A stand-in for the libevent thread: it sleeps until a post wakes it up,
+// the way event_active() wakes up the event loop.
+template<typename Queue>
+class Consumer
+{
+public:
+    Consumer()
+        : thread_{ [this]() { run(); } }
+    {
+    }
+
+    ~Consumer()
+    {
+        stopping_ = true;
+        wake();
+        thread_.join();
+    }
+
+    template<typename Func>
+    void post(Func&& func)
+    {
+        if (queue_.push(std::forward<Func>(func)))
+        {
+            wakeups_.fetch_add(1, std::memory_order_relaxed);
+            wake();
+        }
+    }
+
+    [[nodiscard]] auto wakeups() const noexcept
+    {
+        return wakeups_.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> n_run = {};
+
+private:
+    void wake()
+    {
+        auto const lock = std::lock_guard{ mutex_ };
+        woken_ = true;
+        cv_.notify_one();
+    }
+
+    void run()
+    {
+        for (;;)
+        {
+            auto lock = std::unique_lock{ mutex_ };
+            cv_.wait(lock, [this]() { return woken_; });
+            woken_ = false;
+            lock.unlock();
+
+            queue_.drain();
+
+            if (stopping_)
+            {
+                return;
+            }
+        }
+    }
+
+    Queue queue_;
+    std::atomic<uint64_t> wakeups_ = {};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool woken_ = false;
+    std::atomic<bool> stopping_ = false;
+    std::thread thread_;
+};
+
+void incrementRunCount(std::atomic<uint64_t>* n_run)
+{
+    n_run->fetch_add(1, std::memory_order_relaxed);
+}
+
+// Mirrors the closure that tr_runInEventThread(session, func, args...) builds.
+template<typename Func, typename... Args>
+auto makeClosure(Func func, Args... args)
+{
+    return [func, args = std::make_tuple(args...)]() mutable
+    {
+        std::apply(func, args);
+    };
+}
+
+template<typename Queue>
+void BM_CrossThreadPost(benchmark::State& state)
+{
+    static Consumer<Queue>* consumer = nullptr;
+
+    if (state.thread_index() == 0)
+    {
+        consumer = new Consumer<Queue>{};
+    }
+
+    for (auto _ : state)
+    {
+        consumer->post(makeClosure(incrementRunCount, &consumer->n_run));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0)
+    {
+        auto const wakeups = consumer->wakeups();
+        delete consumer;
+        consumer = nullptr;
+        state.counters["wakeups"] = benchmark::Counter(static_cast<double>(wakeups), benchmark::Counter::kIsRate);
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_CrossThreadPost, tr_task_queue)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_CrossThreadPost, MutexListQueue)->ThreadRange(1, 8)->UseRealTime();
+
+} // namespace
@@ -0,0 +1,821 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+// Local stand-ins for the things a session announces to: HTTP and UDP
+// trackers, and a swarm of DHT nodes. Each one answers from a libevent loop
+// in a thread of its own and counts the torrents that it has heard from,
+// so benchmarks can tell when a session has gotten through all of them.
+
+#pragma once
+
+#include <algorithm> // std::copy_n(), std::partial_sort()
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // size_t, std::byte
+#include <cstdint>
+#include <functional>
+#include <iterator> // std::back_inserter()
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple> // std::tuple_size_v
+#include <utility> // std::move()
+#include <vector>
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/util.h>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "transmission.h"
+
+#include "benc.h"
+#include "net.h"
+#include "tr-strbuf.h"
+#include "trevent.h"
+#include "variant.h"
+#include "web-utils.h"
+
+#include "benchmark-fixtures.h"
+
+namespace libtransmission
+{
+
+namespace bench
+{
+
+// A libevent loop in a thread of its own, so that the stand-ins keep
+// answering while the session under test is busy. Stand-ins set up their
+// events before start() and must stop() before freeing them.
+class StandInLoop
+{
+public:
+    StandInLoop()
+    {
+        tr_evthread_init();
+        base_ = event_base_new();
+    }
+
+    ~StandInLoop()
+    {
+        stop();
+        event_base_free(base_);
+    }
+
+    StandInLoop(StandInLoop const&) = delete;
+    StandInLoop& operator=(StandInLoop const&) = delete;
+
+    [[nodiscard]] event_base* base() const noexcept
+    {
+        return base_;
+    }
+
+    void start()
+    {
+        thread_ = std::thread{ [this]() { event_base_loop(base_, EVLOOP_NO_EXIT_ON_EMPTY); } };
+    }
+
+    void stop()
+    {
+        if (thread_.joinable())
+        {
+            event_base_loopexit(base_, nullptr);
+            thread_.join();
+        }
+    }
+
+    // Calls `func` from the loop's thread once `delay` has passed.
+    void runLater(std::chrono::milliseconds delay, std::function<void()> func)
+    {
+        if (delay.count() <= 0)
+        {
+            func();
+            return;
+        }
+
+        auto const msec = delay.count();
+        auto const tv = timeval{ static_cast<decltype(timeval::tv_sec)>(msec / 1000),
+                                 static_cast<decltype(timeval::tv_usec)>((msec % 1000) * 1000) };
+        event_base_once(
+            base_,
+            -1,
+            EV_TIMEOUT,
+            [](evutil_socket_t /*fd*/, short /*events*/, void* vfunc)
+            {
+                auto const run = std::unique_ptr<std::function<void()>>{ static_cast<std::function<void()>*>(vfunc) };
+                (*run)();
+            },
+            new std::function<void()>{ std::move(func) },
+            &tv);
+    }
+
+private:
+    event_base* base_ = nullptr;
+    std::thread thread_;
+};
+
+// Appends `str` to `out` as a bencoded string.
+inline void bencString(std::string& out, std::string_view str)
+{
+    fmt::format_to(std::back_inserter(out), FMT_STRING("{:d}:"), std::size(str));
+    out += str;
+}
+
+[[nodiscard]] inline std::string_view digestView(tr_sha1_digest_t const& digest)
+{
+    return { reinterpret_cast<char const*>(std::data(digest)), std::size(digest) };
+}
+
+[[nodiscard]] inline tr_sha1_digest_t toDigest(std::string_view raw)
+{
+    auto digest = tr_sha1_digest_t{};
+    std::copy_n(reinterpret_cast<std::byte const*>(std::data(raw)), std::size(digest), std::begin(digest));
+    return digest;
+}
+
+// The port that the kernel picked for a socket bound to port 0.
+[[nodiscard]] inline tr_port boundPort(evutil_socket_t sock)
+{
+    auto ss = sockaddr_storage{};
+    auto sslen = socklen_t{ sizeof(ss) };
+    getsockname(sock, reinterpret_cast<sockaddr*>(&ss), &sslen);
+
+    auto addr = tr_address{};
+    auto port = tr_port{};
+    tr_address_from_sockaddr_storage(&addr, &port, &ss);
+    return port;
+}
+
+// How a stand-in tracker answers.
+struct TrackerBehavior
+{
+    // how long to wait before answering each request
+    std::chrono::milliseconds delay = {};
+
+    // the intervals that announce responses ask for
+    int interval_sec = 1800;
+    int min_interval_sec = 900;
+
+    // the fraction of requests that get a failure reason instead of an answer
+    double error_rate = 0.0;
+
+    // scrapes for more torrents than this are refused as too big; 0 for no limit
+    size_t multiscrape_max = 0U;
+};
+
+class TrackerStandIn
+{
+public:
+    explicit TrackerStandIn(TrackerBehavior const& behavior)
+        : behavior_{ behavior }
+    {
+    }
+
+    virtual ~TrackerStandIn() = default;
+
+    TrackerStandIn(TrackerStandIn const&) = delete;
+    TrackerStandIn& operator=(TrackerStandIn const&) = delete;
+
+    [[nodiscard]] virtual std::string announceUrl() const = 0;
+
+    // How many different torrents have had an announce or a scrape answered.
+    // Failure reasons count as answers; scrapes refused as too big don't.
+    [[nodiscard]] size_t announced() const noexcept
+    {
+        return n_announced_.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] size_t scraped() const noexcept
+    {
+        return n_scraped_.load(std::memory_order_relaxed);
+    }
+
+    // scrapes refused because they asked about too many torrents
+    [[nodiscard]] uint64_t refusedScrapes() const noexcept
+    {
+        return n_refused_.load(std::memory_order_relaxed);
+    }
+
+protected:
+    static auto constexpr ErrorMessage = "stand-in tracker error"sv;
+    static auto constexpr TooBigMessage = "Bad Request"sv;
+
+    // Everything below is only used from the stand-in's own thread.
+
+    void onAnnounce(tr_sha1_digest_t const& info_hash)
+    {
+        if (announced_.insert(info_hash).second)
+        {
+            n_announced_.store(std::size(announced_), std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the scrape is refused as too big.
+    [[nodiscard]] bool onScrape(std::vector<tr_sha1_digest_t> const& info_hashes)
+    {
+        if (behavior_.multiscrape_max != 0U && std::size(info_hashes) > behavior_.multiscrape_max)
+        {
+            n_refused_.fetch_add(1U, std::memory_order_relaxed);
+            return false;
+        }
+
+        scraped_.insert(std::begin(info_hashes), std::end(info_hashes));
+        n_scraped_.store(std::size(scraped_), std::memory_order_relaxed);
+        return true;
+    }
+
+    [[nodiscard]] bool shouldFail()
+    {
+        return behavior_.error_rate > 0.0 && std::uniform_real_distribution<double>{}(rng_) < behavior_.error_rate;
+    }
+
+    // every torrent is in a swarm of this size
+    static auto constexpr Seeders = 10;
+    static auto constexpr Leechers = 20;
+    static auto constexpr Downloads = 5;
+
+    TrackerBehavior const behavior_;
+    StandInLoop loop_;
+
+private:
+    std::mt19937_64 rng_ = makeRandomEngine();
+    std::set<tr_sha1_digest_t> announced_;
+    std::set<tr_sha1_digest_t> scraped_;
+    std::atomic<size_t> n_announced_ = {};
+    std::atomic<size_t> n_scraped_ = {};
+    std::atomic<uint64_t> n_refused_ = {};
+};
+
+// An HTTP tracker on 127.0.0.1 that answers /announce and /scrape.
+// Announce responses have no peers and no `downloaded` count, so the
+// session follows every announce with a scrape.
+class HttpTrackerStandIn final : public TrackerStandIn
+{
+public:
+    explicit HttpTrackerStandIn(TrackerBehavior const& behavior = {})
+        : TrackerStandIn{ behavior }
+        , http_{ evhttp_new(loop_.base()) }
+    {
+        auto* const handle = evhttp_bind_socket_with_handle(http_, "127.0.0.1", 0);
+        port_ = boundPort(evhttp_bound_socket_get_fd(handle));
+        evhttp_set_gencb(http_, onRequest, this);
+        loop_.start();
+    }
+
+    ~HttpTrackerStandIn() override
+    {
+        loop_.stop();
+        evhttp_free(http_);
+    }
+
+    [[nodiscard]] std::string announceUrl() const override
+    {
+        return fmt::format(FMT_STRING("http://127.0.0.1:{:d}/announce"), port_.host());
+    }
+
+private:
+    static void onRequest(evhttp_request* req, void* vself)
+    {
+        auto* const self = static_cast<HttpTrackerStandIn*>(vself);
+
+        auto const uri = std::string_view{ evhttp_request_get_uri(req) };
+        auto const pos = uri.find('?');
+        auto const path = uri.substr(0, pos);
+        auto const query = pos == std::string_view::npos ? ""sv : uri.substr(pos + 1);
+
+        auto info_hashes = std::vector<tr_sha1_digest_t>{};
+        for (auto const& [key, val] : tr_url_query_view{ query })
+        {
+            if (key != "info_hash"sv)
+            {
+                continue;
+            }
+
+            if (auto const raw = tr_urlPercentDecode(val); std::size(raw) == std::tuple_size_v<tr_sha1_digest_t>)
+            {
+                info_hashes.push_back(toDigest(raw));
+            }
+        }
+
+        auto code = int{ HTTP_OK };
+        auto reason = "OK";
+        auto body = std::string{};
+        if (path == "/announce"sv && std::size(info_hashes) == 1U)
+        {
+            self->onAnnounce(info_hashes.front());
+            body = self->shouldFail() ? failure() : self->announceResponse();
+        }
+        else if (path == "/scrape"sv && !std::empty(info_hashes))
+        {
+            if (!self->onScrape(info_hashes))
+            {
+                code = HTTP_BADREQUEST;
+                reason = "Bad Request";
+            }
+            else
+            {
+                body = self->shouldFail() ? failure() : scrapeResponse(info_hashes);
+            }
+        }
+        else
+        {
+            code = HTTP_NOTFOUND;
+            reason = "Not Found";
+        }
+
+        self->loop_.runLater(
+            self->behavior_.delay,
+            [req, code, reason, body = std::move(body)]()
+            {
+                auto* const buf = evbuffer_new();
+                evbuffer_add(buf, std::data(body), std::size(body));
+                evhttp_send_reply(req, code, reason, buf);
+                evbuffer_free(buf);
+            });
+    }
+
+    [[nodiscard]] std::string announceResponse() const
+    {
+        return fmt::format(
+            FMT_STRING("d8:completei{:d}e10:incompletei{:d}e8:intervali{:d}e12:min intervali{:d}e5:peers0:e"),
+            Seeders,
+            Leechers,
+            behavior_.interval_sec,
+            behavior_.min_interval_sec);
+    }
+
+    [[nodiscard]] static std::string scrapeResponse(std::vector<tr_sha1_digest_t> const& info_hashes)
+    {
+        auto benc = std::string{ "d5:filesd" };
+        for (auto const& info_hash : info_hashes)
+        {
+            bencString(benc, digestView(info_hash));
+            fmt::format_to(
+                std::back_inserter(benc),
+                FMT_STRING("d8:completei{:d}e10:downloadedi{:d}e10:incompletei{:d}ee"),
+                Seeders,
+                Downloads,
+                Leechers);
+        }
+        benc += "ee";
+        return benc;
+    }
+
+    [[nodiscard]] static std::string failure()
+    {
+        auto benc = std::string{ "d14:failure reason" };
+        bencString(benc, ErrorMessage);
+        benc += 'e';
+        return benc;
+    }
+
+    evhttp* const http_;
+    tr_port port_;
+};
+
+// A UDP tracker (BEP 15) on 127.0.0.1.
+class UdpTrackerStandIn final : public TrackerStandIn
+{
+public:
+    explicit UdpTrackerStandIn(TrackerBehavior const& behavior = {})
+        : TrackerStandIn{ behavior }
+        , sock_{ socket(AF_INET, SOCK_DGRAM, 0) }
+    {
+        auto const [ss, sslen] = tr_address::fromString("127.0.0.1"sv)->toSockaddr(tr_port{});
+        bind(sock_, reinterpret_cast<sockaddr const*>(&ss), sslen);
+        evutil_make_socket_nonblocking(sock_);
+        port_ = boundPort(sock_);
+
+        event_ = event_new(loop_.base(), sock_, EV_READ | EV_PERSIST, onReadable, this);
+        event_add(event_, nullptr);
+        loop_.start();
+    }
+
+    ~UdpTrackerStandIn() override
+    {
+        loop_.stop();
+        event_free(event_);
+        evutil_closesocket(sock_);
+    }
+
+    [[nodiscard]] std::string announceUrl() const override
+    {
+        return fmt::format(FMT_STRING("udp://127.0.0.1:{:d}/announce"), port_.host());
+    }
+
+private:
+    static auto constexpr ProtocolId = uint64_t{ 0x41727101980 };
+    static auto constexpr ConnectionId = uint64_t{ 0x5452'5354'414E'4449 };
+
+    enum Action : uint32_t
+    {
+        Connect = 0,
+        Announce = 1,
+        Scrape = 2,
+        Error = 3
+    };
+
+    static void onReadable(evutil_socket_t sock, short /*events*/, void* vself)
+    {
+        auto* const self = static_cast<UdpTrackerStandIn*>(vself);
+
+        auto buf = std::array<uint8_t, 4096>{};
+        auto from = sockaddr_storage{};
+        auto fromlen = socklen_t{ sizeof(from) };
+        for (;;)
+        {
+            auto const n_read = recvfrom(
+                sock,
+                reinterpret_cast<char*>(std::data(buf)),
+                std::size(buf),
+                0,
+                reinterpret_cast<sockaddr*>(&from),
+                &fromlen);
+            if (n_read <= 0)
+            {
+                break;
+            }
+
+            self->onMessage(std::data(buf), static_cast<size_t>(n_read), from, fromlen);
+            fromlen = sizeof(from);
+        }
+    }
+
+    void onMessage(uint8_t const* msg, size_t msglen, sockaddr_storage const& from, socklen_t fromlen)
+    {
+        static auto constexpr HeaderSize = size_t{ 16 };
+        static auto constexpr AnnounceSize = size_t{ 98 };
+        static auto constexpr HashSize = std::tuple_size_v<tr_sha1_digest_t>;
+
+        if (msglen < HeaderSize)
+        {
+            return;
+        }
+
+        auto const action = read32(msg + 8);
+        auto reply = std::vector<uint8_t>{};
+        auto const respond = [&reply, msg](uint32_t response_action)
+        {
+            write32(reply, response_action);
+            reply.insert(std::end(reply), msg + 12, msg + 16); // transaction_id
+        };
+        auto const fail = [&reply, &respond](std::string_view errmsg)
+        {
+            respond(Error);
+            reply.insert(std::end(reply), std::begin(errmsg), std::end(errmsg));
+        };
+
+        if (action == Connect && read64(msg) == ProtocolId)
+        {
+            respond(Connect);
+            write32(reply, static_cast<uint32_t>(ConnectionId >> 32U));
+            write32(reply, static_cast<uint32_t>(ConnectionId));
+        }
+        else if (action == Announce && msglen >= AnnounceSize && read64(msg) == ConnectionId)
+        {
+            onAnnounce(toDigest({ reinterpret_cast<char const*>(msg + HeaderSize), HashSize }));
+            if (shouldFail())
+            {
+                fail(ErrorMessage);
+            }
+            else
+            {
+                respond(Announce);
+                write32(reply, static_cast<uint32_t>(behavior_.interval_sec));
+                write32(reply, Leechers);
+                write32(reply, Seeders);
+            }
+        }
+        else if (action == Scrape && msglen > HeaderSize && read64(msg) == ConnectionId)
+        {
+            auto info_hashes = std::vector<tr_sha1_digest_t>{};
+            for (auto const* walk = msg + HeaderSize; walk + HashSize <= msg + msglen; walk += HashSize)
+            {
+                info_hashes.push_back(toDigest({ reinterpret_cast<char const*>(walk), HashSize }));
+            }
+
+            if (!onScrape(info_hashes))
+            {
+                fail(TooBigMessage);
+            }
+            else if (shouldFail())
+            {
+                fail(ErrorMessage);
+            }
+            else
+            {
+                respond(Scrape);
+                for (size_t i = 0; i < std::size(info_hashes); ++i)
+                {
+                    write32(reply, Seeders);
+                    write32(reply, Downloads);
+                    write32(reply, Leechers);
+                }
+            }
+        }
+        else
+        {
+            return;
+        }
+
+        loop_.runLater(
+            behavior_.delay,
+            [sock = sock_, reply = std::move(reply), from, fromlen]()
+            {
+                sendto(
+                    sock,
+                    reinterpret_cast<char const*>(std::data(reply)),
+                    std::size(reply),
+                    0,
+                    reinterpret_cast<sockaddr const*>(&from),
+                    fromlen);
+            });
+    }
+
+    [[nodiscard]] static uint32_t read32(uint8_t const* walk)
+    {
+        return uint32_t{ walk[0] } << 24U | uint32_t{ walk[1] } << 16U | uint32_t{ walk[2] } << 8U | uint32_t{ walk[3] };
+    }
+
+    [[nodiscard]] static uint64_t read64(uint8_t const* walk)
+    {
+        return uint64_t{ read32(walk) } << 32U | read32(walk + 4);
+    }
+
+    static void write32(std::vector<uint8_t>& out, uint32_t val)
+    {
+        for (auto shift = 24; shift >= 0; shift -= 8)
+        {
+            out.push_back(static_cast<uint8_t>(val >> shift));
+        }
+    }
+
+    evutil_socket_t const sock_;
+    event* event_ = nullptr;
+    tr_port port_;
+};
+
+// A swarm of DHT nodes that only know about each other, all listening on
+// one address. Libtransmission ignores DHT nodes on loopback addresses, so
+// that has to be another of the machine's own addresses.
+//
+// The nodes answer ping, find_node, get_peers, and announce_peer queries.
+// They never have any peers to give out, so a session that uses the swarm
+// only ever talks to it, and counts how many torrents were announced.
+class DhtSwarmStandIn
+{
+public:
+    DhtSwarmStandIn(tr_address const& address, size_t n_nodes)
+        : address_{ address }
+    {
+        auto rng = makeRandomEngine();
+        auto const [ss, sslen] = address_.toSockaddr(tr_port{});
+
+        nodes_.reserve(n_nodes);
+        for (size_t i = 0; i < n_nodes; ++i)
+        {
+            auto& node = *nodes_.emplace_back(std::make_unique<Node>());
+            node.swarm = this;
+            for (auto& byte : node.id)
+            {
+                byte = static_cast<std::byte>(rng());
+            }
+
+            node.sock = socket(AF_INET, SOCK_DGRAM, 0);
+            bind(node.sock, reinterpret_cast<sockaddr const*>(&ss), sslen);
+            evutil_make_socket_nonblocking(node.sock);
+            node.port = boundPort(node.sock);
+            node.read_event = event_new(loop_.base(), node.sock, EV_READ | EV_PERSIST, onReadable, &node);
+            event_add(node.read_event, nullptr);
+        }
+
+        loop_.start();
+    }
+
+    ~DhtSwarmStandIn()
+    {
+        loop_.stop();
+
+        for (auto const& node : nodes_)
+        {
+            event_free(node->read_event);
+            evutil_closesocket(node->sock);
+        }
+    }
+
+    DhtSwarmStandIn(DhtSwarmStandIn const&) = delete;
+    DhtSwarmStandIn& operator=(DhtSwarmStandIn const&) = delete;
+
+    // Writes a dht.dat to `config_dir` that a new session will bootstrap from.
+    void writeBootstrapFile(std::string_view config_dir) const
+    {
+        auto compact = std::string{};
+        for (auto const& node : nodes_)
+        {
+            compact += compactAddress(*node);
+        }
+
+        auto benc = tr_variant{};
+        tr_variantInitDict(&benc, 1);
+        tr_variantDictAddRaw(&benc, TR_KEY_nodes, std::data(compact), std::size(compact));
+        tr_variantToFile(&benc, TR_VARIANT_FMT_BENC, tr_pathbuf{ config_dir, "/dht.dat"sv });
+        tr_variantClear(&benc);
+    }
+
+    // how many different torrents have been announced to any of the nodes
+    [[nodiscard]] size_t announced() const noexcept
+    {
+        return n_announced_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static auto constexpr MaxDepth = size_t{ 8 };
+    static auto constexpr NodesPerReply = size_t{ 8 };
+    static auto constexpr Token = "stand-in"sv;
+
+    struct Node
+    {
+        DhtSwarmStandIn* swarm = nullptr;
+        tr_sha1_digest_t id = {};
+        tr_port port;
+        evutil_socket_t sock = TR_BAD_SOCKET;
+        event* read_event = nullptr;
+    };
+
+    // The parts of a KRPC query that the stand-in needs.
+    struct QueryHandler final : public transmission::benc::BasicHandler<MaxDepth>
+    {
+        std::string_view y;
+        std::string_view q;
+        std::string_view t;
+        std::string_view target;
+        std::string_view info_hash;
+
+        bool String(std::string_view value, Context const& /*context*/) override
+        {
+            auto const current = currentKey();
+
+            if (depth() == 1U && current == "y"sv)
+            {
+                y = value;
+            }
+            else if (depth() == 1U && current == "q"sv)
+            {
+                q = value;
+            }
+            else if (depth() == 1U && current == "t"sv)
+            {
+                t = value;
+            }
+            else if (depth() == 2U && key(1) == "a"sv && current == "target"sv)
+            {
+                target = value;
+            }
+            else if (depth() == 2U && key(1) == "a"sv && current == "info_hash"sv)
+            {
+                info_hash = value;
+            }
+
+            return true;
+        }
+    };
+
+    static void onReadable(evutil_socket_t sock, short /*events*/, void* vnode)
+    {
+        auto const& node = *static_cast<Node const*>(vnode);
+
+        auto buf = std::array<char, 4096>{};
+        auto from = sockaddr_storage{};
+        auto fromlen = socklen_t{ sizeof(from) };
+        for (;;)
+        {
+            auto const n_read = recvfrom(sock, std::data(buf), std::size(buf), 0, reinterpret_cast<sockaddr*>(&from), &fromlen);
+            if (n_read <= 0)
+            {
+                break;
+            }
+
+            auto const reply = node.swarm->onQuery(node, { std::data(buf), static_cast<size_t>(n_read) });
+            if (!std::empty(reply))
+            {
+                sendto(sock, std::data(reply), std::size(reply), 0, reinterpret_cast<sockaddr const*>(&from), fromlen);
+            }
+
+            fromlen = sizeof(from);
+        }
+    }
+
+    [[nodiscard]] std::string onQuery(Node const& node, std::string_view benc)
+    {
+        auto handler = QueryHandler{};
+        auto stack = transmission::benc::ParserStack<MaxDepth>{};
+        if (!transmission::benc::parse(benc, stack, handler) || handler.y != "q"sv)
+        {
+            return {};
+        }
+
+        auto reply = std::string{ "d1:rd2:id" };
+        bencString(reply, digestView(node.id));
+
+        if (handler.q == "find_node"sv && std::size(handler.target) == std::tuple_size_v<tr_sha1_digest_t>)
+        {
+            reply += "5:nodes";
+            bencString(reply, closestNodes(toDigest(handler.target)));
+        }
+        else if (handler.q == "get_peers"sv && std::size(handler.info_hash) == std::tuple_size_v<tr_sha1_digest_t>)
+        {
+            reply += "5:nodes";
+            bencString(reply, closestNodes(toDigest(handler.info_hash)));
+            reply += "5:token";
+            bencString(reply, Token);
+        }
+        else if (handler.q == "announce_peer"sv && std::size(handler.info_hash) == std::tuple_size_v<tr_sha1_digest_t>)
+        {
+            if (announced_.insert(toDigest(handler.info_hash)).second)
+            {
+                n_announced_.store(std::size(announced_), std::memory_order_relaxed);
+            }
+        }
+        else if (handler.q != "ping"sv)
+        {
+            reply = "d1:eli204e14:Method Unknowne";
+            reply += "1:t";
+            bencString(reply, handler.t);
+            reply += "1:y1:ee";
+            return reply;
+        }
+
+        reply += "e1:t";
+        bencString(reply, handler.t);
+        reply += "1:y1:re";
+        return reply;
+    }
+
+    // The compact node info of the nodes whose ids are closest to `target`.
+    [[nodiscard]] std::string closestNodes(tr_sha1_digest_t const& target) const
+    {
+        auto const distance = [&target](Node const* node)
+        {
+            auto ret = tr_sha1_digest_t{};
+            for (size_t i = 0; i < std::size(ret); ++i)
+            {
+                ret[i] = node->id[i] ^ target[i];
+            }
+            return ret;
+        };
+
+        auto closest = std::vector<Node const*>{};
+        closest.reserve(std::size(nodes_));
+        for (auto const& node : nodes_)
+        {
+            closest.push_back(node.get());
+        }
+
+        auto const n = std::min(NodesPerReply, std::size(closest));
+        std::partial_sort(
+            std::begin(closest),
+            std::begin(closest) + n,
+            std::end(closest),
+            [&distance](auto const* a, auto const* b) { return distance(a) < distance(b); });
+
+        auto compact = std::string{};
+        for (size_t i = 0; i < n; ++i)
+        {
+            compact += digestView(closest[i]->id);
+            compact += compactAddress(*closest[i]);
+        }
+        return compact;
+    }
+
+    [[nodiscard]] std::string compactAddress(Node const& node) const
+    {
+        auto const nport = node.port.network();
+        auto compact = std::string{ reinterpret_cast<char const*>(&address_.addr.addr4), sizeof(address_.addr.addr4) };
+        compact.append(reinterpret_cast<char const*>(&nport), sizeof(nport));
+        return compact;
+    }
+
+    tr_address const address_;
+    StandInLoop loop_;
+    std::vector<std::unique_ptr<Node>> nodes_;
+    std::set<tr_sha1_digest_t> announced_;
+    std::atomic<size_t> n_announced_ = {};
+};
+
+} // namespace bench
+
+} // namespace libtransmission
@@ -0,0 +1,112 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "transmission.h"
+
+#include "torrent-metainfo.h"
+#include "variant.h"
+
+#include "benchmark-fixtures.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+
+// A torrent with `n_files` files and a piece per file, e.g. a 10,000-file
+// torrent's metainfo is about 700 KiB.
+std::string makeBenc(benchmark::State const& state)
+{
+    auto const n_files = static_cast<size_t>(state.range(0));
+    return makeMetainfo("synthetic", n_files, n_files, 256U * 1024U);
+}
+
+std::string makeJson(benchmark::State const& state)
+{
+    auto const benc = makeBenc(state);
+    auto top = tr_variant{};
+    tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, benc);
+    auto json = tr_variantToStr(&top, TR_VARIANT_FMT_JSON_LEAN);
+    tr_variantClear(&top);
+    return json;
+}
+
+void BM_BencParse(benchmark::State& state)
+{
+    auto const benc = makeBenc(state);
+
+    for (auto _ : state)
+    {
+        auto top = tr_variant{};
+        benchmark::DoNotOptimize(tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, benc));
+        tr_variantClear(&top);
+    }
+
+    state.SetBytesProcessed(state.iterations() * std::size(benc));
+}
+
+void BM_JsonParse(benchmark::State& state)
+{
+    auto const json = makeJson(state);
+
+    for (auto _ : state)
+    {
+        auto top = tr_variant{};
+        benchmark::DoNotOptimize(tr_variantFromBuf(&top, TR_VARIANT_PARSE_JSON | TR_VARIANT_PARSE_INPLACE, json));
+        tr_variantClear(&top);
+    }
+
+    state.SetBytesProcessed(state.iterations() * std::size(json));
+}
+
+template<tr_variant_fmt Fmt>
+void BM_VariantToStr(benchmark::State& state)
+{
+    auto const benc = makeBenc(state);
+    auto top = tr_variant{};
+    tr_variantFromBuf(&top, TR_VARIANT_PARSE_BENC | TR_VARIANT_PARSE_INPLACE, benc);
+
+    auto n_bytes = size_t{};
+    for (auto _ : state)
+    {
+        n_bytes += std::size(tr_variantToStr(&top, Fmt));
+    }
+
+    tr_variantClear(&top);
+    state.SetBytesProcessed(n_bytes);
+}
+
+// Parsing a .torrent file into a tr_torrent_metainfo, e.g. when adding a torrent.
+void BM_MetainfoParse(benchmark::State& state)
+{
+    auto const benc = makeBenc(state);
+
+    for (auto _ : state)
+    {
+        auto metainfo = tr_torrent_metainfo{};
+        if (!metainfo.parseBenc(benc))
+        {
+            state.SkipWithError("parseBenc() failed");
+            break;
+        }
+        benchmark::DoNotOptimize(metainfo.fileCount());
+    }
+
+    state.SetBytesProcessed(state.iterations() * std::size(benc));
+}
+
+BENCHMARK(BM_BencParse)->RangeMultiplier(100)->Range(1, 10000);
+BENCHMARK(BM_JsonParse)->RangeMultiplier(100)->Range(1, 10000);
+BENCHMARK_TEMPLATE(BM_VariantToStr, TR_VARIANT_FMT_BENC)->RangeMultiplier(100)->Range(1, 10000);
+BENCHMARK_TEMPLATE(BM_VariantToStr, TR_VARIANT_FMT_JSON)->RangeMultiplier(100)->Range(1, 10000);
+BENCHMARK_TEMPLATE(BM_VariantToStr, TR_VARIANT_FMT_JSON_LEAN)->RangeMultiplier(100)->Range(1, 10000);
+BENCHMARK(BM_MetainfoParse)->RangeMultiplier(100)->Range(1, 10000);
+
+} // namespace
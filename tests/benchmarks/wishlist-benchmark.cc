@@ -0,0 +1,130 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#define LIBTRANSMISSION_PEER_MODULE
+
+#include "transmission.h"
+
+#include "bitfield.h"
+#include "peer-mgr-wishlist.h"
+
+#include "benchmark-fixtures.h"
+
+using namespace libtransmission::bench;
+
+namespace
+{
+
+// A half-finished download: each piece has BlocksPerPiece blocks, about
+// half of the pieces are done, the rest are partly downloaded, and some
+// of the missing blocks have already been requested from other peers.
+class SyntheticMediator final : public Wishlist::Mediator
+{
+public:
+    static auto constexpr BlocksPerPiece = tr_block_index_t{ 16U };
+
+    explicit SyntheticMediator(tr_piece_index_t n_pieces)
+        : n_pieces_{ n_pieces }
+        , have_blocks_{ size_t{ n_pieces } * BlocksPerPiece }
+        , requested_blocks_{ size_t{ n_pieces } * BlocksPerPiece }
+        , missing_block_counts_(n_pieces)
+        , priorities_(n_pieces)
+    {
+        auto rng = makeRandomEngine();
+
+        for (tr_piece_index_t piece = 0; piece < n_pieces; ++piece)
+        {
+            auto const span = blockSpan(piece);
+
+            if (rng() % 2U == 0U)
+            {
+                have_blocks_.setSpan(span.begin, span.end);
+            }
+            else
+            {
+                for (auto block = span.begin; block < span.end; ++block)
+                {
+                    auto const roll = rng() % 8U;
+                    have_blocks_.set(block, roll == 0U);
+                    requested_blocks_.set(block, roll == 1U);
+                }
+            }
+
+            missing_block_counts_[piece] = BlocksPerPiece - have_blocks_.count(span.begin, span.end);
+            priorities_[piece] = static_cast<tr_priority_t>(int(rng() % 3U) - 1);
+        }
+    }
+
+    [[nodiscard]] bool clientCanRequestBlock(tr_block_index_t block) const override
+    {
+        return !have_blocks_.test(block) && !requested_blocks_.test(block);
+    }
+
+    [[nodiscard]] bool clientCanRequestPiece(tr_piece_index_t piece) const override
+    {
+        return missing_block_counts_[piece] != 0U;
+    }
+
+    [[nodiscard]] bool isEndgame() const override
+    {
+        return false;
+    }
+
+    [[nodiscard]] size_t countActiveRequests(tr_block_index_t block) const override
+    {
+        return requested_blocks_.test(block) ? 1U : 0U;
+    }
+
+    [[nodiscard]] size_t countMissingBlocks(tr_piece_index_t piece) const override
+    {
+        return missing_block_counts_[piece];
+    }
+
+    [[nodiscard]] tr_block_span_t blockSpan(tr_piece_index_t piece) const override
+    {
+        return { piece * BlocksPerPiece, (piece + 1U) * BlocksPerPiece };
+    }
+
+    [[nodiscard]] tr_piece_index_t countAllPieces() const override
+    {
+        return n_pieces_;
+    }
+
+    [[nodiscard]] tr_priority_t priority(tr_piece_index_t piece) const override
+    {
+        return priorities_[piece];
+    }
+
+private:
+    tr_piece_index_t const n_pieces_;
+    tr_bitfield have_blocks_;
+    tr_bitfield requested_blocks_;
+    std::vector<size_t> missing_block_counts_;
+    std::vector<tr_priority_t> priorities_;
+};
+
+// Refilling one peer's request queue.
+void BM_WishlistNext(benchmark::State& state)
+{
+    static auto constexpr NumWantedBlocks = size_t{ 128U };
+    auto const mediator = SyntheticMediator{ static_cast<tr_piece_index_t>(state.range(0)) };
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(Wishlist::next(mediator, NumWantedBlocks));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+// from a small torrent to a 64 GiB torrent with 1 MiB pieces
+BENCHMARK(BM_WishlistNext)->RangeMultiplier(8)->Range(1 << 10, 1 << 16)->Unit(benchmark::kMicrosecond);
+
+} // namespace
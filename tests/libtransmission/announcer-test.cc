@@ -5,6 +5,8 @@
 
 #include <algorithm>
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string_view>
 
 #define LIBTRANSMISSION_ANNOUNCER_MODULE
@@ -303,3 +305,105 @@ TEST_F(AnnouncerTest, parseHttpScrapeResponseMultiWithMissing)
     EXPECT_EQ(8, response.rows[2].leechers);
     EXPECT_EQ(9, response.rows[2].downloads);
 }
+
+TEST_F(AnnouncerTest, hostBudgetLimitsRate)
+{
+    auto budget = tr_tracker_host_budget{};
+    auto now_msec = uint64_t{ 1000000 };
+
+    // a burst of up to a second's worth of requests is allowed
+    auto const n = budget.available(now_msec);
+    EXPECT_EQ(tr_tracker_host_budget::InitialRate, n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        budget.started(now_msec);
+    }
+    EXPECT_EQ(0U, budget.available(now_msec));
+
+    // then the budget refills over time
+    now_msec += 1500U / tr_tracker_host_budget::InitialRate;
+    EXPECT_EQ(1U, budget.available(now_msec));
+}
+
+TEST_F(AnnouncerTest, hostBudgetAdaptsToResponses)
+{
+    auto budget = tr_tracker_host_budget{};
+    auto now_msec = uint64_t{ 1000000 };
+
+    // responses grow the budget
+    for (int i = 0; i < 5; ++i)
+    {
+        budget.started(now_msec);
+        budget.finished(true);
+    }
+    EXPECT_EQ(tr_tracker_host_budget::InitialRate + 5U, budget.rate());
+    EXPECT_EQ(tr_tracker_host_budget::InitialInFlight + 5U, budget.maxInFlight());
+    EXPECT_EQ(0U, budget.inFlight());
+
+    // a tracker that doesn't answer gets backed off
+    budget.started(now_msec);
+    budget.finished(false);
+    EXPECT_EQ((tr_tracker_host_budget::InitialRate + 5U) / 2U, budget.rate());
+    EXPECT_EQ((tr_tracker_host_budget::InitialInFlight + 5U) / 2U, budget.maxInFlight());
+
+    for (int i = 0; i < 10; ++i)
+    {
+        budget.started(now_msec);
+        budget.finished(false);
+    }
+    EXPECT_EQ(1U, budget.rate());
+    EXPECT_EQ(1U, budget.maxInFlight());
+
+    // but is always allowed to try again
+    now_msec += 1000U;
+    EXPECT_EQ(1U, budget.available(now_msec));
+    budget.started(now_msec);
+    EXPECT_EQ(0U, budget.available(now_msec + 1000U));
+}
+
+TEST_F(AnnouncerTest, announcePolicyInterval)
+{
+    auto in = tr_announce_policy_input{};
+    in.interval_sec = 1800;
+    in.min_interval_sec = 300;
+
+    // use the tracker's interval if we don't know the swarm's size
+    EXPECT_EQ(1800, tr_announcerPolicyInterval(in));
+
+    // downloading, with no seeds to download from
+    in.seeders = 0;
+    in.leechers = 10;
+    EXPECT_EQ(900, tr_announcerPolicyInterval(in));
+
+    // downloading, with seeds
+    in.seeders = 3;
+    EXPECT_EQ(1800, tr_announcerPolicyInterval(in));
+
+    // seeding a swarm that's short of seeds
+    in.is_done = true;
+    EXPECT_EQ(900, tr_announcerPolicyInterval(in));
+
+    // ...but never more often than the tracker's min interval
+    in.min_interval_sec = 1200;
+    EXPECT_EQ(1200, tr_announcerPolicyInterval(in));
+    in.min_interval_sec = 300;
+
+    // one of a few seeds in a quiet swarm
+    in.seeders = 4;
+    in.leechers = 1;
+    EXPECT_EQ(1800 * 10 / 8, tr_announcerPolicyInterval(in));
+
+    // one of many seeds in a dead swarm
+    in.seeders = 500;
+    in.leechers = 0;
+    EXPECT_EQ(1800 * 4, tr_announcerPolicyInterval(in));
+
+    // ...unless we've been uploading
+    in.uploaded = true;
+    EXPECT_EQ(1800, tr_announcerPolicyInterval(in));
+    in.uploaded = false;
+
+    // the only seed
+    in.seeders = 1;
+    EXPECT_EQ(1800, tr_announcerPolicyInterval(in));
+}
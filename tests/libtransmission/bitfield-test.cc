@@ -319,3 +319,31 @@ TEST(Bitfield, hasAllNone)
         EXPECT_TRUE(!field.hasNone());
     }
 }
+
+TEST(Bitfield, freesArrayWhenAllOrNoneAreSet)
+{
+    auto constexpr BitCount = size_t{ 100 };
+    auto field = tr_bitfield{ BitCount };
+    EXPECT_EQ(0U, field.memoryUsage());
+
+    // e.g. a peer becoming a seed one `have` message at a time
+    for (size_t i = 0; i < BitCount; ++i)
+    {
+        field.set(i);
+        EXPECT_EQ(i + 1 < BitCount, field.memoryUsage() > 0U);
+    }
+    EXPECT_TRUE(field.hasAll());
+    EXPECT_TRUE(field.test(BitCount - 1));
+
+    field.unset(50);
+    EXPECT_GT(field.memoryUsage(), 0U);
+    EXPECT_EQ(BitCount - 1, field.count());
+    EXPECT_TRUE(field.test(49));
+    EXPECT_FALSE(field.test(50));
+
+    field.setHasNone();
+    field.set(7);
+    field.unset(7);
+    EXPECT_TRUE(field.hasNone());
+    EXPECT_EQ(0U, field.memoryUsage());
+}
@@ -6,12 +6,14 @@
 #include <algorithm>
 #include <array>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
 #include <numeric>
 #include <sstream>
 #include <string>
 #include <string_view>
 #include <unordered_set>
+#include <vector>
 
 #include "transmission.h"
 
@@ -34,6 +36,18 @@ auto constexpr SomeHash = tr_sha1_digest_t{
     std::byte{ 14 }, std::byte{ 15 }, std::byte{ 16 }, std::byte{ 17 }, std::byte{ 18 }, std::byte{ 19 },
 };
 
+template<size_t N>
+std::string toHex(std::array<std::byte, N> const& array)
+{
+    auto ostr = std::ostringstream{};
+    ostr << std::hex << std::setfill('0');
+    for (auto const b : array)
+    {
+        ostr << std::setw(2) << static_cast<unsigned>(b);
+    }
+    return ostr.str();
+}
+
 template<size_t N>
 std::string toString(std::array<std::byte, N> const& array)
 {
@@ -66,6 +80,51 @@ TEST(Crypto, DH)
     EXPECT_NE(toString(a.secret()), toString(c.secret()));
 }
 
+TEST(Crypto, DHKnownAnswer)
+{
+    auto a_private_key = tr_message_stream_encryption::DH::private_key_bigend_t{};
+    auto b_private_key = tr_message_stream_encryption::DH::private_key_bigend_t{};
+    for (size_t i = 0; i < std::size(a_private_key); ++i)
+    {
+        a_private_key[i] = std::byte(i * 7 + 1);
+        b_private_key[i] = std::byte(255 - i * 3);
+    }
+
+    auto a = tr_message_stream_encryption::DH{ a_private_key };
+    auto b = tr_message_stream_encryption::DH{ b_private_key };
+    EXPECT_EQ(
+        "d4017cf6bb3064bf31b657a46aa1afcd5885d049867ae2f1b6a2bfcb2dbad1b8d96f6f7a5422554b84eef0d9dcb210ef"
+        "a2457a21635de27733217d72787d9013bd81077a22e5ac0be030828001da8df37f6b39366d74c5e7e77d90258d74e74b"sv,
+        toHex(a.publicKey()));
+    EXPECT_EQ(
+        "532ffa6648e2f5c8283fc47f55801c68d7d640471b8a1ab20009f716fd546aaee6ffc7509650d12b186c4925b9651c89"
+        "6fa0d60b9611dd336afe1a19af746962ef7b5b1ce649a5c4eab620077f8ce20fea411166998cf64479b49df07479d9a6"sv,
+        toHex(b.publicKey()));
+
+    a.setPeerPublicKey(b.publicKey());
+    EXPECT_EQ(
+        "d935e4784170625fccfa3cb19aef509d6f87b4d9d3c7017c318ea6d504a66c54f9014a01ca096beb09cd4d22ba18922a"
+        "eff8fcba185b1529af2c1d11ab984ba34e82994c9442c5f1acc4722d7868d2ecc468414fa8d5dbd91941045d9b2a8890"sv,
+        toHex(a.secret()));
+}
+
+TEST(Crypto, DHKeyPool)
+{
+    auto pool = tr_message_stream_encryption::KeyPool{ 4 };
+
+    for (int i = 0; i < 8; ++i)
+    {
+        auto a = pool.take();
+        auto b = tr_message_stream_encryption::DH{};
+        a.setPeerPublicKey(b.publicKey());
+        b.setPeerPublicKey(a.publicKey());
+        EXPECT_EQ(a.secret(), b.secret());
+    }
+
+    auto const stats = pool.stats();
+    EXPECT_EQ(8U, stats.hits + stats.misses);
+}
+
 TEST(Crypto, encryptDecrypt)
 {
     auto a_dh = tr_message_stream_encryption::DH{};
@@ -134,6 +193,24 @@ TEST(Crypto, sha1)
     EXPECT_EQ("a94a8fe5ccb19ba61c4c0873d391e987982fbbd3"sv, tr_sha1_to_string(hash5));
 }
 
+TEST(Crypto, sha1Pieces)
+{
+    auto constexpr PieceSize = size_t{ 16384 };
+    auto data = std::vector<char>(PieceSize * 5 + 1000);
+    std::iota(std::begin(data), std::end(data), 0);
+
+    auto const digests = tr_sha1::digestPieces(std::data(data), std::size(data), PieceSize);
+    EXPECT_EQ(6U, std::size(digests));
+    for (size_t i = 0; i < std::size(digests); ++i)
+    {
+        auto const begin = i * PieceSize;
+        auto const len = std::min(PieceSize, std::size(data) - begin);
+        EXPECT_EQ(tr_sha1::digest(std::string_view{ std::data(data) + begin, len }), digests[i]);
+    }
+
+    EXPECT_TRUE(std::empty(tr_sha1::digestPieces(std::data(data), 0U, PieceSize)));
+}
+
 TEST(Crypto, ssha1)
 {
     struct LocalTest
@@ -0,0 +1,276 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <ctime>
+#include <map>
+#include <optional>
+#include <set>
+#include <vector>
+
+#include "transmission.h"
+
+#include "dht-scheduler.h"
+
+#include "gtest/gtest.h"
+
+using DhtSchedulerTest = ::testing::Test;
+
+namespace
+{
+
+class MockMediator final : public tr_dht_scheduler::Mediator
+{
+public:
+    [[nodiscard]] bool isReady(tr_address_type /*type*/) const override
+    {
+        return true;
+    }
+
+    [[nodiscard]] std::optional<size_t> peerCount(tr_torrent_id_t tor_id) const override
+    {
+        if (auto const iter = peers.find(tor_id); iter != std::end(peers))
+        {
+            return iter->second;
+        }
+
+        return {};
+    }
+
+    [[nodiscard]] bool startSearch(tr_torrent_id_t tor_id, tr_address_type /*type*/) override
+    {
+        if (refuse)
+        {
+            ++n_refused;
+            return false;
+        }
+
+        started.push_back(tor_id);
+        return true;
+    }
+
+    std::map<tr_torrent_id_t, size_t> peers;
+    std::vector<tr_torrent_id_t> started;
+    size_t n_refused = 0;
+    bool refuse = false;
+};
+
+auto constexpr Start = time_t{ 1000 };
+
+} // namespace
+
+TEST_F(DhtSchedulerTest, startsNoMoreThanMinSearchesForFewTorrents)
+{
+    auto mediator = MockMediator{};
+    auto scheduler = tr_dht_scheduler{ mediator, Start, 3 };
+
+    for (tr_torrent_id_t id = 1; id <= 10; ++id)
+    {
+        mediator.peers[id] = 0;
+        scheduler.add(id, TR_AF_INET, Start);
+    }
+
+    // enough time to have plenty of pacing tokens
+    scheduler.pulse(Start + 10);
+    EXPECT_EQ(3U, std::size(mediator.started));
+    EXPECT_EQ(3U, scheduler.stats().searching);
+    EXPECT_EQ(7U, scheduler.stats().queued);
+
+    // a finished search frees its slot
+    scheduler.searchDone(mediator.started.front(), TR_AF_INET);
+    scheduler.pulse(Start + 11);
+    EXPECT_EQ(4U, std::size(mediator.started));
+    EXPECT_EQ(6U, scheduler.stats().queued);
+}
+
+TEST_F(DhtSchedulerTest, pacesAnnounces)
+{
+    auto mediator = MockMediator{};
+    auto scheduler = tr_dht_scheduler{ mediator, Start };
+
+    for (tr_torrent_id_t id = 1; id <= 100; ++id)
+    {
+        mediator.peers[id] = 0;
+        scheduler.add(id, TR_AF_INET, Start);
+    }
+
+    // the burst is capped no matter how long the scheduler sat idle
+    scheduler.pulse(Start + 1000);
+    auto const n_burst = std::size(mediator.started);
+    EXPECT_LT(0U, n_burst);
+    EXPECT_GT(20U, n_burst);
+
+    scheduler.pulse(Start + 1001);
+    EXPECT_LT(n_burst, std::size(mediator.started));
+    EXPECT_GT(n_burst + 10U, std::size(mediator.started));
+}
+
+TEST_F(DhtSchedulerTest, prefersTorrentsWithFewPeers)
+{
+    auto mediator = MockMediator{};
+    auto scheduler = tr_dht_scheduler{ mediator, Start, 1 };
+
+    mediator.peers[1] = 50;
+    mediator.peers[2] = 0;
+    mediator.peers[3] = 10;
+    scheduler.add(1, TR_AF_INET, Start);
+    scheduler.add(2, TR_AF_INET, Start);
+    scheduler.add(3, TR_AF_INET, Start);
+
+    auto now = Start + 1;
+    for (int i = 0; i < 3; ++i)
+    {
+        scheduler.pulse(now);
+        scheduler.searchDone(mediator.started.back(), TR_AF_INET);
+        ++now;
+    }
+
+    EXPECT_EQ((std::vector<tr_torrent_id_t>{ 2, 3, 1 }), mediator.started);
+}
+
+TEST_F(DhtSchedulerTest, backsOffWhenRefused)
+{
+    auto mediator = MockMediator{};
+    auto scheduler = tr_dht_scheduler{ mediator, Start };
+
+    for (tr_torrent_id_t id = 1; id <= 4; ++id)
+    {
+        mediator.peers[id] = 0;
+        scheduler.add(id, TR_AF_INET, Start);
+    }
+
+    // one refusal stops the whole pulse
+    mediator.refuse = true;
+    scheduler.pulse(Start + 1);
+    EXPECT_EQ(1U, mediator.n_refused);
+    EXPECT_EQ(1U, scheduler.stats().failed);
+
+    // and nothing is tried again until the backoff is over
+    mediator.refuse = false;
+    scheduler.pulse(Start + 2);
+    EXPECT_TRUE(std::empty(mediator.started));
+
+    scheduler.pulse(Start + 10);
+    EXPECT_EQ(4U, std::size(mediator.started));
+    EXPECT_EQ(0U, scheduler.stats().queued);
+}
+
+TEST_F(DhtSchedulerTest, retriesSearchesThatFailLater)
+{
+    auto mediator = MockMediator{};
+    auto scheduler = tr_dht_scheduler{ mediator, Start, 1 };
+
+    mediator.peers[1] = 0;
+    scheduler.add(1, TR_AF_INET, Start);
+    scheduler.pulse(Start + 1);
+    ASSERT_EQ(1U, std::size(mediator.started));
+
+    // the slot is freed, but the retry waits out the backoff
+    scheduler.searchFailed(1, TR_AF_INET, Start + 2);
+    EXPECT_EQ(0U, scheduler.stats().searching);
+    EXPECT_EQ(1U, scheduler.stats().failed);
+    scheduler.pulse(Start + 3);
+    EXPECT_EQ(1U, std::size(mediator.started));
+
+    scheduler.pulse(Start + 10);
+    EXPECT_EQ(2U, std::size(mediator.started));
+}
+
+TEST_F(DhtSchedulerTest, removedTorrentsDoNotAnnounce)
+{
+    auto mediator = MockMediator{};
+    auto scheduler = tr_dht_scheduler{ mediator, Start };
+
+    mediator.peers[1] = 0;
+    mediator.peers[2] = 0;
+    scheduler.add(1, TR_AF_INET, Start + 5);
+    scheduler.add(1, TR_AF_INET6, Start + 5);
+    scheduler.add(2, TR_AF_INET, Start + 5);
+    EXPECT_EQ(3U, scheduler.stats().scheduled);
+
+    scheduler.remove(1);
+    EXPECT_EQ(1U, scheduler.stats().scheduled);
+
+    // torrents the mediator no longer knows about are dropped too
+    mediator.peers.erase(2);
+    scheduler.pulse(Start + 10);
+    EXPECT_TRUE(std::empty(mediator.started));
+    EXPECT_EQ(0U, scheduler.stats().scheduled);
+    EXPECT_EQ(0U, scheduler.stats().queued);
+}
+
+TEST_F(DhtSchedulerTest, reschedulesAfterAnnouncing)
+{
+    auto mediator = MockMediator{};
+    auto scheduler = tr_dht_scheduler{ mediator, Start };
+
+    mediator.peers[1] = 0;
+    scheduler.add(1, TR_AF_INET, Start);
+    scheduler.pulse(Start + 1);
+    ASSERT_EQ(1U, std::size(mediator.started));
+    scheduler.searchDone(1, TR_AF_INET);
+
+    // not again until the interval has passed
+    scheduler.pulse(Start + tr_dht_scheduler::AnnounceIntervalSec);
+    EXPECT_EQ(1U, std::size(mediator.started));
+
+    scheduler.pulse(Start + 1 + tr_dht_scheduler::AnnounceIntervalSec + tr_dht_scheduler::AnnounceJitterSec);
+    EXPECT_EQ(2U, std::size(mediator.started));
+    EXPECT_EQ(2U, scheduler.stats().started);
+}
+
+TEST_F(DhtSchedulerTest, searchSlotsGrowWithTorrents)
+{
+    auto mediator = MockMediator{};
+    auto scheduler = tr_dht_scheduler{ mediator, Start };
+    EXPECT_EQ(tr_dht_scheduler::DefaultMinSearches, scheduler.maxSearches());
+
+    // enough slots for every torrent to announce once per interval
+    static auto constexpr NumTorrents = tr_torrent_id_t{ 5000 };
+    for (tr_torrent_id_t id = 1; id <= NumTorrents; ++id)
+    {
+        scheduler.add(id, TR_AF_INET, Start + tr_dht_scheduler::AnnounceIntervalSec);
+    }
+    auto const n_busy = NumTorrents * tr_dht_scheduler::ExpectedSearchSec / tr_dht_scheduler::AnnounceIntervalSec;
+    EXPECT_LT(static_cast<size_t>(n_busy), scheduler.maxSearches());
+
+    // but never more than the ceiling
+    for (tr_torrent_id_t id = 1; id <= NumTorrents; ++id)
+    {
+        scheduler.add(id, TR_AF_INET6, Start + tr_dht_scheduler::AnnounceIntervalSec);
+    }
+    EXPECT_EQ(tr_dht_scheduler::MaxSearches, scheduler.maxSearches());
+}
+
+TEST_F(DhtSchedulerTest, announcesEveryTorrentOncePerInterval)
+{
+    auto mediator = MockMediator{};
+    auto scheduler = tr_dht_scheduler{ mediator, Start };
+
+    // more than DefaultMinSearches slots can keep up with
+    static auto constexpr NumTorrents = tr_torrent_id_t{ 4000 };
+    for (tr_torrent_id_t id = 1; id <= NumTorrents; ++id)
+    {
+        mediator.peers[id] = 0;
+        scheduler.add(id, TR_AF_INET, Start);
+    }
+
+    // each search takes as long as libdht's usually do
+    auto const end = Start + tr_dht_scheduler::AnnounceIntervalSec + tr_dht_scheduler::ExpectedSearchSec;
+    auto n_done = size_t{};
+    auto started_at = std::vector<time_t>{};
+    for (auto now = Start + 1; now <= end; ++now)
+    {
+        scheduler.pulse(now);
+        started_at.resize(std::size(mediator.started), now);
+
+        for (; n_done < std::size(started_at) && started_at[n_done] + tr_dht_scheduler::ExpectedSearchSec <= now; ++n_done)
+        {
+            scheduler.searchDone(mediator.started[n_done], TR_AF_INET);
+        }
+    }
+
+    auto const announced = std::set<tr_torrent_id_t>{ std::begin(mediator.started), std::end(mediator.started) };
+    EXPECT_EQ(static_cast<size_t>(NumTorrents), std::size(announced));
+}
@@ -0,0 +1,123 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <event2/event.h>
+
+#include "transmission.h"
+
+#include "event-loop-stats.h"
+#include "timer-ev.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+namespace
+{
+
+[[nodiscard]] size_t index(tr_event_loop_callback callback)
+{
+    return static_cast<size_t>(callback);
+}
+
+} // namespace
+
+TEST(EventLoopStats, scopeRecordsDurationAndLag)
+{
+    auto stats = tr_event_loop_stats{};
+
+    {
+        auto const scope = tr_event_loop_stats::Scope{ stats, tr_event_loop_callback::RechokePulse, 3ms };
+        std::this_thread::sleep_for(2ms);
+    }
+
+    {
+        // no lag given, e.g. a pulse called from another pulse
+        auto const scope = tr_event_loop_stats::Scope{ stats, tr_event_loop_callback::ReconnectPulse };
+    }
+
+    auto const snapshot = stats.snapshot();
+    auto const& rechoke = snapshot.callbacks[index(tr_event_loop_callback::RechokePulse)];
+    EXPECT_EQ(1U, rechoke.duration.count);
+    EXPECT_LE(2000U, rechoke.duration.sum_usec);
+    EXPECT_EQ(1U, rechoke.lag.count);
+    EXPECT_EQ(3000U, rechoke.lag.sum_usec);
+
+    auto const& reconnect = snapshot.callbacks[index(tr_event_loop_callback::ReconnectPulse)];
+    EXPECT_EQ(1U, reconnect.duration.count);
+    EXPECT_EQ(0U, reconnect.lag.count);
+
+    EXPECT_EQ(0U, snapshot.callbacks[index(tr_event_loop_callback::BandwidthPulse)].duration.count);
+}
+
+TEST(EventLoopStats, workQueue)
+{
+    auto stats = tr_event_loop_stats{};
+
+    // a drain that nobody asked for has no lag
+    EXPECT_FALSE(stats.takeWorkQueueLag());
+
+    stats.onWorkQueueWakeup();
+    std::this_thread::sleep_for(2ms);
+    auto const lag = stats.takeWorkQueueLag();
+    ASSERT_TRUE(lag);
+    EXPECT_LE(2ms, *lag);
+    EXPECT_FALSE(stats.takeWorkQueueLag());
+
+    stats.onWorkQueueDrained(5);
+    stats.onWorkQueueDrained(2);
+    auto const snapshot = stats.snapshot();
+    EXPECT_EQ(7U, snapshot.work_queue_tasks);
+    EXPECT_EQ(5U, snapshot.work_queue_max_depth);
+}
+
+TEST(EventLoopStats, describeSkipsIdleCallbacks)
+{
+    auto stats = tr_event_loop_stats{};
+    auto const before = stats.snapshot();
+
+    {
+        auto const scope = tr_event_loop_stats::Scope{ stats, tr_event_loop_callback::SessionSave, 10ms };
+    }
+    {
+        auto const scope = tr_event_loop_stats::Scope{ stats, tr_event_loop_callback::WorkQueue };
+        stats.onWorkQueueDrained(4);
+    }
+
+    auto const lines = tr_event_loop_stats::describe(stats.snapshot(), before);
+    ASSERT_EQ(2U, std::size(lines));
+    EXPECT_TRUE(tr_strvStartsWith(lines[0], "session-save: 1 runs, "sv));
+    EXPECT_NE(std::string::npos, lines[0].find(", 10.0 ms avg lag, 16.4 ms p99 lag"sv));
+    EXPECT_TRUE(tr_strvStartsWith(lines[1], "work-queue: 1 runs, "sv));
+    EXPECT_TRUE(tr_strvEndsWith(lines[1], ", 4 tasks, 4 max depth"sv));
+
+    // nothing happened since the last snapshot
+    EXPECT_TRUE(std::empty(tr_event_loop_stats::describe(stats.snapshot(), stats.snapshot())));
+}
+
+TEST(EventLoopStats, timerLateness)
+{
+    auto const base = std::unique_ptr<event_base, void (*)(event_base*)>{ event_base_new(), event_base_free };
+    auto timer_maker = libtransmission::EvTimerMaker{ base.get() };
+
+    auto lateness = std::vector<std::chrono::microseconds>{};
+    auto timer = timer_maker.create();
+    timer->setCallback([&lateness, &timer]() { lateness.push_back(timer->lateness()); });
+    timer->startSingleShot(10ms);
+
+    // keep the loop busy past the timer's due time
+    std::this_thread::sleep_for(50ms);
+    event_base_loop(base.get(), EVLOOP_ONCE);
+
+    ASSERT_EQ(1U, std::size(lateness));
+    EXPECT_LE(30ms, lateness.front());
+}
@@ -5,8 +5,16 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string_view>
+#include <tuple> // std::tuple_size_v
+#include <utility>
+#include <vector>
 
 #include <event2/util.h>
 
@@ -16,6 +24,7 @@
 #include "peer-io.h"
 #include "session.h" // tr_peerIdInit()
 #include "timer.h"
+#include "trevent.h" // tr_runInEventThread()
 
 #include "test-fixtures.h"
 
@@ -37,6 +46,30 @@ auto constexpr MaxWaitMsec = int{ 5000 };
 class HandshakeTest : public SessionTest
 {
 public:
+    // crypto jobs that a MediatorMock was asked to run,
+    // held so that a test can decide when they finish
+    struct HeldCrypto
+    {
+        using job_t = std::pair<std::function<void()>, std::function<void()>>;
+
+        std::optional<job_t> take()
+        {
+            auto const lock = std::lock_guard(mutex);
+
+            if (std::empty(jobs))
+            {
+                return {};
+            }
+
+            auto job = std::move(jobs.front());
+            jobs.erase(std::begin(jobs));
+            return job;
+        }
+
+        std::mutex mutex;
+        std::vector<job_t> jobs;
+    };
+
     class MediatorMock final : public tr_handshake_mediator
     {
     public:
@@ -105,6 +138,18 @@ public:
         {
         }
 
+        bool runCrypto(std::function<void()> work, std::function<void()> done) override
+        {
+            if (!held_crypto)
+            {
+                return false;
+            }
+
+            auto const lock = std::lock_guard(held_crypto->mutex);
+            held_crypto->jobs.emplace_back(std::move(work), std::move(done));
+            return true;
+        }
+
         void setPrivateKeyFromBase64(std::string_view b64)
         {
             auto const str = tr_base64_decode(b64);
@@ -115,6 +160,7 @@ public:
         tr_session* const session_;
         std::map<tr_sha1_digest_t, torrent_info> torrents;
         tr_message_stream_encryption::DH::private_key_bigend_t private_key_ = {};
+        std::shared_ptr<HeldCrypto> held_crypto;
     };
 
     template<typename Span>
@@ -431,5 +477,165 @@ TEST_F(HandshakeTest, outgoingEncrypted)
     evutil_closesocket(sock);
 }
 
+TEST_F(HandshakeTest, outgoingEncryptedAfterEmptyPadB)
+{
+    using DH = tr_message_stream_encryption::DH;
+
+    // no crypto worker, so the secret is computed inline
+    auto mediator = std::make_unique<MediatorMock>(session_);
+    mediator->torrents.emplace(UbuntuTorrent.info_hash, UbuntuTorrent);
+    mediator->setPrivateKeyFromBase64("0EYKCwBWQ4Dg9kX3c5xxjVtBDKw="sv);
+
+    auto [io, sock] = createOutgoingIo(session_, UbuntuTorrent.info_hash);
+    evutil_make_socket_nonblocking(sock);
+
+    // Yb with an empty PadB, so nothing else arrives until we get req1
+    auto peer_dh = DH{};
+    sendToClient(sock, peer_dh.publicKey());
+
+    auto n_done = std::atomic<int>{};
+    auto* const handshake = tr_handshakeNew(
+        std::move(mediator),
+        io,
+        TR_ENCRYPTION_PREFERRED,
+        [](auto const& resin)
+        {
+            ++*static_cast<std::atomic<int>*>(resin.userData);
+            return true;
+        },
+        &n_done);
+
+    // Ya, PadA, and then HASH('req1', S)
+    auto const n_wanted = std::tuple_size_v<DH::key_bigend_t> + 10U + std::tuple_size_v<tr_sha1_digest_t>;
+    auto received = std::vector<std::byte>{};
+    EXPECT_TRUE(waitFor(
+        [&]()
+        {
+            auto buf = std::array<std::byte, 1024>{};
+            auto const n = recv(sock, reinterpret_cast<char*>(std::data(buf)), std::size(buf), 0);
+            if (n > 0)
+            {
+                received.insert(std::end(received), std::begin(buf), std::begin(buf) + n);
+            }
+            return std::size(received) >= n_wanted;
+        },
+        MaxWaitMsec));
+    ASSERT_LE(n_wanted, std::size(received));
+
+    auto ya = DH::key_bigend_t{};
+    std::copy_n(std::begin(received), std::size(ya), std::begin(ya));
+    peer_dh.setPeerPublicKey(ya);
+    auto const req1 = tr_sha1::digest("req1"sv, peer_dh.secret());
+    EXPECT_TRUE(std::equal(std::begin(req1), std::end(req1), std::begin(received) + std::size(ya) + 10U));
+
+    tr_runInEventThread(session_, [handshake]() { tr_handshakeAbort(handshake); });
+    EXPECT_TRUE(waitFor([&n_done]() { return n_done == 1; }, MaxWaitMsec));
+
+    evutil_closesocket(sock);
+}
+
+TEST_F(HandshakeTest, incomingEncryptedResumesAfterCryptoWorker)
+{
+    static auto constexpr ExpectedPeerId = makePeerId("-TR300Z-w4bd4mkebkbi"sv);
+
+    auto const held_crypto = std::make_shared<HeldCrypto>();
+    auto mediator = std::make_unique<MediatorMock>(session_);
+    mediator->torrents.emplace(UbuntuTorrent.info_hash, UbuntuTorrent);
+    mediator->setPrivateKeyFromBase64("0EYKCwBWQ4Dg9kX3c5xxjVtBDKw="sv);
+    mediator->held_crypto = held_crypto;
+
+    auto [io, sock] = createIncomingIo(session_);
+
+    // same datastream as HandshakeTest.incomingEncrypted
+    sendB64ToClient(
+        sock,
+        "svkySIFcCsrDTeHjPt516UFbsoR+5vfbe5/m6stE7u5JLZ10kJ19NmP64E10qI"
+        "nn78sCrJgjw1yEHHwrzOcKiRlYvcMotzJMe+SjrFUnaw3KBfn2bcKBhxb/sfM9"
+        "J7nJ"sv);
+    sendB64ToClient(
+        sock,
+        "ICAgICAgICAgIKdr4jIBZ4xFfO4xNiRV7Gl2azTSuTFuu06NU1WyRPif018JYe"
+        "VGwrTPstEPu3V5lmzjtMGVLaL5EErlpJ93Xrz+ea6EIQEUZA+D4jKaV/to9NVi"
+        "04/1W1A2PHgg+I9puac/i9BsFPcjdQeoVtU73lNCbTDQgTieyjDWmwo="sv);
+
+    auto result = std::optional<tr_handshake_result>{};
+    tr_handshakeNew(
+        std::move(mediator),
+        io,
+        TR_CLEAR_PREFERRED,
+        [](auto const& resin)
+        {
+            *static_cast<std::optional<tr_handshake_result>*>(resin.userData) = resin;
+            return true;
+        },
+        &result);
+
+    // the handshake should wait for the secret...
+    auto job = std::optional<HeldCrypto::job_t>{};
+    EXPECT_TRUE(waitFor([&held_crypto, &job]() { return (job = held_crypto->take()).has_value(); }, MaxWaitMsec));
+    ASSERT_TRUE(job);
+    EXPECT_FALSE(result);
+
+    // ...and pick up where it left off once the worker posts it back
+    job->first();
+    tr_runInEventThread(session_, std::move(job->second));
+    EXPECT_TRUE(waitFor([&result]() { return result.has_value(); }, MaxWaitMsec));
+
+    // check the results
+    ASSERT_TRUE(result);
+    EXPECT_TRUE(result->isConnected);
+    EXPECT_EQ(ExpectedPeerId, result->peer_id);
+    EXPECT_EQ(UbuntuTorrent.info_hash, io->torrentHash());
+
+    evutil_closesocket(sock);
+}
+
+TEST_F(HandshakeTest, abortWhileCryptoWorkerIsBusy)
+{
+    auto const held_crypto = std::make_shared<HeldCrypto>();
+    auto mediator = std::make_unique<MediatorMock>(session_);
+    mediator->torrents.emplace(UbuntuTorrent.info_hash, UbuntuTorrent);
+    mediator->setPrivateKeyFromBase64("0EYKCwBWQ4Dg9kX3c5xxjVtBDKw="sv);
+    mediator->held_crypto = held_crypto;
+
+    auto [io, sock] = createIncomingIo(session_);
+
+    // Ya and PadA from HandshakeTest.incomingEncrypted
+    sendB64ToClient(
+        sock,
+        "svkySIFcCsrDTeHjPt516UFbsoR+5vfbe5/m6stE7u5JLZ10kJ19NmP64E10qI"
+        "nn78sCrJgjw1yEHHwrzOcKiRlYvcMotzJMe+SjrFUnaw3KBfn2bcKBhxb/sfM9"
+        "J7nJ"sv);
+
+    auto n_done = std::atomic<int>{};
+    auto* const handshake = tr_handshakeNew(
+        std::move(mediator),
+        io,
+        TR_CLEAR_PREFERRED,
+        [](auto const& resin)
+        {
+            ++*static_cast<std::atomic<int>*>(resin.userData);
+            return true;
+        },
+        &n_done);
+
+    auto job = std::optional<HeldCrypto::job_t>{};
+    EXPECT_TRUE(waitFor([&held_crypto, &job]() { return (job = held_crypto->take()).has_value(); }, MaxWaitMsec));
+    ASSERT_TRUE(job);
+
+    tr_runInEventThread(session_, [handshake]() { tr_handshakeAbort(handshake); });
+    EXPECT_TRUE(waitFor([&n_done]() { return n_done == 1; }, MaxWaitMsec));
+
+    // a secret that arrives after the handshake is gone is ignored
+    job->first();
+    tr_runInEventThread(session_, std::move(job->second));
+    auto posted = std::make_shared<std::atomic<bool>>(false);
+    tr_runInEventThread(session_, [posted]() { *posted = true; });
+    EXPECT_TRUE(waitFor([&posted]() { return posted->load(); }, MaxWaitMsec));
+    EXPECT_EQ(1, n_done);
+
+    evutil_closesocket(sock);
+}
+
 } // namespace test
 } // namespace libtransmission
@@ -0,0 +1,77 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+#include "transmission.h"
+
+#include "instrumented-mutex.h"
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+using Mutex = tr_instrumented_recursive_mutex;
+
+TEST(InstrumentedMutex, bucketFor)
+{
+    EXPECT_EQ(0U, Mutex::bucketFor(0us));
+    EXPECT_EQ(1U, Mutex::bucketFor(1us));
+    EXPECT_EQ(2U, Mutex::bucketFor(2us));
+    EXPECT_EQ(2U, Mutex::bucketFor(3us));
+    EXPECT_EQ(3U, Mutex::bucketFor(4us));
+    EXPECT_EQ(10U, Mutex::bucketFor(1ms));
+    EXPECT_EQ(Mutex::NumBuckets - 1U, Mutex::bucketFor(1h));
+}
+
+TEST(InstrumentedMutex, recursiveLockingIsOneHold)
+{
+    auto mutex = Mutex{};
+
+    {
+        auto const outer = std::lock_guard{ mutex };
+        auto const inner = std::lock_guard{ mutex };
+    }
+
+    auto const stats = mutex.stats();
+    auto const sum = [](auto const& histogram)
+    {
+        return std::accumulate(std::begin(histogram), std::end(histogram), uint64_t{});
+    };
+
+    // the first hold, plus the one taken by stats() itself
+    EXPECT_EQ(2U, stats.acquisitions);
+    EXPECT_EQ(0U, stats.contended);
+    EXPECT_EQ(2U, sum(stats.wait_usec));
+    EXPECT_EQ(1U, sum(stats.hold_usec));
+}
+
+TEST(InstrumentedMutex, recordsWaits)
+{
+    auto mutex = Mutex{};
+
+    auto lock = std::unique_lock{ mutex };
+    auto waiter = std::thread{ [&mutex]() { auto const waiter_lock = std::lock_guard{ mutex }; } };
+    std::this_thread::sleep_for(20ms);
+    lock.unlock();
+    waiter.join();
+
+    auto const stats = mutex.stats();
+    EXPECT_EQ(1U, stats.contended);
+
+    // the lock was held, and waited for, for at least 20ms
+    auto const first_long_bucket = Mutex::bucketFor(20ms);
+    auto const count_long = [first_long_bucket](auto const& histogram)
+    {
+        return std::accumulate(std::begin(histogram) + first_long_bucket, std::end(histogram), uint64_t{});
+    };
+    EXPECT_EQ(1U, count_long(stats.wait_usec));
+    EXPECT_EQ(1U, count_long(stats.hold_usec));
+    EXPECT_LE(20000U, stats.wait_sum_usec);
+    EXPECT_LE(20000U, stats.hold_sum_usec);
+}
@@ -140,6 +140,33 @@ TEST_F(MakemetaTest, pieceSize)
     }
 }
 
+TEST_F(MakemetaTest, checksumThreads)
+{
+    // big enough to need several read batches
+    static auto constexpr PieceSize = uint32_t{ 16384U };
+    auto const files = makeRandomFiles(sandboxDir(), 1, 1);
+    auto const [filename, payload] = files.front();
+    auto big_payload = std::string(PieceSize * 700U + 1000U, '\0');
+    tr_rand_buffer(std::data(big_payload), std::size(big_payload));
+    EXPECT_TRUE(tr_saveFile(filename, big_payload));
+
+    for (size_t const n_threads : { 1U, 4U })
+    {
+        auto builder = tr_metainfo_builder{ filename };
+        builder.setPieceSize(PieceSize);
+        builder.setChecksumThreadCount(n_threads);
+        EXPECT_EQ(n_threads, builder.checksumThreadCount());
+
+        auto const metainfo = testBuilder(builder);
+        EXPECT_EQ(builder.pieceCount(), builder.checksumStatus().first);
+        for (tr_piece_index_t piece = 0, n = metainfo.pieceCount(); piece < n; ++piece)
+        {
+            auto const piece_payload = std::string_view{ big_payload }.substr(piece * size_t{ PieceSize }, PieceSize);
+            EXPECT_EQ(tr_sha1::digest(piece_payload), metainfo.pieceHash(piece));
+        }
+    }
+}
+
 TEST_F(MakemetaTest, webseeds)
 {
     auto const files = makeRandomFiles(sandboxDir(), 1);
@@ -0,0 +1,80 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "merkle.h"
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+TEST(Merkle, widthFor)
+{
+    EXPECT_EQ(1U, tr_merkle::widthFor(0));
+    EXPECT_EQ(1U, tr_merkle::widthFor(1));
+    EXPECT_EQ(2U, tr_merkle::widthFor(2));
+    EXPECT_EQ(4U, tr_merkle::widthFor(3));
+    EXPECT_EQ(2048U, tr_merkle::widthFor(1316));
+}
+
+TEST(Merkle, padHash)
+{
+    auto const zero = tr_sha256_digest_t{};
+    EXPECT_EQ(zero, tr_merkle::padHash(0));
+    EXPECT_EQ(tr_sha256::digest(zero, zero), tr_merkle::padHash(1));
+
+    auto const pad1 = tr_merkle::padHash(1);
+    EXPECT_EQ(tr_sha256::digest(pad1, pad1), tr_merkle::padHash(2));
+}
+
+TEST(Merkle, blockHashes)
+{
+    auto data = std::vector<char>(tr_merkle::BlockSize * 2 + 100);
+    for (size_t i = 0; i < std::size(data); ++i)
+    {
+        data[i] = static_cast<char>(i);
+    }
+
+    auto const hashes = tr_merkle::blockHashes(std::data(data), std::size(data));
+    ASSERT_EQ(3U, std::size(hashes));
+    EXPECT_EQ(tr_merkle::blockCount(std::size(data)), std::size(hashes));
+
+    auto const* const begin = std::data(data);
+    auto const block_size = tr_merkle::BlockSize;
+    EXPECT_EQ(tr_sha256::digest(std::string_view{ begin, block_size }), hashes[0]);
+    EXPECT_EQ(tr_sha256::digest(std::string_view{ begin + block_size, block_size }), hashes[1]);
+    EXPECT_EQ(tr_sha256::digest(std::string_view{ begin + block_size * 2, 100 }), hashes[2]);
+}
+
+TEST(Merkle, root)
+{
+    auto const zero = tr_sha256_digest_t{};
+    auto const a = tr_sha256::digest("a"sv);
+    auto const b = tr_sha256::digest("b"sv);
+    auto const c = tr_sha256::digest("c"sv);
+
+    // a single leaf is its own root
+    EXPECT_EQ(a, tr_merkle::root({ a }, 1));
+
+    // leaves are padded with zero hashes
+    auto const ab = tr_sha256::digest(a, b);
+    auto const c0 = tr_sha256::digest(c, zero);
+    EXPECT_EQ(tr_sha256::digest(ab, c0), tr_merkle::root({ a, b, c }, 4));
+
+    // higher layers are padded with the hash of an empty subtree
+    auto const pad1 = tr_merkle::padHash(1);
+    auto const pad2 = tr_merkle::padHash(2);
+    EXPECT_EQ(tr_sha256::digest(tr_sha256::digest(ab, c0), pad2), tr_merkle::root({ ab, c0 }, 4, 1));
+    EXPECT_EQ(tr_sha256::digest(ab, pad1), tr_merkle::root({ ab }, 2, 1));
+
+    // an empty tree is all padding
+    EXPECT_EQ(tr_merkle::padHash(3), tr_merkle::root({}, 4, 1));
+}
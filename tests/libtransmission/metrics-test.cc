@@ -0,0 +1,150 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <fmt/core.h>
+
+#include "transmission.h"
+
+#include "metrics.h"
+#include "rpcimpl.h"
+#include "torrent.h"
+#include "utils.h"
+#include "variant.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+using MetricsWriterTest = ::testing::Test;
+
+TEST_F(MetricsWriterTest, writesFamiliesAndSamples)
+{
+    auto out = tr_metrics_writer{};
+    out.family("test_requests"sv, tr_metrics_writer::Type::Counter, "Requests handled"sv);
+    out.sample("test_requests"sv, 3, { { "method"sv, "get"sv } });
+    out.family("test_temperature"sv, tr_metrics_writer::Type::Gauge, "Current temperature"sv);
+    out.sample("test_temperature"sv, 21.5);
+
+    auto const expected =
+        "# TYPE test_requests counter\n"
+        "# HELP test_requests Requests handled\n"
+        "test_requests_total{method=\"get\"} 3\n"
+        "# TYPE test_temperature gauge\n"
+        "# HELP test_temperature Current temperature\n"
+        "test_temperature 21.5\n"
+        "# EOF\n"sv;
+    EXPECT_EQ(expected, out.finish());
+}
+
+TEST_F(MetricsWriterTest, escapesLabelValues)
+{
+    auto out = tr_metrics_writer{};
+    out.family("test_torrent_peers"sv, tr_metrics_writer::Type::Gauge, "Peers"sv);
+    out.sample("test_torrent_peers"sv, 1, { { "id"sv, "7"sv }, { "name"sv, "a \"quoted\"\\name\nline"sv } });
+
+    auto const text = out.finish();
+    EXPECT_NE(std::string::npos, text.find(R"(test_torrent_peers{id="7",name="a \"quoted\"\\name\nline"} 1)"));
+}
+
+TEST_F(MetricsWriterTest, writesCumulativeHistogramBuckets)
+{
+    auto const buckets = std::array<uint64_t, 4>{ 1, 0, 2, 3 };
+
+    auto out = tr_metrics_writer{};
+    out.family("test_lag_seconds"sv, tr_metrics_writer::Type::Histogram, "Lag"sv);
+    out.histogram("test_lag_seconds"sv, buckets, 1.0, 9.5, { { "kind"sv, "x"sv } });
+
+    auto const expected =
+        "# TYPE test_lag_seconds histogram\n"
+        "# HELP test_lag_seconds Lag\n"
+        "test_lag_seconds_bucket{kind=\"x\",le=\"1\"} 1\n"
+        "test_lag_seconds_bucket{kind=\"x\",le=\"2\"} 1\n"
+        "test_lag_seconds_bucket{kind=\"x\",le=\"4\"} 3\n"
+        "test_lag_seconds_bucket{kind=\"x\",le=\"+Inf\"} 6\n"
+        "test_lag_seconds_count{kind=\"x\"} 6\n"
+        "test_lag_seconds_sum{kind=\"x\"} 9.5\n"
+        "# EOF\n"sv;
+    EXPECT_EQ(expected, out.finish());
+}
+
+TEST_F(MetricsWriterTest, latencyHistogramBuckets)
+{
+    auto histogram = tr_latency_histogram{};
+    histogram.add(0us);
+    histogram.add(1us);
+    histogram.add(3us);
+    histogram.add(4us);
+    histogram.add(std::chrono::hours{ 1 });
+
+    auto const snapshot = histogram.snapshot();
+    EXPECT_EQ(5U, snapshot.count);
+    EXPECT_EQ(8U + 3600000000U, snapshot.sum_usec);
+    EXPECT_EQ(1U, snapshot.buckets[0]); // < 1 µs
+    EXPECT_EQ(1U, snapshot.buckets[1]); // [1, 2) µs
+    EXPECT_EQ(1U, snapshot.buckets[2]); // [2, 4) µs
+    EXPECT_EQ(1U, snapshot.buckets[3]); // [4, 8) µs
+    EXPECT_EQ(1U, snapshot.buckets.back()); // overflow
+}
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+using MetricsTest = SessionTest;
+
+TEST_F(MetricsTest, sessionMetrics)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::Complete);
+    EXPECT_NE(nullptr, tor);
+
+    // make an RPC request so that it shows up in the latency metrics
+    auto request = tr_variant{};
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "session-get");
+    tr_rpc_request_exec_json(session_, &request, nullptr, nullptr);
+    tr_variantClear(&request);
+
+    auto const text = tr_sessionMetrics(session_);
+    auto const has = [&text](std::string_view needle)
+    {
+        return text.find(needle) != std::string::npos;
+    };
+
+    EXPECT_TRUE(tr_strvEndsWith(text, "\n# EOF\n"sv));
+    EXPECT_TRUE(has("# TYPE transmission_torrents gauge\n"sv));
+    EXPECT_TRUE(has("transmission_cache_reads_total{result=\"hit\"} "sv));
+    EXPECT_TRUE(has("transmission_open_files "sv));
+    EXPECT_TRUE(has("transmission_peers{state=\"connected\"} 0\n"sv));
+    EXPECT_TRUE(has("transmission_verify_queue "sv));
+    EXPECT_TRUE(has("transmission_preallocate_zeroed_bytes_total "sv));
+    EXPECT_TRUE(has("transmission_crypto_jobs_total "sv));
+    EXPECT_TRUE(has("transmission_dht_announces_total{result=\"refused\"} "sv));
+    EXPECT_TRUE(has("transmission_tracker_lag_seconds_count{request=\"announce\"} "sv));
+    EXPECT_TRUE(has("transmission_session_lock_hold_seconds_bucket{le=\"+Inf\"} "sv));
+    EXPECT_TRUE(has("transmission_tracker_lag_seconds_sum{request=\"scrape\"} "sv));
+    EXPECT_TRUE(has("transmission_dht_announce_lag_seconds_sum "sv));
+    EXPECT_TRUE(has("transmission_session_lock_wait_seconds_sum "sv));
+    EXPECT_TRUE(has("transmission_event_loop_callback_lag_seconds_count{callback=\"rechoke-pulse\"} "sv));
+    EXPECT_TRUE(has("transmission_event_loop_tasks_total "sv));
+    EXPECT_TRUE(has(fmt::format("transmission_torrent_peers{{id=\"{:d}\",name=\"{:s}\"}} 0\n", tor->id(), tor->name())));
+
+    // one or more session-get calls, depending on which tests ran before this one
+    EXPECT_TRUE(has("transmission_rpc_duration_seconds_count{method=\"session-get\"} "sv));
+    EXPECT_FALSE(has("transmission_rpc_duration_seconds_count{method=\"session-get\"} 0\n"sv));
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+} // namespace test
+
+} // namespace libtransmission
@@ -0,0 +1,64 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstddef>
+
+#include "transmission.h"
+
+#include "outbuf-budget.h"
+
+#include "gtest/gtest.h"
+
+TEST(OutbufBudget, tracksQueuedBytesAndPeers)
+{
+    auto budget = tr_outbuf_budget{ 1024U * 1024U };
+
+    budget.update(0, 100);
+    budget.update(0, 200);
+    EXPECT_EQ(300U, budget.bytes());
+    EXPECT_EQ(2U, budget.queuedPeerCount());
+
+    budget.update(100, 50);
+    budget.update(200, 0);
+    EXPECT_EQ(50U, budget.bytes());
+    EXPECT_EQ(1U, budget.queuedPeerCount());
+}
+
+TEST(OutbufBudget, peersShareTheBudget)
+{
+    auto constexpr Limit = tr_outbuf_budget::MinPeerShare * 8U;
+    auto budget = tr_outbuf_budget{ Limit };
+
+    // a lone peer may use the whole budget
+    EXPECT_EQ(Limit, budget.space(0));
+
+    // with four peers queueing, each gets a quarter
+    for (int i = 0; i < 4; ++i)
+    {
+        budget.update(0, 1);
+    }
+    EXPECT_EQ(Limit / 4U - 1U, budget.space(1));
+
+    // a fifth, idle peer gets a fifth
+    EXPECT_EQ(Limit / 5U, budget.space(0));
+}
+
+TEST(OutbufBudget, slowReadersCantStarveOthers)
+{
+    auto constexpr Limit = tr_outbuf_budget::MinPeerShare * 4U;
+    auto budget = tr_outbuf_budget{ Limit };
+
+    // two slow readers fill the whole budget
+    budget.update(0, Limit / 2U);
+    budget.update(0, Limit / 2U);
+    EXPECT_EQ(0U, budget.space(Limit / 2U));
+
+    // a peer with nothing queued still gets its minimum share
+    EXPECT_EQ(tr_outbuf_budget::MinPeerShare, budget.space(0));
+
+    // but a peer that already has something queued must wait
+    budget.update(0, 1);
+    EXPECT_EQ(0U, budget.space(1));
+}
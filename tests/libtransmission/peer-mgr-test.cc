@@ -0,0 +1,83 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstdint> // uint16_t
+#include <string_view>
+
+#include "transmission.h"
+
+#include "net.h"
+#include "peer-mgr.h"
+#include "session.h"
+#include "torrent.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+namespace test
+{
+
+class PeerMgrTest : public SessionTest
+{
+protected:
+    static auto makePex(std::string_view address, uint16_t port)
+    {
+        return tr_pex{ *tr_address::fromString(address), tr_port::fromHost(port) };
+    }
+
+    void setAllowsLoopbackPeers(bool enabled)
+    {
+        auto const lock = session_->unique_lock();
+        session_->setAllowsLoopbackPeers(enabled);
+    }
+
+    static auto countPeers(tr_torrent const* tor)
+    {
+        return std::size(tr_peerMgrGetPeers(tor, TR_AF_INET, TR_PEERS_INTERESTING, 100));
+    }
+};
+
+TEST_F(PeerMgrTest, peersAtOneAddressAreOnePeer)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    ASSERT_NE(nullptr, tor);
+
+    auto const pex = std::array<tr_pex, 2>{ makePex("8.8.8.8"sv, 51413), makePex("8.8.8.8"sv, 51414) };
+    EXPECT_EQ(2U, tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(pex), std::size(pex)));
+    EXPECT_EQ(1U, countPeers(tor));
+
+    // even when loopback peers are allowed
+    setAllowsLoopbackPeers(true);
+    EXPECT_EQ(2U, tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(pex), std::size(pex)));
+    EXPECT_EQ(1U, countPeers(tor));
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+TEST_F(PeerMgrTest, loopbackPeersAreToldApartByPortOnlyWhenAllowed)
+{
+    auto* const tor = zeroTorrentInit(ZeroTorrentState::NoFiles);
+    ASSERT_NE(nullptr, tor);
+
+    auto const pex = std::array<tr_pex, 2>{ makePex("127.0.0.1"sv, 51413), makePex("127.0.0.1"sv, 51414) };
+
+    // loopback peers aren't accepted by default
+    EXPECT_EQ(0U, tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(pex), std::size(pex)));
+    EXPECT_EQ(0U, countPeers(tor));
+
+    // when they are, each port is a different session
+    setAllowsLoopbackPeers(true);
+    EXPECT_EQ(2U, tr_peerMgrAddPex(tor, TR_PEER_FROM_PEX, std::data(pex), std::size(pex)));
+    EXPECT_EQ(2U, countPeers(tor));
+
+    tr_torrentRemove(tor, false, nullptr);
+}
+
+} // namespace test
+} // namespace libtransmission
@@ -0,0 +1,144 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include "transmission.h"
+
+#include "peer-reactor.h"
+
+#include "gtest/gtest.h"
+
+using namespace std::literals;
+
+#ifdef _WIN32
+#define LOCAL_SOCKETPAIR_AF AF_INET
+#else
+#define LOCAL_SOCKETPAIR_AF AF_UNIX
+#endif
+
+using PeerReactorTest = ::testing::Test;
+
+TEST_F(PeerReactorTest, runsTasksOnItsThreadInOrder)
+{
+    auto reactor = tr_peer_reactor{};
+    EXPECT_FALSE(reactor.amInThread());
+
+    auto order = std::vector<int>{};
+    auto all_in_thread = std::atomic<bool>{ true };
+    auto done = std::promise<void>{};
+
+    for (int i = 0; i < 100; ++i)
+    {
+        reactor.run(
+            [&reactor, &order, &all_in_thread, i]()
+            {
+                if (!reactor.amInThread())
+                {
+                    all_in_thread = false;
+                }
+
+                order.push_back(i);
+            });
+    }
+    reactor.run([&done]() { done.set_value(); });
+
+    ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(5s));
+    EXPECT_TRUE(all_in_thread);
+    ASSERT_EQ(100U, std::size(order));
+    for (int i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(i, order[i]);
+    }
+}
+
+TEST_F(PeerReactorTest, runsQueuedTasksBeforeStopping)
+{
+    auto n_run = std::atomic<int>{};
+
+    auto reactor = std::make_unique<tr_peer_reactor>();
+    for (int i = 0; i < 50; ++i)
+    {
+        reactor->run([&n_run]() { ++n_run; });
+    }
+    reactor.reset();
+
+    EXPECT_EQ(50, n_run);
+}
+
+TEST_F(PeerReactorTest, pollsSocketsOnItsOwnEventBase)
+{
+    auto fds = std::array<evutil_socket_t, 2>{};
+    ASSERT_EQ(0, evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0, std::data(fds)));
+    evutil_make_socket_nonblocking(fds[0]);
+
+    auto reactor = tr_peer_reactor{};
+    auto readable = std::promise<bool>{};
+    event* ev = nullptr;
+
+    reactor.run(
+        [&]()
+        {
+            ev = event_new(
+                reactor.eventBase(),
+                fds[0],
+                EV_READ,
+                [](evutil_socket_t /*fd*/, short /*what*/, void* vreadable)
+                {
+                    auto* const promise = static_cast<std::promise<bool>*>(vreadable);
+                    promise->set_value(true);
+                },
+                &readable);
+            event_add(ev, nullptr);
+        });
+
+    auto const ch = char{ 'x' };
+    ASSERT_EQ(1, send(fds[1], &ch, 1, 0));
+
+    auto future = readable.get_future();
+    ASSERT_EQ(std::future_status::ready, future.wait_for(5s));
+    EXPECT_TRUE(future.get());
+
+    reactor.run([&ev]() { event_free(ev); });
+    evutil_closesocket(fds[0]);
+    evutil_closesocket(fds[1]);
+}
+
+TEST_F(PeerReactorTest, picksTheLeastBusyReactor)
+{
+    auto const reactors = tr_peer_reactors{ 3U };
+    EXPECT_EQ(3U, reactors.size());
+
+    auto picked = std::set<tr_peer_reactor*>{};
+    for (int i = 0; i < 3; ++i)
+    {
+        auto const reactor = reactors.pick();
+        reactor->onSocketAdded();
+        picked.insert(reactor.get());
+    }
+    EXPECT_EQ(3U, std::size(picked));
+
+    // freeing a socket makes its reactor the next pick
+    auto* const first = *std::begin(picked);
+    first->onSocketRemoved();
+    EXPECT_EQ(first, reactors.pick().get());
+
+    for (auto* const reactor : picked)
+    {
+        if (reactor != first)
+        {
+            reactor->onSocketRemoved();
+        }
+    }
+}
@@ -0,0 +1,181 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "transmission.h"
+
+#include "file.h"
+#include "preallocate.h"
+#include "tr-strbuf.h"
+#include "utils.h" // tr_loadFile()
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+using PreallocateTest = SandboxedTest;
+
+TEST_F(PreallocateTest, preallocatesNewFiles)
+{
+    static auto constexpr FileSize = uint64_t{ 3 * 1024 * 1024 + 17 };
+    auto const filename = tr_pathbuf{ sandboxDir(), "/subdir/new-file.bin" };
+
+    auto done = std::atomic<int>{};
+    auto result = std::atomic<int>{ -1 };
+
+    auto worker = tr_preallocate_worker{};
+    worker.addCallback(
+        [&done, &result](tr_torrent_id_t /*tor_id*/, tr_file_index_t /*file_num*/, int error)
+        {
+            result = error;
+            ++done;
+        });
+    worker.add(1, 0, filename, FileSize);
+
+    EXPECT_TRUE(waitFor([&done]() { return done == 1; }, 5000));
+    EXPECT_EQ(0, result);
+    EXPECT_FALSE(worker.isBusy(1, 0));
+    EXPECT_FALSE(worker.progress(1, 0));
+    EXPECT_EQ(1U, worker.stats().files_preallocated);
+
+    auto const info = tr_sys_path_get_info(filename);
+    ASSERT_TRUE(info);
+    EXPECT_EQ(FileSize, info->size);
+}
+
+TEST_F(PreallocateTest, leavesFullSizeFilesAlone)
+{
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    auto const filename = tr_pathbuf{ sandboxDir(), "/existing-file.txt" };
+    createFileWithContents(filename, Contents);
+
+    auto done = std::atomic<int>{};
+
+    auto worker = tr_preallocate_worker{};
+    worker.addCallback([&done](tr_torrent_id_t /*tor_id*/, tr_file_index_t /*file_num*/, int /*error*/) { ++done; });
+    worker.add(1, 0, filename, std::size(Contents));
+
+    EXPECT_TRUE(waitFor([&done]() { return done == 1; }, 5000));
+
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(filename, contents));
+    EXPECT_EQ(Contents, std::string_view(std::data(contents), std::size(contents)));
+}
+
+TEST_F(PreallocateTest, extendsShortFiles)
+{
+    // e.g. what's left of a job that was cancelled partway through
+    static auto constexpr Contents = "Hello, World!\n"sv;
+    static auto constexpr FileSize = uint64_t{ 1024 * 1024 };
+    auto const filename = tr_pathbuf{ sandboxDir(), "/short-file.bin" };
+    createFileWithContents(filename, Contents);
+
+    auto done = std::atomic<int>{};
+    auto result = std::atomic<int>{ -1 };
+
+    auto worker = tr_preallocate_worker{};
+    worker.addCallback(
+        [&done, &result](tr_torrent_id_t /*tor_id*/, tr_file_index_t /*file_num*/, int error)
+        {
+            result = error;
+            ++done;
+        });
+    worker.add(1, 0, filename, FileSize);
+
+    EXPECT_TRUE(waitFor([&done]() { return done == 1; }, 5000));
+    EXPECT_EQ(0, result);
+
+    // the file is full size, and what was already there is kept
+    auto contents = std::vector<char>{};
+    EXPECT_TRUE(tr_loadFile(filename, contents));
+    ASSERT_EQ(FileSize, std::size(contents));
+    EXPECT_EQ(Contents, std::string_view(std::data(contents), std::size(Contents)));
+}
+
+TEST_F(PreallocateTest, prioritizeMovesJobToFront)
+{
+    static auto constexpr NumFiles = tr_file_index_t{ 16 };
+    static auto constexpr Last = NumFiles - 1;
+
+    auto mutex = std::mutex{};
+    auto order = std::vector<tr_file_index_t>{};
+
+    auto worker = tr_preallocate_worker{};
+    worker.addCallback(
+        [&mutex, &order](tr_torrent_id_t /*tor_id*/, tr_file_index_t file_num, int /*error*/)
+        {
+            auto const lock = std::lock_guard{ mutex };
+            order.push_back(file_num);
+        });
+
+    for (tr_file_index_t i = 0; i < NumFiles; ++i)
+    {
+        worker.add(1, i, tr_pathbuf{ sandboxDir(), '/', std::to_string(i) }, 4 * 1024 * 1024);
+    }
+
+    EXPECT_FALSE(worker.prioritize(1, NumFiles));
+    EXPECT_FALSE(worker.prioritize(2, 0));
+
+    auto const prioritized = worker.prioritize(1, Last);
+    auto n_done_before = size_t{};
+    {
+        auto const lock = std::lock_guard{ mutex };
+        n_done_before = std::size(order);
+    }
+
+    EXPECT_TRUE(waitFor(
+        [&mutex, &order]()
+        {
+            auto const lock = std::lock_guard{ mutex };
+            return std::size(order) == NumFiles;
+        },
+        10000));
+
+    // at most the job that was running could finish ahead of it
+    if (prioritized)
+    {
+        auto const lock = std::lock_guard{ mutex };
+        auto const iter = std::find(std::begin(order), std::end(order), Last);
+        auto const pos = static_cast<size_t>(std::distance(std::begin(order), iter));
+        EXPECT_LE(pos, n_done_before + 1U);
+    }
+
+    EXPECT_FALSE(worker.prioritize(1, Last));
+}
+
+TEST_F(PreallocateTest, removeCancelsTorrentJobs)
+{
+    auto worker = tr_preallocate_worker{};
+
+    for (tr_file_index_t i = 0; i < 16; ++i)
+    {
+        worker.add(1, i, tr_pathbuf{ sandboxDir(), "/a/", std::to_string(i) }, 64 * 1024);
+        worker.add(2, i, tr_pathbuf{ sandboxDir(), "/b/", std::to_string(i) }, 64 * 1024);
+    }
+
+    worker.remove(1);
+    EXPECT_FALSE(worker.isBusy(1, 0, 16));
+
+    worker.remove(2);
+    EXPECT_FALSE(worker.isBusy(2, 0, 16));
+    EXPECT_EQ(0U, worker.stats().queued);
+}
+
+} // namespace test
+
+} // namespace libtransmission
@@ -0,0 +1,279 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "transmission.h"
+
+#include "crypto-utils.h"
+#include "file.h"
+#include "quark.h"
+#include "resume-journal.h"
+#include "tr-strbuf.h"
+#include "variant.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+namespace test
+{
+
+class ResumeJournalTest : public SandboxedTest
+{
+protected:
+    static inline auto const SomeHash = tr_sha1::digest("some torrent"sv);
+    static inline auto const OtherHash = tr_sha1::digest("other torrent"sv);
+
+    [[nodiscard]] uint64_t journalSize() const
+    {
+        auto const info = tr_sys_path_get_info(tr_pathbuf{ sandboxDir(), "/resume.journal"sv });
+        return info ? info->size : 0U;
+    }
+
+    static void save(tr_resume_journal& journal, tr_sha1_digest_t const& hash, int64_t downloaded, std::string_view name)
+    {
+        auto dict = tr_variant{};
+        tr_variantInitDict(&dict, 2);
+        tr_variantDictAddInt(&dict, TR_KEY_downloaded, downloaded);
+        if (!std::empty(name))
+        {
+            tr_variantDictAddStr(&dict, TR_KEY_name, name);
+        }
+        journal.save(hash, &dict);
+        tr_variantClear(&dict);
+    }
+
+    static std::optional<std::pair<int64_t, std::string>> load(tr_resume_journal& journal, tr_sha1_digest_t const& hash)
+    {
+        auto dict = tr_variant{};
+        if (!journal.load(hash, &dict))
+        {
+            return {};
+        }
+
+        auto downloaded = int64_t{};
+        auto name = std::string_view{};
+        EXPECT_TRUE(tr_variantDictFindInt(&dict, TR_KEY_downloaded, &downloaded));
+        tr_variantDictFindStrView(&dict, TR_KEY_name, &name);
+        auto ret = std::make_pair(downloaded, std::string{ name });
+        tr_variantClear(&dict);
+        return ret;
+    }
+
+    static std::vector<tr_piece_index_t> loadPieces(tr_resume_journal& journal, tr_sha1_digest_t const& hash)
+    {
+        auto dict = tr_variant{};
+        auto pieces = std::vector<tr_piece_index_t>{};
+        if (journal.load(hash, &dict, &pieces))
+        {
+            tr_variantClear(&dict);
+        }
+        return pieces;
+    }
+
+    static void saveProgress(tr_resume_journal& journal, tr_sha1_digest_t const& hash, int64_t n_pieces)
+    {
+        auto dict = tr_variant{};
+        tr_variantInitDict(&dict, 1);
+        auto* const progress = tr_variantDictAddDict(&dict, TR_KEY_progress, 1);
+        tr_variantDictAddInt(progress, TR_KEY_pieces, n_pieces);
+        journal.save(hash, &dict);
+        tr_variantClear(&dict);
+    }
+};
+
+TEST_F(ResumeJournalTest, saveAndReload)
+{
+    {
+        auto journal = tr_resume_journal{ sandboxDir() };
+        save(journal, SomeHash, 100, "some"sv);
+        save(journal, OtherHash, 200, "other"sv);
+    }
+
+    auto journal = tr_resume_journal{ sandboxDir() };
+    EXPECT_EQ(std::make_pair(int64_t{ 100 }, "some"s), load(journal, SomeHash));
+    EXPECT_EQ(std::make_pair(int64_t{ 200 }, "other"s), load(journal, OtherHash));
+}
+
+TEST_F(ResumeJournalTest, onlyWritesChangedFields)
+{
+    auto const big_name = std::string(4096, 'x');
+
+    auto journal = tr_resume_journal{ sandboxDir() };
+    save(journal, SomeHash, 100, big_name);
+    journal.flush();
+    auto const size_after_first_save = journalSize();
+    EXPECT_GT(size_after_first_save, std::size(big_name));
+
+    // nothing changed
+    save(journal, SomeHash, 100, big_name);
+    journal.flush();
+    EXPECT_EQ(size_after_first_save, journalSize());
+
+    // only 'downloaded' changed
+    save(journal, SomeHash, 101, big_name);
+    journal.flush();
+    EXPECT_GT(journalSize(), size_after_first_save);
+    EXPECT_LT(journalSize(), size_after_first_save + 100U);
+
+    // saved earlier in this session, so it's read back from disk
+    EXPECT_EQ(std::make_pair(int64_t{ 101 }, big_name), load(journal, SomeHash));
+}
+
+TEST_F(ResumeJournalTest, droppedFieldsAreUnset)
+{
+    {
+        auto journal = tr_resume_journal{ sandboxDir() };
+        save(journal, SomeHash, 100, "some"sv);
+        save(journal, SomeHash, 100, {});
+    }
+
+    auto journal = tr_resume_journal{ sandboxDir() };
+    EXPECT_EQ(std::make_pair(int64_t{ 100 }, ""s), load(journal, SomeHash));
+}
+
+TEST_F(ResumeJournalTest, remove)
+{
+    {
+        auto journal = tr_resume_journal{ sandboxDir() };
+        save(journal, SomeHash, 100, "some"sv);
+        save(journal, OtherHash, 200, "other"sv);
+        journal.remove(SomeHash);
+    }
+
+    auto journal = tr_resume_journal{ sandboxDir() };
+    EXPECT_FALSE(load(journal, SomeHash));
+    EXPECT_TRUE(load(journal, OtherHash));
+}
+
+TEST_F(ResumeJournalTest, discardsTornRecord)
+{
+    {
+        auto journal = tr_resume_journal{ sandboxDir() };
+        save(journal, SomeHash, 100, "some"sv);
+    }
+
+    // simulate a crash partway through writing a record
+    auto const filename = tr_pathbuf{ sandboxDir(), "/resume.journal"sv };
+    auto const fd = tr_sys_file_open(filename, TR_SYS_FILE_WRITE | TR_SYS_FILE_APPEND, 0600);
+    ASSERT_NE(TR_BAD_SYS_FILE, fd);
+    auto constexpr Torn = "d4:hash20:0123"sv;
+    blockingFileWrite(fd, std::data(Torn), std::size(Torn));
+    tr_sys_file_close(fd);
+
+    {
+        auto journal = tr_resume_journal{ sandboxDir() };
+        EXPECT_EQ(std::make_pair(int64_t{ 100 }, "some"s), load(journal, SomeHash));
+        save(journal, OtherHash, 200, "other"sv);
+    }
+
+    // records appended after the recovery are readable too
+    auto journal = tr_resume_journal{ sandboxDir() };
+    EXPECT_TRUE(load(journal, OtherHash));
+}
+
+TEST_F(ResumeJournalTest, importBacksUpLegacyFile)
+{
+    auto const legacy_filename = tr_pathbuf{ sandboxDir(), "/legacy.resume"sv };
+    createFileWithContents(legacy_filename, "d10:downloadedi100ee"sv);
+
+    {
+        auto journal = tr_resume_journal{ sandboxDir() };
+        auto dict = tr_variant{};
+        ASSERT_TRUE(tr_variantFromFile(&dict, TR_VARIANT_PARSE_BENC, legacy_filename));
+        journal.import(SomeHash, &dict, legacy_filename);
+        tr_variantClear(&dict);
+        journal.flush();
+        EXPECT_FALSE(tr_sys_path_exists(legacy_filename));
+        EXPECT_TRUE(tr_sys_path_exists(tr_pathbuf{ legacy_filename, ".bak"sv }));
+    }
+
+    auto journal = tr_resume_journal{ sandboxDir() };
+    EXPECT_EQ(std::make_pair(int64_t{ 100 }, ""s), load(journal, SomeHash));
+}
+
+TEST_F(ResumeJournalTest, compactsSupersededRecords)
+{
+    auto const big_name = std::string(256 * 1024, 'x');
+
+    auto journal = tr_resume_journal{ sandboxDir() };
+    for (int i = 0; i < 16; ++i)
+    {
+        save(journal, SomeHash, i, big_name + std::to_string(i));
+        journal.flush();
+    }
+
+    // 16 records of 256 KiB each would be 4 MiB without compaction
+    EXPECT_LT(journalSize(), std::size(big_name) * 4U);
+    EXPECT_EQ(std::make_pair(int64_t{ 15 }, big_name + "15"), load(journal, SomeHash));
+}
+
+TEST_F(ResumeJournalTest, completedPiecesSurviveRestart)
+{
+    {
+        auto journal = tr_resume_journal{ sandboxDir() };
+        save(journal, SomeHash, 100, "some"sv);
+        journal.addCompletedPiece(SomeHash, 3);
+        journal.addCompletedPiece(SomeHash, 7);
+        journal.addCompletedPiece(OtherHash, 1);
+    }
+
+    auto journal = tr_resume_journal{ sandboxDir() };
+    EXPECT_EQ((std::vector<tr_piece_index_t>{ 3, 7 }), loadPieces(journal, SomeHash));
+    EXPECT_EQ((std::vector<tr_piece_index_t>{ 1 }), loadPieces(journal, OtherHash));
+}
+
+TEST_F(ResumeJournalTest, savingProgressForgetsCompletedPieces)
+{
+    {
+        auto journal = tr_resume_journal{ sandboxDir() };
+        journal.addCompletedPiece(SomeHash, 3);
+        saveProgress(journal, SomeHash, 4);
+        journal.addCompletedPiece(SomeHash, 5);
+        journal.addCompletedPiece(OtherHash, 1);
+        journal.remove(OtherHash);
+    }
+
+    auto journal = tr_resume_journal{ sandboxDir() };
+    EXPECT_EQ((std::vector<tr_piece_index_t>{ 5 }), loadPieces(journal, SomeHash));
+    EXPECT_TRUE(std::empty(loadPieces(journal, OtherHash)));
+}
+
+TEST_F(ResumeJournalTest, failedWritesAreReportedAndResent)
+{
+    // put something in the journal's way
+    auto const journal_filename = tr_pathbuf{ sandboxDir(), "/resume.journal"sv };
+    ASSERT_TRUE(tr_sys_dir_create(journal_filename, 0, 0700));
+
+    {
+        auto failed = std::vector<tr_sha1_digest_t>{};
+        auto const on_write_failed = [&failed](std::vector<tr_sha1_digest_t> const& info_hashes, std::string_view /*error*/)
+        {
+            failed = info_hashes;
+        };
+        auto journal = tr_resume_journal{ sandboxDir(), on_write_failed };
+        save(journal, SomeHash, 100, "some"sv);
+        journal.flush();
+        EXPECT_EQ(std::vector<tr_sha1_digest_t>{ SomeHash }, failed);
+
+        // once the way is clear, the next save sends everything again
+        ASSERT_TRUE(tr_sys_path_remove(journal_filename));
+        journal.markUnsaved(SomeHash);
+        save(journal, SomeHash, 100, "some"sv);
+    }
+
+    auto journal = tr_resume_journal{ sandboxDir() };
+    EXPECT_EQ(std::make_pair(int64_t{ 100 }, "some"s), load(journal, SomeHash));
+}
+
+} // namespace test
+} // namespace libtransmission
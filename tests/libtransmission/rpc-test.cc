@@ -4,6 +4,8 @@
 // License text can be found in the licenses/ folder.
 
 #include "transmission.h"
+#include "event-loop-stats.h"
+#include "instrumented-mutex.h"
 #include "rpcimpl.h"
 #include "variant.h"
 
@@ -188,6 +190,121 @@ TEST_F(RpcTest, sessionGet)
     tr_torrentRemove(tor, false, nullptr);
 }
 
+TEST_F(RpcTest, sessionStatsHasMemoryStats)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<tr_variant*>(setme) = *response;
+        tr_variantInitBool(response, false);
+    };
+
+    tr_variant request;
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "session-stats");
+    tr_variant response;
+    tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+    tr_variantClear(&request);
+
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    tr_variant* memory = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(args, TR_KEY_memory_stats, &memory));
+
+    for (auto const key :
+         { TR_KEY_cacheBytes, TR_KEY_peerBitfieldBytes, TR_KEY_peerBufferBytes, TR_KEY_peerObjectBytes, TR_KEY_peerCount })
+    {
+        auto val = int64_t{ -1 };
+        EXPECT_TRUE(tr_variantDictFindInt(memory, key, &val));
+        EXPECT_EQ(0, val);
+    }
+
+    // cleanup
+    tr_variantClear(&response);
+}
+
+TEST_F(RpcTest, sessionStatsHasLockStats)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<tr_variant*>(setme) = *response;
+        tr_variantInitBool(response, false);
+    };
+
+    tr_variant request;
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "session-stats");
+    tr_variant response;
+    tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+    tr_variantClear(&request);
+
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    tr_variant* lock_stats = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(args, TR_KEY_lock_stats, &lock_stats));
+
+    // starting the session took the lock
+    auto acquisitions = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(lock_stats, TR_KEY_acquisitions, &acquisitions));
+    EXPECT_GT(acquisitions, 0);
+
+    for (auto const key : { TR_KEY_holdTimeHistogram, TR_KEY_waitTimeHistogram })
+    {
+        tr_variant* histogram = nullptr;
+        EXPECT_TRUE(tr_variantDictFindList(lock_stats, key, &histogram));
+        EXPECT_EQ(tr_instrumented_recursive_mutex::NumBuckets, tr_variantListSize(histogram));
+    }
+
+    // cleanup
+    tr_variantClear(&response);
+}
+
+TEST_F(RpcTest, sessionStatsHasEventLoopStats)
+{
+    auto const rpc_response_func = [](tr_session* /*session*/, tr_variant* response, void* setme) noexcept
+    {
+        *static_cast<tr_variant*>(setme) = *response;
+        tr_variantInitBool(response, false);
+    };
+
+    tr_variant request;
+    tr_variantInitDict(&request, 1);
+    tr_variantDictAddStrView(&request, TR_KEY_method, "session-stats");
+    tr_variant response;
+    tr_rpc_request_exec_json(session_, &request, rpc_response_func, &response);
+    tr_variantClear(&request);
+
+    tr_variant* args = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(&response, TR_KEY_arguments, &args));
+    tr_variant* loop_stats = nullptr;
+    EXPECT_TRUE(tr_variantDictFindDict(args, TR_KEY_event_loop_stats, &loop_stats));
+
+    // starting the session posted tasks to the libevent thread
+    auto tasks = int64_t{};
+    EXPECT_TRUE(tr_variantDictFindInt(loop_stats, TR_KEY_workQueueTasks, &tasks));
+    EXPECT_GT(tasks, 0);
+
+    tr_variant* callbacks = nullptr;
+    EXPECT_TRUE(tr_variantDictFindList(loop_stats, TR_KEY_callbacks, &callbacks));
+    ASSERT_EQ(std::size(TrEventLoopCallbackNames), tr_variantListSize(callbacks));
+    for (size_t i = 0; i < std::size(TrEventLoopCallbackNames); ++i)
+    {
+        auto* const callback = tr_variantListChild(callbacks, i);
+        auto name = std::string_view{};
+        EXPECT_TRUE(tr_variantDictFindStrView(callback, TR_KEY_name, &name));
+        EXPECT_EQ(TrEventLoopCallbackNames[i], name);
+
+        for (auto const key : { TR_KEY_durationHistogram, TR_KEY_lagHistogram })
+        {
+            tr_variant* histogram = nullptr;
+            EXPECT_TRUE(tr_variantDictFindList(callback, key, &histogram));
+            EXPECT_EQ(tr_latency_histogram::NumBuckets, tr_variantListSize(histogram));
+        }
+    }
+
+    // cleanup
+    tr_variantClear(&response);
+}
+
 } // namespace test
 
 } // namespace libtransmission
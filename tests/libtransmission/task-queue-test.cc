@@ -0,0 +1,136 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "transmission.h"
+
+#include "task-queue.h"
+
+#include "gtest/gtest.h"
+
+TEST(TaskQueue, smallClosuresAreStoredInline)
+{
+    auto n = int{};
+    auto small = tr_task{ [&n]() { ++n; } };
+    EXPECT_TRUE(small.isInline());
+
+    auto big = tr_task{ [&n, padding = std::array<char, tr_task::InlineSize>{}]() { n += std::size(padding) > 0U ? 1 : 0; } };
+    EXPECT_FALSE(big.isInline());
+
+    // moving a task moves the closure
+    auto moved = std::move(big);
+    EXPECT_FALSE(big);
+    moved();
+    small();
+    EXPECT_EQ(2, n);
+}
+
+TEST(TaskQueue, runsTasksInOrder)
+{
+    auto queue = tr_task_queue{ 8 };
+    auto order = std::vector<int>{};
+
+    // only the first push since the last drain needs a wakeup
+    EXPECT_TRUE(queue.push([&order]() { order.push_back(1); }));
+    EXPECT_FALSE(queue.push([&order]() { order.push_back(2); }));
+    EXPECT_FALSE(queue.push([&order]() { order.push_back(3); }));
+    EXPECT_EQ(3U, queue.drain());
+    EXPECT_EQ((std::vector<int>{ 1, 2, 3 }), order);
+
+    EXPECT_TRUE(queue.push([&order]() { order.push_back(4); }));
+    EXPECT_EQ(1U, queue.drain());
+    EXPECT_EQ((std::vector<int>{ 1, 2, 3, 4 }), order);
+}
+
+TEST(TaskQueue, overflowKeepsOrder)
+{
+    auto queue = tr_task_queue{ 4 };
+    auto order = std::vector<int>{};
+
+    // more tasks than the ring can hold
+    for (int i = 0; i < 20; ++i)
+    {
+        (void)queue.push([&order, i]() { order.push_back(i); });
+    }
+
+    EXPECT_EQ(20U, queue.drain());
+    ASSERT_EQ(20U, std::size(order));
+    for (int i = 0; i < 20; ++i)
+    {
+        EXPECT_EQ(i, order[i]);
+    }
+
+    // the ring is usable again after an overflow
+    (void)queue.push([&order]() { order.push_back(20); });
+    queue.drain();
+    EXPECT_EQ(21U, std::size(order));
+}
+
+TEST(TaskQueue, unrunTasksAreDestroyed)
+{
+    auto token = std::make_shared<int>(0);
+
+    {
+        auto queue = tr_task_queue{ 2 };
+        for (int i = 0; i < 4; ++i)
+        {
+            (void)queue.push([token]() { ++*token; });
+        }
+        EXPECT_EQ(5, token.use_count());
+    }
+
+    EXPECT_EQ(1, token.use_count());
+    EXPECT_EQ(0, *token);
+}
+
+TEST(TaskQueue, multipleProducers)
+{
+    static auto constexpr NumProducers = 4;
+    static auto constexpr TasksPerProducer = 5000;
+
+    auto queue = tr_task_queue{ 64 };
+    auto last_seen = std::array<int, NumProducers>{};
+    last_seen.fill(-1);
+    auto in_order = true;
+    auto n_run = int{};
+
+    auto producers = std::vector<std::thread>{};
+    for (int producer = 0; producer < NumProducers; ++producer)
+    {
+        producers.emplace_back(
+            [&, producer]()
+            {
+                for (int i = 0; i < TasksPerProducer; ++i)
+                {
+                    (void)queue.push(
+                        [&, producer, i]()
+                        {
+                            in_order = in_order && last_seen[producer] == i - 1;
+                            last_seen[producer] = i;
+                            ++n_run;
+                        });
+                }
+            });
+    }
+
+    while (n_run < NumProducers * TasksPerProducer)
+    {
+        queue.drain();
+        std::this_thread::yield();
+    }
+
+    for (auto& thread : producers)
+    {
+        thread.join();
+    }
+
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(NumProducers * TasksPerProducer, n_run);
+}
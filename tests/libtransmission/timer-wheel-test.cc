@@ -0,0 +1,140 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <algorithm>
+#include <ctime>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "timer-wheel.h"
+
+#include "gtest/gtest.h"
+
+using TimerWheelTest = ::testing::Test;
+
+namespace
+{
+
+auto advanceTo(tr_timer_wheel<int>& wheel, time_t now)
+{
+    auto fired = std::vector<int>{};
+    wheel.advance(now, [&fired](int value) { fired.push_back(value); });
+    return fired;
+}
+
+} // namespace
+
+TEST_F(TimerWheelTest, firesItemsWhenDue)
+{
+    static auto constexpr Start = time_t{ 1000 };
+
+    auto wheel = tr_timer_wheel<int>{ Start };
+    wheel.add(Start + 5, 5);
+    wheel.add(Start + 1, 1);
+    wheel.add(Start + 5, 55);
+    EXPECT_EQ(3U, wheel.size());
+
+    EXPECT_TRUE(std::empty(advanceTo(wheel, Start)));
+    EXPECT_EQ(std::vector<int>{ 1 }, advanceTo(wheel, Start + 4));
+
+    auto fired = advanceTo(wheel, Start + 5);
+    std::sort(std::begin(fired), std::end(fired));
+    EXPECT_EQ((std::vector<int>{ 5, 55 }), fired);
+    EXPECT_TRUE(wheel.empty());
+}
+
+TEST_F(TimerWheelTest, pastItemsFireOnNextAdvance)
+{
+    static auto constexpr Start = time_t{ 1000 };
+
+    auto wheel = tr_timer_wheel<int>{ Start };
+    wheel.add(Start - 100, 1);
+    wheel.add(Start, 2);
+
+    EXPECT_EQ((std::vector<int>{ 1, 2 }), advanceTo(wheel, Start));
+    EXPECT_TRUE(wheel.empty());
+}
+
+TEST_F(TimerWheelTest, itemsCascadeFromHigherLevels)
+{
+    // an odd start time so that items straddle slot boundaries
+    static auto constexpr Start = time_t{ 1660000123 };
+
+    auto wheel = tr_timer_wheel<int>{ Start };
+    auto const offsets = std::vector<int>{ 1, 63, 64, 65, 4095, 4096, 4097, 300000 };
+    for (auto const offset : offsets)
+    {
+        wheel.add(Start + offset, offset);
+    }
+
+    auto fired = std::vector<std::pair<time_t, int>>{};
+    for (auto now = Start + 1; !wheel.empty(); ++now)
+    {
+        wheel.advance(now, [&fired, now](int offset) { fired.emplace_back(now, offset); });
+        ASSERT_LE(now, Start + 300000);
+    }
+
+    ASSERT_EQ(std::size(offsets), std::size(fired));
+    for (size_t i = 0; i < std::size(offsets); ++i)
+    {
+        EXPECT_EQ(offsets[i], fired[i].second);
+        EXPECT_EQ(Start + offsets[i], fired[i].first);
+    }
+}
+
+TEST_F(TimerWheelTest, callbackCanAddItems)
+{
+    static auto constexpr Start = time_t{ 1000 };
+
+    auto wheel = tr_timer_wheel<int>{ Start };
+    wheel.add(Start + 1, 1);
+
+    auto fired = std::vector<int>{};
+    auto const rescheduler = [&wheel, &fired](int value)
+    {
+        fired.push_back(value);
+        wheel.add(wheel.now() + 10, value + 1);
+    };
+
+    wheel.advance(Start + 1, rescheduler);
+    EXPECT_EQ(std::vector<int>{ 1 }, fired);
+    EXPECT_EQ(1U, wheel.size());
+
+    wheel.advance(Start + 10, rescheduler);
+    EXPECT_EQ(std::vector<int>{ 1 }, fired);
+
+    wheel.advance(Start + 11, rescheduler);
+    EXPECT_EQ((std::vector<int>{ 1, 2 }), fired);
+}
+
+TEST_F(TimerWheelTest, clockJumpsFireWhatIsDue)
+{
+    static auto constexpr Start = time_t{ 1660000123 };
+    static auto constexpr Day = time_t{ 60 * 60 * 24 };
+
+    auto wheel = tr_timer_wheel<int>{ Start };
+    auto const days = std::vector<int>{ 1, 30, 100, 300, 1000 };
+    for (auto const day : days)
+    {
+        wheel.add(Start + day * Day, day);
+    }
+
+    // less than the wheel's span
+    EXPECT_EQ((std::vector<int>{ 1, 30 }), advanceTo(wheel, Start + 50 * Day));
+    EXPECT_EQ(Start + 50 * Day, wheel.now());
+
+    // more than the wheel's span
+    auto fired = advanceTo(wheel, Start + 500 * Day);
+    std::sort(std::begin(fired), std::end(fired));
+    EXPECT_EQ((std::vector<int>{ 100, 300 }), fired);
+    EXPECT_EQ(1U, wheel.size());
+
+    // what's left still fires on time
+    EXPECT_TRUE(std::empty(advanceTo(wheel, Start + 1000 * Day - 1)));
+    EXPECT_EQ(std::vector<int>{ 1000 }, advanceTo(wheel, Start + 1000 * Day));
+    EXPECT_TRUE(wheel.empty());
+}
@@ -3,8 +3,12 @@
 // or any future license endorsed by Mnemosyne LLC.
 // License text can be found in the licenses/ folder.
 
+#include <algorithm>
 #include <array>
+#include <iterator>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include "transmission.h"
 
@@ -182,9 +186,59 @@ TEST_F(TorrentMetainfoTest, AndroidTorrent)
     EXPECT_EQ(336, metainfo->infoDictOffset());
     EXPECT_EQ(26583, metainfo->infoDictSize());
     EXPECT_EQ(592, metainfo->piecesOffset());
+
+    // hybrid v1 + v2 torrent
+    EXPECT_TRUE(metainfo->hasV2Metadata());
+    auto const root = metainfo->piecesRoot(0);
+    ASSERT_TRUE(root);
+    EXPECT_EQ("33be2f96"sv, tr_sha256_to_string(*root).substr(0, 8));
+    auto const hash2 = metainfo->pieceHash2(metainfo->pieceCount() - 1);
+    ASSERT_TRUE(hash2);
+    EXPECT_EQ(metainfo->pieceSize(metainfo->pieceCount() - 1), hash2->length);
+    EXPECT_EQ(metainfo->pieceSize() / tr_block_info::BlockSize, hash2->leaf_count);
     tr_ctorFree(ctor);
 }
 
+TEST_F(TorrentMetainfoTest, hybridTorrentWithBadPieceLayers)
+{
+    auto const filename = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, "/Android-x86 8.1 r6 iso.torrent"sv };
+    auto benc = std::vector<char>{};
+    ASSERT_TRUE(tr_loadFile(filename, benc));
+
+    // corrupt one of the piece layer hashes
+    auto const key = "12:piece layers"sv;
+    auto const it = std::search(std::begin(benc), std::end(benc), std::begin(key), std::end(key));
+    ASSERT_NE(std::end(benc), it);
+    auto const pos = static_cast<size_t>(std::distance(std::begin(benc), it)) + 1000U;
+    ASSERT_LT(pos, std::size(benc));
+    benc[pos] = static_cast<char>(~benc[pos]);
+
+    // the v1 metadata is still usable, but the v2 hashes are dropped
+    auto metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parseBenc({ std::data(benc), std::size(benc) }));
+    EXPECT_FALSE(metainfo.piecesRoot(0));
+    EXPECT_FALSE(metainfo.pieceHash2(0));
+}
+
+TEST_F(TorrentMetainfoTest, hybridTorrentFromMagnetHasNoPieceLayers)
+{
+    auto const filename = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, "/Android-x86 8.1 r6 iso.torrent"sv };
+    auto benc = std::vector<char>{};
+    auto torrent = tr_torrent_metainfo{};
+    ASSERT_TRUE(torrent.parseTorrentFile(filename, &benc));
+
+    // metadata fetched for a magnet link is just the info dict
+    auto const info_dict = std::string_view{ std::data(benc) + torrent.infoDictOffset(), torrent.infoDictSize() };
+    auto const magnet_benc = "d4:info"s + std::string{ info_dict } + "e"s;
+
+    // the pieces roots are kept, but there are no piece hashes to go with them
+    auto metainfo = tr_torrent_metainfo{};
+    EXPECT_TRUE(metainfo.parseBenc(magnet_benc));
+    EXPECT_TRUE(metainfo.hasV2Metadata());
+    EXPECT_EQ(torrent.piecesRoot(0), metainfo.piecesRoot(0));
+    EXPECT_FALSE(metainfo.pieceHash2(0));
+}
+
 TEST_F(TorrentMetainfoTest, ctorSaveContents)
 {
     auto const src_filename = tr_pathbuf{ LIBTRANSMISSION_TEST_ASSETS_DIR, "/Android-x86 8.1 r6 iso.torrent"sv };
@@ -0,0 +1,271 @@
+// This file Copyright (C) 2022 Mnemosyne LLC.
+// It may be used under GPLv2 (SPDX: GPL-2.0-only), GPLv3 (SPDX: GPL-3.0-only),
+// or any future license endorsed by Mnemosyne LLC.
+// License text can be found in the licenses/ folder.
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "transmission.h"
+
+#include "tracing.h"
+#include "tr-strbuf.h"
+#include "utils.h"
+
+#include "test-fixtures.h"
+
+using namespace std::literals;
+
+namespace libtransmission
+{
+
+namespace test
+{
+
+class TracingTest : public SandboxedTest
+{
+protected:
+    struct Record
+    {
+        uint64_t start_usec;
+        uint64_t duration_usec;
+        uint32_t thread_id;
+        tr_trace_event event;
+        uint64_t arg;
+    };
+
+    struct Trace
+    {
+        std::vector<std::string> event_names;
+        std::map<uint32_t, std::string> thread_names;
+        std::map<std::pair<tr_trace_event, uint64_t>, std::string> arg_names;
+        std::vector<Record> records;
+
+        // the records whose arg is in [lo, hi)
+        [[nodiscard]] std::vector<Record> withArgs(uint64_t lo, uint64_t hi) const
+        {
+            auto ret = std::vector<Record>{};
+            for (auto const& record : records)
+            {
+                if (lo <= record.arg && record.arg < hi)
+                {
+                    ret.push_back(record);
+                }
+            }
+            return ret;
+        }
+    };
+
+    // a unique range of args, so that tests can find their own records
+    // among those left in the rings by other tests
+    static uint64_t makeArgBase()
+    {
+        static auto next = uint64_t{ 1 } << 40U;
+        next += uint64_t{ 1 } << 20U;
+        return next;
+    }
+
+    Trace dump()
+    {
+        auto const filename = tr_pathbuf{ sandboxDir(), "/test.trtrace"sv };
+        EXPECT_TRUE(tr_traceDump(filename));
+
+        auto contents = std::vector<char>{};
+        EXPECT_TRUE(tr_loadFile(filename, contents));
+
+        auto trace = Trace{};
+        auto pos = size_t{};
+        auto const take = [&contents, &pos](size_t n_bytes)
+        {
+            auto value = uint64_t{};
+            for (size_t i = 0; i < n_bytes && pos < std::size(contents); ++i)
+            {
+                value |= uint64_t{ static_cast<unsigned char>(contents[pos++]) } << (8U * i);
+            }
+            return value;
+        };
+        auto const take_string = [&contents, &pos, &take]()
+        {
+            auto const len = take(2);
+            auto str = std::string{ std::data(contents) + pos, len };
+            pos += len;
+            return str;
+        };
+
+        EXPECT_EQ("TRTRACE2"sv, std::string_view(std::data(contents), 8));
+        pos = 8;
+
+        for (auto n = take(4); n > 0; --n)
+        {
+            trace.event_names.push_back(take_string());
+        }
+
+        for (auto n = take(4); n > 0; --n)
+        {
+            auto const thread_id = static_cast<uint32_t>(take(4));
+            trace.thread_names[thread_id] = take_string();
+        }
+
+        for (auto n = take(4); n > 0; --n)
+        {
+            auto const event = static_cast<tr_trace_event>(take(1));
+            auto const arg = take(8);
+            trace.arg_names[std::make_pair(event, arg)] = take_string();
+        }
+
+        for (auto n = take(8); n > 0; --n)
+        {
+            auto const start = take(8);
+            auto const packed = take(8);
+            auto const arg = take(8);
+            trace.records.push_back({ start,
+                                      packed >> 32U,
+                                      static_cast<uint32_t>((packed >> 8U) & 0xFFFFFFU),
+                                      static_cast<tr_trace_event>(packed & 0xFFU),
+                                      arg });
+        }
+
+        EXPECT_EQ(std::size(contents), pos);
+        return trace;
+    }
+};
+
+TEST_F(TracingTest, dumpHasEventNames)
+{
+    auto const trace = dump();
+
+    ASSERT_EQ(std::size(TrTraceEventNames), std::size(trace.event_names));
+    for (size_t i = 0; i < std::size(TrTraceEventNames); ++i)
+    {
+        EXPECT_EQ(TrTraceEventNames[i], trace.event_names[i]);
+    }
+}
+
+TEST_F(TracingTest, dumpHasArgNames)
+{
+    auto const arg = makeArgBase();
+    tr_traceSetArgName(tr_trace_event::RpcRequest, arg, "session-get"sv);
+    tr_traceSetArgName(tr_trace_event::RpcRequest, arg + 1, "torrent-get"sv);
+    tr_traceSetArgName(tr_trace_event::RpcRequest, arg, "session-set"sv);
+
+    auto const trace = dump();
+    EXPECT_EQ("session-set"sv, trace.arg_names.at(std::make_pair(tr_trace_event::RpcRequest, arg)));
+    EXPECT_EQ("torrent-get"sv, trace.arg_names.at(std::make_pair(tr_trace_event::RpcRequest, arg + 1)));
+    EXPECT_EQ(0U, trace.arg_names.count(std::make_pair(tr_trace_event::Announce, arg)));
+}
+
+TEST_F(TracingTest, scopeRecordsEvent)
+{
+    auto const arg = makeArgBase();
+    auto const begin = tr_traceNow();
+
+    {
+        auto scope = tr_trace_scope{ tr_trace_event::CacheFlush };
+        std::this_thread::sleep_for(2ms);
+        scope.setArg(arg);
+    }
+
+    auto const records = dump().withArgs(arg, arg + 1);
+    ASSERT_EQ(1U, std::size(records));
+    EXPECT_EQ(tr_trace_event::CacheFlush, records[0].event);
+    EXPECT_LE(begin, records[0].start_usec);
+    EXPECT_LE(2000U, records[0].duration_usec);
+    EXPECT_LE(records[0].start_usec + records[0].duration_usec, tr_traceNow());
+}
+
+TEST_F(TracingTest, disabledScopeRecordsNothing)
+{
+    auto const arg = makeArgBase();
+
+    tr_traceSetEnabled(false);
+    {
+        auto const scope = tr_trace_scope{ tr_trace_event::PeerRead, arg };
+    }
+    tr_traceRecord(tr_trace_event::PeerWrite, tr_traceNow(), arg);
+    tr_traceSetEnabled(true);
+
+    EXPECT_TRUE(std::empty(dump().withArgs(arg, arg + 1)));
+}
+
+TEST_F(TracingTest, recordsFromManyThreads)
+{
+    static auto constexpr NumThreads = 4U;
+    static auto constexpr RecordsPerThread = 100U;
+    auto const arg_base = makeArgBase();
+
+    auto threads = std::vector<std::thread>{};
+    for (uint64_t i = 0; i < NumThreads; ++i)
+    {
+        threads.emplace_back(
+            [i, arg_base]()
+            {
+                tr_traceSetThreadName("worker-"s + std::to_string(i));
+                for (uint64_t j = 0; j < RecordsPerThread; ++j)
+                {
+                    tr_traceRecord(tr_trace_event::HashCheck, tr_traceNow(), arg_base + i * RecordsPerThread + j);
+                }
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    auto const trace = dump();
+    auto const records = trace.withArgs(arg_base, arg_base + NumThreads * RecordsPerThread);
+    ASSERT_EQ(NumThreads * RecordsPerThread, std::size(records));
+
+    // each thread's records have that thread's id and name, in order
+    auto thread_ids = std::map<uint64_t, uint32_t>{};
+    auto last_arg = std::map<uint32_t, uint64_t>{};
+    for (auto const& record : records)
+    {
+        EXPECT_EQ(tr_trace_event::HashCheck, record.event);
+
+        auto const worker = (record.arg - arg_base) / RecordsPerThread;
+        auto const [it, inserted] = thread_ids.try_emplace(worker, record.thread_id);
+        EXPECT_EQ(it->second, record.thread_id);
+        if (inserted)
+        {
+            EXPECT_EQ("worker-"s + std::to_string(worker), trace.thread_names.at(record.thread_id));
+        }
+        else
+        {
+            EXPECT_LT(last_arg[record.thread_id], record.arg);
+        }
+        last_arg[record.thread_id] = record.arg;
+    }
+    EXPECT_EQ(NumThreads, std::size(thread_ids));
+
+    // sorted by start time
+    for (size_t i = 1; i < std::size(trace.records); ++i)
+    {
+        EXPECT_LE(trace.records[i - 1].start_usec, trace.records[i].start_usec);
+    }
+}
+
+TEST_F(TracingTest, ringKeepsMostRecentRecords)
+{
+    static auto constexpr NumRecords = uint64_t{ 200000 };
+    auto const arg_base = makeArgBase();
+
+    for (uint64_t i = 0; i < NumRecords; ++i)
+    {
+        tr_traceRecord(tr_trace_event::PeerRead, tr_traceNow(), arg_base + i);
+    }
+
+    auto const records = dump().withArgs(arg_base, arg_base + NumRecords);
+    ASSERT_FALSE(std::empty(records));
+    EXPECT_GT(NumRecords, std::size(records));
+    EXPECT_EQ(arg_base + NumRecords - 1, records.back().arg);
+}
+
+} // namespace test
+
+} // namespace libtransmission
@@ -35,7 +35,7 @@ char constexpr Usage[] = "Usage: transmission-create [options] <file|directory>"
 
 uint32_t constexpr KiB = 1024;
 
-auto constexpr Options = std::array<tr_option, 10>{
+auto constexpr Options = std::array<tr_option, 11>{
     { { 'p', "private", "Allow this torrent to only be used with the specified tracker(s)", "p", false, nullptr },
       { 'r', "source", "Set the source for private trackers", "r", true, "<source>" },
       { 'o', "outfile", "Save the generated .torrent to this filename", "o", true, "<file>" },
@@ -44,6 +44,7 @@ auto constexpr Options = std::array<tr_option, 10>{
       { 't', "tracker", "Add a tracker's announce URL", "t", true, "<url>" },
       { 'w', "webseed", "Add a webseed URL", "w", true, "<url>" },
       { 'x', "anonymize", "Omit \"Creation date\" and \"Created by\" info", nullptr, false, nullptr },
+      { 'j', "threads", "Number of threads to use for hashing pieces", "j", true, "<count>" },
       { 'V', "version", "Show version number and exit", "V", false, nullptr },
       { 0, nullptr, nullptr, nullptr, false, nullptr } }
 };
@@ -57,6 +58,7 @@ struct app_options
     std::string_view infile;
     std::string_view source;
     uint32_t piece_size = 0;
+    size_t thread_count = 0;
     bool anonymize = false;
     bool is_private = false;
     bool show_version = false;
@@ -115,6 +117,10 @@ int parseCommandLine(app_options& options, int argc, char const* const* argv)
             options.anonymize = true;
             break;
 
+        case 'j':
+            options.thread_count = strtoul(optarg, nullptr, 10);
+            break;
+
         case TR_OPT_UNK:
             options.infile = optarg;
             break;
@@ -242,6 +248,11 @@ int tr_main(int argc, char* argv[])
         builder.setSource(options.source);
     }
 
+    if (options.thread_count != 0)
+    {
+        builder.setChecksumThreadCount(options.thread_count);
+    }
+
     builder.setPrivate(options.is_private);
     builder.setAnonymize(options.anonymize);
     builder.setWebseeds(std::move(options.webseeds));